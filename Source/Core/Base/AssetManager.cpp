@@ -1,99 +1,894 @@
-#include "Kaleido3D.h"
-#include "AssetManager.h"
-#include "Os.h"
-#include "Core/LogUtil.h"
-#include "App.h"
-
-#ifdef USE_TBB_MALLOC
-#include <tbb/scalable_allocator.h>
-#endif
+#include "CoreMinimal.h"
 
 #if K3DPLATFORM_OS_ANDROID
 #include <android/asset_manager.h>
 #endif
 
-#include <fstream>
 #include <algorithm>
-
-#if K3DPLATFORM_OS_WIN
-#include <strsafe.h>
-#endif
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace k3d
 {
-	AssetManager::AssetManager()/* : m_pThreadPool(nullptr) */
-	{
-	}
+static const size_t kMaxPathLength = 1024;
+static const size_t kAssetBlockSize = 128;
 
-	void AssetManager::Init()
-	{
-	}
+// strips the scheme and leading separators, turns '\' into '/', drops "./" and repeated '/',
+// a ".." segment would climb out of the mount and fails like an overlong path
+static size_t __NormalizePath(const char* Path, char* Out, size_t OutSize)
+{
+    if (strncmp(Path, "asset://", 8) == 0)
+        Path += 8;
+    size_t Length = 0;
+    bool SegmentStart = true;
+    const char* It = Path;
+    for (; *It && Length + 1 < OutSize; It++)
+    {
+        char C = *It == '\\' ? '/' : *It;
+        if (C == '/')
+        {
+            if (!SegmentStart)
+                Out[Length++] = '/';
+            SegmentStart = true;
+            continue;
+        }
+        if (SegmentStart && C == '.' && (It[1] == '/' || It[1] == '\\'))
+        {
+            It++;
+            continue;
+        }
+        if (SegmentStart && C == '.' && It[1] == '.' && (!It[2] || It[2] == '/' || It[2] == '\\'))
+            return size_t(-1);
+        Out[Length++] = C;
+        SegmentStart = false;
+    }
+    Out[Length] = 0;
+    return *It ? size_t(-1) : Length;
+}
 
-	void AssetManager::Shutdown()
-	{
-		KLOG(Info, "AssetManager", "Shutdown.");
-	}
+U64 AssetManager::HashPath(const char* Path, size_t Length)
+{
+    U64 Hash = 14695981039346656037ull;
+    for (size_t i = 0; i < Length; i++)
+    {
+        Hash ^= (U8)Path[i];
+        Hash *= 1099511628211ull;
+    }
+    // 0 marks an empty slot in pack tables
+    return Hash ? Hash : 1;
+}
 
+static PoolAllocator& __AssetPool()
+{
+    static PoolAllocator sPool(kAssetBlockSize, 256, "AssetPool");
+    return sPool;
+}
+
+/// every asset handed out comes from the asset pool, callers still just delete them
+struct __PooledAsset : public IAsset
+{
+    static void* operator new(size_t Size) { return __AssetPool().Alloc(Size); }
+    static void operator delete(void* Ptr) { __AssetPool().DeAlloc(Ptr); }
+};
 
-	class MemmapedAsset : public IAsset
-	{
-	public:
-		MemmapedAsset(const char * path)
-		{
-			m_File = MakeShared<Os::MemMapFile>();
-			m_File->Open(path, IORead);
-		}
+class MemoryAsset : public __PooledAsset
+{
+public:
+    /// Owned is freed with the asset
+    MemoryAsset(const U8* Data, U64 Size, U8* Owned = nullptr)
+        : m_Data(Data), m_Size(Size), m_Pos(0), m_Owned(Owned) {}
 
-		~MemmapedAsset() override {}
+    ~MemoryAsset() override
+    {
+        if (m_Owned)
+            GetDefaultAllocator().DeAlloc(m_Owned);
+    }
 
-		uint64 GetLength() override
-		{	return m_File->GetSize();	}
+    U64 GetLength() override { return m_Size; }
+    const void* GetBuffer() override { return m_Data; }
 
-		const void * GetBuffer() override
-		{	return m_File->FileData(); }
+    U64 Read(void* Data, U64 Size) override
+    {
+        U64 Count = std::min(Size, m_Size - m_Pos);
+        memcpy(Data, m_Data + m_Pos, (size_t)Count);
+        m_Pos += Count;
+        return Count;
+    }
 
-		uint64 Read(void *data, uint64 size) override { return m_File->Read((char*)data, (size_t)size); }
-		bool Seek(uint64 offset) override { return m_File->Seek((size_t)offset); }
+    bool Seek(U64 Offset) override
+    {
+        if (Offset > m_Size)
+            return false;
+        m_Pos = Offset;
+        return true;
+    }
 
-	private:
-		SharedPtr<Os::MemMapFile> m_File;
-	};
+private:
+    const U8*   m_Data;
+    U64         m_Size;
+    U64         m_Pos;
+    U8*         m_Owned;
+};
+
+class MappedAsset : public __PooledAsset
+{
+public:
+    bool Open(const char* Path) { return m_File.Open(Path, IOFlag::Read); }
+
+    U64 GetLength() override { return m_File.GetSize(); }
+    const void* GetBuffer() override { return m_File.FileData(); }
+    U64 Read(void* Data, U64 Size) override { return m_File.Read((char*)Data, (size_t)Size); }
+    bool Seek(U64 Offset) override { return m_File.Seek((size_t)Offset); }
+
+private:
+    os::MemMapFile m_File;
+};
+
+static_assert(sizeof(MemoryAsset) <= kAssetBlockSize, "MemoryAsset outgrew the asset pool");
+static_assert(sizeof(MappedAsset) <= kAssetBlockSize, "MappedAsset outgrew the asset pool");
 
 #if K3DPLATFORM_OS_ANDROID
-	class AndroidAsset : public IAsset
-	{
-	public:
-		AndroidAsset(AAsset * asset) : m_Asset(asset) {}
-		~AndroidAsset() override { if(m_Asset) AAsset_close(m_Asset); }
+class AndroidAsset : public __PooledAsset
+{
+public:
+    AndroidAsset(AAsset * asset) : m_Asset(asset) {}
+    ~AndroidAsset() override { if(m_Asset) AAsset_close(m_Asset); }
 
-		uint64 		GetLength() override { return (uint64)AAsset_getLength64(m_Asset); }
-		const void* GetBuffer() override { return AAsset_isAllocated(m_Asset) ? AAsset_getBuffer(m_Asset) : nullptr; }
+    U64         GetLength() override { return (U64)AAsset_getLength64(m_Asset); }
+    const void* GetBuffer() override { return AAsset_isAllocated(m_Asset) ? AAsset_getBuffer(m_Asset) : nullptr; }
 
-		uint64 Read(void *data, uint64 size) override { return (uint64)AAsset_read(m_Asset, data, (size_t)size); }
-		bool Seek(uint64 offset) override { return AAsset_seek64(m_Asset, offset, SEEK_SET)!=-1; }
+    U64 Read(void *data, U64 size) override { return (U64)AAsset_read(m_Asset, data, (size_t)size); }
+    bool Seek(U64 offset) override { return AAsset_seek64(m_Asset, offset, SEEK_SET)!=-1; }
 
-	private:
-		AAsset	* m_Asset;
-	};
+private:
+    AAsset  * m_Asset;
+};
+
+/// the apk assets
+class AndroidAssetMount : public IMount
+{
+public:
+    IAsset* Open(const char* Path, U64) override
+    {
+        AAsset* Asset = AAssetManager_open(GetEnv().GetAssets(), Path, AASSET_MODE_STREAMING);
+        return Asset ? new AndroidAsset(Asset) : nullptr;
+    }
+
+    bool Exists(const char* Path, U64) override
+    {
+        AAsset* Asset = AAssetManager_open(GetEnv().GetAssets(), Path, AASSET_MODE_UNKNOWN);
+        if (Asset)
+            AAsset_close(Asset);
+        return Asset != nullptr;
+    }
+};
 #endif
 
-	IAsset *AssetManager::Open(const char *path)
-	{
-		if(strncmp(path, "asset://", 8)==0) {
+DirectoryMount::DirectoryMount(String const& Root)
+    : m_Root(Root)
+{
+}
+
+IAsset* DirectoryMount::Open(const char* Path, U64)
+{
+    String FullPath = m_Root.Length() ? os::Join(m_Root, Path) : String(Path);
+    MappedAsset* Asset = new MappedAsset;
+    if (!Asset->Open(FullPath.CStr()))
+    {
+        delete Asset;
+        return nullptr;
+    }
+    return Asset;
+}
+
+bool DirectoryMount::Exists(const char* Path, U64)
+{
+    String FullPath = m_Root.Length() ? os::Join(m_Root, Path) : String(Path);
+    return os::Exists(FullPath.CStr());
+}
+
+struct __MemoryEntry
+{
+    std::string Path;
+    const U8*   Data;
+    U64         Size;
+};
+
+struct MemoryMountPrivate
+{
+    typedef std::unordered_multimap<U64, __MemoryEntry> EntryMap;
+
+    EntryMap::iterator Find(const char* Path, U64 Hash)
+    {
+        auto Range = Entries.equal_range(Hash);
+        for (auto It = Range.first; It != Range.second; ++It)
+        {
+            if (It->second.Path == Path)
+                return It;
+        }
+        return Entries.end();
+    }
+
+    os::SharedMutex Lock;
+    EntryMap        Entries;
+};
+
+MemoryMount::MemoryMount()
+    : d(new MemoryMountPrivate)
+{
+}
+
+MemoryMount::~MemoryMount()
+{
+    delete d;
+    d = nullptr;
+}
+
+void MemoryMount::Add(const char* Path, const void* Data, U64 Size)
+{
+    char Normalized[kMaxPathLength];
+    size_t Length = __NormalizePath(Path, Normalized, kMaxPathLength);
+    if (Length == size_t(-1))
+        return;
+    U64 Hash = AssetManager::HashPath(Normalized, Length);
+    os::SharedMutex::AutoLock Guard(&d->Lock);
+    auto It = d->Find(Normalized, Hash);
+    if (It != d->Entries.end())
+        d->Entries.erase(It);
+    __MemoryEntry Entry = { Normalized, (const U8*)Data, Size };
+    d->Entries.emplace(Hash, Entry);
+}
+
+bool MemoryMount::Remove(const char* Path)
+{
+    char Normalized[kMaxPathLength];
+    size_t Length = __NormalizePath(Path, Normalized, kMaxPathLength);
+    if (Length == size_t(-1))
+        return false;
+    os::SharedMutex::AutoLock Guard(&d->Lock);
+    auto It = d->Find(Normalized, AssetManager::HashPath(Normalized, Length));
+    if (It == d->Entries.end())
+        return false;
+    d->Entries.erase(It);
+    return true;
+}
+
+IAsset* MemoryMount::Open(const char* Path, U64 Hash)
+{
+    os::SharedMutex::AutoReadLock Guard(&d->Lock);
+    auto It = d->Find(Path, Hash);
+    if (It == d->Entries.end())
+        return nullptr;
+    return new MemoryAsset(It->second.Data, It->second.Size);
+}
+
+bool MemoryMount::Exists(const char* Path, U64 Hash)
+{
+    os::SharedMutex::AutoReadLock Guard(&d->Lock);
+    return d->Find(Path, Hash) != d->Entries.end();
+}
+
+/*
+ * Pack layout:
+ *   header
+ *   entry data, each aligned to 16 bytes
+ *   table       TableSize (a power of 2) entries, linear probing from Hash & (TableSize - 1)
+ *   names       zero terminated normalized paths, checked on lookup against hash collisions
+ */
+static const U32 kPackMagic = 0x4b50334b; // K3PK
+static const U32 kPackVersion = 1;
+static const U32 kPackEntryCompressed = 1;
+
+struct __PackHeader
+{
+    U32 Magic;
+    U32 Version;
+    U32 EntryCount;
+    U32 TableSize;
+    U64 TableOffset;
+    U64 NamesOffset;
+    U64 NamesSize;
+};
+
+struct __PackEntry
+{
+    U64 Hash;
+    U64 Offset;
+    U64 Size;
+    U64 RawSize;
+    U32 NameOffset;
+    U32 Flags;
+};
+
+/// shared by the mount and the assets pointing into its mapping, the last one unmaps it
+struct PackMountPrivate
+{
+    PackMountPrivate() : Header(nullptr), Table(nullptr), Names(nullptr), Refs(1) {}
+
+    void AddRef()
+    {
+        Refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Release()
+    {
+        if (Refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+    const __PackEntry* Find(const char* Path, U64 Hash) const
+    {
+        if (!Table)
+            return nullptr;
+        U32 Mask = Header->TableSize - 1;
+        for (U32 Probe = 0; Probe < Header->TableSize; Probe++)
+        {
+            const __PackEntry& Entry = Table[(Hash + Probe) & Mask];
+            if (!Entry.Hash)
+                return nullptr;
+            if (Entry.Hash == Hash && Entry.NameOffset < Header->NamesSize
+                && strcmp(Names + Entry.NameOffset, Path) == 0)
+                return &Entry;
+        }
+        return nullptr;
+    }
+
+    os::MemMapFile      File;
+    const __PackHeader* Header;
+    const __PackEntry*  Table;
+    const char*         Names;
+    std::atomic<U32>    Refs;
+};
+
+/// an uncompressed entry read in place, holds the mapping past Unmount
+class PackAsset : public MemoryAsset
+{
+public:
+    PackAsset(PackMountPrivate* Pack, const U8* Data, U64 Size)
+        : MemoryAsset(Data, Size), m_Pack(Pack)
+    {
+        m_Pack->AddRef();
+    }
+
+    ~PackAsset() override
+    {
+        m_Pack->Release();
+    }
+
+private:
+    PackMountPrivate* m_Pack;
+};
+
+static_assert(sizeof(PackAsset) <= kAssetBlockSize, "PackAsset outgrew the asset pool");
+
+PackMount::PackMount()
+    : d(new PackMountPrivate)
+{
+}
+
+PackMount::~PackMount()
+{
+    d->Release();
+    d = nullptr;
+}
+
+bool PackMount::Load(const char* PackFile)
+{
+    d->File.SetAccessPattern(os::MapAccess::Random);
+    if (!d->File.Open(PackFile, IOFlag::Read))
+        return false;
+    U64 Size = (U64)d->File.GetSize();
+    const U8* Base = d->File.FileData();
+    const __PackHeader* Header = (const __PackHeader*)Base;
+    // offsets are compared against what's left so a huge one can't wrap around,
+    // and the names must end in a zero for the lookups to stop inside the mapping
+    if (Size < sizeof(__PackHeader) || Header->Magic != kPackMagic || Header->Version != kPackVersion
+        || !Header->TableSize || (Header->TableSize & (Header->TableSize - 1))
+        || Header->TableOffset > Size || (U64)Header->TableSize * sizeof(__PackEntry) > Size - Header->TableOffset
+        || Header->NamesOffset > Size || Header->NamesSize > Size - Header->NamesOffset
+        || (Header->NamesSize && Base[Header->NamesOffset + Header->NamesSize - 1] != 0))
+    {
+        d->File.Close();
+        return false;
+    }
+    d->Header = Header;
+    d->Table = (const __PackEntry*)(Base + Header->TableOffset);
+    d->Names = (const char*)(Base + Header->NamesOffset);
+    return true;
+}
+
+U32 PackMount::GetEntryCount() const
+{
+    return d->Header ? d->Header->EntryCount : 0;
+}
+
+IAsset* PackMount::Open(const char* Path, U64 Hash)
+{
+    const __PackEntry* Entry = d->Find(Path, Hash);
+    U64 FileSize = (U64)d->File.GetSize();
+    if (!Entry || Entry->Offset > FileSize || Entry->Size > FileSize - Entry->Offset)
+        return nullptr;
+    const U8* Data = d->File.FileData() + Entry->Offset;
+    if (!(Entry->Flags & kPackEntryCompressed))
+        return new PackAsset(d, Data, Entry->Size);
+    U8* Inflated = (U8*)GetDefaultAllocator().Alloc((size_t)Entry->RawSize);
+    if (!Inflated || LZDecompress(Data, (size_t)Entry->Size, Inflated, (size_t)Entry->RawSize) != Entry->RawSize)
+    {
+        GetDefaultAllocator().DeAlloc(Inflated);
+        return nullptr;
+    }
+    return new MemoryAsset(Inflated, Entry->RawSize, Inflated);
+}
+
+bool PackMount::Exists(const char* Path, U64 Hash)
+{
+    return d->Find(Path, Hash) != nullptr;
+}
+
+struct __PackSource
+{
+    std::string     Path;
+    U64             Hash;
+    U64             RawSize;
+    U32             Flags;
+    std::vector<U8> Data;
+};
+
+struct PackBuilderPrivate
+{
+    std::vector<__PackSource>                   Sources;
+    std::unordered_map<std::string, size_t>     Lookup;
+};
+
+PackBuilder::PackBuilder()
+    : d(new PackBuilderPrivate)
+{
+}
+
+PackBuilder::~PackBuilder()
+{
+    delete d;
+    d = nullptr;
+}
+
+void PackBuilder::Add(const char* Path, const void* Data, U64 Size, bool Compress)
+{
+    char Normalized[kMaxPathLength];
+    size_t Length = __NormalizePath(Path, Normalized, kMaxPathLength);
+    if (Length == size_t(-1) || !Length)
+        return;
+    auto Found = d->Lookup.find(Normalized);
+    if (Found == d->Lookup.end())
+    {
+        Found = d->Lookup.emplace(Normalized, d->Sources.size()).first;
+        d->Sources.push_back(__PackSource());
+    }
+    __PackSource& Source = d->Sources[Found->second];
+    Source.Path = Normalized;
+    Source.Hash = AssetManager::HashPath(Normalized, Length);
+    Source.RawSize = Size;
+    Source.Flags = 0;
+    if (Compress && Size)
+    {
+        Source.Data.resize(LZCompressBound((size_t)Size));
+        size_t Packed = LZCompress(Data, (size_t)Size, Source.Data.data(), Source.Data.size());
+        if (Packed && Packed < Size)
+        {
+            Source.Data.resize(Packed);
+            Source.Flags = kPackEntryCompressed;
+            return;
+        }
+    }
+    Source.Data.assign((const U8*)Data, (const U8*)Data + Size);
+}
+
+bool PackBuilder::AddFile(const char* Path, const char* FileName, bool Compress)
+{
+    os::File File;
+    if (!File.Open(FileName, IOFlag::Read))
+        return false;
+    I64 Size = File.GetSize();
+    if (Size < 0)
+        return false;
+    std::vector<U8> Data((size_t)Size);
+    if (Size && File.Read((char*)Data.data(), (size_t)Size) != (size_t)Size)
+        return false;
+    Add(Path, Data.data(), (U64)Size, Compress);
+    return true;
+}
+
+bool PackBuilder::Save(const char* PackFile)
+{
+    auto& Sources = d->Sources;
+    U32 TableSize = 2;
+    while (TableSize < Sources.size() * 2)
+        TableSize <<= 1;
+
+    std::vector<__PackEntry> Table(TableSize);
+    memset(Table.data(), 0, Table.size() * sizeof(__PackEntry));
+    std::string Names;
+    U64 Offset = sizeof(__PackHeader);
+    for (auto& Source : Sources)
+    {
+        Offset = (Offset + 15) & ~15ull;
+        U32 Slot = (U32)(Source.Hash & (TableSize - 1));
+        while (Table[Slot].Hash)
+            Slot = (Slot + 1) & (TableSize - 1);
+        __PackEntry& Entry = Table[Slot];
+        Entry.Hash = Source.Hash;
+        Entry.Offset = Offset;
+        Entry.Size = Source.Data.size();
+        Entry.RawSize = Source.RawSize;
+        Entry.NameOffset = (U32)Names.size();
+        Entry.Flags = Source.Flags;
+        Names.append(Source.Path.c_str(), Source.Path.size() + 1);
+        Offset += Source.Data.size();
+    }
+
+    __PackHeader Header;
+    memset(&Header, 0, sizeof(Header));
+    Header.Magic = kPackMagic;
+    Header.Version = kPackVersion;
+    Header.EntryCount = (U32)Sources.size();
+    Header.TableSize = TableSize;
+    Header.TableOffset = (Offset + 15) & ~15ull;
+    Header.NamesOffset = Header.TableOffset + TableSize * sizeof(__PackEntry);
+    Header.NamesSize = Names.size();
+
+    os::File File;
+    if (!File.Open(PackFile, IOFlag::Write))
+        return false;
+    BufferedWriter Writer(&File);
+    static const U8 Padding[16] = { 0 };
+    U64 Written = 0;
+    auto Append = [&Writer, &Written](const void* Data, U64 Size)
+    {
+        Written += Writer.Write(Data, (size_t)Size);
+    };
+    Append(&Header, sizeof(Header));
+    for (auto& Source : Sources)
+    {
+        Append(Padding, ((Written + 15) & ~15ull) - Written);
+        Append(Source.Data.data(), Source.Data.size());
+    }
+    Append(Padding, Header.TableOffset - Written);
+    Append(Table.data(), Table.size() * sizeof(__PackEntry));
+    Append(Names.data(), Names.size());
+    Writer.Close();
+    return Written == Header.NamesOffset + Header.NamesSize;
+}
+
+struct __MountPoint
+{
+    std::string Prefix;
+    I32         Priority;
+    IMount*     Mount;
+    /// host directory without trailing separators, empty if none
+    std::string HostRoot;
+};
+
+struct __ReloadListener
+{
+    U32                 Id;
+    std::string         Prefix;
+    os::PFN_FileChanges Callback;
+    void*               UserData;
+};
+
+// the manager and listener whose callback runs on this thread, see RemoveReloadListener
+static thread_local struct AssetManagerPrivate* tNotifyingManager = nullptr;
+static thread_local U32 tNotifyingListener = 0;
+
+struct AssetManagerPrivate
+{
+    AssetManagerPrivate() : Initialized(false), Watcher(nullptr), NextListenerId(1) {}
+
+    ~AssetManagerPrivate()
+    {
+        delete Watcher;
+        for (auto& Point : Mounts)
+            delete Point.Mount;
+    }
+
+    static void OnFilesChanged(const os::FileEvent* Events, U32 Count, void* UserData);
+
+    os::SharedMutex             Lock;
+    std::vector<__MountPoint>   Mounts;
+    std::atomic<bool>           Initialized;
+    /// guarded by Lock
+    os::FileWatcher*            Watcher;
+
+    os::Mutex                       ListenerLock;
+    std::vector<__ReloadListener>   Listeners;
+    /// ids whose callback is running
+    std::vector<U32>                Notifying;
+    os::ConditionVariable           Notified;
+    U32                             NextListenerId;
+};
+
+AssetManager::AssetManager()
+    : d(new AssetManagerPrivate)
+{
+}
+
+AssetManager::~AssetManager()
+{
+    delete d;
+    d = nullptr;
+}
+
+AssetManager& AssetManager::Get()
+{
+    static AssetManager sManager;
+    return sManager;
+}
+
+void AssetManager::Init()
+{
+    if (d->Initialized.load(std::memory_order_acquire))
+        return;
+    {
+        os::SharedMutex::AutoLock Guard(&d->Lock);
+        if (d->Initialized)
+            return;
+        d->Initialized = true;
+    }
+    // below the default priority so explicit mounts override it
 #if K3DPLATFORM_OS_ANDROID
-			AAssetManager* mgr = GetEnv()->GetAssets();
-			std::string relpath(path);
-			relpath = relpath.substr(8, relpath.size() - 8);
-			AAsset * asset = AAssetManager_open(mgr, relpath.c_str(), AASSET_MODE_STREAMING);
-			K3D_ASSERT(asset!= nullptr);
-			return new AndroidAsset(asset);
+    Mount("", new AndroidAssetMount, -1);
 #else
-            String RealPath(path);
-            RealPath = Os::Path::Join(GetEnv()->GetDataDir(), RealPath.SubStr(8, RealPath.Length()-8));
-			return new MemmapedAsset(RealPath.CStr());
+    String DataDir = GetEnv().GetDataDir();
+    if (DataDir.Length())
+        Mount("", new DirectoryMount(DataDir), -1);
 #endif
-		}
-		return nullptr;
-	}
+}
+
+void AssetManager::Shutdown()
+{
+    KLOG(Info, AssetManager, "Shutdown.");
+    DisableHotReload();
+    os::SharedMutex::AutoLock Guard(&d->Lock);
+    for (auto& Point : d->Mounts)
+        delete Point.Mount;
+    d->Mounts.clear();
+    d->Initialized = false;
+}
+
+void AssetManager::Mount(const char* MountPoint, IMount* Mount, I32 Priority)
+{
+    if (!Mount)
+        return;
+    char Normalized[kMaxPathLength];
+    size_t Length = __NormalizePath(MountPoint ? MountPoint : "", Normalized, kMaxPathLength - 1);
+    if (Length == size_t(-1))
+    {
+        delete Mount;
+        return;
+    }
+    if (Length && Normalized[Length - 1] != '/')
+    {
+        Normalized[Length++] = '/';
+        Normalized[Length] = 0;
+    }
+    __MountPoint Point = { Normalized, Priority, Mount, Mount->GetHostDirectory() ? Mount->GetHostDirectory() : "" };
+    while (!Point.HostRoot.empty() && (Point.HostRoot.back() == '/' || Point.HostRoot.back() == '\\'))
+        Point.HostRoot.pop_back();
+    os::SharedMutex::AutoLock Guard(&d->Lock);
+    if (d->Watcher && !Point.HostRoot.empty())
+        d->Watcher->Watch(Point.HostRoot.c_str());
+    auto It = std::find_if(d->Mounts.begin(), d->Mounts.end(),
+        [Priority](__MountPoint const& Other) { return Other.Priority <= Priority; });
+    d->Mounts.insert(It, Point);
+}
+
+bool AssetManager::MountDirectory(const char* MountPoint, const char* Directory, I32 Priority)
+{
+    if (!os::Exists(Directory))
+        return false;
+    Mount(MountPoint, new DirectoryMount(Directory), Priority);
+    return true;
+}
+
+bool AssetManager::MountPack(const char* MountPoint, const char* PackFile, I32 Priority)
+{
+    PackMount* Pack = new PackMount;
+    if (!Pack->Load(PackFile))
+    {
+        delete Pack;
+        return false;
+    }
+    Mount(MountPoint, Pack, Priority);
+    return true;
+}
+
+bool AssetManager::Unmount(IMount* Mount)
+{
+    os::SharedMutex::AutoLock Guard(&d->Lock);
+    auto It = std::find_if(d->Mounts.begin(), d->Mounts.end(),
+        [Mount](__MountPoint const& Point) { return Point.Mount == Mount; });
+    if (It == d->Mounts.end())
+        return false;
+    if (d->Watcher && !It->HostRoot.empty())
+        d->Watcher->Unwatch(It->HostRoot.c_str());
+    delete It->Mount;
+    d->Mounts.erase(It);
+    return true;
+}
+
+template <class F>
+static bool __ForEachMount(AssetManagerPrivate* d, const char* Path, F const& Visit)
+{
+    char Normalized[kMaxPathLength];
+    size_t Length = __NormalizePath(Path, Normalized, kMaxPathLength);
+    if (Length == size_t(-1) || !Length)
+        return false;
+    os::SharedMutex::AutoReadLock Guard(&d->Lock);
+    // mounts sharing a prefix length share the hash of the relative path
+    size_t HashedFrom = size_t(-1);
+    U64 Hash = 0;
+    for (auto& Point : d->Mounts)
+    {
+        size_t PrefixLength = Point.Prefix.size();
+        if (PrefixLength >= Length || strncmp(Normalized, Point.Prefix.c_str(), PrefixLength) != 0)
+            continue;
+        if (HashedFrom != PrefixLength)
+        {
+            Hash = AssetManager::HashPath(Normalized + PrefixLength, Length - PrefixLength);
+            HashedFrom = PrefixLength;
+        }
+        if (Visit(Point.Mount, Normalized + PrefixLength, Hash))
+            return true;
+    }
+    return false;
+}
+
+bool AssetManager::Exists(const char* Path)
+{
+    Init();
+    return __ForEachMount(d, Path, [](IMount* Mount, const char* Relative, U64 Hash)
+    {
+        return Mount->Exists(Relative, Hash);
+    });
+}
+
+IAsset* AssetManager::Open(const char* Path)
+{
+    AssetManager& Self = Get();
+    Self.Init();
+    IAsset* Asset = nullptr;
+    __ForEachMount(Self.d, Path, [&Asset](IMount* Mount, const char* Relative, U64 Hash)
+    {
+        Asset = Mount->Open(Relative, Hash);
+        return Asset != nullptr;
+    });
+    return Asset;
+}
+
+bool AssetManager::EnableHotReload(U32 DebounceMs)
+{
+    Init();
+    os::SharedMutex::AutoLock Guard(&d->Lock);
+    if (d->Watcher)
+        return true;
+    d->Watcher = new os::FileWatcher(DebounceMs);
+    d->Watcher->Subscribe(&AssetManagerPrivate::OnFilesChanged, d);
+    bool Watching = false;
+    for (auto const& Point : d->Mounts)
+        if (!Point.HostRoot.empty())
+            Watching |= d->Watcher->Watch(Point.HostRoot.c_str());
+    return Watching;
+}
+
+void AssetManager::DisableHotReload()
+{
+    os::FileWatcher* Watcher = nullptr;
+    {
+        os::SharedMutex::AutoLock Guard(&d->Lock);
+        std::swap(Watcher, d->Watcher);
+    }
+    // waits for the batch in flight, which takes the lock to resolve paths
+    delete Watcher;
+}
+
+U32 AssetManager::AddReloadListener(const char* Prefix, os::PFN_FileChanges Listener, void* UserData)
+{
+    char Normalized[kMaxPathLength];
+    if (!Listener || __NormalizePath(Prefix ? Prefix : "", Normalized, kMaxPathLength) == size_t(-1))
+        return 0;
+    os::Mutex::AutoLock Guard(&d->ListenerLock);
+    U32 Id = d->NextListenerId++;
+    d->Listeners.push_back({ Id, Normalized, Listener, UserData });
+    return Id;
+}
+
+void AssetManager::RemoveReloadListener(U32 Id)
+{
+    os::Mutex::AutoLock Guard(&d->ListenerLock);
+    auto It = std::find_if(d->Listeners.begin(), d->Listeners.end(),
+        [Id](__ReloadListener const& Listener) { return Listener.Id == Id; });
+    if (It != d->Listeners.end())
+        d->Listeners.erase(It);
+    size_t Own = tNotifyingManager == d && tNotifyingListener == Id ? 1 : 0;
+    while ((size_t)std::count(d->Notifying.begin(), d->Notifying.end(), Id) > Own)
+        d->Notified.Wait(&d->ListenerLock);
+}
 
-}
\ No newline at end of file
+void AssetManagerPrivate::OnFilesChanged(const os::FileEvent* Events, U32 Count, void* UserData)
+{
+    AssetManagerPrivate* d = (AssetManagerPrivate*)UserData;
+    std::vector<os::FileEvent> Changes;
+    {
+        os::SharedMutex::AutoReadLock Guard(&d->Lock);
+        for (U32 i = 0; i < Count; i++)
+        {
+            const char* Path = Events[i].Path.CStr();
+            size_t Length = Events[i].Path.Length();
+            for (size_t Index = 0; Index < d->Mounts.size(); Index++)
+            {
+                __MountPoint const& Point = d->Mounts[Index];
+                size_t RootLength = Point.HostRoot.size();
+                if (!RootLength || Length < RootLength || strncmp(Path, Point.HostRoot.c_str(), RootLength) != 0)
+                    continue;
+                if (Length == RootLength)
+                {
+                    // the whole mount went away or needs a rescan
+                    Changes.push_back({ String(Point.Prefix.c_str()), Events[i].Changes });
+                    continue;
+                }
+                if (Path[RootLength] != '/')
+                    continue;
+                std::string Asset = Point.Prefix + (Path + RootLength + 1);
+                // hidden behind a mount searched first
+                bool Shadowed = false;
+                for (size_t Front = 0; Front < Index && !Shadowed; Front++)
+                {
+                    __MountPoint const& Other = d->Mounts[Front];
+                    size_t PrefixLength = Other.Prefix.size();
+                    if (PrefixLength >= Asset.size() || Asset.compare(0, PrefixLength, Other.Prefix) != 0)
+                        continue;
+                    const char* Relative = Asset.c_str() + PrefixLength;
+                    Shadowed = Other.Mount->Exists(Relative,
+                        AssetManager::HashPath(Relative, Asset.size() - PrefixLength));
+                }
+                if (!Shadowed)
+                    Changes.push_back({ String(Asset.c_str()), Events[i].Changes });
+            }
+        }
+    }
+    if (Changes.empty())
+        return;
+    std::vector<__ReloadListener> Listeners;
+    {
+        os::Mutex::AutoLock Guard(&d->ListenerLock);
+        Listeners = d->Listeners;
+    }
+    std::vector<os::FileEvent> Matching;
+    for (auto const& Listener : Listeners)
+    {
+        Matching.clear();
+        for (auto const& Change : Changes)
+            if (strncmp(Change.Path.CStr(), Listener.Prefix.c_str(), Listener.Prefix.size()) == 0)
+                Matching.push_back(Change);
+        if (Matching.empty())
+            continue;
+        {
+            os::Mutex::AutoLock Guard(&d->ListenerLock);
+            // removed since the copy, its UserData may be gone already
+            if (std::find_if(d->Listeners.begin(), d->Listeners.end(),
+                    [&Listener](__ReloadListener const& Other) { return Other.Id == Listener.Id; }) == d->Listeners.end())
+                continue;
+            d->Notifying.push_back(Listener.Id);
+        }
+        tNotifyingManager = d;
+        tNotifyingListener = Listener.Id;
+        Listener.Callback(Matching.data(), (U32)Matching.size(), Listener.UserData);
+        tNotifyingManager = nullptr;
+        tNotifyingListener = 0;
+        os::Mutex::AutoLock Guard(&d->ListenerLock);
+        d->Notifying.erase(std::find(d->Notifying.begin(), d->Notifying.end(), Listener.Id));
+        d->Notified.NotifyAll();
+    }
+}
+}
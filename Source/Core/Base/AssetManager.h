@@ -2,44 +2,145 @@
 #define __AssetManager_h__
 #pragma once
 
-#include <Core/KTL/Singleton.hpp>
-#include <Core/Interface/IIODevice.h>
+namespace k3d
+{
+    /// asset opened through the AssetManager, release it with delete
+    struct K3D_CORE_API IAsset
+    {
+        virtual ~IAsset() {}
+        virtual U64         GetLength() = 0;
+        /// the whole content, nullptr when the asset can only be streamed
+        virtual const void* GetBuffer() = 0;
+        virtual U64         Read(void* Data, U64 Size) = 0;
+        virtual bool        Seek(U64 Offset) = 0;
+    };
 
-//#include "MeshData.h"
+    /// source of assets attached to the virtual file system
+    struct K3D_CORE_API IMount
+    {
+        virtual ~IMount() {}
+        /// \param Path normalized and relative to the mount point
+        /// \param Hash AssetManager::HashPath of Path
+        virtual IAsset* Open(const char* Path, U64 Hash) = 0;
+        virtual bool    Exists(const char* Path, U64 Hash) = 0;
+        /// host directory backing the mount, watched for hot reload
+        virtual const char* GetHostDirectory() { return nullptr; }
+    };
 
-#include <atomic>
-#include <memory>
+    /// files below a directory of the host file system, memory mapped on Open
+    class K3D_CORE_API DirectoryMount : public IMount
+    {
+    public:
+        explicit DirectoryMount(String const& Root);
 
-namespace k3d
-{
-    struct IAsset
-	{
-		virtual ~IAsset() {}
-		virtual uint64	GetLength() = 0;
-		virtual const void*	GetBuffer() = 0;
-		virtual uint64 Read(void *data, uint64 size) = 0;
-		virtual bool Seek(uint64 offset) = 0;
-	};
-
-	/// AssetManager
-	/// **Support Asynchronic Reader
-	/// Search Path Supported
-	/// fix: Need Archieve Support
-	/// With A Pool-Allocator
-	class K3D_CORE_API AssetManager : public Singleton<AssetManager>
-	{
-	public:
-		void Init();
-
-		void Shutdown();
-
-		AssetManager();
-
-	public:
-		
-        static IAsset * 		Open(const char* path);
-	protected:
-	};
+        IAsset* Open(const char* Path, U64 Hash) override;
+        bool    Exists(const char* Path, U64 Hash) override;
+        const char* GetHostDirectory() override { return m_Root.CStr(); }
+
+    private:
+        String  m_Root;
+    };
+
+    /// assets living in memory, Data must outlive the mount
+    class K3D_CORE_API MemoryMount : public IMount
+    {
+    public:
+        MemoryMount();
+        ~MemoryMount();
+
+        void    Add(const char* Path, const void* Data, U64 Size);
+        bool    Remove(const char* Path);
+
+        IAsset* Open(const char* Path, U64 Hash) override;
+        bool    Exists(const char* Path, U64 Hash) override;
+
+    private:
+        struct MemoryMountPrivate* d;
+    };
+
+    /**
+     * Pack archive built by PackBuilder: the entries followed by an open addressing
+     * table keyed by path hash. The pack is mapped once, Open is a table probe and
+     * stored assets point into the mapping, which they keep alive past Unmount.
+     */
+    class K3D_CORE_API PackMount : public IMount
+    {
+    public:
+        PackMount();
+        ~PackMount();
+
+        bool    Load(const char* PackFile);
+        U32     GetEntryCount() const;
+
+        IAsset* Open(const char* Path, U64 Hash) override;
+        bool    Exists(const char* Path, U64 Hash) override;
+
+    private:
+        struct PackMountPrivate* d;
+    };
+
+    class K3D_CORE_API PackBuilder
+    {
+    public:
+        PackBuilder();
+        ~PackBuilder();
+
+        /// \param Compress stores the entry LZ compressed, it's inflated on Open
+        void    Add(const char* Path, const void* Data, U64 Size, bool Compress = false);
+        bool    AddFile(const char* Path, const char* FileName, bool Compress = false);
+        bool    Save(const char* PackFile);
+
+    private:
+        struct PackBuilderPrivate* d;
+    };
+
+    /// AssetManager
+    /// Virtual file system over ordered mount points, paths may carry an "asset://" prefix.
+    /// Init, done on first use, mounts the data directory at the root with priority -1.
+    class K3D_CORE_API AssetManager
+    {
+    public:
+        static AssetManager& Get();
+
+        void Init();
+
+        void Shutdown();
+
+        /// mounts are searched by descending priority, the latest first among equals,
+        /// the manager takes ownership of Mount
+        void Mount(const char* MountPoint, IMount* Mount, I32 Priority = 0);
+        bool MountDirectory(const char* MountPoint, const char* Directory, I32 Priority = 0);
+        bool MountPack(const char* MountPoint, const char* PackFile, I32 Priority = 0);
+        /// deletes Mount
+        bool Unmount(IMount* Mount);
+
+        bool Exists(const char* Path);
+
+        /// watches the directory mounts, including those mounted later
+        bool EnableHotReload(U32 DebounceMs = 50);
+        void DisableHotReload();
+        /**
+         * Listener receives batches of changed assets below Prefix, Path being the
+         * asset path. Changes hidden by a higher priority mount are left out, so only
+         * the resources that actually change need reloading.
+         */
+        U32  AddReloadListener(const char* Prefix, os::PFN_FileChanges Listener, void* UserData);
+        /// like FileWatcher::Unsubscribe, waits for the callbacks of Id still running
+        void RemoveReloadListener(U32 Id);
+
+        static IAsset*  Open(const char* Path);
+        /// FNV-1a of a normalized path
+        static U64      HashPath(const char* Path, size_t Length);
+
+        AssetManager(const AssetManager&) = delete;
+        AssetManager& operator=(const AssetManager&) = delete;
+
+    private:
+        AssetManager();
+        ~AssetManager();
+
+        struct AssetManagerPrivate* d;
+    };
 }
 
 #endif
@@ -0,0 +1,344 @@
+#include "CoreMinimal.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define __K3D_BASE64_X86 1
+#if K3DCOMPILER_MSVC
+#include <intrin.h>
+#define __K3D_TARGET(Isa)
+#else
+#include <immintrin.h>
+// the vector paths are compiled for their ISA whatever the build targets and picked at run time
+#define __K3D_TARGET(Isa) __attribute__((target(Isa)))
+#endif
+#elif defined(__aarch64__) && K3D_USE_NEON
+#define __K3D_BASE64_NEON 1
+#endif
+
+namespace k3d
+{
+/*
+ * The vector codecs follow W. Mula and D. Lemire, "Faster Base64 Encoding and
+ * Decoding using AVX2 Instructions": the byte shuffle spreads 3 bytes over 4
+ * lanes, two multiplies move the 6 bit fields in place, and a 16 entry lookup
+ * on the range of the index gives the offset to its character. Decoding runs
+ * it backwards and checks the alphabet with two nibble lookups; a block with
+ * padding or any other character is left to the scalar loop, which stops
+ * there.
+ */
+static const char __Alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+    "abcdefghijklmnopqrstuvwxyz"
+    "0123456789+/";
+
+static const U8 __Invalid = 0xFF;
+
+struct __DecodeTable
+{
+    __DecodeTable()
+    {
+        memset(Values, __Invalid, sizeof(Values));
+        for (U8 i = 0; i < 64; i++)
+            Values[(U8)__Alphabet[i]] = i;
+    }
+    U8 Values[256];
+};
+
+/// built on first use, Base64Decode may run from other static initializers
+static const U8* __DecodeValues()
+{
+    static const __DecodeTable Table;
+    return Table.Values;
+}
+
+static size_t __EncodeScalar(const U8* In, size_t Size, char* Out)
+{
+    char* Start = Out;
+    size_t i = 0;
+    for (; i + 3 <= Size; i += 3)
+    {
+        U32 Triple = ((U32)In[i] << 16) | ((U32)In[i + 1] << 8) | In[i + 2];
+        Out[0] = __Alphabet[Triple >> 18];
+        Out[1] = __Alphabet[(Triple >> 12) & 63];
+        Out[2] = __Alphabet[(Triple >> 6) & 63];
+        Out[3] = __Alphabet[Triple & 63];
+        Out += 4;
+    }
+    if (i < Size)
+    {
+        U32 Triple = (U32)In[i] << 16;
+        if (i + 1 < Size)
+            Triple |= (U32)In[i + 1] << 8;
+        Out[0] = __Alphabet[Triple >> 18];
+        Out[1] = __Alphabet[(Triple >> 12) & 63];
+        Out[2] = i + 1 < Size ? __Alphabet[(Triple >> 6) & 63] : '=';
+        Out[3] = '=';
+        Out += 4;
+    }
+    return Out - Start;
+}
+
+/// decodes up to the first character outside the alphabet, \return bytes written
+static size_t __DecodeScalar(const U8* In, size_t Size, U8* Out)
+{
+    const U8* Values = __DecodeValues();
+    U8* Start = Out;
+    size_t i = 0;
+    for (; i + 4 <= Size; i += 4)
+    {
+        U8 A = Values[In[i]], B = Values[In[i + 1]];
+        U8 C = Values[In[i + 2]], D = Values[In[i + 3]];
+        if ((A | B | C | D) == __Invalid)
+            break;
+        U32 Triple = ((U32)A << 18) | ((U32)B << 12) | ((U32)C << 6) | D;
+        Out[0] = (U8)(Triple >> 16);
+        Out[1] = (U8)(Triple >> 8);
+        Out[2] = (U8)Triple;
+        Out += 3;
+    }
+    // the last, padded or cut group: as many whole bytes as its valid characters carry
+    U32 Triple = 0;
+    U32 Count = 0;
+    for (; i < Size && Count < 4; i++, Count++)
+    {
+        U8 Value = Values[In[i]];
+        if (Value == __Invalid)
+            break;
+        Triple |= (U32)Value << (18 - 6 * Count);
+    }
+    for (U32 j = 0; j + 1 < Count; j++)
+        *Out++ = (U8)(Triple >> (16 - 8 * j));
+    return Out - Start;
+}
+
+#if __K3D_BASE64_X86
+enum class __Base64Isa : U8
+{
+    Scalar,
+    Ssse3,
+    Avx2,
+};
+
+static __Base64Isa __DetectIsa()
+{
+    simd::CpuFeatures const& Features = simd::GetCpuFeatures();
+    return Features.Avx2 ? __Base64Isa::Avx2 : Features.Ssse3 ? __Base64Isa::Ssse3 : __Base64Isa::Scalar;
+}
+
+static const __Base64Isa __Isa = __DetectIsa();
+
+__K3D_TARGET("ssse3") static inline __m128i __EncodeBlock(__m128i In)
+{
+    // bytes [b1 b0 b2 b1] per lane, then a and c of each 3 bytes to 6 bit fields
+    In = _mm_shuffle_epi8(In, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    __m128i Ac = _mm_mulhi_epu16(_mm_and_si128(In, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+    __m128i Bd = _mm_mullo_epi16(_mm_and_si128(In, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+    __m128i Indices = _mm_or_si128(Ac, Bd);
+    // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12
+    __m128i Range = _mm_subs_epu8(Indices, _mm_set1_epi8(51));
+    __m128i Upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), Indices);
+    Range = _mm_or_si128(Range, _mm_and_si128(Upper, _mm_set1_epi8(13)));
+    const __m128i Offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    return _mm_add_epi8(Indices, _mm_shuffle_epi8(Offsets, Range));
+}
+
+__K3D_TARGET("ssse3") static size_t __EncodeSsse3(const U8* In, size_t Size, char* Out)
+{
+    // 12 bytes in, 16 characters out, the load reads 4 bytes ahead
+    size_t i = 0;
+    char* Start = Out;
+    for (; i + 16 <= Size; i += 12, Out += 16)
+        _mm_storeu_si128((__m128i*)Out, __EncodeBlock(_mm_loadu_si128((const __m128i*)(In + i))));
+    return (Out - Start) + __EncodeScalar(In + i, Size - i, Out);
+}
+
+__K3D_TARGET("avx2") static size_t __EncodeAvx2(const U8* In, size_t Size, char* Out)
+{
+    const __m256i Shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i Offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    // 24 bytes in, 12 per lane, 32 characters out
+    size_t i = 0;
+    char* Start = Out;
+    for (; i + 28 <= Size; i += 24, Out += 32)
+    {
+        __m256i Block = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(In + i))),
+            _mm_loadu_si128((const __m128i*)(In + i + 12)), 1);
+        Block = _mm256_shuffle_epi8(Block, Shuffle);
+        __m256i Ac = _mm256_mulhi_epu16(_mm256_and_si256(Block, _mm256_set1_epi32(0x0FC0FC00)),
+            _mm256_set1_epi32(0x04000040));
+        __m256i Bd = _mm256_mullo_epi16(_mm256_and_si256(Block, _mm256_set1_epi32(0x003F03F0)),
+            _mm256_set1_epi32(0x01000010));
+        __m256i Indices = _mm256_or_si256(Ac, Bd);
+        __m256i Range = _mm256_subs_epu8(Indices, _mm256_set1_epi8(51));
+        __m256i Upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), Indices);
+        Range = _mm256_or_si256(Range, _mm256_and_si256(Upper, _mm256_set1_epi8(13)));
+        _mm256_storeu_si256((__m256i*)Out, _mm256_add_epi8(Indices, _mm256_shuffle_epi8(Offsets, Range)));
+    }
+    return (Out - Start) + __EncodeSsse3(In + i, Size - i, Out);
+}
+
+__K3D_TARGET("ssse3") static size_t __DecodeSsse3(const U8* In, size_t Size, U8* Out)
+{
+    const __m128i LowBits = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i HighBits = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i Roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i Slash = _mm_set1_epi8(0x2F);
+    // 16 characters in, 12 bytes out; the store writes 4 bytes ahead, which the
+    // next block or the tail overwrites, and the loop stops short of the end
+    size_t i = 0;
+    U8* Start = Out;
+    for (; i + 24 <= Size; i += 16, Out += 12)
+    {
+        __m128i Block = _mm_loadu_si128((const __m128i*)(In + i));
+        __m128i High = _mm_and_si128(_mm_srli_epi32(Block, 4), Slash);
+        __m128i Low = _mm_and_si128(Block, Slash);
+        __m128i Check = _mm_and_si128(_mm_shuffle_epi8(LowBits, Low), _mm_shuffle_epi8(HighBits, High));
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(Check, _mm_setzero_si128())))
+            break;
+        __m128i IsSlash = _mm_cmpeq_epi8(Block, Slash);
+        Block = _mm_add_epi8(Block, _mm_shuffle_epi8(Roll, _mm_add_epi8(IsSlash, High)));
+        __m128i Pairs = _mm_maddubs_epi16(Block, _mm_set1_epi32(0x01400140));
+        __m128i Words = _mm_madd_epi16(Pairs, _mm_set1_epi32(0x00011000));
+        Words = _mm_shuffle_epi8(Words, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128((__m128i*)Out, Words);
+    }
+    return (Out - Start) + __DecodeScalar(In + i, Size - i, Out);
+}
+
+__K3D_TARGET("avx2") static size_t __DecodeAvx2(const U8* In, size_t Size, U8* Out)
+{
+    const __m256i LowBits = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i HighBits = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i Roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i Slash = _mm256_set1_epi8(0x2F);
+    const __m256i Pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    // 32 characters in, 24 bytes out with a 32 byte store
+    size_t i = 0;
+    U8* Start = Out;
+    for (; i + 48 <= Size; i += 32, Out += 24)
+    {
+        __m256i Block = _mm256_loadu_si256((const __m256i*)(In + i));
+        __m256i High = _mm256_and_si256(_mm256_srli_epi32(Block, 4), Slash);
+        __m256i Low = _mm256_and_si256(Block, Slash);
+        __m256i Check = _mm256_and_si256(_mm256_shuffle_epi8(LowBits, Low), _mm256_shuffle_epi8(HighBits, High));
+        if (_mm256_movemask_epi8(_mm256_cmpgt_epi8(Check, _mm256_setzero_si256())))
+            break;
+        __m256i IsSlash = _mm256_cmpeq_epi8(Block, Slash);
+        Block = _mm256_add_epi8(Block, _mm256_shuffle_epi8(Roll, _mm256_add_epi8(IsSlash, High)));
+        __m256i Pairs = _mm256_maddubs_epi16(Block, _mm256_set1_epi32(0x01400140));
+        __m256i Words = _mm256_madd_epi16(Pairs, _mm256_set1_epi32(0x00011000));
+        Words = _mm256_shuffle_epi8(Words, Pack);
+        // the 12 bytes of each lane side by side
+        Words = _mm256_permutevar8x32_epi32(Words, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_storeu_si256((__m256i*)Out, Words);
+    }
+    return (Out - Start) + __DecodeSsse3(In + i, Size - i, Out);
+}
+#endif
+
+#if __K3D_BASE64_NEON
+static size_t __EncodeNeon(const U8* In, size_t Size, char* Out)
+{
+    uint8x16x4_t Table;
+    for (int t = 0; t < 4; t++)
+        Table.val[t] = vld1q_u8((const U8*)__Alphabet + 16 * t);
+    // 48 bytes in, de-interleaved by vld3, 64 characters out interleaved by vst4
+    size_t i = 0;
+    char* Start = Out;
+    for (; i + 48 <= Size; i += 48, Out += 64)
+    {
+        uint8x16x3_t Bytes = vld3q_u8(In + i);
+        const uint8x16_t Six = vdupq_n_u8(63);
+        uint8x16x4_t Chars;
+        Chars.val[0] = vshrq_n_u8(Bytes.val[0], 2);
+        Chars.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(Bytes.val[0], 4), vshrq_n_u8(Bytes.val[1], 4)), Six);
+        Chars.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(Bytes.val[1], 2), vshrq_n_u8(Bytes.val[2], 6)), Six);
+        Chars.val[3] = vandq_u8(Bytes.val[2], Six);
+        for (int c = 0; c < 4; c++)
+            Chars.val[c] = vqtbl4q_u8(Table, Chars.val[c]);
+        vst4q_u8((U8*)Out, Chars);
+    }
+    return (Out - Start) + __EncodeScalar(In + i, Size - i, Out);
+}
+
+static size_t __DecodeNeon(const U8* In, size_t Size, U8* Out)
+{
+    // the decode table for characters 0..127, 0xFF marks the ones outside the alphabet
+    const U8* Values = __DecodeValues();
+    uint8x16x4_t Low, High;
+    for (int t = 0; t < 4; t++)
+    {
+        Low.val[t] = vld1q_u8(Values + 16 * t);
+        High.val[t] = vld1q_u8(Values + 64 + 16 * t);
+    }
+    const uint8x16_t Sixty4 = vdupq_n_u8(64);
+    size_t i = 0;
+    U8* Start = Out;
+    for (; i + 64 <= Size; i += 64, Out += 48)
+    {
+        uint8x16x4_t Chars = vld4q_u8(In + i);
+        uint8x16_t Bad = vdupq_n_u8(0);
+        for (int c = 0; c < 4; c++)
+        {
+            uint8x16_t Char = Chars.val[c];
+            // out of range indices give 0 from tbl and keep the value with tbx;
+            // a character past 127 is caught by its own high bit
+            uint8x16_t Value = vqtbx4q_u8(vqtbl4q_u8(Low, Char), High, vsubq_u8(Char, Sixty4));
+            Bad = vorrq_u8(Bad, vorrq_u8(Value, Char));
+            Chars.val[c] = Value;
+        }
+        if (vmaxvq_u8(Bad) & 0x80)
+            break;
+        uint8x16x3_t Bytes;
+        Bytes.val[0] = vorrq_u8(vshlq_n_u8(Chars.val[0], 2), vshrq_n_u8(Chars.val[1], 4));
+        Bytes.val[1] = vorrq_u8(vshlq_n_u8(Chars.val[1], 4), vshrq_n_u8(Chars.val[2], 2));
+        Bytes.val[2] = vorrq_u8(vshlq_n_u8(Chars.val[2], 6), Chars.val[3]);
+        vst3q_u8(Out, Bytes);
+    }
+    return (Out - Start) + __DecodeScalar(In + i, Size - i, Out);
+}
+#endif
+
+K3D_CORE_API size_t Base64Encode(const void* Data, size_t Size, char* Out)
+{
+    const U8* In = (const U8*)Data;
+#if __K3D_BASE64_X86
+    if (__Isa == __Base64Isa::Avx2)
+        return __EncodeAvx2(In, Size, Out);
+    if (__Isa == __Base64Isa::Ssse3)
+        return __EncodeSsse3(In, Size, Out);
+#elif __K3D_BASE64_NEON
+    return __EncodeNeon(In, Size, Out);
+#endif
+    return __EncodeScalar(In, Size, Out);
+}
+
+K3D_CORE_API size_t Base64Decode(const char* Text, size_t Size, void* Out)
+{
+    const U8* In = (const U8*)Text;
+#if __K3D_BASE64_X86
+    if (__Isa == __Base64Isa::Avx2)
+        return __DecodeAvx2(In, Size, (U8*)Out);
+    if (__Isa == __Base64Isa::Ssse3)
+        return __DecodeSsse3(In, Size, (U8*)Out);
+#elif __K3D_BASE64_NEON
+    return __DecodeNeon(In, Size, (U8*)Out);
+#endif
+    return __DecodeScalar(In, Size, (U8*)Out);
+}
+}
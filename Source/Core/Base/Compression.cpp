@@ -0,0 +1,782 @@
+#include "CoreMinimal.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#if K3DCOMPILER_MSVC
+#include <intrin.h>
+#endif
+
+namespace k3d
+{
+/*
+ * Block format, LZ4 style sequences:
+ *   token       literal length in the high nibble, match length - 4 in the low one,
+ *               15 continues the length in following bytes of 255 until one is smaller
+ *   literals
+ *   offset      2 bytes little endian, 1..65535 back from the current output
+ * the last sequence has literals only.
+ */
+static const U32 kHashLog = 14;
+static const U32 kMinMatch = 4;
+static const U32 kMaxOffset = 65535;
+// matches stop this far from the end, so the tail of a block is always literals
+static const U32 kLastLiterals = 5;
+static const U32 kMinInput = 13;
+
+static inline U32 __Read32(const U8* Ptr)
+{
+    U32 Value;
+    memcpy(&Value, Ptr, sizeof(Value));
+    return Value;
+}
+
+static inline U64 __Read64(const U8* Ptr)
+{
+    U64 Value;
+    memcpy(&Value, Ptr, sizeof(Value));
+    return Value;
+}
+
+static inline U32 __Hash(U32 Sequence)
+{
+    return (Sequence * 2654435761u) >> (32 - kHashLog);
+}
+
+static inline U32 __CountTrailingZeros(U64 Value)
+{
+#if K3DCOMPILER_MSVC
+    unsigned long Index;
+    _BitScanForward64(&Index, Value);
+    return Index;
+#else
+    return (U32)__builtin_ctzll(Value);
+#endif
+}
+
+static inline U8* __WriteLength(U8* Out, size_t Length)
+{
+    while (Length >= 255)
+    {
+        *Out++ = 255;
+        Length -= 255;
+    }
+    *Out++ = (U8)Length;
+    return Out;
+}
+
+size_t LZCompressBound(size_t Size)
+{
+    return Size + Size / 255 + 16;
+}
+
+size_t LZCompress(const void* Src, size_t SrcSize, void* Dst, size_t DstCapacity)
+{
+    if (DstCapacity < LZCompressBound(SrcSize))
+        return 0;
+    const U8* const Begin = (const U8*)Src;
+    const U8* const End = Begin + SrcSize;
+    const U8* Anchor = Begin;
+    U8* Out = (U8*)Dst;
+
+    if (SrcSize >= kMinInput)
+    {
+        U32 Table[1 << kHashLog];
+        memset(Table, 0, sizeof(Table));
+        const U8* const MatchLimit = End - kLastLiterals;
+        const U8* const InputLimit = End - kMinInput + 1;
+        const U8* In = Begin + 1;
+        while (In < InputLimit)
+        {
+            U32 Sequence = __Read32(In);
+            U32 Hash = __Hash(Sequence);
+            const U8* Ref = Begin + Table[Hash];
+            Table[Hash] = (U32)(In - Begin);
+            if (Ref >= In || In - Ref > kMaxOffset || __Read32(Ref) != Sequence)
+            {
+                // step faster through data that doesn't compress
+                In += 1 + ((In - Anchor) >> 6);
+                continue;
+            }
+            while (In > Anchor && Ref > Begin && In[-1] == Ref[-1])
+            {
+                In--;
+                Ref--;
+            }
+            const U8* MatchEnd = In + kMinMatch;
+            const U8* RefEnd = Ref + kMinMatch;
+            while (MatchEnd + 8 <= MatchLimit)
+            {
+                U64 Diff = __Read64(MatchEnd) ^ __Read64(RefEnd);
+                if (Diff)
+                {
+                    MatchEnd += __CountTrailingZeros(Diff) >> 3;
+                    goto MatchFound;
+                }
+                MatchEnd += 8;
+                RefEnd += 8;
+            }
+            while (MatchEnd < MatchLimit && *MatchEnd == *RefEnd)
+            {
+                MatchEnd++;
+                RefEnd++;
+            }
+        MatchFound:
+            {
+                size_t Literals = In - Anchor;
+                size_t MatchLength = MatchEnd - In - kMinMatch;
+                U8* Token = Out++;
+                U8 TokenValue = 0;
+                if (Literals >= 15)
+                {
+                    TokenValue = 15 << 4;
+                    Out = __WriteLength(Out, Literals - 15);
+                }
+                else
+                {
+                    TokenValue = (U8)(Literals << 4);
+                }
+                memcpy(Out, Anchor, Literals);
+                Out += Literals;
+                U32 Offset = (U32)(In - Ref);
+                *Out++ = (U8)(Offset & 0xff);
+                *Out++ = (U8)(Offset >> 8);
+                if (MatchLength >= 15)
+                {
+                    TokenValue |= 15;
+                    Out = __WriteLength(Out, MatchLength - 15);
+                }
+                else
+                {
+                    TokenValue |= (U8)MatchLength;
+                }
+                *Token = TokenValue;
+            }
+            In = MatchEnd;
+            Anchor = In;
+            if (In - 2 > Begin && In < InputLimit)
+            {
+                Table[__Hash(__Read32(In - 2))] = (U32)(In - 2 - Begin);
+            }
+        }
+    }
+
+    size_t Literals = End - Anchor;
+    if (Literals >= 15)
+    {
+        *Out++ = 15 << 4;
+        Out = __WriteLength(Out, Literals - 15);
+    }
+    else
+    {
+        *Out++ = (U8)(Literals << 4);
+    }
+    memcpy(Out, Anchor, Literals);
+    Out += Literals;
+    return Out - (U8*)Dst;
+}
+
+size_t LZDecompress(const void* Src, size_t SrcSize, void* Dst, size_t DstCapacity)
+{
+    const size_t kError = size_t(-1);
+    const U8* In = (const U8*)Src;
+    const U8* const InEnd = In + SrcSize;
+    U8* const OutBegin = (U8*)Dst;
+    U8* Out = OutBegin;
+    U8* const OutEnd = Out + DstCapacity;
+    while (In < InEnd)
+    {
+        U32 Token = *In++;
+        size_t Literals = Token >> 4;
+        if (Literals == 15)
+        {
+            U8 Byte;
+            do
+            {
+                if (In >= InEnd)
+                    return kError;
+                Byte = *In++;
+                Literals += Byte;
+            } while (Byte == 255);
+        }
+        if (Literals > (size_t)(InEnd - In) || Literals > (size_t)(OutEnd - Out))
+            return kError;
+        memcpy(Out, In, Literals);
+        In += Literals;
+        Out += Literals;
+        if (In >= InEnd)
+            break;
+
+        if (InEnd - In < 2)
+            return kError;
+        size_t Offset = In[0] | (In[1] << 8);
+        In += 2;
+        if (Offset == 0 || Offset > (size_t)(Out - OutBegin))
+            return kError;
+        size_t MatchLength = Token & 15;
+        if (MatchLength == 15)
+        {
+            U8 Byte;
+            do
+            {
+                if (In >= InEnd)
+                    return kError;
+                Byte = *In++;
+                MatchLength += Byte;
+            } while (Byte == 255);
+        }
+        MatchLength += kMinMatch;
+        if (MatchLength > (size_t)(OutEnd - Out))
+            return kError;
+        const U8* Match = Out - Offset;
+        if (Offset >= 8)
+        {
+            while (MatchLength >= 8)
+            {
+                memcpy(Out, Match, 8);
+                Out += 8;
+                Match += 8;
+                MatchLength -= 8;
+            }
+        }
+        // overlapping copies repeat the pattern byte by byte
+        while (MatchLength--)
+        {
+            *Out++ = *Match++;
+        }
+    }
+    return Out - OutBegin;
+}
+
+/*
+ * Stream layout:
+ *   header      magic, version, block size, offset of the block index (0 until Close)
+ *   blocks      packed size (high bit set when stored raw), raw size, payload
+ *   index       block count, then offset, packed size and raw size of every block
+ */
+static const U32 kStreamMagic = 0x5a4c334b; // K3LZ
+static const U16 kStreamVersion = 1;
+static const U32 kStreamHeaderSize = 24;
+static const U32 kIndexOffsetField = 16;
+static const U32 kBlockHeaderSize = 8;
+static const U32 kIndexEntrySize = 16;
+static const U32 kStoredFlag = 0x80000000u;
+static const U32 kMaxBatch = 16;
+
+struct __BlockEntry
+{
+    U64 Offset;
+    U64 RawOffset;
+    U32 Packed;
+    U32 RawSize;
+
+    U32 PackedSize() const { return Packed & ~kStoredFlag; }
+};
+
+struct __DecodedBlock
+{
+    U32             Block;
+    U64             LastUse;
+    std::vector<U8> Data;
+};
+
+static os::ThreadPool& __CodecPool()
+{
+    static os::ThreadPool sPool(0, "LZCodec");
+    return sPool;
+}
+
+// runs Body(0..Count) across the codec pool, the caller takes index 0
+template <class F>
+static void __ParallelFor(U32 Count, U32 Threads, F const& Body)
+{
+    if (Count <= 1 || Threads <= 1)
+    {
+        for (U32 i = 0; i < Count; i++)
+            Body(i);
+        return;
+    }
+    os::JobCounter Counter;
+    auto& Pool = __CodecPool();
+    for (U32 i = 1; i < Count; i++)
+    {
+        Pool.Enqueue([&Body, i]() { Body(i); }, os::TaskPriority::High, &Counter);
+    }
+    Body(0);
+    Counter.Wait();
+}
+
+struct CompressedStreamPrivate
+{
+    CompressedStreamPrivate(IIODevice* InDevice, U32 InBlockSize, U32 InThreads)
+        : Device(InDevice)
+        , BlockSize(InBlockSize ? InBlockSize : CompressedStream::kDefaultBlockSize)
+        , Threads(InThreads ? InThreads : std::max<U32>(os::GetCpuCoreNum(), 1))
+        , Attached(false)
+        , Writing(false)
+        , RawSize(0)
+        , Pos(0)
+        , DeviceOffset(0)
+        , UseClock(0)
+        , PendingSize(0)
+    {
+        // the stored flag leaves 31 bits for a packed block
+        BlockSize = std::min<U32>(BlockSize, 1u << 30);
+    }
+
+    void Reset()
+    {
+        Attached = false;
+        Writing = false;
+        Blocks.clear();
+        Cache.clear();
+        RawSize = Pos = DeviceOffset = 0;
+        PendingSize = 0;
+    }
+
+    bool WriteHeader(U64 IndexOffset)
+    {
+        U8 Header[kStreamHeaderSize] = { 0 };
+        U32 Magic = kStreamMagic;
+        U16 Version = kStreamVersion;
+        memcpy(Header, &Magic, 4);
+        memcpy(Header + 4, &Version, 2);
+        memcpy(Header + 8, &BlockSize, 4);
+        memcpy(Header + kIndexOffsetField, &IndexOffset, 8);
+        return Device->Write(Header, kStreamHeaderSize) == kStreamHeaderSize;
+    }
+
+    bool ReadHeader()
+    {
+        U8 Header[kStreamHeaderSize];
+        if (!Device->Seek(0) || Device->Read((char*)Header, kStreamHeaderSize) != kStreamHeaderSize)
+            return false;
+        U32 Magic;
+        U16 Version;
+        U64 IndexOffset;
+        memcpy(&Magic, Header, 4);
+        memcpy(&Version, Header + 4, 2);
+        memcpy(&BlockSize, Header + 8, 4);
+        memcpy(&IndexOffset, Header + kIndexOffsetField, 8);
+        if (Magic != kStreamMagic || Version != kStreamVersion || !BlockSize || BlockSize > (1u << 30))
+            return false;
+        if (IndexOffset && ReadIndex(IndexOffset))
+            return true;
+        return ScanBlocks();
+    }
+
+    void AddBlock(U64 Offset, U32 Packed, U32 Raw)
+    {
+        __BlockEntry Entry = { Offset, RawSize, Packed, Raw };
+        Blocks.push_back(Entry);
+        RawSize += Raw;
+    }
+
+    // IIODevice has no size, so whether the device reaches End is probed by reading
+    // its last byte; leaves the device at End
+    bool HasBytesUpTo(U64 End)
+    {
+        char Byte;
+        return End && End - 1 <= (U64)size_t(-1)
+            && Device->Seek((size_t)(End - 1)) && Device->Read(&Byte, 1) == 1;
+    }
+
+    // sizes the writer can produce, anything else is corrupt
+    bool IsValidBlock(U32 Packed, U32 Raw) const
+    {
+        U32 PackedSize = Packed & ~kStoredFlag;
+        return Raw && Raw <= BlockSize
+            && ((Packed & kStoredFlag) ? PackedSize == Raw : PackedSize && PackedSize < Raw);
+    }
+
+    bool ReadIndex(U64 IndexOffset)
+    {
+        U64 Count = 0;
+        if (IndexOffset < kStreamHeaderSize || !Device->Seek(IndexOffset) || Device->Read((char*)&Count, 8) != 8)
+            return false;
+        // check the count against the device before it sizes anything
+        U64 MaxCount = std::min<U64>((U64(-1) - IndexOffset - 8), size_t(-1)) / kIndexEntrySize;
+        if (Count > MaxCount || (Count && !HasBytesUpTo(IndexOffset + 8 + Count * kIndexEntrySize)))
+            return false;
+        std::vector<U8> Index((size_t)Count * kIndexEntrySize);
+        if (!Device->Seek(IndexOffset + 8) || Device->Read((char*)Index.data(), Index.size()) != Index.size())
+            return false;
+        Blocks.clear();
+        RawSize = 0;
+        // blocks lie in order between the stream header and the index
+        U64 End = kStreamHeaderSize;
+        for (U64 i = 0; i < Count; i++)
+        {
+            U64 Offset;
+            U32 Packed, Raw;
+            memcpy(&Offset, &Index[i * kIndexEntrySize], 8);
+            memcpy(&Packed, &Index[i * kIndexEntrySize + 8], 4);
+            memcpy(&Raw, &Index[i * kIndexEntrySize + 12], 4);
+            if (!IsValidBlock(Packed, Raw) || Offset < End || Offset > IndexOffset
+                || IndexOffset - Offset < kBlockHeaderSize + (Packed & ~kStoredFlag))
+            {
+                Blocks.clear();
+                RawSize = 0;
+                return false;
+            }
+            AddBlock(Offset, Packed, Raw);
+            End = Offset + kBlockHeaderSize + (Packed & ~kStoredFlag);
+        }
+        return true;
+    }
+
+    // the index is missing when the writer didn't get to Close, walk the block headers;
+    // a corrupt or truncated block ends the stream
+    bool ScanBlocks()
+    {
+        Blocks.clear();
+        RawSize = 0;
+        if (!Device->Seek(kStreamHeaderSize))
+            return false;
+        U64 Offset = kStreamHeaderSize;
+        U32 Header[2];
+        while (Device->Read((char*)Header, kBlockHeaderSize) == kBlockHeaderSize)
+        {
+            U64 End = Offset + kBlockHeaderSize + (Header[0] & ~kStoredFlag);
+            if (!IsValidBlock(Header[0], Header[1]) || !HasBytesUpTo(End))
+                break;
+            AddBlock(Offset, Header[0], Header[1]);
+            Offset = End;
+        }
+        return true;
+    }
+
+    U32 FindBlock(U64 Offset) const
+    {
+        auto It = std::upper_bound(Blocks.begin(), Blocks.end(), Offset,
+            [](U64 Value, __BlockEntry const& Entry) { return Value < Entry.RawOffset; });
+        return (U32)(It - Blocks.begin()) - 1;
+    }
+
+    // reads the contiguous payloads of Count blocks at once, then decodes them in parallel
+    bool LoadBlocks(U32 First, U32 Count, U8** Dests)
+    {
+        const __BlockEntry& Last = Blocks[First + Count - 1];
+        U64 Begin = Blocks[First].Offset;
+        size_t Size = (size_t)(Last.Offset + kBlockHeaderSize + Last.PackedSize() - Begin);
+        Packed.resize(Size);
+        if (!Device->Seek(Begin) || Device->Read((char*)Packed.data(), Size) != Size)
+            return false;
+        std::atomic<bool> Ok(true);
+        __ParallelFor(Count, Threads, [this, First, Begin, Dests, &Ok](U32 i)
+        {
+            const __BlockEntry& Entry = Blocks[First + i];
+            const U8* Src = Packed.data() + (Entry.Offset - Begin) + kBlockHeaderSize;
+            if (Entry.Packed & kStoredFlag)
+            {
+                if (Entry.PackedSize() != Entry.RawSize)
+                    Ok = false;
+                else
+                    memcpy(Dests[i], Src, Entry.RawSize);
+            }
+            else if (LZDecompress(Src, Entry.PackedSize(), Dests[i], Entry.RawSize) != Entry.RawSize)
+            {
+                Ok = false;
+            }
+        });
+        return Ok;
+    }
+
+    __DecodedBlock* FindCached(U32 Block)
+    {
+        for (auto& Decoded : Cache)
+        {
+            if (Decoded.Block == Block)
+                return &Decoded;
+        }
+        return nullptr;
+    }
+
+    // decodes Block together with the blocks following it, one per thread
+    __DecodedBlock* GetBlock(U32 Block)
+    {
+        if (__DecodedBlock* Decoded = FindCached(Block))
+        {
+            Decoded->LastUse = ++UseClock;
+            return Decoded;
+        }
+        U32 Count = 1;
+        while (Count < std::min(Threads, kMaxBatch) && Block + Count < Blocks.size()
+            && !FindCached(Block + Count))
+        {
+            Count++;
+        }
+        size_t Capacity = std::max<size_t>(2 * std::min(Threads, kMaxBatch), 2);
+        U8* Dests[kMaxBatch];
+        __DecodedBlock* Slots[kMaxBatch];
+        for (U32 i = 0; i < Count; i++)
+        {
+            __DecodedBlock* Slot = nullptr;
+            if (Cache.size() < Capacity)
+            {
+                // the cache is sized once so slots never move
+                Cache.reserve(Capacity);
+                Cache.push_back(__DecodedBlock());
+                Slot = &Cache.back();
+            }
+            else
+            {
+                Slot = &*std::min_element(Cache.begin(), Cache.end(),
+                    [](__DecodedBlock const& A, __DecodedBlock const& B) { return A.LastUse < B.LastUse; });
+            }
+            Slot->Block = Block + i;
+            Slot->LastUse = ++UseClock;
+            Slot->Data.resize(Blocks[Block + i].RawSize);
+            Dests[i] = Slot->Data.data();
+            Slots[i] = Slot;
+        }
+        if (!LoadBlocks(Block, Count, Dests))
+        {
+            for (U32 i = 0; i < Count; i++)
+                Slots[i]->Block = ~0u;
+            return nullptr;
+        }
+        return Slots[0];
+    }
+
+    size_t Read(char* Data, size_t Size)
+    {
+        size_t Total = 0;
+        while (Total < Size && Pos < RawSize)
+        {
+            U32 Block = FindBlock(Pos);
+            const __BlockEntry& Entry = Blocks[Block];
+            size_t Left = Size - Total;
+            if (Pos == Entry.RawOffset && Left >= Entry.RawSize && !FindCached(Block))
+            {
+                // whole blocks are decoded straight into the destination
+                U8* Dests[kMaxBatch * 4];
+                U32 Count = 0;
+                size_t Bytes = 0;
+                U32 MaxRun = std::min<U32>(std::min(Threads, kMaxBatch) * 4, kMaxBatch * 4);
+                while (Count < MaxRun && Block + Count < Blocks.size()
+                    && Bytes + Blocks[Block + Count].RawSize <= Left)
+                {
+                    Dests[Count] = (U8*)Data + Total + Bytes;
+                    Bytes += Blocks[Block + Count].RawSize;
+                    Count++;
+                }
+                if (!LoadBlocks(Block, Count, Dests))
+                    break;
+                Total += Bytes;
+                Pos += Bytes;
+                continue;
+            }
+            __DecodedBlock* Decoded = GetBlock(Block);
+            if (!Decoded)
+                break;
+            size_t Offset = (size_t)(Pos - Entry.RawOffset);
+            size_t Chunk = std::min<size_t>(Left, Entry.RawSize - Offset);
+            memcpy(Data + Total, Decoded->Data.data() + Offset, Chunk);
+            Total += Chunk;
+            Pos += Chunk;
+        }
+        return Total;
+    }
+
+    size_t Write(const void* Data, size_t Size)
+    {
+        size_t Total = 0;
+        while (Total < Size)
+        {
+            size_t Chunk = std::min(Size - Total, Pending.size() - PendingSize);
+            memcpy(Pending.data() + PendingSize, (const U8*)Data + Total, Chunk);
+            PendingSize += Chunk;
+            Total += Chunk;
+            if (PendingSize == Pending.size() && !WriteBlocks())
+                break;
+        }
+        Pos += Total;
+        return Total;
+    }
+
+    // compresses the pending blocks in parallel and appends them in order
+    bool WriteBlocks()
+    {
+        if (!PendingSize)
+            return true;
+        U32 Count = (U32)((PendingSize + BlockSize - 1) / BlockSize);
+        size_t Bound = LZCompressBound(BlockSize);
+        if (Out.size() < Count)
+            Out.resize(Count);
+        size_t OutSize[kMaxBatch];
+        __ParallelFor(Count, Threads, [this, Bound, &OutSize](U32 i)
+        {
+            size_t Raw = std::min<size_t>(BlockSize, PendingSize - (size_t)i * BlockSize);
+            Out[i].resize(Bound);
+            OutSize[i] = LZCompress(Pending.data() + (size_t)i * BlockSize, Raw, Out[i].data(), Bound);
+        });
+        bool Ok = true;
+        for (U32 i = 0; i < Count && Ok; i++)
+        {
+            U32 Raw = (U32)std::min<size_t>(BlockSize, PendingSize - (size_t)i * BlockSize);
+            const U8* Payload = Out[i].data();
+            U32 Packed = (U32)OutSize[i];
+            if (!Packed || Packed >= Raw)
+            {
+                Payload = Pending.data() + (size_t)i * BlockSize;
+                Packed = Raw | kStoredFlag;
+            }
+            U32 Header[2] = { Packed, Raw };
+            U32 PackedSize = Packed & ~kStoredFlag;
+            Ok = Device->Write(Header, kBlockHeaderSize) == kBlockHeaderSize
+                && Device->Write(Payload, PackedSize) == PackedSize;
+            if (Ok)
+            {
+                AddBlock(DeviceOffset, Packed, Raw);
+                DeviceOffset += kBlockHeaderSize + PackedSize;
+            }
+        }
+        PendingSize = 0;
+        return Ok;
+    }
+
+    bool WriteIndex()
+    {
+        std::vector<U8> Index(8 + Blocks.size() * kIndexEntrySize);
+        U64 Count = Blocks.size();
+        memcpy(Index.data(), &Count, 8);
+        for (size_t i = 0; i < Blocks.size(); i++)
+        {
+            U8* Entry = &Index[8 + i * kIndexEntrySize];
+            memcpy(Entry, &Blocks[i].Offset, 8);
+            memcpy(Entry + 8, &Blocks[i].Packed, 4);
+            memcpy(Entry + 12, &Blocks[i].RawSize, 4);
+        }
+        if (Device->Write(Index.data(), Index.size()) != Index.size())
+            return false;
+        // readers fall back to scanning the blocks if the device can't seek back
+        return Device->Seek(kIndexOffsetField)
+            && Device->Write(&DeviceOffset, 8) == 8;
+    }
+
+    IIODevice*                      Device;
+    U32                             BlockSize;
+    U32                             Threads;
+    bool                            Attached;
+    bool                            Writing;
+    std::vector<__BlockEntry>       Blocks;
+    U64                             RawSize;
+    U64                             Pos;
+    U64                             DeviceOffset;
+
+    std::vector<__DecodedBlock>     Cache;
+    U64                             UseClock;
+    std::vector<U8>                 Packed;
+
+    std::vector<U8>                 Pending;
+    size_t                          PendingSize;
+    std::vector<std::vector<U8>>    Out;
+};
+
+CompressedStream::CompressedStream(IIODevice* Device, U32 BlockSize, U32 Threads)
+    : d(new CompressedStreamPrivate(Device, BlockSize, Threads))
+{
+}
+
+CompressedStream::~CompressedStream()
+{
+    if (d->Attached && d->Writing)
+    {
+        Close();
+    }
+    delete d;
+    d = nullptr;
+}
+
+bool CompressedStream::Attach(IOFlag Mode)
+{
+    d->Reset();
+    if (!d->Device)
+        return false;
+    d->Writing = (Mode & IOFlag::Write) != 0;
+    if (d->Writing)
+    {
+        d->Pending.resize((size_t)d->BlockSize * std::min(d->Threads, kMaxBatch));
+        d->DeviceOffset = kStreamHeaderSize;
+        d->Attached = d->WriteHeader(0);
+    }
+    else
+    {
+        d->Attached = d->ReadHeader();
+    }
+    return d->Attached;
+}
+
+U64 CompressedStream::GetSize() const
+{
+    return d->RawSize + (d->Writing ? d->PendingSize : 0);
+}
+
+U32 CompressedStream::GetBlockCount() const
+{
+    return (U32)d->Blocks.size();
+}
+
+bool CompressedStream::Open(const char* FileName, IOFlag Mode)
+{
+    if (!d->Device || !d->Device->Open(FileName, (IOFlag)(Mode & ~IOFlag::SnappyCompressed)))
+        return false;
+    return Attach(Mode);
+}
+
+bool CompressedStream::IsEOF()
+{
+    return !d->Attached || (!d->Writing && d->Pos >= d->RawSize);
+}
+
+size_t CompressedStream::Read(char* Data, size_t Size)
+{
+    if (!d->Attached || d->Writing)
+        return 0;
+    return d->Read(Data, Size);
+}
+
+size_t CompressedStream::Write(const void* Data, size_t Size)
+{
+    if (!d->Attached || !d->Writing)
+        return 0;
+    return d->Write(Data, Size);
+}
+
+bool CompressedStream::Seek(size_t Offset)
+{
+    if (!d->Attached || d->Writing || Offset > d->RawSize)
+        return false;
+    d->Pos = Offset;
+    return true;
+}
+
+bool CompressedStream::Skip(size_t Offset)
+{
+    return Seek((size_t)d->Pos + Offset);
+}
+
+void CompressedStream::Flush()
+{
+    if (!d->Attached || !d->Writing)
+        return;
+    d->WriteBlocks();
+    d->Device->Flush();
+}
+
+void CompressedStream::Close()
+{
+    if (d->Attached && d->Writing)
+    {
+        d->WriteBlocks();
+        d->WriteIndex();
+    }
+    if (d->Attached)
+    {
+        d->Device->Close();
+    }
+    d->Reset();
+}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#ifndef __k3d_Compression_h__
+#define __k3d_Compression_h__
+
+namespace k3d
+{
+    /// worst case output of LZCompress for Size input bytes
+    extern K3D_CORE_API size_t LZCompressBound(size_t Size);
+    /**
+     * LZ77 block codec in the LZ4/Snappy family, tuned for speed over ratio.
+     * Dst must hold LZCompressBound(SrcSize) bytes, returns the compressed size.
+     */
+    extern K3D_CORE_API size_t LZCompress(const void* Src, size_t SrcSize, void* Dst, size_t DstCapacity);
+    /// returns the decompressed size, or size_t(-1) on corrupt input or too small Dst
+    extern K3D_CORE_API size_t LZDecompress(const void* Src, size_t SrcSize, void* Dst, size_t DstCapacity);
+
+    /**
+     * IIODevice decorator implementing IOFlag::SnappyCompressed. Data is compressed
+     * in independent blocks followed by a block index, so reads can Seek anywhere and
+     * neighbouring blocks are decompressed in parallel on a shared thread pool.
+     * The stream must span the whole underlying device, and is either read or written.
+     */
+    class K3D_CORE_API CompressedStream : public IIODevice
+    {
+    public:
+        static const U32 kDefaultBlockSize = 256 * 1024;
+
+        /// \param Threads 0 uses one per core, 1 codes on the calling thread
+        explicit CompressedStream(IIODevice* Device, U32 BlockSize = kDefaultBlockSize, U32 Threads = 0);
+        ~CompressedStream();
+
+        /// starts reading or writing a device that is already open
+        bool        Attach(IOFlag Mode);
+        /// uncompressed size, known when reading
+        U64         GetSize() const;
+        U32         GetBlockCount() const;
+
+        /// opens the underlying device, then Attach
+        bool        Open(const char* FileName, IOFlag Mode) override;
+        bool        IsEOF() override;
+        size_t      Read(char* Data, size_t Size) override;
+        size_t      Write(const void* Data, size_t Size) override;
+        /// uncompressed offset, reading only
+        bool        Seek(size_t Offset) override;
+        bool        Skip(size_t Offset) override;
+        /// ends the current block early and writes it out
+        void        Flush() override;
+        /// writes the block index, then closes the device
+        void        Close() override;
+
+        CompressedStream(const CompressedStream&) = delete;
+        CompressedStream& operator=(const CompressedStream&) = delete;
+
+    private:
+        struct CompressedStreamPrivate* d;
+    };
+}
+
+#endif
@@ -104,6 +104,27 @@ namespace k3d
 
     };
 
+    /// one message of MD5Batch or SHA1Batch, Data stays untouched
+    struct DigestJob
+    {
+        const void* Data;
+        U64         Size;
+        /// the digest bytes as usually printed, MD5 fills the first 16
+        U8          Digest[20];
+    };
+
+    /**
+     * Digests of many independent messages, for checking bundle chunks against a
+     * manifest. The messages go through the lanes of the widest vector unit, 16
+     * with AVX-512, 8 with AVX2, 4 with SSE2 or NEON, one block of each lane per
+     * step; a lane takes the next job as soon as its message ended. Throughput
+     * grows with the lanes as long as there are jobs to keep them busy, single
+     * messages are best left to MD5 and SHA1.
+     */
+    K3D_CORE_API void MD5Batch(DigestJob* Jobs, U32 Count);
+    /// as MD5Batch; below AVX2 the SHA extensions hash the messages one by one when the CPU has them
+    K3D_CORE_API void SHA1Batch(DigestJob* Jobs, U32 Count);
+
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,303 @@
+#include "CoreMinimal.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace k3d
+{
+static const U32 kIndexMagic = 0x4946334B; // "K3FI"
+// 2: content hashed with Hash64
+static const U32 kIndexVersion = 2;
+
+struct __IndexHeader
+{
+    U32 Magic;
+    U32 Version;
+    U32 FileCount;
+    U32 Reserved;
+    U64 NamesSize;
+};
+
+struct __IndexRecord
+{
+    U64 PathHash;
+    U64 Size;
+    U64 ModifiedTime;
+    U64 ContentHash;
+    U32 NameOffset;
+    U32 NameLength;
+};
+
+static bool __HashFile(const char* Path, U64 Size, U64& Hash)
+{
+    if (!Size)
+    {
+        Hash = Hash64(nullptr, 0);
+        return true;
+    }
+    os::MemMapFile File;
+    File.SetAccessPattern(os::MapAccess::Sequential);
+    if (!File.Open(Path, IOFlag::Read) || (U64)File.GetSize() != Size)
+        return false;
+    Hash = Hash64(File.FileData(), (size_t)Size);
+    return true;
+}
+
+struct __IndexedFile
+{
+    std::string Path;
+    FileRecord  Record;
+};
+
+struct FileIndexPrivate
+{
+    void Rebuild()
+    {
+        Lookup.clear();
+        Lookup.reserve(Files.size());
+        for (U32 i = 0; i < Files.size(); i++)
+            Lookup.emplace(Files[i].Path, i);
+    }
+
+    const __IndexedFile* Find(std::string const& Path) const
+    {
+        auto It = Lookup.find(Path);
+        return It == Lookup.end() ? nullptr : &Files[It->second];
+    }
+
+    std::vector<__IndexedFile>              Files;
+    std::unordered_map<std::string, U32>    Lookup;
+    std::vector<os::FileEvent>              Changes;
+};
+
+FileIndex::FileIndex()
+    : d(new FileIndexPrivate)
+{
+}
+
+FileIndex::~FileIndex()
+{
+    delete d;
+    d = nullptr;
+}
+
+bool FileIndex::Load(const char* IndexFile)
+{
+    Clear();
+    os::MemMapFile File;
+    if (!File.Open(IndexFile, IOFlag::Read))
+        return false;
+    U64 FileSize = (U64)File.GetSize();
+    const U8* Data = File.FileData();
+    if (FileSize < sizeof(__IndexHeader))
+        return false;
+    __IndexHeader Header;
+    memcpy(&Header, Data, sizeof(Header));
+    U64 NamesOffset = sizeof(Header) + (U64)Header.FileCount * sizeof(__IndexRecord);
+    if (Header.Magic != kIndexMagic || Header.Version != kIndexVersion ||
+        NamesOffset + Header.NamesSize > FileSize)
+        return false;
+    const char* Names = (const char*)Data + NamesOffset;
+    d->Files.resize(Header.FileCount);
+    for (U32 i = 0; i < Header.FileCount; i++)
+    {
+        __IndexRecord Record;
+        memcpy(&Record, Data + sizeof(Header) + i * sizeof(__IndexRecord), sizeof(Record));
+        if ((U64)Record.NameOffset + Record.NameLength > Header.NamesSize)
+        {
+            Clear();
+            return false;
+        }
+        __IndexedFile& Indexed = d->Files[i];
+        Indexed.Path.assign(Names + Record.NameOffset, Record.NameLength);
+        Indexed.Record.Size = Record.Size;
+        Indexed.Record.ModifiedTime = Record.ModifiedTime;
+        Indexed.Record.ContentHash = Record.ContentHash;
+    }
+    d->Rebuild();
+    return true;
+}
+
+bool FileIndex::Save(const char* IndexFile) const
+{
+    std::string Names;
+    std::vector<__IndexRecord> Records(d->Files.size());
+    for (size_t i = 0; i < d->Files.size(); i++)
+    {
+        __IndexedFile const& Indexed = d->Files[i];
+        __IndexRecord& Record = Records[i];
+        Record.PathHash = AssetManager::HashPath(Indexed.Path.c_str(), Indexed.Path.size());
+        Record.Size = Indexed.Record.Size;
+        Record.ModifiedTime = Indexed.Record.ModifiedTime;
+        Record.ContentHash = Indexed.Record.ContentHash;
+        Record.NameOffset = (U32)Names.size();
+        Record.NameLength = (U32)Indexed.Path.size();
+        Names += Indexed.Path;
+    }
+    __IndexHeader Header = { kIndexMagic, kIndexVersion, (U32)Records.size(), 0, Names.size() };
+
+    // written aside and renamed over, so an interrupted save keeps the previous index
+    std::string Temporary = std::string(IndexFile) + ".tmp";
+    os::Remove(Temporary.c_str());
+    os::File File;
+    if (!File.Open(Temporary.c_str(), IOFlag::Write))
+        return false;
+    BufferedWriter Writer(&File);
+    size_t Written = Writer.Write(&Header, sizeof(Header));
+    Written += Writer.Write(Records.data(), Records.size() * sizeof(__IndexRecord));
+    Written += Writer.Write(Names.data(), Names.size());
+    Writer.Close();
+    if (Written != sizeof(Header) + Records.size() * sizeof(__IndexRecord) + Names.size())
+        return false;
+    os::Remove(IndexFile);
+    return rename(Temporary.c_str(), IndexFile) == 0;
+}
+
+struct __WalkState
+{
+    os::SpinMutex               Lock;
+    std::vector<__IndexedFile>  Files;
+    size_t                      RootLength;
+};
+
+static void __CollectFiles(const os::WalkEntry* Entries, U32 Count, void* UserData)
+{
+    __WalkState* State = (__WalkState*)UserData;
+    std::vector<__IndexedFile> Files(Count);
+    for (U32 i = 0; i < Count; i++)
+    {
+        Files[i].Path.assign(Entries[i].Path + State->RootLength, Entries[i].PathLength - State->RootLength);
+        Files[i].Record.Size = Entries[i].Size;
+        Files[i].Record.ModifiedTime = Entries[i].ModifiedTime;
+        Files[i].Record.ContentHash = 0;
+    }
+    os::SpinMutex::AutoLock Guard(&State->Lock);
+    for (auto& File : Files)
+        State->Files.push_back(std::move(File));
+}
+
+bool FileIndex::Update(const char* Root, os::ThreadPool* Jobs)
+{
+    std::string RootPath(Root ? Root : "");
+    while (RootPath.size() > 1 && (RootPath.back() == '/' || RootPath.back() == '\\'))
+        RootPath.pop_back();
+    __WalkState State;
+    State.RootLength = RootPath.size() + 1;
+    d->Changes.clear();
+
+    os::ThreadPool* Local = Jobs ? nullptr : new os::ThreadPool(0, "FileIndex");
+    os::ThreadPool* Pool = Jobs ? Jobs : Local;
+    if (!os::WalkTree(RootPath.c_str(), &__CollectFiles, &State, Pool))
+    {
+        delete Local;
+        return false;
+    }
+    std::vector<__IndexedFile>& Files = State.Files;
+    std::sort(Files.begin(), Files.end(),
+        [](__IndexedFile const& A, __IndexedFile const& B) { return A.Path < B.Path; });
+
+    // size and time unchanged keep the known content hash, the rest is read in parallel
+    std::vector<U8> Seen(d->Files.size(), 0);
+    std::vector<size_t> Stale;
+    for (size_t i = 0; i < Files.size(); i++)
+    {
+        auto It = d->Lookup.find(Files[i].Path);
+        if (It != d->Lookup.end())
+        {
+            Seen[It->second] = 1;
+            FileRecord const& Known = d->Files[It->second].Record;
+            if (Known.Size == Files[i].Record.Size && Known.ModifiedTime == Files[i].Record.ModifiedTime)
+            {
+                Files[i].Record.ContentHash = Known.ContentHash;
+                continue;
+            }
+        }
+        Stale.push_back(i);
+    }
+
+    std::vector<U8> Hashed(Stale.size(), 0);
+    os::JobCounter Counter;
+    for (size_t i = 0; i < Stale.size(); i++)
+    {
+        __IndexedFile* File = &Files[Stale[i]];
+        U8* Result = &Hashed[i];
+        std::string FullPath = RootPath + "/" + File->Path;
+        Pool->Enqueue([File, Result, FullPath]()
+        {
+            *Result = __HashFile(FullPath.c_str(), File->Record.Size, File->Record.ContentHash);
+        }, os::TaskPriority::Normal, &Counter);
+    }
+    Counter.Wait();
+    delete Local;
+
+    std::vector<__IndexedFile> Indexed;
+    Indexed.reserve(Files.size());
+    size_t Next = 0;
+    for (size_t i = 0; i < Files.size(); i++)
+    {
+        bool WasStale = Next < Stale.size() && Stale[Next] == i;
+        if (WasStale)
+        {
+            const __IndexedFile* Known = d->Find(Files[i].Path);
+            if (!Hashed[Next++])
+            {
+                // vanished or changing while read, keep what we knew and retry next time
+                if (Known)
+                    Indexed.push_back(*Known);
+                continue;
+            }
+            if (!Known)
+                d->Changes.push_back({ String(Files[i].Path.c_str()), os::FileAdded });
+            else if (Known->Record.ContentHash != Files[i].Record.ContentHash)
+                d->Changes.push_back({ String(Files[i].Path.c_str()), os::FileModified });
+        }
+        Indexed.push_back(std::move(Files[i]));
+    }
+    for (size_t i = 0; i < d->Files.size(); i++)
+        if (!Seen[i])
+            d->Changes.push_back({ String(d->Files[i].Path.c_str()), os::FileRemoved });
+
+    d->Files.swap(Indexed);
+    d->Rebuild();
+    return true;
+}
+
+void FileIndex::Clear()
+{
+    d->Files.clear();
+    d->Lookup.clear();
+    d->Changes.clear();
+}
+
+bool FileIndex::Find(const char* Path, FileRecord& Record) const
+{
+    const __IndexedFile* Indexed = d->Find(Path);
+    if (!Indexed)
+        return false;
+    Record = Indexed->Record;
+    return true;
+}
+
+U32 FileIndex::GetFileCount() const
+{
+    return (U32)d->Files.size();
+}
+
+U32 FileIndex::GetChangeCount() const
+{
+    return (U32)d->Changes.size();
+}
+
+os::FileEvent const& FileIndex::GetChange(U32 Index) const
+{
+    return d->Changes[Index];
+}
+
+U64 FileIndex::HashContent(const void* Data, size_t Size)
+{
+    return Hash64(Data, Size);
+}
+}
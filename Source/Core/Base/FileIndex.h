@@ -0,0 +1,55 @@
+#ifndef __k3d_FileIndex_h__
+#define __k3d_FileIndex_h__
+#pragma once
+
+namespace k3d
+{
+    struct FileRecord
+    {
+        U64 Size;
+        /// nanoseconds since the epoch
+        U64 ModifiedTime;
+        U64 ContentHash;
+    };
+
+    /**
+     * Persistent index of the files below a directory, for tools that want to skip
+     * unchanged inputs. Update walks the tree in parallel with os::WalkTree and only
+     * reads the files whose size or modification time differ from the index, so a
+     * run over an unchanged tree costs a directory scan.
+     */
+    class K3D_CORE_API FileIndex
+    {
+    public:
+        FileIndex();
+        ~FileIndex();
+
+        /// replaces the content with a saved index, false if missing or stale
+        bool Load(const char* IndexFile);
+        bool Save(const char* IndexFile) const;
+
+        /// rescans Root and records the changes since the previous state
+        bool Update(const char* Root, os::ThreadPool* Jobs = nullptr);
+        void Clear();
+
+        /// \param Path relative to the root, '/' separated
+        bool Find(const char* Path, FileRecord& Record) const;
+        U32  GetFileCount() const;
+
+        /// files added, modified or removed by the last Update, touched files with the
+        /// same content are not reported
+        U32  GetChangeCount() const;
+        os::FileEvent const& GetChange(U32 Index) const;
+
+        /// the ContentHash of a FileRecord computed over a buffer, Hash64 with seed 0
+        static U64 HashContent(const void* Data, size_t Size);
+
+        FileIndex(const FileIndex&) = delete;
+        FileIndex& operator=(const FileIndex&) = delete;
+
+    private:
+        struct FileIndexPrivate* d;
+    };
+}
+
+#endif
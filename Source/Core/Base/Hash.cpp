@@ -0,0 +1,273 @@
+#include "CoreMinimal.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define __K3D_CRC_X86 1
+#if K3DCOMPILER_MSVC
+#include <intrin.h>
+#define __K3D_TARGET(Isa)
+#else
+#include <immintrin.h>
+#define __K3D_TARGET(Isa) __attribute__((target(Isa)))
+#endif
+#elif defined(__ARM_FEATURE_CRC32)
+#define __K3D_CRC_ARM 1
+#include <arm_acle.h>
+#endif
+
+namespace k3d
+{
+static const U64 kPrime1 = 0x9E3779B185EBCA87ull;
+static const U64 kPrime2 = 0xC2B2AE3D27D4EB4Full;
+static const U64 kPrime3 = 0x165667B19E3779F9ull;
+static const U64 kPrime4 = 0x85EBCA77C2B2AE63ull;
+static const U64 kPrime5 = 0x27D4EB2F165667C5ull;
+static const size_t kStripe = 32;
+
+static inline U64 __Rotl(U64 Value, int Bits)
+{
+    return (Value << Bits) | (Value >> (64 - Bits));
+}
+
+static inline U64 __Read64(const U8* Data)
+{
+    U64 Value;
+    memcpy(&Value, Data, sizeof(Value));
+    return Value;
+}
+
+static inline U32 __Read32(const U8* Data)
+{
+    U32 Value;
+    memcpy(&Value, Data, sizeof(Value));
+    return Value;
+}
+
+static inline U64 __Round(U64 Lane, U64 Input)
+{
+    return __Rotl(Lane + Input * kPrime2, 31) * kPrime1;
+}
+
+static inline U64 __Merge(U64 Hash, U64 Lane)
+{
+    return (Hash ^ __Round(0, Lane)) * kPrime1 + kPrime4;
+}
+
+static inline void __InitLanes(U64 (&Lanes)[4], U64 Seed)
+{
+    Lanes[0] = Seed + kPrime1 + kPrime2;
+    Lanes[1] = Seed + kPrime2;
+    Lanes[2] = Seed;
+    Lanes[3] = Seed - kPrime1;
+}
+
+/// whole stripes of Data into the lanes, \return the bytes taken
+static inline size_t __Consume(U64 (&Lanes)[4], const U8* Data, size_t Size)
+{
+    U64 A = Lanes[0], B = Lanes[1], C = Lanes[2], D = Lanes[3];
+    size_t Pos = 0;
+    for (; Pos + kStripe <= Size; Pos += kStripe)
+    {
+        A = __Round(A, __Read64(Data + Pos));
+        B = __Round(B, __Read64(Data + Pos + 8));
+        C = __Round(C, __Read64(Data + Pos + 16));
+        D = __Round(D, __Read64(Data + Pos + 24));
+    }
+    Lanes[0] = A; Lanes[1] = B; Lanes[2] = C; Lanes[3] = D;
+    return Pos;
+}
+
+/**
+ * Folds the lanes, the length and the bytes past the last stripe. High is the
+ * second half of Hash64x2: the lanes merged in the other order from another
+ * start, then the same tail.
+ */
+static U64 __Finish(U64 const (&Lanes)[4], U64 Seed, U64 Total, const U8* Tail, size_t TailSize, bool High)
+{
+    U64 Hash;
+    if (Total >= kStripe)
+    {
+        if (!High)
+        {
+            Hash = __Rotl(Lanes[0], 1) + __Rotl(Lanes[1], 7) + __Rotl(Lanes[2], 12) + __Rotl(Lanes[3], 18);
+            for (int i = 0; i < 4; i++)
+                Hash = __Merge(Hash, Lanes[i]);
+        }
+        else
+        {
+            Hash = __Rotl(Lanes[0], 18) + __Rotl(Lanes[1], 12) + __Rotl(Lanes[2], 7) + __Rotl(Lanes[3], 1);
+            for (int i = 3; i >= 0; i--)
+                Hash = __Merge(Hash, Lanes[i]);
+        }
+    }
+    else
+    {
+        Hash = Seed + (High ? kPrime3 : kPrime5);
+    }
+    Hash += Total;
+    size_t Pos = 0;
+    for (; Pos + 8 <= TailSize; Pos += 8)
+        Hash = __Rotl(Hash ^ __Round(0, __Read64(Tail + Pos)), 27) * kPrime1 + kPrime4;
+    if (Pos + 4 <= TailSize)
+    {
+        Hash = __Rotl(Hash ^ (__Read32(Tail + Pos) * kPrime1), 23) * kPrime2 + kPrime3;
+        Pos += 4;
+    }
+    for (; Pos < TailSize; Pos++)
+        Hash = __Rotl(Hash ^ (Tail[Pos] * kPrime5), 11) * kPrime1;
+    Hash ^= Hash >> 33;
+    Hash *= kPrime2;
+    Hash ^= Hash >> 29;
+    Hash *= kPrime3;
+    Hash ^= Hash >> 32;
+    return Hash;
+}
+
+K3D_CORE_API U64 Hash64(const void* Data, size_t Size, U64 Seed)
+{
+    const U8* Bytes = (const U8*)Data;
+    U64 Lanes[4];
+    __InitLanes(Lanes, Seed);
+    size_t Pos = __Consume(Lanes, Bytes, Size);
+    return __Finish(Lanes, Seed, Size, Bytes + Pos, Size - Pos, false);
+}
+
+K3D_CORE_API Hash128 Hash64x2(const void* Data, size_t Size, U64 Seed)
+{
+    const U8* Bytes = (const U8*)Data;
+    U64 Lanes[4];
+    __InitLanes(Lanes, Seed);
+    size_t Pos = __Consume(Lanes, Bytes, Size);
+    Hash128 Result;
+    Result.Low = __Finish(Lanes, Seed, Size, Bytes + Pos, Size - Pos, false);
+    Result.High = __Finish(Lanes, Seed, Size, Bytes + Pos, Size - Pos, true);
+    return Result;
+}
+
+HashStream::HashStream(U64 Seed)
+{
+    Reset(Seed);
+}
+
+void HashStream::Reset(U64 Seed)
+{
+    __InitLanes(m_Lanes, Seed);
+    m_Seed = Seed;
+    m_Total = 0;
+    m_Buffered = 0;
+}
+
+void HashStream::Update(const void* Data, size_t Size)
+{
+    const U8* Bytes = (const U8*)Data;
+    m_Total += Size;
+    if (m_Buffered)
+    {
+        size_t Take = kStripe - m_Buffered < Size ? kStripe - m_Buffered : Size;
+        memcpy(m_Buffer + m_Buffered, Bytes, Take);
+        m_Buffered += (U32)Take;
+        Bytes += Take;
+        Size -= Take;
+        if (m_Buffered < kStripe)
+            return;
+        __Consume(m_Lanes, m_Buffer, kStripe);
+        m_Buffered = 0;
+    }
+    size_t Pos = __Consume(m_Lanes, Bytes, Size);
+    memcpy(m_Buffer, Bytes + Pos, Size - Pos);
+    m_Buffered = (U32)(Size - Pos);
+}
+
+U64 HashStream::Digest64() const
+{
+    return __Finish(m_Lanes, m_Seed, m_Total, m_Buffer, m_Buffered, false);
+}
+
+Hash128 HashStream::Digest64x2() const
+{
+    Hash128 Result;
+    Result.Low = __Finish(m_Lanes, m_Seed, m_Total, m_Buffer, m_Buffered, false);
+    Result.High = __Finish(m_Lanes, m_Seed, m_Total, m_Buffer, m_Buffered, true);
+    return Result;
+}
+
+// -------------------------------------------------------------------------------------------------------------
+//                                                    CRC-32C
+//--------------------------------------------------------------------------------------------------------------
+struct __CrcTables
+{
+    __CrcTables()
+    {
+        // the reflected Castagnoli polynomial
+        for (U32 i = 0; i < 256; i++)
+        {
+            U32 Crc = i;
+            for (int Bit = 0; Bit < 8; Bit++)
+                Crc = (Crc >> 1) ^ (0x82F63B78u & (0u - (Crc & 1)));
+            Table[0][i] = Crc;
+        }
+        for (U32 i = 0; i < 256; i++)
+        {
+            for (int k = 1; k < 8; k++)
+                Table[k][i] = (Table[k - 1][i] >> 8) ^ Table[0][Table[k - 1][i] & 0xFF];
+        }
+    }
+    U32 Table[8][256];
+};
+
+static U32 __Crc32cTables(U32 Crc, const U8* Data, size_t Size)
+{
+    static const __CrcTables Tables;
+    const U32 (&T)[8][256] = Tables.Table;
+    for (; Size >= 8; Data += 8, Size -= 8)
+    {
+        U64 Word = __Read64(Data) ^ Crc;
+        Crc = T[7][Word & 0xFF] ^ T[6][(Word >> 8) & 0xFF] ^ T[5][(Word >> 16) & 0xFF] ^
+            T[4][(Word >> 24) & 0xFF] ^ T[3][(Word >> 32) & 0xFF] ^ T[2][(Word >> 40) & 0xFF] ^
+            T[1][(Word >> 48) & 0xFF] ^ T[0][Word >> 56];
+    }
+    for (; Size; Data++, Size--)
+        Crc = (Crc >> 8) ^ T[0][(Crc ^ *Data) & 0xFF];
+    return Crc;
+}
+
+#if __K3D_CRC_X86
+static const bool __HasSse42 = simd::GetCpuFeatures().Sse42;
+
+__K3D_TARGET("sse4.2") static U32 __Crc32cSse42(U32 Crc, const U8* Data, size_t Size)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    U64 Wide = Crc;
+    for (; Size >= 8; Data += 8, Size -= 8)
+        Wide = _mm_crc32_u64(Wide, __Read64(Data));
+    Crc = (U32)Wide;
+#endif
+    for (; Size >= 4; Data += 4, Size -= 4)
+        Crc = _mm_crc32_u32(Crc, __Read32(Data));
+    for (; Size; Data++, Size--)
+        Crc = _mm_crc32_u8(Crc, *Data);
+    return Crc;
+}
+#elif __K3D_CRC_ARM
+static U32 __Crc32cArm(U32 Crc, const U8* Data, size_t Size)
+{
+    for (; Size >= 8; Data += 8, Size -= 8)
+        Crc = __crc32cd(Crc, __Read64(Data));
+    for (; Size; Data++, Size--)
+        Crc = __crc32cb(Crc, *Data);
+    return Crc;
+}
+#endif
+
+K3D_CORE_API U32 Crc32c(const void* Data, size_t Size, U32 Crc)
+{
+    const U8* Bytes = (const U8*)Data;
+    Crc = ~Crc;
+#if __K3D_CRC_X86
+    if (__HasSse42)
+        return ~__Crc32cSse42(Crc, Bytes, Size);
+#elif __K3D_CRC_ARM
+    return ~__Crc32cArm(Crc, Bytes, Size);
+#endif
+    return ~__Crc32cTables(Crc, Bytes, Size);
+}
+}
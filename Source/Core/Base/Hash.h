@@ -0,0 +1,112 @@
+#pragma once
+
+#ifndef __k3d_Hash_h__
+#define __k3d_Hash_h__
+
+#include <type_traits>
+
+/* Non-cryptographic hashes for cache keys, content identity and checksums */
+namespace k3d
+{
+    struct Hash128
+    {
+        U64 Low;
+        U64 High;
+
+        bool operator==(Hash128 const& Rhs) const { return Low == Rhs.Low && High == Rhs.High; }
+        bool operator!=(Hash128 const& Rhs) const { return !(*this == Rhs); }
+    };
+
+    /**
+     * xxHash64: four multiply-rotate lanes over 32 byte stripes and a final
+     * avalanche, running at memory bandwidth on large buffers. Not for input an
+     * attacker picks to collide.
+     */
+    extern K3D_CORE_API U64 Hash64(const void* Data, size_t Size, U64 Seed = 0);
+    /**
+     * Hash64's lanes finished twice, in two orders, for content identity where 64
+     * bits collide too soon. Low is Hash64. This is not XXH128 and its digests don't
+     * match XXH128's, hence the name.
+     */
+    extern K3D_CORE_API Hash128 Hash64x2(const void* Data, size_t Size, U64 Seed = 0);
+    /**
+     * CRC-32C (Castagnoli), the checksum of iSCSI, ext4 and SSE4.2. Uses the crc32
+     * instruction on x86 with SSE4.2, picked at run time, and on ARMv8 with the CRC
+     * extension, slicing-by-8 tables otherwise. Pass the previous result as Crc to
+     * continue over the next buffer.
+     */
+    extern K3D_CORE_API U32 Crc32c(const void* Data, size_t Size, U32 Crc = 0);
+
+    /// Hash64 and Hash64x2 over data handed in pieces, the digests equal the one-shot ones
+    class K3D_CORE_API HashStream
+    {
+    public:
+        explicit HashStream(U64 Seed = 0);
+
+        void        Reset(U64 Seed = 0);
+        void        Update(const void* Data, size_t Size);
+        /// the hash of everything so far, updating may go on
+        U64         Digest64() const;
+        Hash128     Digest64x2() const;
+
+    private:
+        U64         m_Lanes[4];
+        U64         m_Seed;
+        U64         m_Total;
+        U8          m_Buffer[32];
+        U32         m_Buffered;
+    };
+
+    /// avalanche of one word, spreads integer and pointer keys over all the bits
+    KFORCE_INLINE U64 HashMix(U64 Value)
+    {
+        Value ^= Value >> 33;
+        Value *= 0xFF51AFD7ED558CCDull;
+        Value ^= Value >> 33;
+        Value *= 0xC4CEB9FE1A85EC53ull;
+        Value ^= Value >> 33;
+        return Value;
+    }
+
+    /// Hash64 of the object representation, so a struct's padding must be zeroed where it is built
+    template <class T>
+    KFORCE_INLINE U64 HashPod(T const& Value, U64 Seed = 0)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "HashPod hashes the bytes of a trivially copyable type");
+        return Hash64(&Value, sizeof(T), Seed);
+    }
+
+    /**
+     * Hash functor for containers and caches, specialized for the integers, enums,
+     * pointers and String. Other keys specialize it, or use PodHasher when their
+     * bytes are their identity.
+     */
+    template <class T, class Enable = void>
+    struct Hasher;
+
+    template <class T>
+    struct Hasher<T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type>
+    {
+        U64 operator()(T Value) const { return HashMix((U64)Value); }
+    };
+
+    template <class T>
+    struct Hasher<T*>
+    {
+        U64 operator()(const T* Value) const { return HashMix((U64)(uintptr_t)Value); }
+    };
+
+    template <>
+    struct Hasher<String>
+    {
+        U64 operator()(String const& Value) const { return Hash64(Value.CStr(), (size_t)Value.Length()); }
+    };
+
+    template <class T>
+    struct PodHasher
+    {
+        U64 operator()(T const& Value) const { return HashPod(Value); }
+    };
+}
+
+#endif
@@ -0,0 +1,272 @@
+#include "CoreMinimal.h"
+
+namespace k3d
+{
+BufferedReader::BufferedReader(IIODevice* Device, size_t BufferSize)
+    : m_Device(nullptr)
+    , m_Buffer(nullptr)
+    , m_Capacity(0)
+    , m_Pos(0)
+    , m_End(0)
+{
+    Attach(Device, BufferSize);
+}
+
+BufferedReader::~BufferedReader()
+{
+    free(m_Buffer);
+}
+
+void BufferedReader::Attach(IIODevice* Device, size_t BufferSize)
+{
+    m_Device = Device;
+    m_Pos = m_End = 0;
+    if (BufferSize != m_Capacity)
+    {
+        // allocated on first Fill
+        free(m_Buffer);
+        m_Buffer = nullptr;
+        m_Capacity = BufferSize ? BufferSize : 1;
+    }
+}
+
+bool BufferedReader::Fill(size_t Size)
+{
+    if (!m_Device)
+        return false;
+    if (m_Pos > 0)
+    {
+        memmove(m_Buffer, m_Buffer + m_Pos, m_End - m_Pos);
+        m_End -= m_Pos;
+        m_Pos = 0;
+    }
+    if (!m_Buffer || Size > m_Capacity)
+    {
+        // a Peek larger than the block size grows the buffer
+        m_Capacity = Size > m_Capacity ? Size : m_Capacity;
+        U8* Buffer = (U8*)realloc(m_Buffer, m_Capacity);
+        if (!Buffer)
+            return false;
+        m_Buffer = Buffer;
+    }
+    bool Progress = false;
+    while (m_End < Size)
+    {
+        size_t Got = m_Device->Read((char*)m_Buffer + m_End, m_Capacity - m_End);
+        if (Got == 0 || Got == size_t(-1))
+            break;
+        m_End += Got;
+        Progress = true;
+    }
+    return Progress;
+}
+
+const U8* BufferedReader::Peek(size_t Size, size_t& OutSize)
+{
+    if (m_End - m_Pos < Size)
+        Fill(Size);
+    OutSize = m_End - m_Pos;
+    return m_Buffer ? m_Buffer + m_Pos : nullptr;
+}
+
+void BufferedReader::Consume(size_t Size)
+{
+    m_Pos += Size < m_End - m_Pos ? Size : m_End - m_Pos;
+}
+
+bool BufferedReader::Open(const char* FileName, IOFlag Mode)
+{
+    m_Pos = m_End = 0;
+    return m_Device && m_Device->Open(FileName, Mode);
+}
+
+bool BufferedReader::IsEOF()
+{
+    return m_Pos == m_End && (!m_Device || m_Device->IsEOF());
+}
+
+size_t BufferedReader::Read(char* Data, size_t Size)
+{
+    size_t Buffered = m_End - m_Pos;
+    if (Size <= Buffered)
+    {
+        memcpy(Data, m_Buffer + m_Pos, Size);
+        m_Pos += Size;
+        return Size;
+    }
+    if (Buffered)
+    {
+        memcpy(Data, m_Buffer + m_Pos, Buffered);
+    }
+    m_Pos = m_End = 0;
+    size_t Total = Buffered;
+    if (!m_Device)
+        return Total;
+    if (Size - Total >= m_Capacity)
+    {
+        // large reads go straight to the device
+        while (Total < Size)
+        {
+            size_t Got = m_Device->Read(Data + Total, Size - Total);
+            if (Got == 0 || Got == size_t(-1))
+                break;
+            Total += Got;
+        }
+        return Total;
+    }
+    if (Fill(Size - Total))
+    {
+        size_t Chunk = Size - Total < m_End ? Size - Total : m_End;
+        memcpy(Data + Total, m_Buffer, Chunk);
+        m_Pos = Chunk;
+        Total += Chunk;
+    }
+    return Total;
+}
+
+size_t BufferedReader::Write(const void*, size_t)
+{
+    return 0;
+}
+
+bool BufferedReader::Seek(size_t Offset)
+{
+    m_Pos = m_End = 0;
+    return m_Device && m_Device->Seek(Offset);
+}
+
+bool BufferedReader::Skip(size_t Offset)
+{
+    size_t Buffered = m_End - m_Pos;
+    if (Offset <= Buffered)
+    {
+        m_Pos += Offset;
+        return true;
+    }
+    m_Pos = m_End = 0;
+    return m_Device && m_Device->Skip(Offset - Buffered);
+}
+
+void BufferedReader::Close()
+{
+    m_Pos = m_End = 0;
+    if (m_Device)
+        m_Device->Close();
+}
+
+BufferedWriter::BufferedWriter(IIODevice* Device, size_t BufferSize)
+    : m_Device(nullptr)
+    , m_Buffer(nullptr)
+    , m_Capacity(0)
+    , m_Size(0)
+{
+    Attach(Device, BufferSize);
+}
+
+BufferedWriter::~BufferedWriter()
+{
+    Drain();
+    free(m_Buffer);
+}
+
+void BufferedWriter::Attach(IIODevice* Device, size_t BufferSize)
+{
+    Drain();
+    m_Device = Device;
+    if (BufferSize != m_Capacity)
+    {
+        free(m_Buffer);
+        m_Buffer = nullptr;
+        m_Capacity = BufferSize ? BufferSize : 1;
+    }
+}
+
+U8* BufferedWriter::Reserve(size_t Size)
+{
+    if (Size > m_Capacity)
+        return nullptr;
+    if (m_Size + Size > m_Capacity && !Drain())
+        return nullptr;
+    if (!m_Buffer)
+    {
+        m_Buffer = (U8*)malloc(m_Capacity);
+        if (!m_Buffer)
+            return nullptr;
+    }
+    return m_Buffer + m_Size;
+}
+
+void BufferedWriter::Commit(size_t Size)
+{
+    m_Size += Size;
+}
+
+bool BufferedWriter::Drain()
+{
+    if (!m_Size)
+        return true;
+    if (!m_Device)
+        return false;
+    size_t Written = m_Device->Write(m_Buffer, m_Size);
+    bool Complete = Written == m_Size;
+    m_Size = 0;
+    return Complete;
+}
+
+bool BufferedWriter::Open(const char* FileName, IOFlag Mode)
+{
+    Drain();
+    return m_Device && m_Device->Open(FileName, Mode);
+}
+
+bool BufferedWriter::IsEOF()
+{
+    return !m_Device || m_Device->IsEOF();
+}
+
+size_t BufferedWriter::Read(char*, size_t)
+{
+    return 0;
+}
+
+size_t BufferedWriter::Write(const void* Data, size_t Size)
+{
+    if (!m_Device)
+        return 0;
+    if (Size >= m_Capacity)
+    {
+        if (!Drain())
+            return 0;
+        return m_Device->Write(Data, Size);
+    }
+    U8* Dest = Reserve(Size);
+    if (!Dest)
+        return 0;
+    memcpy(Dest, Data, Size);
+    Commit(Size);
+    return Size;
+}
+
+bool BufferedWriter::Seek(size_t Offset)
+{
+    return Drain() && m_Device->Seek(Offset);
+}
+
+bool BufferedWriter::Skip(size_t Offset)
+{
+    return Drain() && m_Device->Skip(Offset);
+}
+
+void BufferedWriter::Flush()
+{
+    if (Drain() && m_Device)
+        m_Device->Flush();
+}
+
+void BufferedWriter::Close()
+{
+    Drain();
+    if (m_Device)
+        m_Device->Close();
+}
+}
@@ -9,7 +9,10 @@ namespace k3d
     {
         Read                = 1,
         Write               = 1 << 1,
+        /// read and written in compressed blocks through k3d::CompressedStream
         SnappyCompressed    = 1 << 2,
+        /// bypass the page cache, offsets, sizes and buffers must be aligned to os::AsyncIO::GetDirectIOAlignment()
+        Direct              = 1 << 3,
     };
 
     struct K3D_CORE_API IIODevice
@@ -25,6 +28,96 @@ namespace k3d
         virtual void      Close() = 0;
     };
 
+    /**
+     * Reads an IIODevice in blocks, small Reads are served from the buffer.
+     * Peek/Consume expose the buffered bytes so parsers can work in place.
+     */
+    class K3D_CORE_API BufferedReader : public IIODevice
+    {
+    public:
+        static const size_t kDefaultBufferSize = 64 * 1024;
+
+        explicit BufferedReader(IIODevice* Device = nullptr, size_t BufferSize = kDefaultBufferSize);
+        ~BufferedReader();
+
+        /// drops buffered data and reads from Device from now on
+        void        Attach(IIODevice* Device, size_t BufferSize = kDefaultBufferSize);
+        IIODevice*  GetDevice() const { return m_Device; }
+        size_t      GetBuffered() const { return m_End - m_Pos; }
+
+        /// at least Size bytes unless the device ends first, OutSize is what's available
+        const U8*   Peek(size_t Size, size_t& OutSize);
+        /// advances past bytes returned by Peek
+        void        Consume(size_t Size);
+
+        bool        Open(const char* FileName, IOFlag Mode) override;
+        bool        IsEOF() override;
+        size_t      Read(char* Data, size_t Size) override;
+        /// not supported, returns 0
+        size_t      Write(const void* Data, size_t Size) override;
+        bool        Seek(size_t Offset) override;
+        bool        Skip(size_t Offset) override;
+        void        Flush() override {}
+        void        Close() override;
+
+        BufferedReader(const BufferedReader&) = delete;
+        BufferedReader& operator=(const BufferedReader&) = delete;
+
+    private:
+        /// tops the buffer up to Size bytes, false if nothing could be read
+        bool        Fill(size_t Size);
+
+        IIODevice*  m_Device;
+        U8*         m_Buffer;
+        size_t      m_Capacity;
+        size_t      m_Pos;
+        size_t      m_End;
+    };
+
+    /**
+     * Coalesces small Writes to an IIODevice into blocks, Flush or the destructor
+     * pushes what's left. Reserve/Commit let serializers write into the buffer directly.
+     */
+    class K3D_CORE_API BufferedWriter : public IIODevice
+    {
+    public:
+        static const size_t kDefaultBufferSize = 64 * 1024;
+
+        explicit BufferedWriter(IIODevice* Device = nullptr, size_t BufferSize = kDefaultBufferSize);
+        ~BufferedWriter();
+
+        /// flushes to the previous device, then writes to Device
+        void        Attach(IIODevice* Device, size_t BufferSize = kDefaultBufferSize);
+        IIODevice*  GetDevice() const { return m_Device; }
+        size_t      GetBuffered() const { return m_Size; }
+
+        /// Size contiguous bytes at the end of the buffer, nullptr if Size exceeds the block size
+        U8*         Reserve(size_t Size);
+        /// appends Size bytes written through Reserve
+        void        Commit(size_t Size);
+        /// writes the buffered bytes without flushing the device
+        bool        Drain();
+
+        bool        Open(const char* FileName, IOFlag Mode) override;
+        bool        IsEOF() override;
+        /// not supported, returns 0
+        size_t      Read(char* Data, size_t Size) override;
+        size_t      Write(const void* Data, size_t Size) override;
+        bool        Seek(size_t Offset) override;
+        bool        Skip(size_t Offset) override;
+        void        Flush() override;
+        void        Close() override;
+
+        BufferedWriter(const BufferedWriter&) = delete;
+        BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    private:
+        IIODevice*  m_Device;
+        U8*         m_Buffer;
+        size_t      m_Capacity;
+        size_t      m_Size;
+    };
+
     //KTYPE_META_TEMPLATE( IIODevice );
 
     template <class IsIODevice>
@@ -41,6 +41,138 @@ namespace k3d
         static SystemAllocator SysAllc;
         return SysAllc;
     }
+
+    struct PoolAllocatorPrivate
+    {
+        struct FreeBlock
+        {
+            FreeBlock* Next;
+        };
+
+        struct Chunk
+        {
+            Chunk* Next;
+            U8*    Begin;
+            U8*    End;
+        };
+
+        PoolAllocatorPrivate(size_t InBlockSize, size_t InBlocksPerChunk, const char* InName)
+            : BlockSize((InBlockSize + 15) & ~(size_t)15)
+            , BlocksPerChunk(InBlocksPerChunk ? InBlocksPerChunk : 1)
+            , Name(InName)
+            , FreeList(nullptr)
+            , Chunks(nullptr)
+            , Used(0)
+        {
+            if (BlockSize < sizeof(FreeBlock))
+                BlockSize = sizeof(FreeBlock);
+        }
+
+        ~PoolAllocatorPrivate()
+        {
+            while (Chunks)
+            {
+                Chunk* Next = Chunks->Next;
+                GetDefaultAllocator().DeAlloc(Chunks);
+                Chunks = Next;
+            }
+        }
+
+        bool Owns(void* Ptr) const
+        {
+            for (Chunk* It = Chunks; It; It = It->Next)
+            {
+                if (Ptr >= It->Begin && Ptr < It->End)
+                    return true;
+            }
+            return false;
+        }
+
+        // threads every block of a new chunk onto the free list
+        bool Grow()
+        {
+            size_t Header = (sizeof(Chunk) + 15) & ~(size_t)15;
+            U8* Memory = (U8*)GetDefaultAllocator().Alloc(Header + BlockSize * BlocksPerChunk);
+            if (!Memory)
+                return false;
+            Chunk* NewChunk = (Chunk*)Memory;
+            NewChunk->Begin = Memory + Header;
+            NewChunk->End = NewChunk->Begin + BlockSize * BlocksPerChunk;
+            NewChunk->Next = Chunks;
+            Chunks = NewChunk;
+            for (size_t i = BlocksPerChunk; i > 0; i--)
+            {
+                FreeBlock* Block = (FreeBlock*)(NewChunk->Begin + BlockSize * (i - 1));
+                Block->Next = FreeList;
+                FreeList = Block;
+            }
+            return true;
+        }
+
+        size_t              BlockSize;
+        size_t              BlocksPerChunk;
+        const char*         Name;
+        FreeBlock*          FreeList;
+        Chunk*              Chunks;
+        size_t              Used;
+        mutable os::SpinMutex Lock;
+    };
+
+    PoolAllocator::PoolAllocator(size_t BlockSize, size_t BlocksPerChunk, const char* Name)
+        : d(new PoolAllocatorPrivate(BlockSize, BlocksPerChunk, Name))
+    {
+    }
+
+    PoolAllocator::~PoolAllocator()
+    {
+        delete d;
+        d = nullptr;
+    }
+
+    void* PoolAllocator::Alloc(size_t SzToAlloc, int Alignment, int AlignOffset, int Flags, const char* AllocInfo)
+    {
+        if (SzToAlloc > d->BlockSize || Alignment > 16)
+            return GetDefaultAllocator().Alloc(SzToAlloc, Alignment, AlignOffset, Flags, AllocInfo);
+        os::SpinMutex::AutoLock Guard(&d->Lock);
+        if (!d->FreeList && !d->Grow())
+            return nullptr;
+        auto Block = d->FreeList;
+        d->FreeList = Block->Next;
+        d->Used++;
+        return Block;
+    }
+
+    void PoolAllocator::DeAlloc(void* Ptr)
+    {
+        if (!Ptr)
+            return;
+        os::SpinMutex::AutoLock Guard(&d->Lock);
+        if (!d->Owns(Ptr))
+        {
+            GetDefaultAllocator().DeAlloc(Ptr);
+            return;
+        }
+        auto Block = (PoolAllocatorPrivate::FreeBlock*)Ptr;
+        Block->Next = d->FreeList;
+        d->FreeList = Block;
+        d->Used--;
+    }
+
+    const char* PoolAllocator::GetName() const
+    {
+        return d->Name;
+    }
+
+    size_t PoolAllocator::GetBlockSize() const
+    {
+        return d->BlockSize;
+    }
+
+    size_t PoolAllocator::GetUsedCount() const
+    {
+        os::SpinMutex::AutoLock Guard(&d->Lock);
+        return d->Used;
+    }
 }
 
 K3D_CORE_API void* k3d_malloc(size_t SzObj)
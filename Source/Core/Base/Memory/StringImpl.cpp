@@ -13,110 +13,39 @@ K3D_CORE_API int Vsnprintf(char*dest, int n, const char* fmt, va_list list)
 // -------------------------------------------------------------------------------------------------------------
 //                                                    Base64
 //--------------------------------------------------------------------------------------------------------------
-static const char* base64_chars =
-"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-"abcdefghijklmnopqrstuvwxyz"
-"0123456789+/";
-
 K3D_CORE_API String Base64Encode(String const & in)
 {
-	auto in_len = in.Length();
-	auto bytes_to_encode = in.CStr();
-	int reckon_len = ((4 * in_len / 3) + 3) & ~3;
-	String ret;
-	ret.Resize(reckon_len);
-	int i = 0;
-	int j = 0;
-	unsigned char char_array_3[3];
-	unsigned char char_array_4[4];
-
-	while (in_len--) {
-		char_array_3[i++] = *(bytes_to_encode++);
-		if (i == 3) {
-			char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-			char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-			char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-			char_array_4[3] = char_array_3[2] & 0x3f;
-
-			for (i = 0; (i <4); i++)
-				ret += base64_chars[char_array_4[i]];
-			i = 0;
-		}
-	}
-
-	if (i)
-	{
-		for (j = i; j < 3; j++)
-			char_array_3[j] = '\0';
-
-		char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-		char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-		char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-		char_array_4[3] = char_array_3[2] & 0x3f;
-
-		for (j = 0; (j < i + 1); j++)
-			ret += base64_chars[char_array_4[j]];
-
-		while ((i++ < 3))
-			ret += '=';
-
-	}
+	size_t out_len = Base64EncodedLength(in.Length());
+	String ret((I64)out_len + 1, true);
+	Base64Encode(in.CStr(), in.Length(), ret.Data());
+	ret.Data()[out_len] = 0;
 	return ret;
 }
 
-static inline bool is_base64(unsigned char c) {
-	return (isalnum(c) || (c == '+') || (c == '/'));
-}
-
-static inline int find_base64char(unsigned char c)
-{
-	for (int i = 0; i < 64; i++)
-	{
-		if (c == base64_chars[i])
-			return i;
-	}
-	return -1;
-}
-
 K3D_CORE_API String Base64Decode(String const& encoded_string)
 {
 	size_t in_len = encoded_string.Length();
-	int i = 0;
-	int j = 0;
-	int in_ = 0;
-	unsigned char char_array_4[4], char_array_3[3];
-	String ret;
-	ret.Resize(encoded_string.Length());
-
-	while (in_len-- && (encoded_string[in_] != '=') && is_base64(encoded_string[in_])) {
-		char_array_4[i++] = encoded_string[in_]; in_++;
-		if (i == 4) {
-			for (i = 0; i <4; i++)
-				char_array_4[i] = static_cast<unsigned char>(find_base64char(char_array_4[i]));
-
-			char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-			char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-			char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-
-			for (i = 0; (i < 3); i++)
-				ret += char_array_3[i];
-			i = 0;
-		}
-	}
-
-	if (i) {
-		for (j = i; j <4; j++)
-			char_array_4[j] = 0;
-
-		for (j = 0; j <4; j++)
-			char_array_4[j] = static_cast<unsigned char>(find_base64char(char_array_4[j]));
-
-		char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-		char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-		char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-
-		for (j = 0; (j < i - 1); j++) ret += char_array_3[j];
+	const char* in = encoded_string.CStr();
+	if (in_len % 4 != 0)
+	{
+		// unpadded or cut text, decoded aside and copied
+		String buffer((I64)Base64DecodedCapacity(in_len), true);
+		size_t out_len = Base64Decode(in, in_len, buffer.Data());
+		return out_len ? String(buffer.CStr(), out_len) : String();
 	}
+	// padded text decodes to exactly this, in place; no path writes past it,
+	// text cut short by a bad character is copied out
+	size_t padding = 0;
+	while (padding < 2 && padding < in_len && in[in_len - 1 - padding] == '=')
+		padding++;
+	size_t expected = in_len / 4 * 3 - padding;
+	if (!expected)
+		return String();
+	String ret((I64)expected + 1, true);
+	size_t out_len = Base64Decode(in, in_len, ret.Data());
+	if (out_len != expected)
+		return out_len ? String(ret.CStr(), out_len) : String();
+	ret.Data()[out_len] = 0;
 	return ret;
 }
 // -------------------------------------------------------------------------------------------------------------
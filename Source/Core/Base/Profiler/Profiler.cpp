@@ -1 +1,110 @@
 #include "CoreMinimal.h"
+#include <string>
+#include <unordered_map>
+
+namespace k3d
+{
+    namespace profiler
+    {
+        struct CounterRegistry
+        {
+            CounterRegistry() : Lock("Profiler::Counters") {}
+
+            os::Mutex                                   Lock;
+            std::unordered_map<std::string, Counter>    Counters;
+        };
+
+        static CounterRegistry& GetRegistry()
+        {
+            static CounterRegistry Registry;
+            return Registry;
+        }
+
+        void SetCounter(const char* Name, double Value, CounterUnit Unit)
+        {
+            if (!Name)
+                return;
+            auto& Registry = GetRegistry();
+            os::Mutex::AutoLock Lock(&Registry.Lock);
+            auto& Entry = Registry.Counters[Name];
+            if (Entry.Name.Empty())
+            {
+                Entry.Name = Name;
+            }
+            Entry.Unit = Unit;
+            Entry.Value = Value;
+            Entry.Timestamp = os::Clock::NowNs();
+        }
+
+        bool GetCounter(const char* Name, Counter& OutCounter)
+        {
+            auto& Registry = GetRegistry();
+            os::Mutex::AutoLock Lock(&Registry.Lock);
+            auto Iter = Registry.Counters.find(Name);
+            if (Iter == Registry.Counters.end())
+                return false;
+            OutCounter = Iter->second;
+            return true;
+        }
+
+        void GetCounters(DynArray<Counter>& OutCounters)
+        {
+            auto& Registry = GetRegistry();
+            os::Mutex::AutoLock Lock(&Registry.Lock);
+            for (auto& Entry : Registry.Counters)
+            {
+                OutCounters.Append(Entry.second);
+            }
+        }
+
+        void RemoveCounter(const char* Name)
+        {
+            auto& Registry = GetRegistry();
+            os::Mutex::AutoLock Lock(&Registry.Lock);
+            Registry.Counters.erase(Name);
+        }
+
+        void ResetCounters()
+        {
+            auto& Registry = GetRegistry();
+            os::Mutex::AutoLock Lock(&Registry.Lock);
+            Registry.Counters.clear();
+        }
+
+#if !K3DPLATFORM_OS_LINUX
+        // sampling is implemented in Platform/Linux/SamplingProfiler.cpp
+        bool StartSampling(U32)
+        {
+            return false;
+        }
+
+        void StopSampling()
+        {
+        }
+
+        bool IsSampling()
+        {
+            return false;
+        }
+
+        void GetSamplingStats(SamplingStats& OutStats)
+        {
+            OutStats = SamplingStats();
+        }
+
+        bool ExportCollapsedStacks(const char*)
+        {
+            return false;
+        }
+
+        bool ExportRawSamples(const char*)
+        {
+            return false;
+        }
+
+        void ResetSamples()
+        {
+        }
+#endif
+    }
+}
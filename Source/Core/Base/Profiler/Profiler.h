@@ -0,0 +1,102 @@
+#pragma once
+
+#ifndef __k3d_Profiler_h__
+#define __k3d_Profiler_h__
+
+namespace k3d
+{
+    namespace profiler
+    {
+        enum class CounterUnit : U32
+        {
+            Count,
+            Percent,
+            MicroSecond,
+            Byte,
+        };
+
+        /**
+         * Named value published by engine subsystems (cpu sampler, allocators, etc.),
+         * names are grouped by '/', e.g. "Cpu/Core0", "Cpu/Thread/FileLogger".
+         */
+        struct Counter
+        {
+            String      Name;
+            CounterUnit Unit = CounterUnit::Count;
+            double      Value = 0.0;
+            U64         Timestamp = 0; // os::Clock::NowNs() of the last update
+        };
+
+        extern K3D_CORE_API void SetCounter(const char* Name, double Value, CounterUnit Unit = CounterUnit::Count);
+        extern K3D_CORE_API bool GetCounter(const char* Name, Counter& OutCounter);
+        extern K3D_CORE_API void GetCounters(DynArray<Counter>& OutCounters);
+        extern K3D_CORE_API void RemoveCounter(const char* Name);
+        extern K3D_CORE_API void ResetCounters();
+
+        /**
+         * Statistical sampling profiler, only implemented on Linux so far.
+         * Samples every thread of the process at FrequencyHz using a perf_event
+         * task clock when permitted, otherwise SIGPROF driven by setitimer.
+         * Call stacks are unwound with frame pointers (build with
+         * -fno-omit-frame-pointer -mno-omit-leaf-frame-pointer), or libunwind
+         * when ENABLE_LIBUNWIND is on, and kept as raw addresses until export.
+         */
+        struct SamplingStats
+        {
+            U64         Samples = 0;
+            U64         Dropped = 0;        // ring buffer was full
+            bool        UsePerfEvent = false;
+        };
+
+        extern K3D_CORE_API bool StartSampling(U32 FrequencyHz = 997);
+        extern K3D_CORE_API void StopSampling();
+        extern K3D_CORE_API bool IsSampling();
+        extern K3D_CORE_API void GetSamplingStats(SamplingStats& OutStats);
+        /// one "thread;root;...;leaf count" line per unique stack, input of flamegraph.pl
+        extern K3D_CORE_API bool ExportCollapsedStacks(const char* Path);
+        /// unsymbolized stacks followed by /proc/self/maps, for symbolizing on another machine
+        extern K3D_CORE_API bool ExportRawSamples(const char* Path);
+        /// drop all collected samples
+        extern K3D_CORE_API void ResetSamples();
+
+        /**
+         * Lock contention profiling of os::Mutex and os::ConditionVariable, off by default.
+         * Mutexes constructed with a name are aggregated by name, unnamed ones by
+         * the code that constructed them. Call sites are the return addresses of
+         * Mutex::Lock, i.e. the function taking the lock or owning the AutoLock.
+         */
+        struct LockCallSite
+        {
+            void*       Address = nullptr;
+            String      Symbol;
+            U64         Acquisitions = 0;
+            U64         Contentions = 0;
+            U64         WaitNs = 0;
+            U64         HoldNs = 0;
+        };
+
+        struct LockStats
+        {
+            String                  Name;
+            U64                     Acquisitions = 0;
+            U64                     Contentions = 0;   // Lock() found the mutex already held
+            U64                     WaitNs = 0;
+            U64                     MaxWaitNs = 0;
+            U64                     HoldNs = 0;        // excludes time spent in ConditionVariable::Wait
+            U64                     MaxHoldNs = 0;
+            U64                     CondWaits = 0;
+            U64                     CondWaitNs = 0;
+            DynArray<LockCallSite>  CallSites;         // sorted by WaitNs
+        };
+
+        extern K3D_CORE_API void EnableLockProfiling(bool Enable);
+        extern K3D_CORE_API bool IsLockProfilingEnabled();
+        /// hottest locks first, ranked by total wait time then hold time
+        extern K3D_CORE_API void GetLockStats(DynArray<LockStats>& OutStats);
+        /// human readable ranking of the TopN hottest locks and their top call sites
+        extern K3D_CORE_API String FormatLockReport(U32 TopN = 16);
+        extern K3D_CORE_API void ResetLockStats();
+    }
+}
+
+#endif
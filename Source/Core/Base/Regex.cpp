@@ -1,4 +1,8 @@
 #include "CoreMinimal.h"
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #define PCRE2_STATIC 1
 #define PCRE2_CODE_UNIT_WIDTH 8
@@ -6,101 +10,309 @@
 
 namespace k3d
 {
-    class MatchBase
+    /// a compiled pattern, shared by every RegEx of the same expression and mode
+    class RegExPrivate
     {
     public:
-        MatchBase(pcre2_real_code_8* InRE)
-            : m_RE(InRE)
+        RegExPrivate(const char* Expr, U32 Options)
+            : Code(nullptr)
+            , CaptureCount(0)
+            , NameCount(0)
+            , NameEntrySize(0)
+            , NameTable(nullptr)
+            , ErrorNo(0)
+            , ErrorOffset(0)
+            , Refs(1)
         {
-            m_Data = pcre2_match_data_create_from_pattern(m_RE, NULL);
+            Code = pcre2_compile((PCRE2_SPTR)Expr, PCRE2_ZERO_TERMINATED, Options,
+                &ErrorNo, &ErrorOffset, NULL);
+            if (!Code)
+                return;
+            // matching falls back to the interpreter where PCRE2 has no JIT for the platform
+            pcre2_jit_compile(Code, PCRE2_JIT_COMPLETE);
+            pcre2_pattern_info(Code, PCRE2_INFO_CAPTURECOUNT, &CaptureCount);
+            pcre2_pattern_info(Code, PCRE2_INFO_NAMECOUNT, &NameCount);
+            pcre2_pattern_info(Code, PCRE2_INFO_NAMEENTRYSIZE, &NameEntrySize);
+            pcre2_pattern_info(Code, PCRE2_INFO_NAMETABLE, &NameTable);
         }
-        virtual ~MatchBase()
+
+        ~RegExPrivate()
+        {
+            if (Code)
+                pcre2_code_free(Code);
+        }
+
+        void AddRef()
+        {
+            Refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void Release()
         {
-            if (m_Data)
+            if (Refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                delete this;
+        }
+
+        pcre2_code*         Code;
+        U32                 CaptureCount;
+        U32                 NameCount;
+        U32                 NameEntrySize;
+        PCRE2_SPTR          NameTable;
+        int                 ErrorNo;
+        PCRE2_SIZE          ErrorOffset;
+        /// one of them is the cache's
+        std::atomic<U32>    Refs;
+    };
+
+    /**
+     * The patterns compiled so far, by expression and options. Past kMaxPatterns
+     * the ones no RegEx holds any more are dropped.
+     */
+    class RegExCache
+    {
+    public:
+        static const size_t kMaxPatterns = 256;
+
+        ~RegExCache()
+        {
+            for (auto& Entry : m_Patterns)
+                Entry.second->Release();
+        }
+
+        /// \return the pattern with a reference for the caller
+        RegExPrivate* Acquire(const char* Expr, U32 Options)
+        {
+            std::string Key(Expr);
+            Key.append(1, '\0');
+            Key.append((const char*)&Options, sizeof(Options));
             {
-                pcre2_match_data_free(m_Data);
-                m_Data = nullptr;
+                os::Mutex::AutoLock Guard(&m_Lock);
+                auto Found = m_Patterns.find(Key);
+                if (Found != m_Patterns.end())
+                {
+                    Found->second->AddRef();
+                    return Found->second;
+                }
             }
+            // compiled outside the lock, another thread may have been quicker
+            RegExPrivate* Pattern = new RegExPrivate(Expr, Options);
+            os::Mutex::AutoLock Guard(&m_Lock);
+            auto Found = m_Patterns.find(Key);
+            if (Found != m_Patterns.end())
+            {
+                Pattern->Release();
+                Found->second->AddRef();
+                return Found->second;
+            }
+            if (m_Patterns.size() >= kMaxPatterns)
+                Trim();
+            Pattern->AddRef();
+            m_Patterns.emplace(Move(Key), Pattern);
+            return Pattern;
         }
-        bool Search(const char* Str)
+
+    private:
+        void Trim()
         {
-            int rc = pcre2_match(m_RE, (PCRE2_SPTR)Str, strlen(Str),
-                0,                      /* starting offset in the subject */
-                0,                      /* options */
-                m_Data,
-                NULL);                  /* use default match context */
-            if (rc < 0)
+            for (auto It = m_Patterns.begin(); It != m_Patterns.end();)
             {
-                return false;
+                // new references are only taken under the lock
+                if (It->second->Refs.load(std::memory_order_acquire) == 1)
+                {
+                    It->second->Release();
+                    It = m_Patterns.erase(It);
+                }
+                else
+                {
+                    ++It;
+                }
             }
-            return rc > 0;
         }
-    protected:
-        pcre2_real_code_8*          m_RE;
-        pcre2_real_match_data_8*    m_Data;
+
+        os::Mutex                                       m_Lock;
+        std::unordered_map<std::string, RegExPrivate*>  m_Patterns;
     };
 
-    class MatchGroup : public MatchBase
+    static RegExCache& GetRegExCache()
+    {
+        static RegExCache Cache;
+        return Cache;
+    }
+
+    /**
+     * Match context of a thread, with a JIT stack above the default 32 KB for
+     * patterns that backtrack a lot, and the match data it keeps for reuse.
+     */
+    class RegExThread
     {
     public:
-        MatchGroup(pcre2_real_code_8* InRe, RegEx::Groups& OutGroup);
-        ~MatchGroup();
+        RegExThread()
+            : m_Context(pcre2_match_context_create(NULL))
+            , m_JitStack(pcre2_jit_stack_create(32 * 1024, 1024 * 1024, NULL))
+        {
+            if (m_Context && m_JitStack)
+                pcre2_jit_stack_assign(m_Context, NULL, m_JitStack);
+        }
+
+        ~RegExThread()
+        {
+            for (pcre2_match_data* Data : m_Spare)
+                pcre2_match_data_free(Data);
+            if (m_Context)
+                pcre2_match_context_free(m_Context);
+            if (m_JitStack)
+                pcre2_jit_stack_free(m_JitStack);
+        }
+
+        pcre2_match_context* GetContext() const { return m_Context; }
+
+        /// match data for Pairs offset pairs, handed back with Recycle
+        pcre2_match_data* Take(U32 Pairs)
+        {
+            for (size_t i = m_Spare.size(); i-- > 0;)
+            {
+                if (pcre2_get_ovector_count(m_Spare[i]) >= Pairs)
+                {
+                    pcre2_match_data* Data = m_Spare[i];
+                    m_Spare[i] = m_Spare.back();
+                    m_Spare.pop_back();
+                    return Data;
+                }
+            }
+            return pcre2_match_data_create(Pairs < 16 ? 16 : Pairs, NULL);
+        }
 
-        bool Match(const char* Str);
+        void Recycle(pcre2_match_data* Data)
+        {
+            if (m_Spare.size() < 8)
+                m_Spare.push_back(Data);
+            else
+                pcre2_match_data_free(Data);
+        }
 
     private:
-        RegEx::Groups&              m_Groups;
+        pcre2_match_context*            m_Context;
+        pcre2_jit_stack*                m_JitStack;
+        std::vector<pcre2_match_data*>  m_Spare;
     };
 
+    static thread_local RegExThread tRegExThread;
+
+    static U32 CompileOptions(RegEx::Option Mode)
+    {
+        U32 Options = PCRE2_UTF;
+        if (Mode & RegEx::IgnoreCase)
+            Options |= PCRE2_CASELESS;
+        if (Mode & RegEx::MultiLine)
+            Options |= PCRE2_MULTILINE;
+        return Options;
+    }
+
     RegEx::RegEx(const char * Expr, Option Mode)
-        : m_Code(nullptr)
-        , m_Mode(Mode)
-        , m_CompileErrorNo(0)
-        , m_CompileErrorOffset(0)
+        : d(GetRegExCache().Acquire(Expr, CompileOptions(Mode)))
     {
-        /*
-        if (opt & RegEx::IgnoreCase)
-        {
-            m_Flags |= PCRE2_CASELESS;
-        }*/
-        m_Code = pcre2_compile(
-            (PCRE2_SPTR)Expr, PCRE2_ZERO_TERMINATED,
-            PCRE2_UTF,
-            &m_CompileErrorNo, &m_CompileErrorOffset,
-            NULL);
+    }
+
+    RegEx::RegEx(const RegEx& Other)
+        : d(Other.d)
+    {
+        d->AddRef();
+    }
+
+    RegEx& RegEx::operator=(const RegEx& Other)
+    {
+        Other.d->AddRef();
+        d->Release();
+        d = Other.d;
+        return *this;
     }
 
     RegEx::~RegEx()
     {
-        if (m_Code)
-        {
-            pcre2_code_free(m_Code);
-            m_Code = nullptr;
-        }
+        d->Release();
     }
 
     bool RegEx::IsValid() const
     {
-        return m_Code != nullptr;
+        return d->Code != nullptr;
     }
 
     String RegEx::GetError() const
     {
         PCRE2_UCHAR buffer[256] = { 0 };
-        pcre2_get_error_message(m_CompileErrorNo, buffer, sizeof(buffer));
-        return String::Format("PCRE2 compilation failed at offset %d: %s\n", (int)m_CompileErrorOffset, buffer);
+        pcre2_get_error_message(d->ErrorNo, buffer, sizeof(buffer));
+        return String::Format("PCRE2 compilation failed at offset %d: %s\n", (int)d->ErrorOffset, buffer);
     }
 
     bool RegEx::Match(const char * Str, Option option)
     {
-        MatchBase match(m_Code);
-        return match.Search(Str);
+        if (!d->Code)
+            return false;
+        pcre2_match_data* Data = tRegExThread.Take(d->CaptureCount + 1);
+        int rc = pcre2_match(d->Code, (PCRE2_SPTR)Str, strlen(Str),
+            0,                      /* starting offset in the subject */
+            0,                      /* options */
+            Data,
+            tRegExThread.GetContext());
+        tRegExThread.Recycle(Data);
+        return rc > 0;
     }
 
     bool RegEx::Match(const char * Str, Groups& OutGroups, Option InOption)
     {
-        MatchGroup match(m_Code, OutGroups);
-        return match.Match(Str);
+        if (!d->Code)
+            return false;
+        pcre2_match_data* Data = tRegExThread.Take(d->CaptureCount + 1);
+        int rc = pcre2_match(d->Code, (PCRE2_SPTR)Str, strlen(Str),
+            0,                  /* starting offset in the subject */
+            PCRE2_ANCHORED,     /* options */
+            Data,               /* block for storing the result */
+            tRegExThread.GetContext());
+
+        if (rc <= 0)
+        {
+            tRegExThread.Recycle(Data);
+            return false;
+        }
+
+        PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(Data);
+        RegEx::Group group(rc, Str);
+        PCRE2_SPTR tabptr = d->NameTable;
+        for (U32 i = 0; i < d->NameCount; i++, tabptr += d->NameEntrySize)
+        {
+            int index = (tabptr[0] << 8) | tabptr[1];
+            // named groups past the last one set took no part in the match
+            if (index >= rc)
+                continue;
+            PCRE2_SPTR name_ptr = tabptr + 2;
+            RegEx::GroupElement element;
+            element.Name = Move(String(name_ptr, strlen((const char*)name_ptr)));
+            element.Index = index;
+            element.Start = (int)ovector[2 * index];
+            element.Length = (int)(ovector[2 * index + 1] - ovector[2 * index]);
+            group.SetType(index, RegEx::Group::Named);
+            group.AppendNamedElement(Move(element));
+        }
+
+        for (int i = 1; i < rc; i++)
+        {
+            if (!group.IsNamed(i))
+            {
+                RegEx::GroupElement element;
+                element.Index = i;
+                element.Start = (int)ovector[2 * i];
+                element.Length = (int)(ovector[2 * i + 1] - ovector[2 * i]);
+                group.AppendNonNamedElement(Move(element));
+            }
+        }
+        tRegExThread.Recycle(Data);
+        OutGroups.Append(group);
+        return true;
+    }
+
+    RegEx::MatchIterator RegEx::MatchAll(const char* Str, U64 Length) const
+    {
+        return MatchIterator(d, Str, Length == UINT64_MAX ? strlen(Str) : Length);
     }
 
     String RegEx::Group::SubGroup(int Id) const
@@ -120,69 +332,104 @@ namespace k3d
         return String(m_Ptr + m_SubNamedGroups[i].Start, m_SubNamedGroups[i].Length);
     }
 
-    MatchGroup::MatchGroup(pcre2_real_code_8 * InRe, RegEx::Groups& OutGroup)
-        : MatchBase(InRe)
-        , m_Groups(OutGroup)
+    RegEx::MatchIterator::MatchIterator(RegExPrivate* Pattern, const char* Subject, U64 Size)
+        : m_Pattern(Pattern)
+        , m_Data(nullptr)
+        , m_Subject(Subject)
+        , m_Size(Size)
+        , m_Offset(0)
+        , m_Options(0)
+        , m_Matched(false)
     {
+        m_Pattern->AddRef();
+        if (m_Pattern->Code)
+            m_Data = tRegExThread.Take(m_Pattern->CaptureCount + 1);
     }
 
-    MatchGroup::~MatchGroup()
+    RegEx::MatchIterator::MatchIterator(MatchIterator&& Other)
+        : m_Pattern(Other.m_Pattern)
+        , m_Data(Other.m_Data)
+        , m_Subject(Other.m_Subject)
+        , m_Size(Other.m_Size)
+        , m_Offset(Other.m_Offset)
+        , m_Options(Other.m_Options)
+        , m_Matched(Other.m_Matched)
     {
+        Other.m_Pattern = nullptr;
+        Other.m_Data = nullptr;
+        Other.m_Matched = false;
     }
 
-    bool MatchGroup::Match(const char * Str)
+    RegEx::MatchIterator::~MatchIterator()
     {
-        int rc = pcre2_match(m_RE, (PCRE2_SPTR)Str, strlen(Str),
-            0,                  /* starting offset in the subject */
-            PCRE2_ANCHORED,                  /* options */
-            m_Data,             /* block for storing the result */
-            NULL);              /* use default match context */
-
-        if (rc <= 0)
-            return false;
+        if (m_Data)
+            tRegExThread.Recycle(m_Data);
+        if (m_Pattern)
+            m_Pattern->Release();
+    }
 
-        PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(m_Data);
-        int namecount = 0;
-        pcre2_pattern_info(m_RE, PCRE2_INFO_NAMECOUNT, &namecount);
-        
-        RegEx::Group group(rc, Str);
-        if (namecount > 0)
+    bool RegEx::MatchIterator::Next()
+    {
+        m_Matched = false;
+        while (m_Data && m_Offset <= m_Size)
         {
-            int name_entry_size = 0;
-            PCRE2_SPTR tabptr;
-            pcre2_pattern_info(m_RE, PCRE2_INFO_NAMETABLE, &tabptr);
-            pcre2_pattern_info(m_RE, PCRE2_INFO_NAMEENTRYSIZE, &name_entry_size);
-            for (int i = 0; i < namecount; i++)
+            int rc = pcre2_match(m_Pattern->Code, (PCRE2_SPTR)m_Subject, m_Size, m_Offset,
+                m_Options, m_Data, tRegExThread.GetContext());
+            if (rc == PCRE2_ERROR_NOMATCH && (m_Options & PCRE2_NOTEMPTY_ATSTART))
             {
-                int index = (tabptr[0] << 8) | tabptr[1];
-                int name_len = name_entry_size - 3;
-                PCRE2_SPTR name_ptr = tabptr + 2;
-                int value_len = (int)(ovector[2 * index + 1] - ovector[2 * index]);
-                PCRE2_SPTR value_ptr = (PCRE2_SPTR)Str + ovector[2 * index];
-                tabptr += name_entry_size;
-                RegEx::GroupElement element;
-                element.Name = Move(String(name_ptr, name_len));
-                element.Index = index;
-                element.Start = ovector[2 * index];
-                element.Length = value_len;
-                group.SetType(index, RegEx::Group::Named);
-                group.AppendNamedElement(Move(element));
+                // only the empty match again here, go on from the next character
+                m_Offset++;
+                while (m_Offset < m_Size && (m_Subject[m_Offset] & 0xC0) == 0x80)
+                    m_Offset++;
+                m_Options = PCRE2_NO_UTF_CHECK;
+                continue;
             }
-        }
-
-        for (int i = 1; i < rc; i++)
-        {
-            if (!group.IsNamed(i))
+            if (rc < 0)
+                break;
+            PCRE2_SIZE* Ovector = pcre2_get_ovector_pointer(m_Data);
+            // the first match checked the subject is valid UTF-8, the rest needn't again
+            m_Options = PCRE2_NO_UTF_CHECK;
+            if (Ovector[1] < Ovector[0])
             {
-                RegEx::GroupElement element;
-                element.Index = i;
-                element.Start = ovector[2 * i];
-                element.Length = ovector[2 * i + 1] - ovector[2 * i];
-                group.AppendNonNamedElement(Move(element));
+                // \K in a lookahead ended the match before its start, there is no going on
+                m_Offset = m_Size + 1;
+            }
+            else
+            {
+                if (Ovector[0] == Ovector[1])
+                    m_Options |= PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED;
+                m_Offset = Ovector[1];
             }
+            m_Matched = true;
+            return true;
         }
-        m_Groups.Append(group);
-        return true;
+        m_Offset = m_Size + 1;
+        return false;
     }
 
-}
\ No newline at end of file
+    RegEx::Span RegEx::MatchIterator::GetGroup(U32 Index) const
+    {
+        Span Group;
+        if (!m_Matched || Index > m_Pattern->CaptureCount)
+            return Group;
+        PCRE2_SIZE* Ovector = pcre2_get_ovector_pointer(m_Data);
+        if (Ovector[2 * Index] == PCRE2_UNSET || Ovector[2 * Index + 1] < Ovector[2 * Index])
+            return Group;
+        Group.Data = m_Subject + Ovector[2 * Index];
+        Group.Size = Ovector[2 * Index + 1] - Ovector[2 * Index];
+        return Group;
+    }
+
+    RegEx::Span RegEx::MatchIterator::GetGroup(const char* Name) const
+    {
+        if (!m_Matched)
+            return Span();
+        int Index = pcre2_substring_number_from_name(m_Pattern->Code, (PCRE2_SPTR)Name);
+        return Index < 0 ? Span() : GetGroup((U32)Index);
+    }
+
+    U32 RegEx::MatchIterator::GetGroupCount() const
+    {
+        return m_Pattern && m_Pattern->Code ? m_Pattern->CaptureCount + 1 : 0;
+    }
+}
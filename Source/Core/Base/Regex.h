@@ -7,6 +7,12 @@ namespace k3d
 {
     class RegExPrivate;
 
+    /**
+     * PCRE2 pattern, UTF-8. Patterns are compiled once per process: a RegEx built
+     * from an expression and mode seen before shares its compiled code, JIT
+     * compiled where PCRE2 supports it. Matching takes its match data from the
+     * calling thread, so a RegEx may match on many threads at once.
+     */
     class K3D_CORE_API RegEx
     {
     public:
@@ -24,7 +30,7 @@ namespace k3d
             int Start = 0;
             int Length = 0;
         };
-        
+
         class K3D_CORE_API Group
         {
         public:
@@ -71,7 +77,52 @@ namespace k3d
 
         using Groups = DynArray<Group>;
 
+        /// bytes of the subject, Data is null for a group that took no part in the match
+        struct Span
+        {
+            const char* Data = nullptr;
+            U64         Size = 0;
+        };
+
+        /**
+         * The matches of a RegEx over a subject one after the other, from MatchAll.
+         * The spans point into the subject, which must outlive the iterator; no
+         * String is built. Past an empty match the search goes on one character
+         * further, like a global match in Perl.
+         */
+        class K3D_CORE_API MatchIterator
+        {
+        public:
+            MatchIterator(MatchIterator&& Other);
+            ~MatchIterator();
+
+            /// moves to the next match, false past the last one
+            bool        Next();
+            /// group Index of the current match, 0 is the whole match
+            Span        GetGroup(U32 Index) const;
+            Span        GetGroup(const char* Name) const;
+            /// the capturing groups of the pattern plus the whole match
+            U32         GetGroupCount() const;
+
+            MatchIterator(const MatchIterator&) = delete;
+            MatchIterator& operator=(const MatchIterator&) = delete;
+
+        private:
+            friend class RegEx;
+            MatchIterator(RegExPrivate* Pattern, const char* Subject, U64 Size);
+
+            RegExPrivate*               m_Pattern;
+            pcre2_real_match_data_8*    m_Data;
+            const char*                 m_Subject;
+            U64                         m_Size;
+            U64                         m_Offset;
+            U32                         m_Options;
+            bool                        m_Matched;
+        };
+
         RegEx(const char* Expr, Option Mode);
+        RegEx(const RegEx& Other);
+        RegEx& operator=(const RegEx& Other);
         ~RegEx();
 
         bool IsValid() const;
@@ -81,10 +132,10 @@ namespace k3d
         bool Match(const char* Str, Option InOption = Default);
         bool Match(const char* Str, Groups& OutGroups, Option InOption = Default);
 
+        /// every match in Str[0, Length), UINT64_MAX takes up to the terminating zero
+        MatchIterator MatchAll(const char* Str, U64 Length = UINT64_MAX) const;
+
     private:
-        pcre2_real_code_8*  m_Code;
-        Option              m_Mode;
-        int                 m_CompileErrorNo;
-        size_t              m_CompileErrorOffset;
+        RegExPrivate*       d;
     };
-}
\ No newline at end of file
+}
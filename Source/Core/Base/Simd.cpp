@@ -5,10 +5,199 @@
 #include <smmintrin.h>
 #endif
 
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define __K3D_SIMD_X86 1
+#if K3DCOMPILER_MSVC
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif (K3DPLATFORM_OS_LINUX || K3DPLATFORM_OS_ANDROID) && (defined(__aarch64__) || defined(__arm__))
+#define __K3D_SIMD_HWCAP 1
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
 namespace k3d
 {
     namespace simd
     {
+#if __K3D_SIMD_X86
+        static void __Cpuid(U32 Leaf, U32 (&Regs)[4])
+        {
+#if K3DCOMPILER_MSVC
+            __cpuidex((int*)Regs, (int)Leaf, 0);
+#else
+            __cpuid_count(Leaf, 0, Regs[0], Regs[1], Regs[2], Regs[3]);
+#endif
+        }
+
+        static U64 __ReadXcr0()
+        {
+#if K3DCOMPILER_MSVC
+            return _xgetbv(0);
+#else
+            U32 Eax, Edx;
+            __asm__ volatile("xgetbv" : "=a"(Eax), "=d"(Edx) : "c"(0));
+            return ((U64)Edx << 32) | Eax;
+#endif
+        }
+#endif
+
+        static CpuFeatures __DetectCpuFeatures()
+        {
+            CpuFeatures Features;
+#if __K3D_SIMD_X86
+            U32 Regs[4];
+            __Cpuid(0, Regs);
+            U32 MaxLeaf = Regs[0];
+            __Cpuid(1, Regs);
+            Features.Sse2 = (Regs[3] >> 26) & 1;
+            Features.Ssse3 = (Regs[2] >> 9) & 1;
+            Features.Sse41 = (Regs[2] >> 19) & 1;
+            Features.Sse42 = (Regs[2] >> 20) & 1;
+            // the OS has to save the YMM state for AVX, and the opmask and ZMM state on top for AVX-512
+            U64 Xcr0 = ((Regs[2] >> 27) & 1) ? __ReadXcr0() : 0;
+            bool Ymm = (Xcr0 & 0x6) == 0x6;
+            bool Zmm = Ymm && (Xcr0 & 0xE0) == 0xE0;
+            Features.Avx = Ymm && ((Regs[2] >> 28) & 1);
+            Features.Fma = Features.Avx && ((Regs[2] >> 12) & 1);
+            if (MaxLeaf >= 7)
+            {
+                __Cpuid(7, Regs);
+                Features.Avx2 = Features.Avx && ((Regs[1] >> 5) & 1);
+                Features.Avx512F = Zmm && ((Regs[1] >> 16) & 1);
+                Features.Avx512BW = Features.Avx512F && ((Regs[1] >> 30) & 1);
+                Features.Avx512VL = Features.Avx512F && ((Regs[1] >> 31) & 1);
+                Features.Sha = (Regs[1] >> 29) & 1;
+            }
+#elif __K3D_SIMD_HWCAP && defined(__aarch64__)
+            unsigned long Caps = getauxval(AT_HWCAP);
+            Features.Neon = (Caps & HWCAP_ASIMD) != 0;
+            Features.Crc32 = (Caps & HWCAP_CRC32) != 0;
+            Features.Sha = (Caps & HWCAP_SHA1) && (Caps & HWCAP_SHA2);
+#elif __K3D_SIMD_HWCAP
+            unsigned long Caps = getauxval(AT_HWCAP), Caps2 = getauxval(AT_HWCAP2);
+            Features.Neon = (Caps & HWCAP_NEON) != 0;
+            Features.Crc32 = (Caps2 & HWCAP2_CRC32) != 0;
+            Features.Sha = (Caps2 & HWCAP2_SHA1) && (Caps2 & HWCAP2_SHA2);
+#else
+            // no way to ask, what the compiler was told the target has
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+            Features.Neon = true;
+#endif
+#if defined(__ARM_FEATURE_CRC32)
+            Features.Crc32 = true;
+#endif
+#if defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_SHA2)
+            Features.Sha = true;
+#endif
+#endif
+            return Features;
+        }
+
+        CpuFeatures const& GetCpuFeatures()
+        {
+            static const CpuFeatures Features = __DetectCpuFeatures();
+            return Features;
+        }
+
+        static U32 __DetectSimdWidth()
+        {
+            CpuFeatures const& Features = GetCpuFeatures();
+#if __K3D_SIMD_X86 && K3D_SIMD_VECTOR_EXT
+            // only GCC and Clang compile the wide lanes for their ISA
+            if (Features.Avx512F)
+                return 16;
+            if (Features.Avx2 && Features.Fma)
+                return 8;
+#endif
+            return Features.Sse2 || Features.Neon ? 4 : 1;
+        }
+
+        U32 GetSimdWidth()
+        {
+            static const U32 Width = __DetectSimdWidth();
+            return Width;
+        }
+
+        U32 SelectSimdWidth(U32 Requested)
+        {
+            U32 Best = GetSimdWidth();
+            U32 Width = Requested == 0 || Requested > Best ? Best : Requested;
+            return Width >= 16 ? 16 : Width >= 8 ? 8 : Width >= 4 ? 4 : 1;
+        }
+
+        template <U32 N>
+        K3D_SIMD_INLINE void __CullSpheres(const float* CenterX, const float* CenterY, const float* CenterZ,
+            const float* Radius, U32 Count, const float (*Planes)[4], U32 NumPlanes, U8* Visible)
+        {
+            for (U32 i = 0; i < Count; i += N)
+            {
+                U32 Take = Count - i < N ? Count - i : N;
+                VecF<N> X = VecF<N>::Load(CenterX + i, Take);
+                VecF<N> Y = VecF<N>::Load(CenterY + i, Take);
+                VecF<N> Z = VecF<N>::Load(CenterZ + i, Take);
+                VecF<N> NegRadius = -VecF<N>::Load(Radius + i, Take);
+                Mask<N> Inside = Mask<N>::Broadcast(-1);
+                for (U32 p = 0; p < NumPlanes; p++)
+                {
+                    VecF<N> Distance = Fma(Z, VecF<N>::Broadcast(Planes[p][2]), VecF<N>::Broadcast(Planes[p][3]));
+                    Distance = Fma(Y, VecF<N>::Broadcast(Planes[p][1]), Distance);
+                    Distance = Fma(X, VecF<N>::Broadcast(Planes[p][0]), Distance);
+                    Inside = Inside & (Distance >= NegRadius);
+                }
+                for (U32 j = 0; j < Take; j++)
+                    Visible[i + j] = (U8)(Inside[j] & 1);
+            }
+        }
+
+        template <U32 N>
+        K3D_SIMD_INLINE void __ApplyCurve(const float* In, float* Out, U64 Count, const float* Table, U32 TableSize)
+        {
+            const VecF<N> Zero = VecF<N>::Broadcast(0.0f), One = VecF<N>::Broadcast(1.0f);
+            const VecF<N> Scale = VecF<N>::Broadcast((float)(TableSize - 1));
+            const VecI<N> Last = VecI<N>::Broadcast((I32)TableSize - 2), Next = VecI<N>::Broadcast(1);
+            for (U64 i = 0; i < Count; i += N)
+            {
+                U32 Take = Count - i < N ? (U32)(Count - i) : N;
+                VecF<N> X = Min(Max(VecF<N>::Load(In + i, Take), Zero), One) * Scale;
+                // 1.0 lands on the last segment at its far end
+                VecI<N> Index = Min(Convert<I32>(X), Last);
+                VecF<N> Fraction = X - Convert<float>(Index);
+                VecF<N> From = Gather(Table, Index);
+                VecF<N> To = Gather(Table, Index + Next);
+                Fma(Fraction, To - From, From).Store(Out + i, Take);
+            }
+        }
+
+        K3D_SIMD_MULTIVERSION(__CullSpheresX, __CullSpheres,
+            (const float* CenterX, const float* CenterY, const float* CenterZ, const float* Radius,
+                U32 Count, const float (*Planes)[4], U32 NumPlanes, U8* Visible),
+            (CenterX, CenterY, CenterZ, Radius, Count, Planes, NumPlanes, Visible))
+
+        K3D_SIMD_MULTIVERSION(__ApplyCurveX, __ApplyCurve,
+            (const float* In, float* Out, U64 Count, const float* Table, U32 TableSize),
+            (In, Out, Count, Table, TableSize))
+
+        void CullSpheres(const float* CenterX, const float* CenterY, const float* CenterZ,
+            const float* Radius, U32 Count, const float (*Planes)[4], U32 NumPlanes, U8* Visible, U32 Lanes)
+        {
+            __CullSpheresXFor(Lanes)(CenterX, CenterY, CenterZ, Radius, Count, Planes, NumPlanes, Visible);
+        }
+
+        void ApplyCurve(const float* In, float* Out, U64 Count, const float* Table, U32 TableSize, U32 Lanes)
+        {
+            if (TableSize < 2)
+            {
+                for (U64 i = 0; i < Count; i++)
+                    Out[i] = TableSize ? Table[0] : 0.0f;
+                return;
+            }
+            // the lookups load lane by lane, past 8 lanes they cost more than the wider math saves
+            __ApplyCurveXFor(Lanes ? Lanes : 8)(In, Out, Count, Table, TableSize);
+        }
+
         void MemoryCopy(void* __restrict Dst, const void* __restrict Src, size_t NumQuadwords)
         {
 #if K3D_USE_SSE
@@ -88,12 +277,14 @@ namespace k3d
             }
 
             _mm_sfence();
+#else
+            memcpy(Dst, Src, NumQuadwords * 16);
 #endif
         }
 
+#if K3D_USE_SSE
         void MemFill(void* __restrict _Dest, __m128 FillVector, size_t NumQuadwords)
         {
-#if K3D_USE_SSE
 //            assert(kMath::IsAligned(_Dest, 16));
 
             register const __m128i Source = _mm_castps_si128(FillVector);
@@ -130,7 +321,7 @@ namespace k3d
             }
 
             _mm_sfence();
-#endif
         }
+#endif
     }
 }
\ No newline at end of file
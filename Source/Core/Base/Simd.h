@@ -9,18 +9,75 @@
 #define _MM_PERM2_W			3
 #define _MM_PERM2(X,Y,Z,W)	_MM_SHUFFLE(_MM_PERM2_ ## W,_MM_PERM2_ ## Z,_MM_PERM2_ ## Y,_MM_PERM2_ ## X)
 #define _MM_SWIZZLE(V,X,Y,Z,W) _mm_shuffle_ps(V,V,_MM_PERM2(X,Y,Z,W))
+#elif !K3D_USE_NEON
+#include <math.h>
+#include <string.h>
 #endif
 
 namespace k3d
 {
     namespace simd
     {
+        /**
+         * What the CPU and the OS running us support, detected once on first use,
+         * with cpuid and xgetbv on x86 and the hwcaps on ARM Linux. A feature the
+         * OS does not save the registers of (AVX state off) reads as missing.
+         */
+        struct CpuFeatures
+        {
+            bool Sse2 = false;
+            bool Ssse3 = false;
+            bool Sse41 = false;
+            bool Sse42 = false;
+            bool Avx = false;
+            bool Avx2 = false;
+            bool Fma = false;
+            bool Avx512F = false;
+            bool Avx512BW = false;
+            bool Avx512VL = false;
+            /// SHA-NI on x86, the SHA1 and SHA2 instructions on ARM
+            bool Sha = false;
+            bool Neon = false;
+            /// the ARMv8 CRC32 instructions
+            bool Crc32 = false;
+        };
+
+        extern K3D_CORE_API CpuFeatures const& GetCpuFeatures();
+
+        /**
+         * The widest lanes of 32 bit values worth running here: 16 with AVX-512F,
+         * 8 with AVX2 and FMA, 4 with SSE2 or NEON, 1 otherwise.
+         */
+        extern K3D_CORE_API U32 GetSimdWidth();
+
+        /// Requested lanes rounded down to a width this CPU runs, 0 asks for the widest
+        extern K3D_CORE_API U32 SelectSimdWidth(U32 Requested);
+
+#if !K3D_USE_SSE && !K3D_USE_NEON
+        // the scalar V4F keeps its bits in floats, the logic ops go through V4I
+        KFORCE_INLINE V4I __AsInt4(V4F const & v)
+        {
+            V4I r;
+            memcpy(&r, &v, sizeof(r));
+            return r;
+        }
+
+        KFORCE_INLINE V4F __AsFloat4(V4I const & v)
+        {
+            V4F r;
+            memcpy(&r, &v, sizeof(r));
+            return r;
+        }
+#endif
+
         KFORCE_INLINE V4F MakeFloat4(float v) {
 #if K3D_USE_SSE
             return _mm_set_ps1(v);
 #elif K3D_USE_NEON
             return vdupq_n_f32(v);
 #else
+            V4F r = { { v, v, v, v } };
+            return r;
 #endif
         }
 
@@ -29,12 +86,14 @@ namespace k3d
             return _mm_setr_ps(x, y, z, w);
 #elif K3D_USE_NEON
             union { V4F v; float f[4]; } shadow_float4;
-            shadow_float4.f[0] = X;
-            shadow_float4.f[1] = Y;
-            shadow_float4.f[2] = Z;
-            shadow_float4.f[3] = W;
+            shadow_float4.f[0] = x;
+            shadow_float4.f[1] = y;
+            shadow_float4.f[2] = z;
+            shadow_float4.f[3] = w;
             return shadow_float4.v;
 #else
+            V4F r = { { x, y, z, w } };
+            return r;
 #endif
         }
 
@@ -43,8 +102,11 @@ namespace k3d
 #if K3D_USE_SSE
             return _mm_load_ps(Ptr);
 #elif K3D_USE_NEON
-            return vloadq_f32(Ptr);
+            return vld1q_f32(Ptr);
 #else
+            V4F r;
+            memcpy(&r, Ptr, sizeof(r));
+            return r;
 #endif
         }
 
@@ -67,6 +129,10 @@ namespace k3d
 #elif K3D_USE_NEON
             return vandq_s32(a, b);
 #else
+            V4I r;
+            for (int i = 0; i < 4; i++)
+                r.u32[i] = a.u32[i] & b.u32[i];
+            return r;
 #endif
         }
 
@@ -77,6 +143,8 @@ namespace k3d
 #elif K3D_USE_NEON
             return (V4F)vandq_u32((V4I)a, (V4I)b);
 #else
+            V4I x = __AsInt4(a), y = __AsInt4(b);
+            return __AsFloat4(And(x, y));
 #endif
         }
 
@@ -87,6 +155,10 @@ namespace k3d
 #elif K3D_USE_NEON
             return vorrq_s32(a, b);
 #else
+            V4I r;
+            for (int i = 0; i < 4; i++)
+                r.u32[i] = a.u32[i] | b.u32[i];
+            return r;
 #endif
         }
 
@@ -97,6 +169,8 @@ namespace k3d
 #elif K3D_USE_NEON
             return (V4F)vorrq_u32((V4I)a, (V4I)b);
 #else
+            V4I x = __AsInt4(a), y = __AsInt4(b);
+            return __AsFloat4(Or(x, y));
 #endif
         }
 
@@ -107,6 +181,10 @@ namespace k3d
 #elif K3D_USE_NEON
             return veorq_s32(a, b);
 #else
+            V4I r;
+            for (int i = 0; i < 4; i++)
+                r.u32[i] = a.u32[i] ^ b.u32[i];
+            return r;
 #endif
         }
 
@@ -117,6 +195,8 @@ namespace k3d
 #elif K3D_USE_NEON
             return (V4F)veorq_u32((V4I)a, (V4I)b);
 #else
+            V4I x = __AsInt4(a), y = __AsInt4(b);
+            return __AsFloat4(Xor(x, y));
 #endif
         }
         /*
@@ -150,8 +230,12 @@ namespace k3d
 #if K3D_USE_SSE
             return _mm_xor_ps(b, _mm_and_ps(m, _mm_xor_ps(a, b)));
 #elif K3D_USE_NEON
-            return vbslq_f32((V4I)m, a, b);
+            return vbslq_f32((uint32x4_t)m, a, b);
 #else
+            V4I x = __AsInt4(a), y = __AsInt4(b), z = __AsInt4(m), r;
+            for (int i = 0; i < 4; i++)
+                r.u32[i] = y.u32[i] ^ (z.u32[i] & (x.u32[i] ^ y.u32[i]));
+            return __AsFloat4(r);
 #endif
         }
 
@@ -160,8 +244,12 @@ namespace k3d
 #if K3D_USE_SSE
             return _mm_xor_si128(b, _mm_and_si128(m, _mm_xor_si128(a, b)));
 #elif K3D_USE_NEON
-            return vloadq_f32(Ptr);
+            return vbslq_s32((uint32x4_t)m, a, b);
 #else
+            V4I r;
+            for (int i = 0; i < 4; i++)
+                r.u32[i] = b.u32[i] ^ (m.u32[i] & (a.u32[i] ^ b.u32[i]));
+            return r;
 #endif
         }
 
@@ -171,7 +259,10 @@ namespace k3d
 #elif K3D_USE_NEON
             return vaddq_f32(a, b);
 #else
-
+            V4F r;
+            for (int i = 0; i < 4; i++)
+                r.f32[i] = a.f32[i] + b.f32[i];
+            return r;
 #endif
         }
 
@@ -181,7 +272,10 @@ namespace k3d
 #elif K3D_USE_NEON
             return vaddq_s32(a, b);
 #else
-
+            V4I r;
+            for (int i = 0; i < 4; i++)
+                r.u32[i] = a.u32[i] + b.u32[i];
+            return r;
 #endif
         }
 
@@ -189,9 +283,12 @@ namespace k3d
 #if K3D_USE_SSE
             return _mm_sub_ps(a, b);
 #elif K3D_USE_NEON
-            return vsubq_s32(a, b);
+            return vsubq_f32(a, b);
 #else
-
+            V4F r;
+            for (int i = 0; i < 4; i++)
+                r.f32[i] = a.f32[i] - b.f32[i];
+            return r;
 #endif
         }
 
@@ -199,9 +296,12 @@ namespace k3d
 #if K3D_USE_SSE
             return _mm_sub_epi32(a, b);
 #elif K3D_USE_NEON
-            return vsubq_f32(a, b);
+            return vsubq_s32(a, b);
 #else
-
+            V4I r;
+            for (int i = 0; i < 4; i++)
+                r.u32[i] = a.u32[i] - b.u32[i];
+            return r;
 #endif
         }
 
@@ -211,6 +311,10 @@ namespace k3d
 #elif K3D_USE_NEON
             return vmulq_f32(a, b);
 #else
+            V4F r;
+            for (int i = 0; i < 4; i++)
+                r.f32[i] = a.f32[i] * b.f32[i];
+            return r;
 #endif
         }
 
@@ -254,7 +358,10 @@ namespace k3d
 #elif K3D_USE_NEON
             return vminq_f32(a, b);
 #else
-
+            V4F r;
+            for (int i = 0; i < 4; i++)
+                r.f32[i] = a.f32[i] < b.f32[i] ? a.f32[i] : b.f32[i];
+            return r;
 #endif
         }
 
@@ -264,7 +371,10 @@ namespace k3d
 #elif K3D_USE_NEON
             return vmaxq_f32(a, b);
 #else
-
+            V4F r;
+            for (int i = 0; i < 4; i++)
+                r.f32[i] = a.f32[i] > b.f32[i] ? a.f32[i] : b.f32[i];
+            return r;
 #endif
         }
 
@@ -276,7 +386,12 @@ namespace k3d
             tmp = _mm_shuffle_ps(dot, dot, _MM_SHUFFLE(0, 0, 0, 1));
             return _mm_add_ps(dot, tmp);
 #elif K3D_USE_NEON
+            V4F dot = vmulq_f32(a, b);
+            float32x2_t sum = vadd_f32(vget_low_f32(dot), vget_high_f32(dot));
+            sum = vpadd_f32(sum, sum);
+            return vcombine_f32(sum, sum);
 #else
+            return MakeFloat4(a.f32[0] * b.f32[0] + a.f32[1] * b.f32[1] + a.f32[2] * b.f32[2] + a.f32[3] * b.f32[3]);
 #endif
         }
 
@@ -287,6 +402,10 @@ namespace k3d
 #elif K3D_USE_NEON
             return vrecpeq_f32(v);
 #else
+            V4F r;
+            for (int i = 0; i < 4; i++)
+                r.f32[i] = 1.0f / v.f32[i];
+            return r;
 #endif
         }
 
@@ -297,6 +416,10 @@ namespace k3d
 #elif K3D_USE_NEON
             return vrsqrteq_f32(v);
 #else
+            V4F r;
+            for (int i = 0; i < 4; i++)
+                r.f32[i] = 1.0f / sqrtf(v.f32[i]);
+            return r;
 #endif
         }
 
@@ -310,29 +433,66 @@ namespace k3d
         }
 
 
+#if K3D_USE_SSE
         KFORCE_INLINE V4F _mm_rcp_ss_nr(V4F v)
         {
             V4F iv = _mm_rcp_ss(v);
             return _mm_sub_ss(_mm_add_ss(iv, iv), _mm_mul_ss(v, _mm_mul_ss(iv, iv)));
         }
+#endif
 
-        // row major vector?
+        // row major matrix a times column vector b, result[i] = dot(a[i], b)
         KFORCE_INLINE void MatrixVectorMultiply(void* result, void* a, void* b) {
 #if K3D_USE_SSE
+            const V4F *m = (const V4F*)a;
+            V4F v = *(const V4F*)b;
+            V4F x = _mm_mul_ps(m[0], v);
+            V4F y = _mm_mul_ps(m[1], v);
+            V4F z = _mm_mul_ps(m[2], v);
+            V4F w = _mm_mul_ps(m[3], v);
+            _MM_TRANSPOSE4_PS(x, y, z, w);
+            *(V4F*)result = _mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, w));
 #elif K3D_USE_NEON
-
-#else // Dumy imp
-
+            const V4F *m = (const V4F*)a;
+            V4F v = *(const V4F*)b;
+            V4F x = vmulq_f32(m[0], v);
+            V4F y = vmulq_f32(m[1], v);
+            V4F z = vmulq_f32(m[2], v);
+            V4F w = vmulq_f32(m[3], v);
+            float32x2_t xy = vpadd_f32(vadd_f32(vget_low_f32(x), vget_high_f32(x)), vadd_f32(vget_low_f32(y), vget_high_f32(y)));
+            float32x2_t zw = vpadd_f32(vadd_f32(vget_low_f32(z), vget_high_f32(z)), vadd_f32(vget_low_f32(w), vget_high_f32(w)));
+            *(V4F*)result = vcombine_f32(xy, zw);
+#else
+            const float *m = (const float*)a, *v = (const float*)b;
+            float r[4];
+            for (int i = 0; i < 4; i++)
+                r[i] = m[i * 4] * v[0] + m[i * 4 + 1] * v[1] + m[i * 4 + 2] * v[2] + m[i * 4 + 3] * v[3];
+            memcpy(result, r, sizeof(r));
 #endif
         }
 
-        // column major vector
+        // row vector a times row major matrix b, result = sum of a[i] * b[i]
         KFORCE_INLINE void VectorMatrixMultiply(void* result, void* a, void* b) {
 #if K3D_USE_SSE
+            V4F v = *(const V4F*)a;
+            const V4F *m = (const V4F*)b;
+            V4F r = _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)), m[0]);
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)), m[1]));
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)), m[2]));
+            *(V4F*)result = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)), m[3]));
 #elif K3D_USE_NEON
-
-#else // Dumy imp
-
+            V4F v = *(const V4F*)a;
+            const V4F *m = (const V4F*)b;
+            V4F r = vmulq_lane_f32(m[0], vget_low_f32(v), 0);
+            r = vmlaq_lane_f32(r, m[1], vget_low_f32(v), 1);
+            r = vmlaq_lane_f32(r, m[2], vget_high_f32(v), 0);
+            *(V4F*)result = vmlaq_lane_f32(r, m[3], vget_high_f32(v), 1);
+#else
+            const float *v = (const float*)a, *m = (const float*)b;
+            float r[4];
+            for (int i = 0; i < 4; i++)
+                r[i] = v[0] * m[i] + v[1] * m[4 + i] + v[2] * m[8 + i] + v[3] * m[12 + i];
+            memcpy(result, r, sizeof(r));
 #endif
         }
 
@@ -444,9 +604,43 @@ namespace k3d
             R[2] = R2;
             R[3] = R3;
 #else
+            // the same order as the SSE path, result row i = sum of b[i][j] * a[j]
+            const float *A = (const float*)a, *B = (const float*)b;
+            float R[16];
+            for (int i = 0; i < 4; i++)
+                for (int k = 0; k < 4; k++)
+                    R[i * 4 + k] = B[i * 4] * A[k] + B[i * 4 + 1] * A[4 + k] + B[i * 4 + 2] * A[8 + k] + B[i * 4 + 3] * A[12 + k];
+            memcpy(result, R, sizeof(R));
 #endif
         }
 
+#if !K3D_USE_SSE
+        // cofactors over the determinant, for any layout of 16 floats
+        KFORCE_INLINE void __MatrixInverseScalar(const float* m, float* dest)
+        {
+            float inv[16];
+            inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+            inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+            inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+            inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+            inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+            inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+            inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+            inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+            inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+            inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+            inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+            inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+            inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+            inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+            inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+            inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+            float det = 1.0f / (m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12]);
+            for (int i = 0; i < 16; i++)
+                dest[i] = inv[i] * det;
+        }
+#endif
+
         KFORCE_INLINE void MatrixInverse(void* _src, void* _dest) {
 #if K3D_USE_SSE
             V4F *src = (V4F*)_src;
@@ -513,13 +707,30 @@ namespace k3d
             dest[1] = _mm_mul_ps(res_1, tmp_lane);
             dest[2] = _mm_mul_ps(res_2, tmp_lane);
             dest[3] = _mm_mul_ps(res_3, tmp_lane);
-#elif K3D_USE_NEON
 #else
-
+            __MatrixInverseScalar((const float*)_src, (float*)_dest);
 #endif
         }
 
         extern K3D_CORE_API void MemoryCopy(void* __restrict Dest, const void* __restrict Source, size_t NumQuadwords);
+
+        /**
+         * Sphere against frustum for Count spheres laid out as arrays. Visible[i] is 1
+         * unless sphere i lies entirely behind one of the planes, Planes[p] holding the
+         * inward normal and distance (nx, ny, nz, d). Lanes picks the SIMD width as
+         * SelectSimdWidth does, 0 for the widest this CPU runs.
+         */
+        extern K3D_CORE_API void CullSpheres(const float* CenterX, const float* CenterY, const float* CenterZ,
+            const float* Radius, U32 Count, const float (*Planes)[4], U32 NumPlanes, U8* Visible, U32 Lanes = 0);
+
+        /**
+         * Maps Count values in [0, 1] through a curve of TableSize >= 2 samples spread
+         * evenly over [0, 1], interpolating linearly between them: tone curves and
+         * gamma on image channels. Values out of range clamp, NaN reads as 0. Lanes 0
+         * runs up to 8 lanes, the table lookups do not gain from more.
+         */
+        extern K3D_CORE_API void ApplyCurve(const float* In, float* Out, U64 Count,
+            const float* Table, U32 TableSize, U32 Lanes = 0);
     }
 }
 
@@ -0,0 +1,440 @@
+#pragma once
+#ifndef __k3d_SimdVec_h__
+#define __k3d_SimdVec_h__
+#include "Types.h"
+#include <string.h>
+
+/**
+ * Width generic SIMD: Vec<T, N> holds N lanes of a 32 bit T (float, I32, U32),
+ * N one of 1, 4, 8 or 16. On GCC and Clang it is a vector type, which the
+ * compiler lowers to SSE, AVX2, AVX-512 or NEON as the enclosing function is
+ * compiled for; elsewhere the lanes are an array and every op a loop, so code
+ * written once stays correct without any vector unit.
+ *
+ * Kernels are templates on N marked K3D_SIMD_INLINE, stamped out once per
+ * width with K3D_SIMD_MULTIVERSION, which compiles the 8 and 16 lane copies
+ * for AVX2 and AVX-512 and picks one from the CPU at run time.
+ */
+
+#if defined(__GNUC__)
+#define K3D_SIMD_VECTOR_EXT 1
+#define K3D_SIMD_INLINE inline __attribute__((always_inline))
+#else
+#define K3D_SIMD_INLINE KFORCE_INLINE
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define K3D_SIMD_TARGET(Isa) __attribute__((target(Isa)))
+#else
+#define K3D_SIMD_TARGET(Isa)
+#endif
+
+/**
+ * Defines Name1, Name4, Name8 and Name16 calling Kernel<N>, and NameFor(Lanes)
+ * returning the one for SelectSimdWidth(Lanes):
+ *
+ *   template <U32 N> K3D_SIMD_INLINE void ScaleKernel(float* Data, U32 Count, float By);
+ *   K3D_SIMD_MULTIVERSION(Scale, ScaleKernel, (float* Data, U32 Count, float By), (Data, Count, By))
+ *   ScaleFor(0)(Data, Count, 2.0f);
+ */
+#define K3D_SIMD_MULTIVERSION(Name, Kernel, Params, Args) \
+    static auto Name##1 Params -> decltype(Kernel<1> Args) { return Kernel<1> Args; } \
+    static auto Name##4 Params -> decltype(Kernel<4> Args) { return Kernel<4> Args; } \
+    K3D_SIMD_TARGET("avx2,fma") static auto Name##8 Params -> decltype(Kernel<8> Args) { return Kernel<8> Args; } \
+    K3D_SIMD_TARGET("avx512f,avx2,fma") static auto Name##16 Params -> decltype(Kernel<16> Args) { return Kernel<16> Args; } \
+    static decltype(&Name##1) Name##For(::k3d::U32 Lanes) \
+    { \
+        switch (::k3d::simd::SelectSimdWidth(Lanes)) \
+        { \
+        case 16: return Name##16; \
+        case 8: return Name##8; \
+        case 4: return Name##4; \
+        default: return Name##1; \
+        } \
+    }
+
+namespace k3d
+{
+    namespace simd
+    {
+        template <typename T, U32 N>
+        struct Vec
+        {
+            static_assert(sizeof(T) == 4, "lanes are 32 bits");
+            static_assert(N == 1 || N == 4 || N == 8 || N == 16, "1, 4, 8 or 16 lanes");
+
+            typedef T Scalar;
+            static const U32 Lanes = N;
+#if K3D_SIMD_VECTOR_EXT
+            typedef T Native __attribute__((vector_size(sizeof(T) * N)));
+#else
+            typedef T Native[N];
+#endif
+            Native V;
+
+            static K3D_SIMD_INLINE Vec Broadcast(T Value)
+            {
+                Vec r;
+                for (U32 i = 0; i < N; i++)
+                    r.V[i] = Value;
+                return r;
+            }
+
+            /// Start, Start + 1, ... Start + N - 1
+            static K3D_SIMD_INLINE Vec Sequence(T Start)
+            {
+                Vec r;
+                for (U32 i = 0; i < N; i++)
+                    r.V[i] = Start + (T)i;
+                return r;
+            }
+
+            static K3D_SIMD_INLINE Vec Load(const T* Ptr)
+            {
+                Vec r;
+                memcpy(&r.V, Ptr, sizeof(r.V));
+                return r;
+            }
+
+            /// the first Count lanes from Ptr, zero past them, for the tail of an array
+            static K3D_SIMD_INLINE Vec Load(const T* Ptr, U32 Count)
+            {
+                if (Count >= N)
+                    return Load(Ptr);
+                Vec r = Broadcast(T(0));
+                memcpy(&r.V, Ptr, sizeof(T) * Count);
+                return r;
+            }
+
+            K3D_SIMD_INLINE void Store(T* Ptr) const
+            {
+                memcpy(Ptr, &V, sizeof(V));
+            }
+
+            K3D_SIMD_INLINE void Store(T* Ptr, U32 Count) const
+            {
+                if (Count >= N)
+                    return Store(Ptr);
+                memcpy(Ptr, &V, sizeof(T) * Count);
+            }
+
+            K3D_SIMD_INLINE T operator[](U32 Index) const
+            {
+                return V[Index];
+            }
+        };
+
+        /// all ones in a lane where a comparison holds, zero where it does not
+        template <U32 N>
+        using Mask = Vec<I32, N>;
+
+        template <U32 N>
+        using VecF = Vec<float, N>;
+
+        template <U32 N>
+        using VecI = Vec<I32, N>;
+
+#if K3D_SIMD_VECTOR_EXT
+#define __K3D_SIMD_BINARY(Op) \
+        template <typename T, U32 N> \
+        K3D_SIMD_INLINE Vec<T, N> operator Op(Vec<T, N> const& a, Vec<T, N> const& b) \
+        { \
+            Vec<T, N> r; \
+            r.V = a.V Op b.V; \
+            return r; \
+        }
+#define __K3D_SIMD_COMPARE(Op) \
+        template <typename T, U32 N> \
+        K3D_SIMD_INLINE Mask<N> operator Op(Vec<T, N> const& a, Vec<T, N> const& b) \
+        { \
+            Mask<N> r; \
+            r.V = (typename Mask<N>::Native)(a.V Op b.V); \
+            return r; \
+        }
+#else
+#define __K3D_SIMD_BINARY(Op) \
+        template <typename T, U32 N> \
+        K3D_SIMD_INLINE Vec<T, N> operator Op(Vec<T, N> const& a, Vec<T, N> const& b) \
+        { \
+            Vec<T, N> r; \
+            for (U32 i = 0; i < N; i++) \
+                r.V[i] = a.V[i] Op b.V[i]; \
+            return r; \
+        }
+#define __K3D_SIMD_COMPARE(Op) \
+        template <typename T, U32 N> \
+        K3D_SIMD_INLINE Mask<N> operator Op(Vec<T, N> const& a, Vec<T, N> const& b) \
+        { \
+            Mask<N> r; \
+            for (U32 i = 0; i < N; i++) \
+                r.V[i] = a.V[i] Op b.V[i] ? -1 : 0; \
+            return r; \
+        }
+#endif
+
+        __K3D_SIMD_BINARY(+)
+        __K3D_SIMD_BINARY(-)
+        __K3D_SIMD_BINARY(*)
+        __K3D_SIMD_BINARY(/)
+        /// bitwise ops are for I32 and U32 lanes, masks included
+        __K3D_SIMD_BINARY(&)
+        __K3D_SIMD_BINARY(|)
+        __K3D_SIMD_BINARY(^)
+
+        __K3D_SIMD_COMPARE(==)
+        __K3D_SIMD_COMPARE(!=)
+        __K3D_SIMD_COMPARE(<)
+        __K3D_SIMD_COMPARE(<=)
+        __K3D_SIMD_COMPARE(>)
+        __K3D_SIMD_COMPARE(>=)
+
+#undef __K3D_SIMD_BINARY
+#undef __K3D_SIMD_COMPARE
+
+        template <typename T, U32 N>
+        K3D_SIMD_INLINE Vec<T, N> operator-(Vec<T, N> const& a)
+        {
+            Vec<T, N> r;
+#if K3D_SIMD_VECTOR_EXT
+            r.V = -a.V;
+#else
+            for (U32 i = 0; i < N; i++)
+                r.V[i] = -a.V[i];
+#endif
+            return r;
+        }
+
+        template <typename T, U32 N>
+        K3D_SIMD_INLINE Vec<T, N> operator~(Vec<T, N> const& a)
+        {
+            return a ^ Vec<T, N>::Broadcast(T(-1));
+        }
+
+        template <typename T, U32 N>
+        K3D_SIMD_INLINE Vec<T, N> operator<<(Vec<T, N> const& a, int Count)
+        {
+            Vec<T, N> r;
+#if K3D_SIMD_VECTOR_EXT
+            r.V = a.V << Count;
+#else
+            for (U32 i = 0; i < N; i++)
+                r.V[i] = a.V[i] << Count;
+#endif
+            return r;
+        }
+
+        /// arithmetic for I32 lanes, logical for U32
+        template <typename T, U32 N>
+        K3D_SIMD_INLINE Vec<T, N> operator>>(Vec<T, N> const& a, int Count)
+        {
+            Vec<T, N> r;
+#if K3D_SIMD_VECTOR_EXT
+            r.V = a.V >> Count;
+#else
+            for (U32 i = 0; i < N; i++)
+                r.V[i] = a.V[i] >> Count;
+#endif
+            return r;
+        }
+
+        /// the same bits read as To
+        template <typename To, typename T, U32 N>
+        K3D_SIMD_INLINE Vec<To, N> BitCast(Vec<T, N> const& a)
+        {
+            Vec<To, N> r;
+#if K3D_SIMD_VECTOR_EXT
+            r.V = (typename Vec<To, N>::Native)a.V;
+#else
+            memcpy(&r.V, &a.V, sizeof(r.V));
+#endif
+            return r;
+        }
+
+        /// lane by lane conversion, float to integer truncates
+        template <typename To, typename T, U32 N>
+        K3D_SIMD_INLINE Vec<To, N> Convert(Vec<T, N> const& a)
+        {
+            Vec<To, N> r;
+#if K3D_SIMD_VECTOR_EXT && (defined(__clang__) || __GNUC__ >= 9)
+            r.V = __builtin_convertvector(a.V, typename Vec<To, N>::Native);
+#else
+            for (U32 i = 0; i < N; i++)
+                r.V[i] = (To)a.V[i];
+#endif
+            return r;
+        }
+
+        /// a where m is set, b elsewhere
+        template <typename T, U32 N>
+        K3D_SIMD_INLINE Vec<T, N> Select(Mask<N> const& m, Vec<T, N> const& a, Vec<T, N> const& b)
+        {
+#if K3D_SIMD_VECTOR_EXT
+            Mask<N> x = BitCast<I32>(a), y = BitCast<I32>(b);
+            return BitCast<T>((x & m) | (y & ~m));
+#else
+            Vec<T, N> r;
+            for (U32 i = 0; i < N; i++)
+                r.V[i] = m.V[i] ? a.V[i] : b.V[i];
+            return r;
+#endif
+        }
+
+        /// b when either is NaN, like minps and maxps
+        template <typename T, U32 N>
+        K3D_SIMD_INLINE Vec<T, N> Min(Vec<T, N> const& a, Vec<T, N> const& b)
+        {
+            return Select(a < b, a, b);
+        }
+
+        template <typename T, U32 N>
+        K3D_SIMD_INLINE Vec<T, N> Max(Vec<T, N> const& a, Vec<T, N> const& b)
+        {
+            return Select(a > b, a, b);
+        }
+
+        template <typename T, U32 N>
+        K3D_SIMD_INLINE Vec<T, N> Abs(Vec<T, N> const& a)
+        {
+            return Select(a < Vec<T, N>::Broadcast(T(0)), -a, a);
+        }
+
+        /// a * b + c, one fused multiply-add on the widths compiled with FMA
+        template <U32 N>
+        K3D_SIMD_INLINE VecF<N> Fma(VecF<N> const& a, VecF<N> const& b, VecF<N> const& c)
+        {
+            return a * b + c;
+        }
+
+        /// Base[Index[i]] in lane i, one load per lane
+        template <typename T, U32 N>
+        K3D_SIMD_INLINE Vec<T, N> Gather(const T* Base, VecI<N> const& Index)
+        {
+            // through arrays, extracting and inserting lanes one by one costs more on wide vectors
+            I32 At[N];
+            T Values[N];
+            Index.Store(At);
+            for (U32 i = 0; i < N; i++)
+                Values[i] = Base[At[i]];
+            return Vec<T, N>::Load(Values);
+        }
+
+        /// lanes off in m keep Fallback and read nothing, their indices may be out of range
+        template <typename T, U32 N>
+        K3D_SIMD_INLINE Vec<T, N> Gather(const T* Base, VecI<N> const& Index, Mask<N> const& m, Vec<T, N> const& Fallback)
+        {
+            Vec<T, N> r;
+            for (U32 i = 0; i < N; i++)
+                r.V[i] = m.V[i] ? Base[Index.V[i]] : Fallback.V[i];
+            return r;
+        }
+
+        /// bit i set when lane i of m is
+        template <U32 N>
+        K3D_SIMD_INLINE U32 BitMask(Mask<N> const& m)
+        {
+            U32 Bits = 0;
+            for (U32 i = 0; i < N; i++)
+                Bits |= (U32)(m.V[i] & 1) << i;
+            return Bits;
+        }
+
+        // halves folded with vector ops down to 64 bit words, no lane by lane extracts
+        template <U32 N>
+        struct __MaskFold
+        {
+            static K3D_SIMD_INLINE void Halves(Mask<N> const& m, Mask<N / 2>& Low, Mask<N / 2>& High)
+            {
+                memcpy(&Low.V, &m.V, sizeof(Low.V));
+                memcpy(&High.V, (const char*)&m.V + sizeof(Low.V), sizeof(High.V));
+            }
+
+            static K3D_SIMD_INLINE U64 Or(Mask<N> const& m)
+            {
+                Mask<N / 2> Low, High;
+                Halves(m, Low, High);
+                return __MaskFold<N / 2>::Or(Low | High);
+            }
+
+            static K3D_SIMD_INLINE U64 And(Mask<N> const& m)
+            {
+                Mask<N / 2> Low, High;
+                Halves(m, Low, High);
+                return __MaskFold<N / 2>::And(Low & High);
+            }
+        };
+
+        template <>
+        struct __MaskFold<4>
+        {
+            static K3D_SIMD_INLINE U64 Or(Mask<4> const& m)
+            {
+                U64 Words[2];
+                memcpy(Words, &m.V, sizeof(Words));
+                return Words[0] | Words[1];
+            }
+
+            static K3D_SIMD_INLINE U64 And(Mask<4> const& m)
+            {
+                U64 Words[2];
+                memcpy(Words, &m.V, sizeof(Words));
+                return Words[0] & Words[1];
+            }
+        };
+
+        template <>
+        struct __MaskFold<1>
+        {
+            static K3D_SIMD_INLINE U64 Or(Mask<1> const& m)
+            {
+                return (U32)m.V[0];
+            }
+
+            static K3D_SIMD_INLINE U64 And(Mask<1> const& m)
+            {
+                return m.V[0] ? ~0ull : 0;
+            }
+        };
+
+        template <U32 N>
+        K3D_SIMD_INLINE bool Any(Mask<N> const& m)
+        {
+            return __MaskFold<N>::Or(m) != 0;
+        }
+
+        template <U32 N>
+        K3D_SIMD_INLINE bool All(Mask<N> const& m)
+        {
+            return __MaskFold<N>::And(m) == ~0ull;
+        }
+
+        /// lanes added in order, lane 0 first
+        template <typename T, U32 N>
+        K3D_SIMD_INLINE T ReduceAdd(Vec<T, N> const& a)
+        {
+            T Sum = a.V[0];
+            for (U32 i = 1; i < N; i++)
+                Sum += a.V[i];
+            return Sum;
+        }
+
+        template <typename T, U32 N>
+        K3D_SIMD_INLINE T ReduceMin(Vec<T, N> const& a)
+        {
+            T Value = a.V[0];
+            for (U32 i = 1; i < N; i++)
+                Value = a.V[i] < Value ? a.V[i] : Value;
+            return Value;
+        }
+
+        template <typename T, U32 N>
+        K3D_SIMD_INLINE T ReduceMax(Vec<T, N> const& a)
+        {
+            T Value = a.V[0];
+            for (U32 i = 1; i < N; i++)
+                Value = a.V[i] > Value ? a.V[i] : Value;
+            return Value;
+        }
+    }
+}
+
+#endif
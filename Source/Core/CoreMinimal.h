@@ -216,6 +216,7 @@ namespace __intrinsics__
 
 #include "Base/Types.h"
 #include "Base/Simd.h"
+#include "Base/SimdVec.h"
 #include "Base/IO.h"
 #include "Base/Memory.h"
 
@@ -235,14 +236,20 @@ namespace __intrinsics__
 
 #include "Base/Module.h"
 #include "Base/Log.h"
+#include "Base/Hash.h"
 #include "Base/Encoder.h"
+#include "Base/Compression.h"
 #include "Base/Regex.h"
 #include "Base/Profiler/Profiler.h"
 
 #include "XPlatform/App.h"
 #include "XPlatform/Os.h"
+#include "XPlatform/Timer.h"
 #include "XPlatform/Window.h"
 
+#include "Base/AssetManager.h"
+#include "Base/FileIndex.h"
+
 #include "KTL/LockFreeQueue.h"
 
 #include "Net/Net.h"
@@ -48,6 +48,28 @@ namespace k3d
 
     extern K3D_CORE_API IAllocatorAdapter& GetDefaultAllocator();
 
+    /**
+     * Hands out fixed size blocks carved from larger chunks, freed blocks are
+     * recycled through a free list. Thread safe, chunks are released on destruction.
+     */
+    class K3D_CORE_API PoolAllocator : public IAllocatorAdapter
+    {
+    public:
+        PoolAllocator(size_t BlockSize, size_t BlocksPerChunk = 64, const char* Name = "PoolAllocator");
+        ~PoolAllocator() override;
+
+        /// requests larger than the block size go to the default allocator
+        void*       Alloc(size_t SzToAlloc, int Alignment = 0, int AlignOffset = 0, int Flags = 0, const char* AllocInfo = nullptr) override;
+        void        DeAlloc(void* Ptr) override;
+        const char* GetName() const override;
+
+        size_t      GetBlockSize() const;
+        size_t      GetUsedCount() const;
+
+    private:
+        struct PoolAllocatorPrivate* d;
+    };
+
 	class kAllocator
 	{
 	public:
@@ -3,47 +3,69 @@
 
 namespace k3d
 {
+    /**
+     * Serializes through a BufferedReader/BufferedWriter over the device, so an
+     * Archive is meant for either reading or writing. Call FlushCurrentCache before
+     * closing the device, written data is otherwise only pushed on destruction.
+     */
     class K3D_CORE_API Archive {
     public:
         Archive() : Handler(nullptr) {}
         virtual ~Archive() {}
         
-        void SetIODevice(IIODevice * ioHandler) {
+        /// \param bufferSize 0 reads and writes the device unbuffered
+        void SetIODevice(IIODevice * ioHandler, size_t bufferSize = BufferedWriter::kDefaultBufferSize) {
+            Writer.Attach(bufferSize ? ioHandler : nullptr, bufferSize);
+            Reader.Attach(bufferSize ? ioHandler : nullptr, bufferSize);
             Handler = ioHandler;
         }
+
+        /// buffered input, Peek/Consume read serialized data in place
+        BufferedReader & GetReader() {
+            return Reader;
+        }
         
         template <typename T>
         Archive & operator >> (T & data) {
             assert(std::is_pointer<T>::value != true && "cannot be serialize, not a pod class!!");
-            Handler->Read((char*)&data, sizeof(T));
+            Input()->Read((char*)&data, sizeof(T));
             return *this;
         }
         
         template <typename T>
         Archive & operator << (const T data) {
             assert(std::is_pointer<T>::value != true && "cannot be serialize, not a pod class!!");
-            Handler->Write((U8*)&data, sizeof(T));
+            Output()->Write((U8*)&data, sizeof(T));
             return *this;
         }
         
         template <typename T>
         void ArrayIn(T *dataArray, size_t elemCount) {
             assert(std::is_pointer<T>::value != true && "ArrayIn Error: not a pod class");
-            Handler->Write((U8*)dataArray, elemCount*sizeof(T));
+            Output()->Write((U8*)dataArray, elemCount*sizeof(T));
         }
         
         template <typename T>
         void ArrayOut(T *dataArray, size_t elemCount) {
             assert(std::is_pointer<T>::value != true && "ArrayOut Error: not a pod class");
-            Handler->Read((char*)dataArray, elemCount*sizeof(T));
+            Input()->Read((char*)dataArray, elemCount*sizeof(T));
         }
         
         virtual void FlushCurrentCache() {
-            Handler->Flush();
+            Output()->Flush();
         }
         
     protected:
+        IIODevice* Input() {
+            return Reader.GetDevice() ? (IIODevice*)&Reader : Handler;
+        }
+
+        IIODevice* Output() {
+            return Writer.GetDevice() ? (IIODevice*)&Writer : Handler;
+        }
         
         IIODevice* Handler;
+        BufferedReader Reader;
+        BufferedWriter Writer;
     };
 }
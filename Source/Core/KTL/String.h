@@ -189,6 +189,12 @@ KFORCE_INLINE void StringBase<BaseChar, Allocator>::Deallocate()
 template <typename BaseChar, typename Allocator>
 KFORCE_INLINE void StringBase<BaseChar, Allocator>::MoveAssign(StringBase<BaseChar, Allocator> && rhs)
 {
+    if (this == &rhs)
+        return;
+    if (m_pStringData)
+    {
+        Deallocate();
+    }
     m_pStringData = rhs.m_pStringData;
     m_StringLength = rhs.m_StringLength;
     m_Capacity = rhs.m_Capacity;
@@ -258,7 +264,7 @@ template <typename BaseChar, typename Allocator>
 StringBase<BaseChar, Allocator>
 StringBase<BaseChar, Allocator>::Format(const BaseChar *fmt, ...)
 {
-    static BaseChar Buffer[16] = { 0 };
+    BaseChar Buffer[16] = { 0 };
     va_list va;
     va_start(va, fmt);
     int PreAllocLength = Vsnprintf(Buffer, 16, fmt, va);
@@ -584,6 +590,23 @@ typedef StringBase<char, kAllocator> String;
 
 extern K3D_CORE_API String Base64Encode(String const & in);
 extern K3D_CORE_API String Base64Decode(String const& in);
+
+/// padded text length of Size bytes
+inline size_t Base64EncodedLength(size_t Size) { return (Size + 2) / 3 * 4; }
+/// room Base64Decode needs for Size characters
+inline size_t Base64DecodedCapacity(size_t Size) { return Size / 4 * 3 + 2; }
+/**
+ * Writes the padded text of Data to Out, which holds Base64EncodedLength(Size)
+ * characters, without terminator. Runs 24 bytes a step with AVX2, 12 with SSSE3,
+ * 48 with NEON, picked by the CPU at run time. \return characters written
+ */
+extern K3D_CORE_API size_t Base64Encode(const void* Data, size_t Size, char* Out);
+/**
+ * Decodes Text up to its padding, or its first character outside the alphabet,
+ * into Out, which holds Base64DecodedCapacity(Size) bytes; the vector paths may
+ * scribble past the result within that room. \return bytes written
+ */
+extern K3D_CORE_API size_t Base64Decode(const char* Text, size_t Size, void* Out);
 extern K3D_CORE_API String MD5Encode(String const& in);
 }
 
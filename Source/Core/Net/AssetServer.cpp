@@ -0,0 +1,282 @@
+#include "CoreMinimal.h"
+#include "Base/Platform.h"
+#include "Net/HttpUtil.h"
+
+#include <string>
+
+namespace k3d
+{
+    namespace net
+    {
+        // a request head past this size is refused
+        static const size_t kMaxRequestHead = 16 * 1024;
+
+        struct AssetStat
+        {
+            U64 Size;
+            /// seconds since the epoch
+            U64 ModifiedTime;
+        };
+
+        static bool StatRegularFile(const char* Path, AssetStat& Stat)
+        {
+#if K3DPLATFORM_OS_WINDOWS
+            WIN32_FILE_ATTRIBUTE_DATA Data;
+            if (!::GetFileAttributesExA(Path, GetFileExInfoStandard, &Data) ||
+                (Data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+                return false;
+            Stat.Size = ((U64)Data.nFileSizeHigh << 32) | Data.nFileSizeLow;
+            U64 Time = ((U64)Data.ftLastWriteTime.dwHighDateTime << 32) | Data.ftLastWriteTime.dwLowDateTime;
+            Stat.ModifiedTime = (Time - 116444736000000000ull) / 10000000ull;
+#else
+            struct stat Info;
+            if (::stat(Path, &Info) != 0 || !S_ISREG(Info.st_mode))
+                return false;
+            Stat.Size = (U64)Info.st_size;
+            Stat.ModifiedTime = (U64)Info.st_mtime;
+#endif
+            return true;
+        }
+
+        static int HexValue(char c)
+        {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        }
+
+        /// percent-decoded path without the query, false if it could leave the root
+        static bool DecodeTarget(std::string const& Target, std::string& Path)
+        {
+            Path.clear();
+            if (Target.empty() || Target[0] != '/')
+                return false;
+            for (size_t i = 0; i < Target.size() && Target[i] != '?' && Target[i] != '#'; i++)
+            {
+                char c = Target[i];
+                if (c == '%')
+                {
+                    int High = i + 2 < Target.size() ? HexValue(Target[i + 1]) : -1;
+                    int Low = i + 2 < Target.size() ? HexValue(Target[i + 2]) : -1;
+                    if (High < 0 || Low < 0)
+                        return false;
+                    c = (char)(High * 16 + Low);
+                    i += 2;
+                }
+                if (c == '\0' || c == '\\')
+                    return false;
+                Path.push_back(c);
+            }
+            // no segment may climb out of the root
+            for (size_t Begin = 0; Begin < Path.size();)
+            {
+                size_t End = Path.find('/', Begin + 1);
+                if (End == std::string::npos)
+                    End = Path.size();
+                if (Path.compare(Begin, End - Begin, "/..") == 0)
+                    return false;
+                Begin = End;
+            }
+            return Path.size() > 1;
+        }
+
+        enum RangeResult
+        {
+            RangeNone,
+            RangeValid,
+            RangeUnsatisfiable,
+        };
+
+        /// single "bytes=First-Last", "bytes=First-" or "bytes=-Suffix" ranges only
+        static RangeResult ParseRange(std::string const& Value, U64 Size, U64& First, U64& Last)
+        {
+            if (Value.compare(0, 6, "bytes=") != 0 || Value.find(',') != std::string::npos)
+                return RangeNone;
+            const char* Spec = Value.c_str() + 6;
+            char* End = nullptr;
+            if (*Spec == '-')
+            {
+                U64 Suffix = strtoull(Spec + 1, &End, 10);
+                if (End == Spec + 1 || *End)
+                    return RangeNone;
+                if (!Suffix || !Size)
+                    return RangeUnsatisfiable;
+                First = Suffix < Size ? Size - Suffix : 0;
+                Last = Size - 1;
+                return RangeValid;
+            }
+            First = strtoull(Spec, &End, 10);
+            if (End == Spec || *End != '-')
+                return RangeNone;
+            const char* LastSpec = End + 1;
+            Last = *LastSpec ? strtoull(LastSpec, &End, 10) : Size - 1;
+            if (*LastSpec && *End)
+                return RangeNone;
+            if (First >= Size)
+                return RangeUnsatisfiable;
+            if (Last >= Size)
+                Last = Size - 1;
+            return First <= Last ? RangeValid : RangeNone;
+        }
+
+        struct AssetServerPrivate : public os::IConnectionHandler
+        {
+            AssetServerPrivate(os::Reactor* InLoop, const char* InRoot)
+                : Loop(InLoop), Root(InRoot ? InRoot : "."), Requests(0), BytesServed(0)
+            {
+                while (Root.size() > 1 && (Root.back() == '/' || Root.back() == '\\'))
+                    Root.pop_back();
+            }
+
+            void OnReceived(os::Connection* Conn) override
+            {
+                // pipelined requests are answered in order, their responses queue up
+                while (Conn->IsConnected() && Serve(Conn))
+                {
+                }
+            }
+
+            /// answers one complete request, false when more input is needed
+            bool Serve(os::Connection* Conn)
+            {
+                const char* Head = (const char*)Conn->GetInput();
+                size_t Size = (size_t)Conn->GetInputSize();
+                size_t HeadSize = FindHttpHeadEnd(Head, Size < kMaxRequestHead ? Size : kMaxRequestHead);
+                if (!HeadSize)
+                {
+                    if (Size >= kMaxRequestHead)
+                        Reply(Conn, 431, "Request Header Fields Too Large", false);
+                    return false;
+                }
+
+                size_t LineEnd = std::string(Head, HeadSize).find("\r\n");
+                std::string Line(Head, LineEnd);
+                size_t Space1 = Line.find(' ');
+                size_t Space2 = Space1 == std::string::npos ? Space1 : Line.find(' ', Space1 + 1);
+                if (Space2 == std::string::npos)
+                {
+                    Reply(Conn, 400, "Bad Request", false);
+                    return false;
+                }
+                std::string Method = Line.substr(0, Space1);
+                std::string Target = Line.substr(Space1 + 1, Space2 - Space1 - 1);
+                std::string Version = Line.substr(Space2 + 1);
+
+                std::string ConnectionField, Range, IfNoneMatch;
+                bool HasConnection = FindHttpHeader(Head, HeadSize, "connection", ConnectionField);
+                bool HasRange = FindHttpHeader(Head, HeadSize, "range", Range);
+                bool HasIfNoneMatch = FindHttpHeader(Head, HeadSize, "if-none-match", IfNoneMatch);
+                // HTTP/1.1 keeps the connection unless told otherwise, 1.0 only when asked
+                bool KeepAlive = Version == "HTTP/1.1"
+                    ? !(HasConnection && HasHttpToken(ConnectionField, "close"))
+                    : HasConnection && HasHttpToken(ConnectionField, "keep-alive");
+                Conn->Consume(HeadSize);
+                Requests++;
+
+                bool IsHead = Method == "HEAD";
+                if (!IsHead && Method != "GET")
+                    return Reply(Conn, 405, "Method Not Allowed", KeepAlive, "Allow: GET, HEAD\r\n");
+                std::string Path;
+                if (!DecodeTarget(Target, Path))
+                    return Reply(Conn, 404, "Not Found", KeepAlive);
+                std::string FullPath = Root + Path;
+                AssetStat Stat;
+                os::File File;
+                if (!StatRegularFile(FullPath.c_str(), Stat) || !File.Open(FullPath.c_str(), IOFlag::Read))
+                    return Reply(Conn, 404, "Not Found", KeepAlive);
+
+                char ETag[48], Date[40], Headers[256];
+                snprintf(ETag, sizeof(ETag), "\"%llx-%llx\"", (unsigned long long)Stat.Size,
+                    (unsigned long long)Stat.ModifiedTime);
+                FormatHttpDate(Stat.ModifiedTime, Date, sizeof(Date));
+                if (HasIfNoneMatch && (IfNoneMatch == ETag || IfNoneMatch == "*"))
+                {
+                    snprintf(Headers, sizeof(Headers), "ETag: %s\r\nLast-Modified: %s\r\n", ETag, Date);
+                    return Reply(Conn, 304, "Not Modified", KeepAlive, Headers, true);
+                }
+
+                U64 First = 0, Last = Stat.Size ? Stat.Size - 1 : 0;
+                RangeResult Ranged = HasRange ? ParseRange(Range, Stat.Size, First, Last) : RangeNone;
+                if (Ranged == RangeUnsatisfiable)
+                {
+                    snprintf(Headers, sizeof(Headers), "Content-Range: bytes */%llu\r\n",
+                        (unsigned long long)Stat.Size);
+                    return Reply(Conn, 416, "Range Not Satisfiable", KeepAlive, Headers);
+                }
+                U64 Length = Stat.Size ? Last - First + 1 : 0;
+
+                std::string Response;
+                Response.reserve(384);
+                Response += Ranged == RangeValid ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n";
+                snprintf(Headers, sizeof(Headers),
+                    "Content-Length: %llu\r\nContent-Type: application/octet-stream\r\n"
+                    "Accept-Ranges: bytes\r\nETag: %s\r\nLast-Modified: %s\r\n",
+                    (unsigned long long)Length, ETag, Date);
+                Response += Headers;
+                if (Ranged == RangeValid)
+                {
+                    snprintf(Headers, sizeof(Headers), "Content-Range: bytes %llu-%llu/%llu\r\n",
+                        (unsigned long long)First, (unsigned long long)Last, (unsigned long long)Stat.Size);
+                    Response += Headers;
+                }
+                Response += KeepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+                Conn->Send(Response.data(), Response.size());
+                if (!IsHead && Length)
+                {
+                    Conn->SendFile(File, First, Length);
+                    BytesServed += Length;
+                }
+                if (!KeepAlive)
+                    Conn->Close();
+                return KeepAlive;
+            }
+
+            /// a response without a file body, returns KeepAlive
+            bool Reply(os::Connection* Conn, int Status, const char* Reason, bool KeepAlive,
+                const char* Extra = "", bool NoBody = false)
+            {
+                char Response[512];
+                int Body = NoBody ? 0 : (int)strlen(Reason);
+                int Size = snprintf(Response, sizeof(Response),
+                    "HTTP/1.1 %d %s\r\n%sContent-Length: %d\r\nContent-Type: text/plain\r\nConnection: %s\r\n\r\n%s",
+                    Status, Reason, Extra, Body, KeepAlive ? "keep-alive" : "close", NoBody ? "" : Reason);
+                Conn->Send(Response, (U64)Size);
+                if (!KeepAlive)
+                    Conn->Close();
+                return KeepAlive;
+            }
+
+            os::Reactor*        Loop;
+            std::string         Root;
+            std::atomic<U64>    Requests;
+            std::atomic<U64>    BytesServed;
+        };
+
+        AssetServer::AssetServer(os::Reactor* Loop, const char* Root)
+            : d(new AssetServerPrivate(Loop, Root))
+        {
+        }
+
+        AssetServer::~AssetServer()
+        {
+            delete d;
+            d = nullptr;
+        }
+
+        I32 AssetServer::Listen(os::IpAddress const& Address)
+        {
+            return d->Loop->Listen(Address, d);
+        }
+
+        U64 AssetServer::GetRequestCount() const
+        {
+            return d->Requests.load();
+        }
+
+        U64 AssetServer::GetBytesServed() const
+        {
+            return d->BytesServed.load();
+        }
+    }
+}
@@ -0,0 +1,339 @@
+#include "CoreMinimal.h"
+#include "Base/FileIndex.h"
+#include "Net/HttpUtil.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace k3d
+{
+    namespace net
+    {
+        static const U32 kProgressMagic = 0x4C44334B; // "K3DL"
+        // 2: ranges hashed with Hash64
+        static const U32 kProgressVersion = 2;
+        // a range failing its expected hash is fetched this many times
+        static const U32 kMaxRangeAttempts = 2;
+        static const U32 kProgressIntervalMs = 100;
+
+        /// "<Path>.part" is this header followed by one record per range
+        struct ProgressHeader
+        {
+            U32 Magic;
+            U32 Version;
+            U64 Total;
+            U64 RangeSize;
+            /// hash of the url and the validator the ranges were fetched under
+            U64 Source;
+            U32 RangeCount;
+            U32 Reserved;
+        };
+
+        struct ProgressRecord
+        {
+            U64 Hash;
+            U32 Done;
+            U32 Reserved;
+        };
+
+        /// lays the body of one range at its place in the mapped file, refuses any byte past it
+        struct RangeSink : public IIODevice
+        {
+            RangeSink(U8* InTarget, U64 InCapacity, std::atomic<U64>& InReceived)
+                : Target(InTarget), Capacity(InCapacity), Written(0), Received(InReceived) {}
+
+            bool      Open(const char*, IOFlag) override { return true; }
+            bool      IsEOF() override { return Written == Capacity; }
+            size_t    Read(char*, size_t) override { return 0; }
+            size_t    Write(const void* Data, size_t Size) override
+            {
+                if (Size > Capacity - Written)
+                    return 0;
+                memcpy(Target + Written, Data, Size);
+                Written += Size;
+                Received.fetch_add(Size);
+                return Size;
+            }
+            bool      Seek(size_t) override { return false; }
+            bool      Skip(size_t) override { return false; }
+            void      Flush() override {}
+            void      Close() override {}
+
+            U8*                 Target;
+            U64                 Capacity;
+            U64                 Written;
+            std::atomic<U64>&   Received;
+        };
+
+        struct DownloaderPrivate
+        {
+            explicit DownloaderPrivate(HttpClient* InClient)
+                : Client(InClient), RangeSize(4 * 1024 * 1024), Parallelism(4)
+                , Progress(nullptr), ProgressData(nullptr)
+                , Total(0), RangeCount(0), Data(nullptr), Records(nullptr)
+                , Received(0), Resumed(0), Cancelled(false), Failed(false)
+            {
+            }
+
+            bool Download(const char* InUrl, const char* Path);
+            /// a server without byte ranges, the body goes to Path as it comes
+            bool DownloadWhole(const char* Path);
+            /// takes the recorded range if its bytes still match, otherwise fetches it
+            void RunRange(U32 Index);
+            bool FetchRange(U64 First, U64 Length);
+            bool Matches(U32 Index, U64 Hash) const
+            {
+                return Index >= Expected.size() || Expected[Index] == Hash;
+            }
+            void Report(U64& LastReceived, U64& LastTime, bool Final, U64 StartTime);
+
+            HttpClient*             Client;
+            U64                     RangeSize;
+            U32                     Parallelism;
+            PFN_DownloadProgress    Progress;
+            void*                   ProgressData;
+            std::vector<U64>        Expected;
+
+            // state of the Download in progress
+            std::string             Url;
+            std::string             Validator;
+            U64                     Total;
+            U32                     RangeCount;
+            U8*                     Data;
+            ProgressRecord*         Records;
+            std::atomic<U64>        Received;
+            std::atomic<U64>        Resumed;
+            std::atomic<bool>       Cancelled;
+            std::atomic<bool>       Failed;
+        };
+
+        bool DownloaderPrivate::Download(const char* InUrl, const char* Path)
+        {
+            Url = InUrl ? InUrl : "";
+            Validator.clear();
+            Total = 0;
+            RangeCount = 0;
+            Received = 0;
+            Resumed = 0;
+            Failed = false;
+
+            HttpResponse Head = Client->Fetch(HttpRequest("HEAD", Url.c_str()));
+            if (Head.Status != 200)
+                return false;
+            String Length, Ranges, Value;
+            bool HasLength = Head.GetHeader("content-length", Length);
+            if (!HasLength || !Head.GetHeader("accept-ranges", Ranges) || !HasHttpToken(Ranges.CStr(), "bytes"))
+                return DownloadWhole(Path);
+            Total = strtoull(Length.CStr(), nullptr, 10);
+            // a strong ETag names the exact bytes, Last-Modified is a weaker fallback
+            if (Head.GetHeader("etag", Value) && Value.Length() && strncmp(Value.CStr(), "W/", 2) != 0)
+                Validator.assign(Value.CStr(), Value.Length());
+            else if (Head.GetHeader("last-modified", Value) && Value.Length())
+                Validator.assign(Value.CStr(), Value.Length());
+
+            std::string PartPath = std::string(Path) + ".part";
+            if (!Total)
+            {
+                // opening for write keeps what a previous file had
+                os::Remove(Path);
+                os::File Empty;
+                if (!Empty.Open(Path, IOFlag::Write))
+                    return false;
+                Empty.Close();
+                os::Remove(PartPath.c_str());
+                return true;
+            }
+            RangeCount = (U32)((Total + RangeSize - 1) / RangeSize);
+
+            // both files are mapped whole and written in place, the records go out with
+            // the page cache even when the process dies
+            os::MemMapFile Journal;
+            U64 JournalSize = sizeof(ProgressHeader) + (U64)RangeCount * sizeof(ProgressRecord);
+            if (!Journal.Open(PartPath.c_str(), IOFlag::Write) || !Journal.Resize(JournalSize))
+                return false;
+            U8* JournalData = Journal.MapRange(0, (size_t)JournalSize);
+            if (!JournalData)
+                return false;
+            std::string Source = Url + "\n" + Validator;
+            ProgressHeader Header = { kProgressMagic, kProgressVersion, Total, RangeSize,
+                FileIndex::HashContent(Source.data(), Source.size()), RangeCount, 0 };
+            if (memcmp(JournalData, &Header, sizeof(Header)) != 0)
+            {
+                memset(JournalData, 0, (size_t)JournalSize);
+                memcpy(JournalData, &Header, sizeof(Header));
+            }
+            Records = (ProgressRecord*)(JournalData + sizeof(ProgressHeader));
+
+            os::MemMapFile Target;
+            if (!Target.Open(Path, IOFlag::Write) || !Target.Resize(Total) ||
+                !(Data = Target.MapRange(0, (size_t)Total)))
+                return false;
+
+            os::JobCounter Pending;
+            {
+                os::ThreadPool Workers(Parallelism, "Download");
+                for (U32 i = 0; i < RangeCount; i++)
+                    Workers.Enqueue([this, i]() { RunRange(i); }, os::TaskPriority::Normal, &Pending);
+                U64 StartTime = os::Clock::NowNs(), LastTime = StartTime, LastReceived = 0;
+                while (!Pending.Wait(kProgressIntervalMs))
+                    Report(LastReceived, LastTime, false, StartTime);
+                Report(LastReceived, LastTime, true, StartTime);
+            }
+            Data = nullptr;
+            Records = nullptr;
+
+            bool Complete = !Failed && !Cancelled;
+            Target.Close();
+            Journal.Close();
+            if (Complete)
+                os::Remove(PartPath.c_str());
+            return Complete;
+        }
+
+        bool DownloaderPrivate::DownloadWhole(const char* Path)
+        {
+            // opening for write doesn't truncate, a longer old file would keep its tail
+            os::Remove(Path);
+            os::File Target;
+            if (!Target.Open(Path, IOFlag::Write))
+                return false;
+            HttpResponse Response = Client->Fetch(HttpRequest("GET", Url.c_str()), &Target);
+            Target.Close();
+            std::string PartPath = std::string(Path) + ".part";
+            os::Remove(PartPath.c_str());
+            return Response.Status == 200;
+        }
+
+        void DownloaderPrivate::RunRange(U32 Index)
+        {
+            U64 First = (U64)Index * RangeSize;
+            U64 Length = First + RangeSize < Total ? RangeSize : Total - First;
+            ProgressRecord& Record = Records[Index];
+            if (Record.Done)
+            {
+                U64 Hash = FileIndex::HashContent(Data + First, (size_t)Length);
+                if (Hash == Record.Hash && Matches(Index, Hash))
+                {
+                    Resumed.fetch_add(Length);
+                    return;
+                }
+                Record.Done = 0;
+            }
+            for (U32 Attempt = 0; Attempt < kMaxRangeAttempts; Attempt++)
+            {
+                if (Cancelled || Failed)
+                    return;
+                if (!FetchRange(First, Length))
+                    break;
+                U64 Hash = FileIndex::HashContent(Data + First, (size_t)Length);
+                if (Matches(Index, Hash))
+                {
+                    Record.Hash = Hash;
+                    Record.Done = 1;
+                    return;
+                }
+                Received.fetch_sub(Length);
+            }
+            Failed = true;
+        }
+
+        bool DownloaderPrivate::FetchRange(U64 First, U64 Length)
+        {
+            char Range[64];
+            snprintf(Range, sizeof(Range), "bytes=%llu-%llu", (unsigned long long)First,
+                (unsigned long long)(First + Length - 1));
+            HttpRequest Request("GET", Url.c_str());
+            Request.AddHeader("Range", Range);
+            // a changed resource comes back whole as 200 instead of mixing versions
+            if (!Validator.empty())
+                Request.AddHeader("If-Range", Validator.c_str());
+            RangeSink Sink(Data + First, Length, Received);
+            HttpResponse Response = Client->Fetch(Request, &Sink);
+
+            String ContentRange;
+            if (Response.Status == 206 && Sink.Written == Length && Response.GetHeader("content-range", ContentRange))
+            {
+                unsigned long long RangeFirst = 0, RangeLast = 0, RangeTotal = 0;
+                if (sscanf(ContentRange.CStr(), "bytes %llu-%llu/%llu", &RangeFirst, &RangeLast, &RangeTotal) == 3 &&
+                    RangeFirst == First && RangeLast == First + Length - 1 && RangeTotal == Total)
+                    return true;
+            }
+            Received.fetch_sub(Sink.Written);
+            return false;
+        }
+
+        void DownloaderPrivate::Report(U64& LastReceived, U64& LastTime, bool Final, U64 StartTime)
+        {
+            if (!Progress)
+                return;
+            U64 Now = os::Clock::NowNs();
+            U64 Fetched = Received.load();
+            // the periodic reports show the current rate, the last one the average
+            U64 Bytes = Final ? Fetched : Fetched - LastReceived;
+            U64 Elapsed = Now - (Final ? StartTime : LastTime);
+            float KBPerSecond = Elapsed ? (float)((double)Bytes * 1e9 / 1024.0 / (double)Elapsed) : 0.0f;
+            LastReceived = Fetched;
+            LastTime = Now;
+            Progress(Fetched + Resumed.load(), Total, KBPerSecond, ProgressData);
+        }
+
+        Downloader::Downloader(HttpClient* Client)
+            : d(new DownloaderPrivate(Client))
+        {
+        }
+
+        Downloader::~Downloader()
+        {
+            delete d;
+            d = nullptr;
+        }
+
+        void Downloader::SetRangeSize(U64 Bytes)
+        {
+            d->RangeSize = Bytes ? Bytes : 1;
+        }
+
+        void Downloader::SetParallelism(U32 Count)
+        {
+            d->Parallelism = Count ? Count : 1;
+        }
+
+        void Downloader::SetProgressCallback(PFN_DownloadProgress Callback, void* UserData)
+        {
+            d->Progress = Callback;
+            d->ProgressData = UserData;
+        }
+
+        void Downloader::SetExpectedHashes(const U64* Hashes, U32 Count)
+        {
+            d->Expected.assign(Hashes, Hashes + Count);
+        }
+
+        bool Downloader::Download(const char* Url, const char* Path)
+        {
+            d->Cancelled = false;
+            return d->Download(Url, Path);
+        }
+
+        void Downloader::Cancel()
+        {
+            d->Cancelled = true;
+        }
+
+        U64 Downloader::GetTotalSize() const
+        {
+            return d->Total;
+        }
+
+        U64 Downloader::GetResumedBytes() const
+        {
+            return d->Resumed.load();
+        }
+
+        U32 Downloader::GetRangeCount() const
+        {
+            return d->RangeCount;
+        }
+    }
+}
@@ -0,0 +1,508 @@
+#include "CoreMinimal.h"
+#include "Base/Compression.h"
+#include "Base/FileIndex.h"
+#include "Net/HttpUtil.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace k3d
+{
+    namespace net
+    {
+        static const U32 kCacheMagic = 0x4348334B; // "K3HC"
+        // 2: keys hashed with Hash64
+        static const U32 kCacheVersion = 2;
+        // a body is compressed when this much of its start shrinks below 7/8
+        static const size_t kCompressProbe = 64 * 1024;
+        static const U32 kEntryCompressed = 1;
+        // stores write the index at most this often, the rest waits for the next one or the destructor
+        static const U64 kSaveIntervalNs = 1000000000ull;
+
+        /// "<Directory>/index" is this header followed by the records, each trailed by its url and head
+        struct CacheIndexHeader
+        {
+            U32 Magic;
+            U32 Version;
+            U32 EntryCount;
+            U32 Reserved;
+            U64 Clock;
+        };
+
+        struct CacheIndexRecord
+        {
+            U64 UrlHash;
+            U64 BodySize;
+            U64 StoredSize;
+            U64 LastUsed;
+            U32 Flags;
+            U32 UrlLength;
+            U32 HeadLength;
+            U32 Reserved;
+        };
+
+        struct CacheEntry
+        {
+            std::string Url;
+            /// head of the 200 the body came with, holds the validators
+            std::string Head;
+            U64         BodySize;
+            U64         StoredSize;
+            U64         LastUsed;
+            U32         Flags;
+        };
+
+        struct HttpCacheBodyPrivate
+        {
+            HttpCacheBodyPrivate() : Data(nullptr), Size(0), FromCache(false) {}
+
+            void Reset()
+            {
+                Mapped.Close();
+                Buffer.clear();
+                Fetched = String();
+                Data = nullptr;
+                Size = 0;
+                FromCache = false;
+            }
+
+            /// the raw entry, or the device a compressed one is decoded from
+            os::MemMapFile  Mapped;
+            std::vector<U8> Buffer;
+            /// a body that just came from the server
+            String          Fetched;
+            const U8*       Data;
+            U64             Size;
+            bool            FromCache;
+        };
+
+        static bool HeaderValue(std::string const& Head, const char* Name, std::string& Value)
+        {
+            return !Head.empty() && FindHttpHeader(Head.data(), Head.size(), Name, Value);
+        }
+
+        struct HttpCachePrivate
+        {
+            HttpCachePrivate(HttpClient* InClient, const char* InDirectory)
+                : Client(InClient), MaxSize(256ull * 1024 * 1024), Clock(0), Size(0), Dirty(false), LastSave(0), Serial(0)
+            {
+                if (InDirectory)
+                    Directory = InDirectory;
+                else
+                {
+                    String DataDir = GetEnv().GetDataDir();
+                    if (DataDir.Length())
+                        Directory.assign(DataDir.CStr(), DataDir.Length()).append("/");
+                    Directory += "HttpCache";
+                }
+                while (Directory.size() > 1 && (Directory.back() == '/' || Directory.back() == '\\'))
+                    Directory.pop_back();
+                os::MakeDir(Directory.c_str());
+                Load();
+            }
+
+            ~HttpCachePrivate()
+            {
+                if (Dirty)
+                    Save();
+            }
+
+            std::string EntryPath(U64 Key) const
+            {
+                char Name[24];
+                snprintf(Name, sizeof(Name), "/%016llx", (unsigned long long)Key);
+                return Directory + Name;
+            }
+
+            HttpResponse Get(HttpRequest const& Request, HttpCacheBodyPrivate& Body);
+            /// maps the entry file into Body, Lock held
+            bool Open(U64 Key, CacheEntry const& Entry, HttpCacheBodyPrivate& Body);
+            /// decodes a compressed entry opened by Open, without the Lock
+            bool Decode(CacheEntry const& Entry, HttpCacheBodyPrivate& Body);
+            void Store(U64 Key, std::string const& Url, HttpResponse const& Response);
+            /// Lock held for the rest
+            void Drop(U64 Key);
+            void Evict(U64 Keep);
+            bool Load();
+            bool Save();
+
+            HttpClient*                             Client;
+            std::string                             Directory;
+            U64                                     MaxSize;
+            os::Mutex                               Lock;
+            std::unordered_map<U64, CacheEntry>     Entries;
+            /// ticks on every use, orders the entries for eviction
+            U64                                     Clock;
+            U64                                     Size;
+            bool                                    Dirty;
+            U64                                     LastSave;
+            std::atomic<U32>                        Serial;
+        };
+
+        HttpResponse HttpCachePrivate::Get(HttpRequest const& Request, HttpCacheBodyPrivate& Body)
+        {
+            Body.Reset();
+            std::string Url(Request.Url.Length() ? Request.Url.CStr() : "", (size_t)Request.Url.Length());
+            U64 Key = FileIndex::HashContent(Url.data(), Url.size());
+            CacheEntry Cached;
+            bool HasEntry = false;
+            {
+                os::Mutex::AutoLock Guard(&Lock);
+                auto It = Entries.find(Key);
+                if (It != Entries.end() && It->second.Url == Url)
+                {
+                    Cached = It->second;
+                    HasEntry = true;
+                }
+            }
+
+            HttpRequest Conditional = Request;
+            std::string ETag, Modified;
+            if (HasEntry && HeaderValue(Cached.Head, "etag", ETag))
+                Conditional.AddHeader("If-None-Match", ETag.c_str());
+            if (HasEntry && HeaderValue(Cached.Head, "last-modified", Modified))
+                Conditional.AddHeader("If-Modified-Since", Modified.c_str());
+            HttpResponse Response = Client->Fetch(Conditional);
+
+            if (HasEntry && Response.Status == 304)
+            {
+                bool Opened = false;
+                {
+                    os::Mutex::AutoLock Guard(&Lock);
+                    auto It = Entries.find(Key);
+                    // the entry may have been replaced or evicted since it was looked up
+                    if (It != Entries.end() && It->second.Url == Url && It->second.Head == Cached.Head)
+                    {
+                        Opened = Open(Key, It->second, Body);
+                        if (Opened)
+                        {
+                            It->second.LastUsed = ++Clock;
+                            Dirty = true;
+                        }
+                    }
+                }
+                if (Opened && Decode(Cached, Body))
+                {
+                    Response.Status = 200;
+                    Response.Head = String(Cached.Head.data(), Cached.Head.size());
+                    Body.FromCache = true;
+                    return Response;
+                }
+                {
+                    os::Mutex::AutoLock Guard(&Lock);
+                    auto It = Entries.find(Key);
+                    if (It != Entries.end() && It->second.Url == Url)
+                        Drop(Key);
+                }
+                Body.Reset();
+                Response = Client->Fetch(Request);
+            }
+
+            if (Response.Status == 200)
+            {
+                Store(Key, Url, Response);
+                Body.Fetched = std::move(Response.Body);
+                Response.Body = String();
+                Body.Data = (const U8*)Body.Fetched.CStr();
+                Body.Size = Body.Fetched.Length();
+            }
+            else if (HasEntry && (Response.Status == 404 || Response.Status == 410))
+            {
+                os::Mutex::AutoLock Guard(&Lock);
+                auto It = Entries.find(Key);
+                if (It != Entries.end() && It->second.Url == Url)
+                    Drop(Key);
+            }
+            return Response;
+        }
+
+        bool HttpCachePrivate::Open(U64 Key, CacheEntry const& Entry, HttpCacheBodyPrivate& Body)
+        {
+            if (!Entry.BodySize)
+                return true;
+            // the mapping keeps the content alive even if the entry is evicted meanwhile
+            std::string Path = EntryPath(Key);
+            if (!Body.Mapped.Open(Path.c_str(), IOFlag::Read) || (U64)Body.Mapped.GetSize() != Entry.StoredSize)
+                return false;
+            if (!(Entry.Flags & kEntryCompressed))
+            {
+                Body.Data = Body.Mapped.FileData();
+                Body.Size = Entry.BodySize;
+            }
+            return true;
+        }
+
+        bool HttpCachePrivate::Decode(CacheEntry const& Entry, HttpCacheBodyPrivate& Body)
+        {
+            if (!Entry.BodySize || !(Entry.Flags & kEntryCompressed))
+                return true;
+            CompressedStream Reader(&Body.Mapped);
+            if (!Reader.Attach(IOFlag(IOFlag::Read | IOFlag::SnappyCompressed)) || Reader.GetSize() != Entry.BodySize)
+                return false;
+            Body.Buffer.resize((size_t)Entry.BodySize);
+            bool Complete = Reader.Read((char*)Body.Buffer.data(), Body.Buffer.size()) == Body.Buffer.size();
+            Reader.Close();
+            Body.Data = Body.Buffer.data();
+            Body.Size = Entry.BodySize;
+            return Complete;
+        }
+
+        void HttpCachePrivate::Store(U64 Key, std::string const& Url, HttpResponse const& Response)
+        {
+            std::string Head(Response.Head.Length() ? Response.Head.CStr() : "", (size_t)Response.Head.Length());
+            std::string Value;
+            if (HeaderValue(Head, "cache-control", Value) && HasHttpToken(Value, "no-store"))
+                return;
+            if (!HeaderValue(Head, "etag", Value) && !HeaderValue(Head, "last-modified", Value))
+                return;
+            U64 BodySize = Response.Body.Length();
+            if (BodySize > MaxSize / 4)
+                return;
+
+            // written aside and renamed over, a reader never sees half an entry
+            const U8* Data = (const U8*)Response.Body.CStr();
+            std::string Path = EntryPath(Key);
+            char Suffix[24];
+            snprintf(Suffix, sizeof(Suffix), ".tmp%u", Serial.fetch_add(1));
+            std::string Temporary = Path + Suffix;
+            U32 Flags = 0;
+            U64 StoredSize = 0;
+            if (BodySize)
+            {
+                size_t Probe = (size_t)std::min<U64>(BodySize, kCompressProbe);
+                std::vector<U8> Packed(LZCompressBound(Probe));
+                if (LZCompress(Data, Probe, Packed.data(), Packed.size()) * 8 < Probe * 7)
+                    Flags |= kEntryCompressed;
+
+                size_t Written = 0;
+                os::File File;
+                if (Flags & kEntryCompressed)
+                {
+                    CompressedStream Writer(&File, CompressedStream::kDefaultBlockSize, 1);
+                    if (Writer.Open(Temporary.c_str(), IOFlag(IOFlag::Write | IOFlag::SnappyCompressed)))
+                        Written = Writer.Write(Data, (size_t)BodySize);
+                    Writer.Close();
+                    if (File.Open(Temporary.c_str(), IOFlag::Read))
+                        StoredSize = (U64)File.GetSize();
+                }
+                else if (File.Open(Temporary.c_str(), IOFlag::Write))
+                {
+                    BufferedWriter Writer(&File);
+                    Written = Writer.Write(Data, (size_t)BodySize);
+                    Writer.Close();
+                    StoredSize = BodySize;
+                }
+                File.Close();
+                if (Written != BodySize)
+                {
+                    os::Remove(Temporary.c_str());
+                    return;
+                }
+            }
+
+            os::Mutex::AutoLock Guard(&Lock);
+            if (Entries.count(Key))
+                Drop(Key);
+            if (BodySize)
+            {
+                os::Remove(Path.c_str());
+                if (rename(Temporary.c_str(), Path.c_str()) != 0)
+                {
+                    os::Remove(Temporary.c_str());
+                    return;
+                }
+            }
+            CacheEntry& Entry = Entries[Key];
+            Entry.Url = Url;
+            Entry.Head = Head;
+            Entry.BodySize = BodySize;
+            Entry.StoredSize = StoredSize;
+            Entry.LastUsed = ++Clock;
+            Entry.Flags = Flags;
+            Size += StoredSize;
+            Dirty = true;
+            Evict(Key);
+            // a burst of stores rewrites the index once, an entry missed by a crash is only an orphan file
+            U64 Now = os::Clock::NowNs();
+            if (Now - LastSave >= kSaveIntervalNs)
+            {
+                LastSave = Now;
+                Save();
+            }
+        }
+
+        void HttpCachePrivate::Drop(U64 Key)
+        {
+            auto It = Entries.find(Key);
+            if (It == Entries.end())
+                return;
+            if (It->second.BodySize)
+                os::Remove(EntryPath(Key).c_str());
+            Size -= It->second.StoredSize;
+            Entries.erase(It);
+            Dirty = true;
+        }
+
+        void HttpCachePrivate::Evict(U64 Keep)
+        {
+            if (Size <= MaxSize)
+                return;
+            std::vector<std::pair<U64, U64>> Order;
+            Order.reserve(Entries.size());
+            for (auto const& Entry : Entries)
+            {
+                if (Entry.first != Keep)
+                    Order.push_back({ Entry.second.LastUsed, Entry.first });
+            }
+            std::sort(Order.begin(), Order.end());
+            for (size_t i = 0; i < Order.size() && Size > MaxSize; i++)
+                Drop(Order[i].second);
+        }
+
+        bool HttpCachePrivate::Load()
+        {
+            std::string IndexPath = Directory + "/index";
+            os::MemMapFile File;
+            if (!File.Open(IndexPath.c_str(), IOFlag::Read))
+                return false;
+            U64 FileSize = (U64)File.GetSize();
+            const U8* Data = File.FileData();
+            CacheIndexHeader Header;
+            if (FileSize < sizeof(Header))
+                return false;
+            memcpy(&Header, Data, sizeof(Header));
+            if (Header.Magic != kCacheMagic || Header.Version != kCacheVersion)
+                return false;
+            U64 Offset = sizeof(Header);
+            for (U32 i = 0; i < Header.EntryCount; i++)
+            {
+                CacheIndexRecord Record;
+                if (Offset + sizeof(Record) > FileSize)
+                    break;
+                memcpy(&Record, Data + Offset, sizeof(Record));
+                Offset += sizeof(Record);
+                if (Offset + Record.UrlLength + Record.HeadLength > FileSize)
+                    break;
+                // a repeated key would count its stored size twice
+                if (Entries.count(Record.UrlHash))
+                {
+                    Offset += Record.UrlLength + Record.HeadLength;
+                    continue;
+                }
+                CacheEntry& Entry = Entries[Record.UrlHash];
+                Entry.Url.assign((const char*)Data + Offset, Record.UrlLength);
+                Entry.Head.assign((const char*)Data + Offset + Record.UrlLength, Record.HeadLength);
+                Entry.BodySize = Record.BodySize;
+                Entry.StoredSize = Record.StoredSize;
+                Entry.LastUsed = Record.LastUsed;
+                Entry.Flags = Record.Flags;
+                Size += Record.StoredSize;
+                Offset += Record.UrlLength + Record.HeadLength;
+            }
+            Clock = Header.Clock;
+            return true;
+        }
+
+        bool HttpCachePrivate::Save()
+        {
+            std::string Index;
+            CacheIndexHeader Header = { kCacheMagic, kCacheVersion, (U32)Entries.size(), 0, Clock };
+            Index.append((const char*)&Header, sizeof(Header));
+            for (auto const& It : Entries)
+            {
+                CacheEntry const& Entry = It.second;
+                CacheIndexRecord Record = { It.first, Entry.BodySize, Entry.StoredSize, Entry.LastUsed, Entry.Flags,
+                    (U32)Entry.Url.size(), (U32)Entry.Head.size(), 0 };
+                Index.append((const char*)&Record, sizeof(Record));
+                Index += Entry.Url;
+                Index += Entry.Head;
+            }
+
+            std::string IndexPath = Directory + "/index";
+            std::string Temporary = IndexPath + ".tmp";
+            os::File File;
+            if (!File.Open(Temporary.c_str(), IOFlag::Write))
+                return false;
+            size_t Written = File.Write(Index.data(), Index.size());
+            File.Close();
+            if (Written != Index.size())
+                return false;
+            os::Remove(IndexPath.c_str());
+            Dirty = rename(Temporary.c_str(), IndexPath.c_str()) != 0;
+            return !Dirty;
+        }
+
+        HttpCacheBody::HttpCacheBody()
+            : d(new HttpCacheBodyPrivate)
+        {
+        }
+
+        HttpCacheBody::~HttpCacheBody()
+        {
+            delete d;
+            d = nullptr;
+        }
+
+        const U8* HttpCacheBody::GetData() const
+        {
+            return d->Data;
+        }
+
+        U64 HttpCacheBody::GetSize() const
+        {
+            return d->Size;
+        }
+
+        bool HttpCacheBody::IsFromCache() const
+        {
+            return d->FromCache;
+        }
+
+        HttpCache::HttpCache(HttpClient* Client, const char* Directory)
+            : d(new HttpCachePrivate(Client, Directory))
+        {
+        }
+
+        HttpCache::~HttpCache()
+        {
+            delete d;
+            d = nullptr;
+        }
+
+        void HttpCache::SetMaxSize(U64 Bytes)
+        {
+            os::Mutex::AutoLock Guard(&d->Lock);
+            d->MaxSize = Bytes;
+            d->Evict(0);
+        }
+
+        HttpResponse HttpCache::Get(HttpRequest const& Request, HttpCacheBody& Body)
+        {
+            return d->Get(Request, *Body.d);
+        }
+
+        void HttpCache::Clear()
+        {
+            os::Mutex::AutoLock Guard(&d->Lock);
+            while (!d->Entries.empty())
+                d->Drop(d->Entries.begin()->first);
+            d->Save();
+        }
+
+        U32 HttpCache::GetEntryCount() const
+        {
+            os::Mutex::AutoLock Guard(&d->Lock);
+            return (U32)d->Entries.size();
+        }
+
+        U64 HttpCache::GetSize() const
+        {
+            os::Mutex::AutoLock Guard(&d->Lock);
+            return d->Size;
+        }
+    }
+}
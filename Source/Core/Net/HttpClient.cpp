@@ -0,0 +1,923 @@
+#include "CoreMinimal.h"
+#include "Net/HttpUtil.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace k3d
+{
+    namespace net
+    {
+        // a response head past this size is treated as a broken server
+        static const size_t kMaxResponseHead = 64 * 1024;
+        // same for a chunk size or trailer line
+        static const size_t kMaxChunkLine = 4 * 1024;
+        // the first try and one retry on a fresh connection
+        static const U32 kMaxAttempts = 2;
+
+        /// "http://host[:port]/path", the target keeps the query and drops the fragment
+        static bool SplitHttpUrl(const char* Url, std::string& Host, I32& Port, std::string& Target)
+        {
+            if (!Url || strncmp(Url, "http://", 7) != 0)
+                return false;
+            const char* Authority = Url + 7;
+            const char* End = Authority + strcspn(Authority, "/?#");
+            std::string HostPort(Authority, End);
+            Port = 80;
+            size_t Colon = std::string::npos;
+            if (!HostPort.empty() && HostPort[0] == '[')
+            {
+                size_t Close = HostPort.find(']');
+                if (Close == std::string::npos)
+                    return false;
+                Host = HostPort.substr(1, Close - 1);
+                if (Close + 1 < HostPort.size())
+                    Colon = HostPort[Close + 1] == ':' ? Close + 1 : HostPort.size();
+            }
+            else
+            {
+                Colon = HostPort.find(':');
+                Host = HostPort.substr(0, Colon);
+            }
+            if (Colon != std::string::npos)
+            {
+                if (Colon + 1 >= HostPort.size())
+                    return false;
+                Port = atoi(HostPort.c_str() + Colon + 1);
+            }
+            Target.assign(End, strcspn(End, "#"));
+            if (Target.empty() || Target[0] != '/')
+                Target.insert(0, "/");
+            return !Host.empty() && Port > 0 && Port < 65536;
+        }
+
+        struct HttpCall;
+        struct PooledConnection;
+        typedef void(*PFN_HttpCallComplete)(HttpCall* Call);
+
+        /// one request on its way through the pool, owned by the reactor until completed
+        struct HttpCall
+        {
+            std::string         HostKey;
+            os::IpAddress*      Address;
+            std::string         Wire;
+            /// GET and HEAD, which may be pipelined and retried
+            bool                Idempotent;
+            bool                NoBody;
+            U32                 Attempts;
+
+            I32                 Status;
+            std::string         Head;
+            /// kept unless a sink takes it
+            std::string         Body;
+            /// gets the bodies of 2xx responses, error pages and redirects stay in Body
+            IIODevice*          Sink;
+            /// body bytes handed out, a request that streamed some can't be retried
+            U64                 Delivered;
+
+            PFN_HttpCallComplete OnComplete;
+            void*               UserData;
+
+            /// the Submit request this call completes, if any
+            HttpAsyncRequest*   Async;
+            U64                 Timer;
+            /// connection the request went out on, nullptr while it waits
+            PooledConnection*   Carrier;
+            /// stays Completed unless the call gets interrupted or fails
+            HttpOutcome         Outcome;
+        };
+
+        enum ChunkState
+        {
+            ChunkSize,
+            ChunkData,
+            ChunkDataEnd,
+            ChunkTrailer,
+        };
+
+        struct HostPool;
+
+        struct PooledConnection
+        {
+            os::Connection*     Conn;
+            HostPool*           Pool;
+            std::deque<HttpCall*> InFlight;
+            bool                Connected;
+            /// false once a response asked to close, nothing more is sent on it
+            bool                Reusable;
+            U64                 IdleTimer;
+
+            // response of InFlight.front()
+            bool                HeadParsed;
+            bool                UntilClose;
+            bool                Chunked;
+            ChunkState          Chunk;
+            /// of the body, or of the current chunk
+            U64                 BodyLeft;
+        };
+
+        struct HostPool
+        {
+            os::IpAddress*      Address;
+            std::deque<HttpCall*> Waiting;
+            std::vector<PooledConnection*> Connections;
+            U32                 Connecting;
+        };
+
+        struct HttpClientPrivate : public os::IConnectionHandler
+        {
+            HttpClientPrivate()
+                : Loop(new os::Reactor)
+                , MaxConnectionsPerHost(6)
+                , IdleTimeout(30000)
+                , PipelineDepth(1)
+                , ConnectCount(0)
+                , OpenConnections(0)
+                , NextId(0)
+                , ShuttingDown(false)
+            {
+                Loop->Start("HttpClient");
+            }
+
+            ~HttpClientPrivate()
+            {
+                // the reactor reports its connections closed, which fails what they carried
+                ShuttingDown = true;
+                delete Loop;
+                Loop = nullptr;
+                for (HttpCall* Call : Incoming)
+                    Fail(Call);
+                for (auto& Entry : Pools)
+                {
+                    while (!Entry.second->Waiting.empty())
+                    {
+                        HttpCall* Call = Entry.second->Waiting.front();
+                        Entry.second->Waiting.pop_front();
+                        Fail(Call);
+                    }
+                    delete Entry.second;
+                }
+                for (auto& Entry : Resolved)
+                    delete Entry.second;
+            }
+
+            /// caller thread, resolves the host once per client
+            HttpCall* Prepare(HttpRequest const& Request)
+            {
+                std::string Host, Target;
+                I32 Port = 0;
+                if (!SplitHttpUrl(Request.Url.CStr(), Host, Port, Target))
+                    return nullptr;
+                char PortText[16];
+                snprintf(PortText, sizeof(PortText), ":%d", Port);
+                std::string HostKey = Host + PortText;
+
+                os::IpAddress* Address = nullptr;
+                {
+                    os::Mutex::AutoLock Lock(&ResolveLock);
+                    auto Found = Resolved.find(HostKey);
+                    if (Found != Resolved.end())
+                        Address = Found->second;
+                }
+                if (!Address)
+                {
+                    Address = os::IpAddress::GetHostIp(String(Host.c_str()));
+                    if (!Address)
+                        return nullptr;
+                    Address->SetAddrPort(Port);
+                    os::Mutex::AutoLock Lock(&ResolveLock);
+                    auto Inserted = Resolved.emplace(HostKey, Address);
+                    if (!Inserted.second)
+                    {
+                        delete Address;
+                        Address = Inserted.first->second;
+                    }
+                }
+
+                std::string Method = Request.Method.Length() ? Request.Method.CStr() : "GET";
+                HttpCall* Call = new HttpCall;
+                Call->HostKey = HostKey;
+                Call->Address = Address;
+                Call->Idempotent = Method == "GET" || Method == "HEAD";
+                Call->NoBody = Method == "HEAD";
+                Call->Attempts = 0;
+                Call->Status = 0;
+                Call->Sink = nullptr;
+                Call->Delivered = 0;
+                Call->OnComplete = nullptr;
+                Call->UserData = nullptr;
+                Call->Async = nullptr;
+                Call->Timer = 0;
+                Call->Carrier = nullptr;
+                Call->Outcome = HttpOutcome::Completed;
+
+                std::string& Wire = Call->Wire;
+                Wire.reserve(128 + Request.Headers.Length() + Request.Body.Length());
+                Wire += Method;
+                Wire += ' ';
+                Wire += Target;
+                Wire += " HTTP/1.1\r\nHost: ";
+                Wire += Host.find(':') == std::string::npos ? Host : "[" + Host + "]";
+                if (Port != 80)
+                    Wire += PortText;
+                Wire += "\r\n";
+                if (Request.Headers.Length())
+                    Wire.append(Request.Headers.CStr(), (size_t)Request.Headers.Length());
+                if (Request.Body.Length() || !Call->Idempotent)
+                {
+                    char Length[48];
+                    snprintf(Length, sizeof(Length), "Content-Length: %llu\r\n", (unsigned long long)Request.Body.Length());
+                    Wire += Length;
+                }
+                Wire += "\r\n";
+                if (Request.Body.Length())
+                    Wire.append(Request.Body.CStr(), (size_t)Request.Body.Length());
+                return Call;
+            }
+
+            /// queued aside rather than in the posted task, so a client going away
+            /// still finds and fails them
+            void Submit(HttpCall** Calls, U32 Count)
+            {
+                {
+                    os::Mutex::AutoLock Lock(&IncomingLock);
+                    Incoming.insert(Incoming.end(), Calls, Calls + Count);
+                }
+                Loop->Post([this]() { TakeIncoming(); });
+            }
+
+            // everything below runs on the reactor thread
+
+            void TakeIncoming()
+            {
+                std::vector<HttpCall*> Calls;
+                {
+                    os::Mutex::AutoLock Lock(&IncomingLock);
+                    Calls.swap(Incoming);
+                }
+                for (HttpCall* Call : Calls)
+                    Enqueue(Call);
+            }
+
+            void Enqueue(HttpCall* Call)
+            {
+                if (Call->Async)
+                {
+                    Active[Call->Async->Id] = Call;
+                    if (Call->Async->TimeoutMs)
+                    {
+                        Call->Timer = Loop->AddTimer(Call->Async->TimeoutMs, 0, [this, Call]() {
+                            Call->Timer = 0;
+                            Interrupt(Call, HttpOutcome::TimedOut);
+                        });
+                    }
+                }
+                HostPool*& Pool = Pools[Call->HostKey];
+                if (!Pool)
+                {
+                    Pool = new HostPool;
+                    Pool->Address = Call->Address;
+                    Pool->Connecting = 0;
+                }
+                Pool->Waiting.push_back(Call);
+                Dispatch(Pool);
+            }
+
+            static bool CanSend(PooledConnection* C)
+            {
+                return C->Connected && C->Reusable && C->Conn->IsConnected();
+            }
+
+            /// hands waiting requests to idle connections, opens new ones up to the
+            /// limit and only then pipelines behind the requests in flight
+            void Dispatch(HostPool* Pool)
+            {
+                while (!Pool->Waiting.empty())
+                {
+                    HttpCall* Call = Pool->Waiting.front();
+                    PooledConnection* Target = nullptr;
+                    for (PooledConnection* C : Pool->Connections)
+                    {
+                        if (CanSend(C) && C->InFlight.empty())
+                        {
+                            Target = C;
+                            break;
+                        }
+                    }
+                    if (!Target)
+                    {
+                        if (Pool->Connections.size() < MaxConnectionsPerHost.load())
+                        {
+                            // connections on their way are already spoken for
+                            if (Pool->Connecting >= Pool->Waiting.size())
+                                return;
+                            if (!Open(Pool))
+                            {
+                                if (Pool->Connections.empty())
+                                    FailWaiting(Pool);
+                                return;
+                            }
+                            continue;
+                        }
+                        U32 Depth = PipelineDepth.load();
+                        for (PooledConnection* C : Pool->Connections)
+                        {
+                            if (!Call->Idempotent || !CanSend(C) || C->InFlight.size() >= Depth)
+                                continue;
+                            bool AllIdempotent = true;
+                            for (HttpCall* Queued : C->InFlight)
+                                AllIdempotent = AllIdempotent && Queued->Idempotent;
+                            if (AllIdempotent && (!Target || C->InFlight.size() < Target->InFlight.size()))
+                                Target = C;
+                        }
+                        if (!Target)
+                            return;
+                    }
+                    Pool->Waiting.pop_front();
+                    Assign(Target, Call);
+                }
+            }
+
+            bool Open(HostPool* Pool)
+            {
+                os::Connection* Conn = Loop->Connect(*Pool->Address, this);
+                if (!Conn)
+                    return false;
+                PooledConnection* C = new PooledConnection;
+                C->Conn = Conn;
+                C->Pool = Pool;
+                C->Connected = false;
+                C->Reusable = true;
+                C->IdleTimer = 0;
+                C->HeadParsed = false;
+                C->UntilClose = false;
+                C->Chunked = false;
+                C->Chunk = ChunkSize;
+                C->BodyLeft = 0;
+                Conn->SetUserData(C);
+                Pool->Connections.push_back(C);
+                Pool->Connecting++;
+                ConnectCount++;
+                OpenConnections++;
+                return true;
+            }
+
+            void Assign(PooledConnection* C, HttpCall* Call)
+            {
+                if (C->IdleTimer)
+                {
+                    Loop->CancelTimer(C->IdleTimer);
+                    C->IdleTimer = 0;
+                }
+                Call->Attempts++;
+                Call->Carrier = C;
+                C->InFlight.push_back(Call);
+                C->Conn->Send(Call->Wire.data(), Call->Wire.size());
+            }
+
+            void OnConnected(os::Connection* Conn) override
+            {
+                PooledConnection* C = (PooledConnection*)Conn->GetUserData();
+                C->Connected = true;
+                C->Pool->Connecting--;
+                Dispatch(C->Pool);
+            }
+
+            void OnReceived(os::Connection* Conn) override
+            {
+                PooledConnection* C = (PooledConnection*)Conn->GetUserData();
+                while (!C->InFlight.empty())
+                {
+                    HttpCall* Call = C->InFlight.front();
+                    if (!C->HeadParsed && !ParseHead(C, Call))
+                        return;
+                    if (!ReadBody(C, Call))
+                        return;
+                    C->InFlight.pop_front();
+                    C->HeadParsed = false;
+                    Complete(Call);
+                }
+                if (Conn->GetInputSize())
+                {
+                    // bytes nobody asked for, the stream can't be trusted any more
+                    C->Reusable = false;
+                    Conn->Consume(Conn->GetInputSize());
+                }
+                if (!C->Reusable)
+                {
+                    Conn->Close();
+                }
+                else if (!C->IdleTimer)
+                {
+                    C->IdleTimer = Loop->AddTimer(IdleTimeout.load(), 0, [C]() {
+                        C->IdleTimer = 0;
+                        if (C->InFlight.empty())
+                            C->Conn->Close();
+                    });
+                }
+                Dispatch(C->Pool);
+            }
+
+            /// true once the body is complete, it goes to the sink as it arrives so
+            /// only the unparsed rest of a read pass is ever held
+            bool ReadBody(PooledConnection* C, HttpCall* Call)
+            {
+                os::Connection* Conn = C->Conn;
+                if (!C->Chunked)
+                {
+                    U64 Size = Conn->GetInputSize();
+                    U64 Take = C->UntilClose || Size < C->BodyLeft ? Size : C->BodyLeft;
+                    if (!Deliver(C, Call, Take))
+                        return false;
+                    C->BodyLeft -= C->UntilClose ? 0 : Take;
+                    return !C->UntilClose && !C->BodyLeft;
+                }
+                for (;;)
+                {
+                    const char* Input = (const char*)Conn->GetInput();
+                    size_t Size = (size_t)Conn->GetInputSize();
+                    switch (C->Chunk)
+                    {
+                    case ChunkData:
+                    {
+                        U64 Take = Size < C->BodyLeft ? Size : C->BodyLeft;
+                        if (!Deliver(C, Call, Take))
+                            return false;
+                        C->BodyLeft -= Take;
+                        if (C->BodyLeft)
+                            return false;
+                        C->Chunk = ChunkDataEnd;
+                        break;
+                    }
+                    case ChunkDataEnd:
+                        if (Size < 2)
+                            return false;
+                        if (Input[0] != '\r' || Input[1] != '\n')
+                        {
+                            Abandon(C);
+                            return false;
+                        }
+                        Conn->Consume(2);
+                        C->Chunk = ChunkSize;
+                        break;
+                    case ChunkSize:
+                    case ChunkTrailer:
+                    {
+                        const char* LineEnd = (const char*)memchr(Input, '\n', Size);
+                        if (!LineEnd || LineEnd == Input || LineEnd[-1] != '\r')
+                        {
+                            if (LineEnd || Size > kMaxChunkLine)
+                                Abandon(C);
+                            return false;
+                        }
+                        size_t Line = LineEnd + 1 - Input;
+                        if (C->Chunk == ChunkTrailer)
+                        {
+                            // trailer fields are skipped, the blank line ends the body
+                            Conn->Consume(Line);
+                            if (Line == 2)
+                                return true;
+                            break;
+                        }
+                        // the size may be followed by ";extension"
+                        char* SizeEnd = nullptr;
+                        U64 ChunkLength = strtoull(Input, &SizeEnd, 16);
+                        if (SizeEnd == Input || (*SizeEnd != ';' && *SizeEnd != '\r' && *SizeEnd != ' '))
+                        {
+                            Abandon(C);
+                            return false;
+                        }
+                        Conn->Consume(Line);
+                        C->BodyLeft = ChunkLength;
+                        C->Chunk = ChunkLength ? ChunkData : ChunkTrailer;
+                        break;
+                    }
+                    }
+                }
+            }
+
+            /// moves Size input bytes to the call's sink or body
+            bool Deliver(PooledConnection* C, HttpCall* Call, U64 Size)
+            {
+                if (!Size)
+                    return true;
+                const U8* Data = C->Conn->GetInput();
+                if (Call->Sink && Call->Status / 100 == 2)
+                {
+                    if (Call->Sink->Write(Data, (size_t)Size) != Size)
+                    {
+                        // the sink gave up, no point in retrying into it
+                        Call->Attempts = kMaxAttempts;
+                        Abandon(C);
+                        return false;
+                    }
+                }
+                else
+                {
+                    Call->Body.append((const char*)Data, (size_t)Size);
+                }
+                Call->Delivered += Size;
+                C->Conn->Consume(Size);
+                return true;
+            }
+
+            /// false while the head is incomplete, or when the connection got closed on it
+            bool ParseHead(PooledConnection* C, HttpCall* Call)
+            {
+                os::Connection* Conn = C->Conn;
+                const char* Input = (const char*)Conn->GetInput();
+                size_t Size = (size_t)Conn->GetInputSize();
+                size_t HeadSize = FindHttpHeadEnd(Input, Size < kMaxResponseHead ? Size : kMaxResponseHead);
+                if (!HeadSize)
+                {
+                    if (Size >= kMaxResponseHead)
+                        Abandon(C);
+                    return false;
+                }
+                int Minor = 0, Status = 0;
+                if (sscanf(Input, "HTTP/1.%d %d", &Minor, &Status) != 2 || Status < 100)
+                {
+                    Abandon(C);
+                    return false;
+                }
+                std::string Connection, Length, Encoding;
+                bool HasConnection = FindHttpHeader(Input, HeadSize, "connection", Connection);
+                bool HasLength = FindHttpHeader(Input, HeadSize, "content-length", Length);
+                bool Chunked = FindHttpHeader(Input, HeadSize, "transfer-encoding", Encoding) &&
+                    HasHttpToken(Encoding, "chunked");
+                if (Status < 200)
+                {
+                    // interim responses carry no body and are followed by the real one
+                    Conn->Consume(HeadSize);
+                    return Conn->GetInputSize() ? ParseHead(C, Call) : false;
+                }
+                if (Minor == 0 ? !(HasConnection && HasHttpToken(Connection, "keep-alive"))
+                               : HasConnection && HasHttpToken(Connection, "close"))
+                    C->Reusable = false;
+
+                Call->Status = Status;
+                Call->Head.assign(Input, HeadSize);
+                Call->Body.clear();
+                C->UntilClose = false;
+                C->Chunked = false;
+                C->BodyLeft = 0;
+                if (Call->NoBody || Status == 204 || Status == 304)
+                    C->BodyLeft = 0;
+                else if (Chunked)
+                {
+                    // framing wins over any Content-Length
+                    C->Chunked = true;
+                    C->Chunk = ChunkSize;
+                }
+                else if (HasLength)
+                    C->BodyLeft = strtoull(Length.c_str(), nullptr, 10);
+                else
+                {
+                    // delimited by the end of the connection
+                    C->UntilClose = true;
+                    C->Reusable = false;
+                }
+                C->HeadParsed = true;
+                Conn->Consume(HeadSize);
+                return true;
+            }
+
+            /// drops a connection whose responses can't be parsed, OnClosed settles its requests
+            void Abandon(PooledConnection* C)
+            {
+                C->Reusable = false;
+                C->Conn->Consume(C->Conn->GetInputSize());
+                C->Conn->Close();
+            }
+
+            void OnClosed(os::Connection* Conn) override
+            {
+                PooledConnection* C = (PooledConnection*)Conn->GetUserData();
+                HostPool* Pool = C->Pool;
+                for (size_t i = 0; i < Pool->Connections.size(); i++)
+                {
+                    if (Pool->Connections[i] == C)
+                    {
+                        Pool->Connections.erase(Pool->Connections.begin() + i);
+                        break;
+                    }
+                }
+                if (!C->Connected)
+                    Pool->Connecting--;
+                if (C->IdleTimer)
+                    Loop->CancelTimer(C->IdleTimer);
+                OpenConnections--;
+
+                if (!C->InFlight.empty() && C->HeadParsed && C->UntilClose &&
+                    C->InFlight.front()->Outcome == HttpOutcome::Completed)
+                {
+                    HttpCall* Call = C->InFlight.front();
+                    C->InFlight.pop_front();
+                    Complete(Call);
+                }
+                // a pooled connection may have been closed by the server while the
+                // requests were on their way, so idempotent ones get another try
+                std::deque<HttpCall*> Retry;
+                for (HttpCall* Call : C->InFlight)
+                {
+                    if (!ShuttingDown && Call->Idempotent && Call->Attempts < kMaxAttempts &&
+                        !(Call->Sink && Call->Delivered) && Call->Outcome == HttpOutcome::Completed)
+                    {
+                        Call->Carrier = nullptr;
+                        Call->Delivered = 0;
+                        Call->Status = 0;
+                        Call->Head.clear();
+                        Call->Body.clear();
+                        Retry.push_back(Call);
+                    }
+                    else
+                    {
+                        Fail(Call);
+                    }
+                }
+                Pool->Waiting.insert(Pool->Waiting.begin(), Retry.begin(), Retry.end());
+                bool Refused = !C->Connected;
+                delete C;
+
+                if (ShuttingDown)
+                    return;
+                // the host can't be reached, don't keep reconnecting for the queue
+                if (Refused && Pool->Connections.empty())
+                    FailWaiting(Pool);
+                else
+                    Dispatch(Pool);
+            }
+
+            void FailWaiting(HostPool* Pool)
+            {
+                std::deque<HttpCall*> Waiting;
+                Waiting.swap(Pool->Waiting);
+                for (HttpCall* Call : Waiting)
+                    Fail(Call);
+            }
+
+            void Fail(HttpCall* Call)
+            {
+                Call->Status = 0;
+                Call->Head.clear();
+                Call->Body.clear();
+                if (Call->Outcome == HttpOutcome::Completed)
+                    Call->Outcome = HttpOutcome::Failed;
+                Complete(Call);
+            }
+
+            void Complete(HttpCall* Call)
+            {
+                if (Call->Timer && Loop)
+                    Loop->CancelTimer(Call->Timer);
+                Call->Timer = 0;
+                if (Call->Async)
+                    Active.erase(Call->Async->Id);
+                Call->OnComplete(Call);
+            }
+
+            /// a waiting call fails at once, one on a connection takes it down with it
+            /// and is failed by OnClosed, without a retry
+            void Interrupt(HttpCall* Call, HttpOutcome Outcome)
+            {
+                if (Call->Outcome != HttpOutcome::Completed)
+                    return;
+                Call->Outcome = Outcome;
+                if (Call->Carrier)
+                {
+                    Abandon(Call->Carrier);
+                    return;
+                }
+                std::deque<HttpCall*>& Waiting = Pools[Call->HostKey]->Waiting;
+                auto Queued = std::find(Waiting.begin(), Waiting.end(), Call);
+                if (Queued != Waiting.end())
+                    Waiting.erase(Queued);
+                Fail(Call);
+            }
+
+            void Cancel(U64 Id)
+            {
+                auto Found = Active.find(Id);
+                if (Found != Active.end())
+                    Interrupt(Found->second, HttpOutcome::Cancelled);
+            }
+
+            /// caller thread, nullptr when the request already failed
+            HttpCall* Start(HttpAsyncRequest& Request, U64& Id)
+            {
+                Id = Request.Id = ++NextId;
+                Request.Outcome = HttpOutcome::Failed;
+                if (Request.Counter)
+                    Request.Counter->Add();
+                HttpCall* Call = Prepare(Request.Request);
+                if (!Call)
+                {
+                    Request.Response = HttpResponse();
+                    Deliver(&Request);
+                    return nullptr;
+                }
+                Call->Sink = Request.BodySink;
+                Call->OnComplete = &CompleteAsync;
+                Call->Async = &Request;
+                return Call;
+            }
+
+            /// hands a finished call back to its HttpAsyncRequest
+            static void CompleteAsync(HttpCall* Call)
+            {
+                HttpAsyncRequest* Request = Call->Async;
+                HttpResponse& Response = Request->Response;
+                Response.Status = Call->Status;
+                Response.Head = Call->Head.empty() ? String() : String(Call->Head.data(), Call->Head.size());
+                Response.Body = Call->Body.empty() ? String() : String(Call->Body.data(), Call->Body.size());
+                Request->Outcome = Call->Outcome;
+                delete Call;
+                Deliver(Request);
+            }
+
+            static void Deliver(HttpAsyncRequest* Request)
+            {
+                if (Request->Jobs)
+                    Request->Jobs->Enqueue([Request]() { Finish(Request); });
+                else
+                    Finish(Request);
+            }
+
+            static void Finish(HttpAsyncRequest* Request)
+            {
+                // OnComplete may free a request nobody counts
+                os::JobCounter* Counter = Request->Counter;
+                if (Request->OnComplete)
+                    Request->OnComplete(*Request);
+                if (Counter)
+                    Counter->Done();
+            }
+
+            os::Reactor*        Loop;
+            std::unordered_map<std::string, HostPool*> Pools;
+            /// submitted calls by HttpAsyncRequest::Id, for Cancel
+            std::unordered_map<U64, HttpCall*> Active;
+
+            os::Mutex           IncomingLock;
+            std::vector<HttpCall*> Incoming;
+
+            os::Mutex           ResolveLock;
+            std::unordered_map<std::string, os::IpAddress*> Resolved;
+
+            std::atomic<U32>    MaxConnectionsPerHost;
+            std::atomic<U32>    IdleTimeout;
+            std::atomic<U32>    PipelineDepth;
+            std::atomic<U64>    ConnectCount;
+            std::atomic<U32>    OpenConnections;
+            std::atomic<U64>    NextId;
+            std::atomic<bool>   ShuttingDown;
+        };
+
+        /// parks Fetch until the reactor completed its call
+        struct FetchWaiter
+        {
+            FetchWaiter() : Done(false) {}
+
+            static void Complete(HttpCall* Call)
+            {
+                FetchWaiter* Waiter = (FetchWaiter*)Call->UserData;
+                os::Mutex::AutoLock Lock(&Waiter->Lock);
+                Waiter->Done = true;
+                Waiter->Signal.NotifyAll();
+            }
+
+            void Wait()
+            {
+                os::Mutex::AutoLock Lock(&this->Lock);
+                while (!Done)
+                    Signal.Wait(&this->Lock);
+            }
+
+            os::Mutex           Lock;
+            os::ConditionVariable Signal;
+            bool                Done;
+        };
+
+        HttpRequest::HttpRequest()
+            : Method("GET")
+        {
+        }
+
+        HttpRequest::HttpRequest(const char* InMethod, const char* InUrl)
+            : Method(InMethod)
+            , Url(InUrl)
+        {
+        }
+
+        HttpRequest& HttpRequest::AddHeader(const char* Name, const char* Value)
+        {
+            Headers.AppendSprintf("%s: %s\r\n", Name, Value);
+            return *this;
+        }
+
+        HttpResponse::HttpResponse()
+            : Status(0)
+        {
+        }
+
+        bool HttpResponse::GetHeader(const char* Name, String& Value) const
+        {
+            std::string LowerName(Name), Found;
+            for (char& c : LowerName)
+                c = (char)tolower((unsigned char)c);
+            if (!Head.Length() || !FindHttpHeader(Head.CStr(), (size_t)Head.Length(), LowerName.c_str(), Found))
+                return false;
+            Value = String(Found.data(), Found.size());
+            return true;
+        }
+
+        HttpClient::HttpClient()
+            : d(new HttpClientPrivate)
+        {
+        }
+
+        HttpClient::~HttpClient()
+        {
+            delete d;
+            d = nullptr;
+        }
+
+        void HttpClient::SetMaxConnectionsPerHost(U32 Count)
+        {
+            d->MaxConnectionsPerHost = Count ? Count : 1;
+        }
+
+        void HttpClient::SetIdleTimeout(U32 Milliseconds)
+        {
+            d->IdleTimeout = Milliseconds;
+        }
+
+        void HttpClient::SetPipelineDepth(U32 Depth)
+        {
+            d->PipelineDepth = Depth ? Depth : 1;
+        }
+
+        HttpResponse HttpClient::Fetch(HttpRequest const& Request, IIODevice* BodySink)
+        {
+            HttpResponse Response;
+            HttpCall* Call = d->Prepare(Request);
+            if (!Call)
+                return Response;
+            Call->Sink = BodySink;
+            FetchWaiter Waiter;
+            Call->OnComplete = &FetchWaiter::Complete;
+            Call->UserData = &Waiter;
+            d->Submit(&Call, 1);
+            Waiter.Wait();
+
+            Response.Status = Call->Status;
+            if (!Call->Head.empty())
+                Response.Head = String(Call->Head.data(), Call->Head.size());
+            if (!Call->Body.empty())
+                Response.Body = String(Call->Body.data(), Call->Body.size());
+            delete Call;
+            return Response;
+        }
+
+        void HttpClient::Submit(HttpAsyncRequest* Requests, U32 Count)
+        {
+            std::vector<HttpCall*> Calls;
+            Calls.reserve(Count);
+            for (U32 i = 0; i < Count; i++)
+            {
+                U64 Id;
+                if (HttpCall* Call = d->Start(Requests[i], Id))
+                    Calls.push_back(Call);
+            }
+            if (!Calls.empty())
+                d->Submit(Calls.data(), (U32)Calls.size());
+        }
+
+        U64 HttpClient::Submit(HttpAsyncRequest& Request)
+        {
+            U64 Id;
+            if (HttpCall* Call = d->Start(Request, Id))
+                d->Submit(&Call, 1);
+            return Id;
+        }
+
+        void HttpClient::Cancel(U64 RequestId)
+        {
+            d->Loop->Post([this, RequestId]() { d->Cancel(RequestId); });
+        }
+
+        U64 HttpClient::GetConnectCount() const
+        {
+            return d->ConnectCount.load();
+        }
+
+        U32 HttpClient::GetOpenConnectionCount() const
+        {
+            return d->OpenConnections.load();
+        }
+    }
+}
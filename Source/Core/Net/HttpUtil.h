@@ -0,0 +1,101 @@
+#ifndef __k3d_HttpUtil_h__
+#define __k3d_HttpUtil_h__
+#pragma once
+
+#include <ctype.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+
+/* HTTP/1.1 message helpers shared by the servers and clients in Net */
+namespace k3d
+{
+    namespace net
+    {
+        /// length of the head up to and including the blank line, 0 while incomplete
+        inline size_t FindHttpHeadEnd(const char* Data, size_t Size)
+        {
+            for (size_t i = 3; i < Size; i++)
+            {
+                if (Data[i] == '\n' && Data[i - 1] == '\r' && Data[i - 2] == '\n' && Data[i - 3] == '\r')
+                    return i + 1;
+            }
+            return 0;
+        }
+
+        /// value of a header field, Name is lower case and compares case insensitively
+        inline bool FindHttpHeader(const char* Head, size_t Length, const char* Name, std::string& Value)
+        {
+            size_t NameLength = strlen(Name);
+            for (size_t Line = 0; Line < Length;)
+            {
+                size_t End = Line;
+                while (End < Length && Head[End] != '\r' && Head[End] != '\n')
+                    End++;
+                if (End - Line > NameLength && Head[Line + NameLength] == ':')
+                {
+                    size_t i = 0;
+                    while (i < NameLength && tolower((unsigned char)Head[Line + i]) == Name[i])
+                        i++;
+                    if (i == NameLength)
+                    {
+                        size_t Begin = Line + NameLength + 1;
+                        while (Begin < End && (Head[Begin] == ' ' || Head[Begin] == '\t'))
+                            Begin++;
+                        size_t Last = End;
+                        while (Last > Begin && (Head[Last - 1] == ' ' || Head[Last - 1] == '\t'))
+                            Last--;
+                        Value.assign(Head + Begin, Last - Begin);
+                        return true;
+                    }
+                }
+                Line = End;
+                while (Line < Length && (Head[Line] == '\r' || Head[Line] == '\n'))
+                    Line++;
+            }
+            return false;
+        }
+
+        /// true if the comma separated header value lists Token, case insensitively
+        inline bool HasHttpToken(std::string const& Value, const char* Token)
+        {
+            size_t TokenLength = strlen(Token);
+            for (size_t Pos = 0; Pos < Value.size();)
+            {
+                while (Pos < Value.size() && (Value[Pos] == ' ' || Value[Pos] == ','))
+                    Pos++;
+                size_t End = Value.find(',', Pos);
+                if (End == std::string::npos)
+                    End = Value.size();
+                size_t Last = End;
+                while (Last > Pos && Value[Last - 1] == ' ')
+                    Last--;
+                if (Last - Pos == TokenLength)
+                {
+                    size_t i = 0;
+                    while (i < TokenLength && tolower((unsigned char)Value[Pos + i]) == Token[i])
+                        i++;
+                    if (i == TokenLength)
+                        return true;
+                }
+                Pos = End;
+            }
+            return false;
+        }
+
+        /// IMF-fixdate, "Sun, 06 Nov 1994 08:49:37 GMT"
+        inline void FormatHttpDate(U64 Seconds, char* Out, size_t Capacity)
+        {
+            time_t Time = (time_t)Seconds;
+            struct tm Utc;
+#if K3DPLATFORM_OS_WINDOWS
+            gmtime_s(&Utc, &Time);
+#else
+            gmtime_r(&Time, &Utc);
+#endif
+            strftime(Out, Capacity, "%a, %d %b %Y %H:%M:%S GMT", &Utc);
+        }
+    }
+}
+
+#endif
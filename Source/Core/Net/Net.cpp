@@ -1,5 +1,12 @@
 #include "CoreMinimal.h"
 #include "Base/Encoder.h"
+#include "Net/HttpUtil.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include <string>
+#include <vector>
 
 namespace k3d
 {
@@ -295,48 +302,44 @@ namespace k3d
 
             // *** message decoding
 
-            int payload_length = 0;
-            int pos = 2;
+            U64 payload_length = 0;
+            size_t pos = 2;
             int length_field = in_buffer[1] & (~0x80);
-            unsigned int mask = 0;
-
-            //printf("IN:"); for(int i=0; i<20; i++) printf("%02x ",buffer[i]); printf("\n");
 
+            // the extended lengths are big endian
             if (length_field <= 125) {
                 payload_length = length_field;
             }
             else if (length_field == 126) { //msglen is 16bit!
-                payload_length = in_buffer[2] + (in_buffer[3] << 8);
+                if (in_length < 4) return INCOMPLETE_FRAME;
+                payload_length = ((U64)in_buffer[2] << 8) | in_buffer[3];
                 pos += 2;
             }
             else if (length_field == 127) { //msglen is 64bit!
-                payload_length = in_buffer[2] + (in_buffer[3] << 8);
+                if (in_length < 10) return INCOMPLETE_FRAME;
+                for (int i = 0; i < 8; i++)
+                    payload_length = (payload_length << 8) | in_buffer[2 + i];
                 pos += 8;
             }
-            //printf("PAYLOAD_LEN: %08x\n", payload_length);
-            if (in_length < payload_length + pos) {
+            if (msg_masked) {
+                pos += 4;
+            }
+            if (in_length < pos || in_length - pos < payload_length) {
                 return INCOMPLETE_FRAME;
             }
+            // the payload and its terminating zero must fit
+            if (out_size <= 0 || payload_length >= (U64)out_size) {
+                return ERROR_FRAME;
+            }
 
             if (msg_masked) {
-                mask = *((unsigned int*)(in_buffer + pos));
-                //printf("MASK: %08x\n", mask);
-                pos += 4;
-
-                // unmask data:
-                unsigned char* c = in_buffer + pos;
-                for (int i = 0; i < payload_length; i++) {
-                    c[i] = c[i] ^ ((unsigned char*)(&mask))[i % 4];
-                }
+                WebSocketMask(out_buffer, in_buffer + pos, payload_length, in_buffer + pos - 4);
             }
-
-            if (payload_length > out_size) {
-                //TODO: if output buffer is too small -- ERROR or resize(free and allocate bigger one) the buffer ?
+            else {
+                memcpy((void*)out_buffer, (void*)(in_buffer + pos), (size_t)payload_length);
             }
-
-            memcpy((void*)out_buffer, (void*)(in_buffer + pos), payload_length);
             out_buffer[payload_length] = 0;
-            *out_length = payload_length + 1;
+            *out_length = (int)payload_length + 1;
 
             //printf("TEXT: %s\n", out_buffer);
 
@@ -348,5 +351,411 @@ namespace k3d
 
             return ERROR_FRAME;
         }
+
+        void WebSocketMask(U8* Out, const U8* In, U64 Size, const U8 Mask[4])
+        {
+            // the 4 byte key repeats in every wider word, native byte order keeps Mask[i & 3] on byte i
+            U32 Key;
+            memcpy(&Key, Mask, 4);
+            U64 i = 0;
+#if defined(__AVX2__)
+            __m256i Key32 = _mm256_set1_epi32((int)Key);
+            for (; i + 64 <= Size; i += 64)
+            {
+                __m256i A = _mm256_loadu_si256((const __m256i*)(In + i));
+                __m256i B = _mm256_loadu_si256((const __m256i*)(In + i + 32));
+                _mm256_storeu_si256((__m256i*)(Out + i), _mm256_xor_si256(A, Key32));
+                _mm256_storeu_si256((__m256i*)(Out + i + 32), _mm256_xor_si256(B, Key32));
+            }
+#endif
+#if K3D_USE_SSE
+            __m128i Key16 = _mm_set1_epi32((int)Key);
+            for (; i + 32 <= Size; i += 32)
+            {
+                __m128i A = _mm_loadu_si128((const __m128i*)(In + i));
+                __m128i B = _mm_loadu_si128((const __m128i*)(In + i + 16));
+                _mm_storeu_si128((__m128i*)(Out + i), _mm_xor_si128(A, Key16));
+                _mm_storeu_si128((__m128i*)(Out + i + 16), _mm_xor_si128(B, Key16));
+            }
+#elif K3D_USE_NEON
+            uint8x16_t Key16 = vreinterpretq_u8_u32(vdupq_n_u32(Key));
+            for (; i + 32 <= Size; i += 32)
+            {
+                vst1q_u8(Out + i, veorq_u8(vld1q_u8(In + i), Key16));
+                vst1q_u8(Out + i + 16, veorq_u8(vld1q_u8(In + i + 16), Key16));
+            }
+#endif
+            U64 Key8 = ((U64)Key << 32) | Key;
+            for (; i + 8 <= Size; i += 8)
+            {
+                U64 Word;
+                memcpy(&Word, In + i, 8);
+                Word ^= Key8;
+                memcpy(Out + i, &Word, 8);
+            }
+            for (; i < Size; i++)
+                Out[i] = In[i] ^ Mask[i & 3];
+        }
+
+        static const char kWebSocketMagic[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+        // a request head or message past these sizes drops the client
+        static const U64 kMaxHandshake = 8 * 1024;
+        static const U64 kMaxMessage = 16 * 1024 * 1024;
+
+        enum WebSocketOpcode : U8
+        {
+            OpContinuation = 0x0,
+            OpText = 0x1,
+            OpBinary = 0x2,
+            OpClose = 0x8,
+            OpPing = 0x9,
+            OpPong = 0xA,
+        };
+
+        static String AcceptKey(std::string const& Key)
+        {
+            std::string Input = Key + kWebSocketMagic;
+            SHA1 Sha;
+            Sha.Input(Input.data(), (unsigned)Input.size());
+            unsigned Words[5];
+            Sha.Result(Words);
+            // the digest words are big endian on the wire
+            char Digest[20];
+            for (int i = 0; i < 5; i++)
+            {
+                Digest[i * 4 + 0] = (char)(Words[i] >> 24);
+                Digest[i * 4 + 1] = (char)(Words[i] >> 16);
+                Digest[i * 4 + 2] = (char)(Words[i] >> 8);
+                Digest[i * 4 + 3] = (char)Words[i];
+            }
+            return Base64Encode(String(Digest, sizeof(Digest)));
+        }
+
+        /// server frames are never masked, \return the header length
+        static U32 MakeFrameHeader(U8 (&Head)[10], U8 Opcode, U64 Size)
+        {
+            Head[0] = (U8)(0x80 | Opcode);
+            if (Size <= 125)
+            {
+                Head[1] = (U8)Size;
+                return 2;
+            }
+            if (Size <= 0xFFFF)
+            {
+                Head[1] = 126;
+                Head[2] = (U8)(Size >> 8);
+                Head[3] = (U8)Size;
+                return 4;
+            }
+            Head[1] = 127;
+            for (int i = 0; i < 8; i++)
+                Head[2 + i] = (U8)(Size >> (56 - 8 * i));
+            return 10;
+        }
+
+        static void AppendFrame(std::string& Out, U8 Opcode, const char* Data, U64 Size)
+        {
+            U8 Head[10];
+            Out.append((const char*)Head, MakeFrameHeader(Head, Opcode, Size));
+            Out.append(Data, (size_t)Size);
+        }
+
+        struct WebSocketClient
+        {
+            WebSocketClient() : Open(false), Binary(false) {}
+            bool                Open;
+            /// opcode of the fragmented message being collected
+            bool                Binary;
+            std::string         Message;
+        };
+
+        struct WebSocketServerPrivate : public os::IConnectionHandler
+        {
+            WebSocketServerPrivate(os::Reactor* InLoop)
+                : Loop(InLoop), Callback(nullptr), UserData(nullptr)
+            {}
+
+            void OnConnected(os::Connection* Conn) override
+            {
+                Conn->SetUserData(new WebSocketClient);
+            }
+
+            void OnReceived(os::Connection* Conn) override
+            {
+                WebSocketClient* Client = (WebSocketClient*)Conn->GetUserData();
+                if (!Client->Open && !Handshake(Conn, Client))
+                    return;
+                while (Client->Open && ReadFrame(Conn, Client))
+                {
+                }
+            }
+
+            void OnClosed(os::Connection* Conn) override
+            {
+                WebSocketClient* Client = (WebSocketClient*)Conn->GetUserData();
+                if (Client && Client->Open)
+                {
+                    os::Mutex::AutoLock Guard(&Lock);
+                    for (size_t i = 0; i < Clients.size(); i++)
+                    {
+                        if (Clients[i] == Conn)
+                        {
+                            Clients[i] = Clients.back();
+                            Clients.pop_back();
+                            break;
+                        }
+                    }
+                }
+                delete Client;
+            }
+
+            bool Handshake(os::Connection* Conn, WebSocketClient* Client)
+            {
+                const char* Head = (const char*)Conn->GetInput();
+                size_t Size = (size_t)Conn->GetInputSize();
+                size_t End = FindHttpHeadEnd(Head, Size);
+                if (!End)
+                {
+                    if (Size > kMaxHandshake)
+                        Conn->Close();
+                    return false;
+                }
+                std::string Key;
+                if (strncmp(Head, "GET ", 4) != 0 || !FindHttpHeader(Head, End, "sec-websocket-key", Key))
+                {
+                    static const char kBadRequest[] = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+                    Conn->Send(kBadRequest, sizeof(kBadRequest) - 1);
+                    Conn->Close();
+                    return false;
+                }
+                String Answer;
+                Answer += "HTTP/1.1 101 Switching Protocols\r\n";
+                Answer += "Upgrade: websocket\r\n";
+                Answer += "Connection: Upgrade\r\n";
+                Answer += "Sec-WebSocket-Accept: " + AcceptKey(Key) + "\r\n\r\n";
+                Conn->Consume(End);
+                // joins the broadcast list only after the answer is queued
+                Conn->Send(Answer.CStr(), Answer.Length());
+                Client->Open = true;
+                os::Mutex::AutoLock Guard(&Lock);
+                Clients.push_back(Conn);
+                return true;
+            }
+
+            /// handles one complete frame, false when more input is needed
+            bool ReadFrame(os::Connection* Conn, WebSocketClient* Client)
+            {
+                const U8* In = Conn->GetInput();
+                U64 Size = Conn->GetInputSize();
+                if (Size < 2)
+                    return false;
+                bool Fin = (In[0] & 0x80) != 0;
+                U8 Opcode = In[0] & 0x0F;
+                bool Masked = (In[1] & 0x80) != 0;
+                U64 Length = In[1] & 0x7F;
+                U64 Pos = 2;
+                if (Length == 126)
+                {
+                    if (Size < 4)
+                        return false;
+                    Length = ((U64)In[2] << 8) | In[3];
+                    Pos = 4;
+                }
+                else if (Length == 127)
+                {
+                    if (Size < 10)
+                        return false;
+                    Length = 0;
+                    for (int i = 0; i < 8; i++)
+                        Length = (Length << 8) | In[2 + i];
+                    Pos = 10;
+                }
+                if (Length > kMaxMessage || Client->Message.size() + Length > kMaxMessage)
+                {
+                    Conn->Close();
+                    return false;
+                }
+                U8 Mask[4] = { 0, 0, 0, 0 };
+                if (Masked)
+                {
+                    if (Size < Pos + 4)
+                        return false;
+                    memcpy(Mask, In + Pos, 4);
+                    Pos += 4;
+                }
+                if (Size < Pos + Length)
+                    return false;
+
+                // data frames are unmasked straight into the message they extend, which keeps
+                // its capacity from one message to the next
+                if (Opcode == OpText || Opcode == OpBinary || Opcode == OpContinuation)
+                {
+                    if (Opcode != OpContinuation)
+                    {
+                        Client->Binary = Opcode == OpBinary;
+                        Client->Message.clear();
+                    }
+                    size_t Offset = Client->Message.size();
+                    Client->Message.resize(Offset + (size_t)Length);
+                    WebSocketMask((U8*)&Client->Message[0] + Offset, In + Pos, Length, Mask);
+                    Conn->Consume(Pos + Length);
+                    if (Fin)
+                        Deliver(Conn, Client);
+                    return true;
+                }
+
+                std::string Payload((size_t)Length, '\0');
+                WebSocketMask((U8*)&Payload[0], In + Pos, Length, Mask);
+                Conn->Consume(Pos + Length);
+                switch (Opcode)
+                {
+                case OpPing:
+                {
+                    std::string Pong;
+                    AppendFrame(Pong, OpPong, Payload.data(), Payload.size());
+                    Conn->Send(Pong.data(), Pong.size());
+                    break;
+                }
+                case OpPong:
+                    break;
+                case OpClose:
+                default:
+                {
+                    // echoes the status code back, then closes once it is sent
+                    std::string Close;
+                    AppendFrame(Close, OpClose, Payload.data(), Payload.size() < 2 ? 0 : 2);
+                    Conn->Send(Close.data(), Close.size());
+                    Conn->Close();
+                    return false;
+                }
+                }
+                return true;
+            }
+
+            void Deliver(os::Connection* Conn, WebSocketClient* Client)
+            {
+                if (Callback)
+                    Callback(Conn, Client->Message.data(), Client->Message.size(), Client->Binary, UserData);
+                Client->Message.clear();
+            }
+
+            os::Reactor*                Loop;
+            PFN_WebSocketMessage        Callback;
+            void*                       UserData;
+            mutable os::Mutex           Lock;
+            std::vector<os::Connection*> Clients;
+        };
+
+        WebSocketServer::WebSocketServer(os::Reactor* Loop)
+            : d(new WebSocketServerPrivate(Loop))
+        {
+        }
+
+        WebSocketServer::~WebSocketServer()
+        {
+            delete d;
+            d = nullptr;
+        }
+
+        I32 WebSocketServer::Listen(os::IpAddress const& Address)
+        {
+            return d->Loop->Listen(Address, d);
+        }
+
+        void WebSocketServer::SetMessageCallback(PFN_WebSocketMessage Callback, void* UserData)
+        {
+            d->Callback = Callback;
+            d->UserData = UserData;
+        }
+
+        void WebSocketServer::Broadcast(const char* Data, U64 Size, bool Binary)
+        {
+            os::IoSlice Slice = { Data, Size };
+            Broadcast(&Slice, 1, Binary);
+        }
+
+        void WebSocketServer::Broadcast(const os::IoSlice* Slices, U32 Count, bool Binary)
+        {
+            U64 Size = 0;
+            for (U32 i = 0; i < Count; i++)
+                Size += Slices[i].Size;
+            U8 Head[10];
+            os::IoSlice Inline[8];
+            std::vector<os::IoSlice> Spilled;
+            os::IoSlice* Frame = Inline;
+            if (Count + 1 > 8)
+            {
+                Spilled.resize(Count + 1);
+                Frame = Spilled.data();
+            }
+            Frame[0].Data = Head;
+            Frame[0].Size = MakeFrameHeader(Head, Binary ? OpBinary : OpText, Size);
+            for (U32 i = 0; i < Count; i++)
+                Frame[i + 1] = Slices[i];
+            // clients leave the list in OnClosed under the same lock, so none is freed here
+            os::Mutex::AutoLock Guard(&d->Lock);
+            for (os::Connection* Client : d->Clients)
+                Client->Send(Frame, Count + 1);
+        }
+
+        U32 WebSocketServer::GetClientCount() const
+        {
+            os::Mutex::AutoLock Guard(&d->Lock);
+            return (U32)d->Clients.size();
+        }
+
+        static void AppendJsonString(std::string& Out, const char* Text)
+        {
+            Out.push_back('"');
+            for (const char* c = Text ? Text : ""; *c; c++)
+            {
+                switch (*c)
+                {
+                case '"': Out += "\\\""; break;
+                case '\\': Out += "\\\\"; break;
+                case '\n': Out += "\\n"; break;
+                case '\r': Out += "\\r"; break;
+                case '\t': Out += "\\t"; break;
+                default:
+                    if ((unsigned char)*c < 0x20)
+                    {
+                        char Escaped[8];
+                        snprintf(Escaped, sizeof(Escaped), "\\u%04x", (unsigned)*c);
+                        Out += Escaped;
+                    }
+                    else
+                    {
+                        Out.push_back(*c);
+                    }
+                }
+            }
+            Out.push_back('"');
+        }
+
+        WebSocketLogger::WebSocketLogger(os::IpAddress const& Address)
+            : m_Server(&m_Reactor)
+            , m_Port(-1)
+        {
+            m_Port = m_Server.Listen(Address);
+            if (m_Port >= 0)
+                m_Reactor.Start("WebSocketLogger");
+        }
+
+        WebSocketLogger::~WebSocketLogger()
+        {
+            m_Reactor.Stop();
+        }
+
+        void WebSocketLogger::Log(ELogLevel const& Level, const char* Tag, const char* Line)
+        {
+            if (!m_Server.GetClientCount())
+                return;
+            std::string Json = "{\"LogLevel\":" + std::to_string((int)Level) + ",\"Tag\":";
+            AppendJsonString(Json, Tag);
+            Json += ",\"Log\":";
+            AppendJsonString(Json, Line);
+            Json += "}";
+            m_Server.Broadcast(Json.data(), Json.size());
+        }
     }
 }
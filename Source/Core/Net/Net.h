@@ -22,22 +22,336 @@ namespace k3d
             WebSocketImpl*      d;
         };
 
+        /**
+         * Out[i] = In[i] ^ Mask[i % 4], the masking of client frame payloads, which
+         * also takes it off again. Out may be In. Goes 64 bytes a step with AVX2,
+         * 32 with SSE2 or NEON, then a word at a time.
+         */
+        K3D_CORE_API void WebSocketMask(U8* Out, const U8* In, U64 Size, const U8 Mask[4]);
+
+        /// Data is the unmasked payload, only valid during the call
+        typedef void(*PFN_WebSocketMessage)(os::Connection* Client, const char* Data, U64 Size,
+            bool Binary, void* UserData);
+
+        /**
+         * WebSocket endpoint served by an os::Reactor. Answers the opening handshake,
+         * decodes the frames of every client and replies to pings and closes, so one
+         * reactor thread serves all the clients.
+         */
+        class K3D_CORE_API WebSocketServer
+        {
+        public:
+            explicit WebSocketServer(os::Reactor* Loop);
+            /// destroy the reactor first, it reports the remaining clients closed
+            ~WebSocketServer();
+
+            /// \return the bound port, -1 on failure
+            I32  Listen(os::IpAddress const& Address);
+            void SetMessageCallback(PFN_WebSocketMessage Callback, void* UserData);
+
+            /// sends one frame to every client past the handshake, thread safe
+            void Broadcast(const char* Data, U64 Size, bool Binary = false);
+            /// one frame holding the slices back to back, sent behind its header with one
+            /// vectored send per client, so the payload is not copied into a frame first
+            void Broadcast(const os::IoSlice* Slices, U32 Count, bool Binary = false);
+            U32  GetClientCount() const;
+
+            WebSocketServer(const WebSocketServer&) = delete;
+            WebSocketServer& operator=(const WebSocketServer&) = delete;
+
+        private:
+            struct WebSocketServerPrivate* d;
+        };
+
+        /**
+         * Streams log lines as JSON text frames to the connected WebSocket clients,
+         * { "LogLevel": 2, "Tag": "...", "Log": "..." }. Serves from a reactor thread
+         * of its own, Log only queues the frame and never blocks on a slow client.
+         */
+        class K3D_CORE_API WebSocketLogger : public ILogger
+        {
+        public:
+            explicit WebSocketLogger(os::IpAddress const& Address);
+            ~WebSocketLogger() override;
+
+            void Log(ELogLevel const& Level, const char* Tag, const char* Line) override;
+            /// -1 if the address couldn't be bound
+            I32  GetPort() const { return m_Port; }
+
+        private:
+            // declared first so the reactor is gone before the server it calls into
+            WebSocketServer     m_Server;
+            os::Reactor         m_Reactor;
+            I32                 m_Port;
+        };
+
+        /**
+         * Small HTTP/1.1 file server for bundles and shader caches, driven by an
+         * os::Reactor. GET and HEAD map the request path below Root, bodies go out
+         * with Connection::SendFile so multi-GB files stream without passing through
+         * user memory. Keeps connections alive, answers pipelined requests in order
+         * and serves single byte ranges, ETag and If-None-Match.
+         */
+        class K3D_CORE_API AssetServer
+        {
+        public:
+            AssetServer(os::Reactor* Loop, const char* Root);
+            /// destroy the reactor first, it reports the remaining clients closed
+            ~AssetServer();
+
+            /// \return the bound port, -1 on failure
+            I32 Listen(os::IpAddress const& Address);
+
+            U64 GetRequestCount() const;
+            /// body bytes queued for sending
+            U64 GetBytesServed() const;
+
+            AssetServer(const AssetServer&) = delete;
+            AssetServer& operator=(const AssetServer&) = delete;
+
+        private:
+            struct AssetServerPrivate* d;
+        };
+
+        /// request for HttpClient, Url is "http://host[:port]/path[?query]"
         class K3D_CORE_API HttpRequest
         {
         public:
             HttpRequest();
+            HttpRequest(const char* InMethod, const char* InUrl);
+
+            /// Host, Content-Length and Connection are written by the client
+            HttpRequest& AddHeader(const char* Name, const char* Value);
+
+            String      Method;
+            String      Url;
+            /// "Name: Value\r\n" lines
+            String      Headers;
+            String      Body;
+        };
+
+        class K3D_CORE_API HttpResponse
+        {
+        public:
+            HttpResponse();
+
+            /// case insensitive lookup in Head
+            bool        GetHeader(const char* Name, String& Value) const;
+
+            /// 0 when no complete response arrived
+            I32         Status;
+            /// status line and header fields, up to the blank line
+            String      Head;
+            String      Body;
+        };
+
+        enum class HttpOutcome : U8
+        {
+            /// a whole response arrived, whatever its status
+            Completed,
+            Failed,
+            TimedOut,
+            Cancelled,
         };
 
+        struct HttpAsyncRequest;
+        typedef void(*PFN_HttpCompletion)(HttpAsyncRequest& Request);
+
+        /**
+         * One request for HttpClient::Submit, owned by the caller and left untouched by
+         * the client until completion, like os::IORequest.
+         */
+        struct HttpAsyncRequest
+        {
+            HttpRequest         Request;
+            /// takes the 2xx body as in HttpClient::Fetch
+            IIODevice*          BodySink = nullptr;
+            /// from Submit to the last body byte, 0 waits as long as it takes
+            U32                 TimeoutMs = 0;
+            /// called on the client's reactor thread, keep it short, or as a task on Jobs;
+            /// it may free the request when there is no Counter
+            PFN_HttpCompletion  OnComplete = nullptr;
+            void*               UserData = nullptr;
+            os::ThreadPool*     Jobs = nullptr;
+            /// Done() is called after OnComplete
+            os::JobCounter*     Counter = nullptr;
+
+            /// Status 0 unless the Outcome is Completed
+            HttpResponse        Response;
+            HttpOutcome         Outcome = HttpOutcome::Failed;
+            /// set by Submit, names the request for Cancel
+            U64                 Id = 0;
+        };
+
+        /**
+         * HTTP/1.1 client keeping a pool of connections per host, served by a reactor
+         * thread of its own. A connection stays open after its response and is reused
+         * by the next request to the host until it idled for the idle timeout; at most
+         * MaxConnectionsPerHost are opened per host, further requests wait for one.
+         * Past that limit GET and HEAD may be pipelined behind the requests in flight
+         * on a busy connection. An idempotent request whose pooled connection turns
+         * out closed by the server is retried once on a fresh one. Fetch blocks the
+         * caller, Submit starts requests and completes them later without a thread
+         * waiting on each.
+         */
         class K3D_CORE_API HttpClient
         {
         public:
             HttpClient();
+            /// fails the requests still in flight
             ~HttpClient();
 
+            /// default 6
+            void        SetMaxConnectionsPerHost(U32 Count);
+            /// default 30 seconds
+            void        SetIdleTimeout(U32 Milliseconds);
+            /// requests in flight per connection, default 1, which disables pipelining
+            void        SetPipelineDepth(U32 Depth);
+
+            /**
+             * Blocks until the response is complete, thread safe. With a BodySink a 2xx
+             * body is written to it as it arrives, de-chunked, and Body stays empty;
+             * an os::File or MemMapFile takes a multi-GB download in constant memory.
+             * The sink is written on the reactor thread, a slow one stops the reading
+             * so TCP throttles the server. A short Write fails the request.
+             */
+            HttpResponse Fetch(HttpRequest const& Request, IIODevice* BodySink = nullptr);
+
+            /**
+             * Starts Requests[0..Count) and returns at once, thread safe. They must stay
+             * valid until their completion; any number may be in flight. The first
+             * request to a host resolves its name on the calling thread, one with a bad
+             * url or host completes as Failed right away.
+             */
+            void        Submit(HttpAsyncRequest* Requests, U32 Count);
+            /// \return the request's Id, still valid when the request is already gone
+            U64         Submit(HttpAsyncRequest& Request);
+            /**
+             * Completes the request with this Id as Cancelled unless it completed already,
+             * thread safe. Returns before that happens, wait for the completion before
+             * reusing the request. One whose response was arriving costs its connection.
+             */
+            void        Cancel(U64 RequestId);
+
+            /// connections opened so far, a reused one counts once
+            U64         GetConnectCount() const;
+            U32         GetOpenConnectionCount() const;
+
+            HttpClient(const HttpClient&) = delete;
+            HttpClient& operator=(const HttpClient&) = delete;
+
+        private:
+            struct HttpClientPrivate* d;
+        };
+
+        /// called on the thread running Download about every 100 ms, and once at the end
+        typedef void(*PFN_DownloadProgress)(U64 Received, U64 Total, float KBPerSecond, void* UserData);
+
+        /**
+         * Fetches one large resource as byte ranges over the pooled connections of a
+         * HttpClient, several at a time, straight into a preallocated, memory mapped
+         * file at their offsets. Finished ranges are recorded with their content hash
+         * in "<Path>.part", so an interrupted download resumes with the missing ranges;
+         * on resume a recorded range whose bytes no longer match is fetched again. The
+         * record is dropped when the server's ETag, Last-Modified or size changed.
+         * Servers without "Accept-Ranges: bytes" get a single streamed GET.
+         */
+        class K3D_CORE_API Downloader
+        {
+        public:
+            /// Client should allow as many connections per host as the parallelism
+            explicit Downloader(HttpClient* Client);
+            ~Downloader();
+
+            /// default 4 MB
+            void        SetRangeSize(U64 Bytes);
+            /// ranges in flight, default 4
+            void        SetParallelism(U32 Count);
+            void        SetProgressCallback(PFN_DownloadProgress Callback, void* UserData);
+            /**
+             * Expected FileIndex::HashContent of every range in order, from a manifest.
+             * A range that doesn't match is fetched once more, then the download fails.
+             */
+            void        SetExpectedHashes(const U64* Hashes, U32 Count);
 
+            /// blocks until Path holds the whole resource, on failure the progress is kept
+            bool        Download(const char* Url, const char* Path);
+            /// thread safe, ranges in flight finish and are recorded, Download returns false
+            void        Cancel();
+
+            /// resource size, known once the download started
+            U64         GetTotalSize() const;
+            /// bytes taken from a previous attempt by the last Download
+            U64         GetResumedBytes() const;
+            U32         GetRangeCount() const;
+
+            Downloader(const Downloader&) = delete;
+            Downloader& operator=(const Downloader&) = delete;
+
+        private:
+            struct DownloaderPrivate* d;
         };
 
+        /// body handed out by HttpCache, mapped read only from the cache file when it was stored raw
+        class K3D_CORE_API HttpCacheBody
+        {
+        public:
+            HttpCacheBody();
+            ~HttpCacheBody();
+
+            const U8*   GetData() const;
+            U64         GetSize() const;
+            /// the server answered 304 and the body came from disk
+            bool        IsFromCache() const;
+
+            HttpCacheBody(const HttpCacheBody&) = delete;
+            HttpCacheBody& operator=(const HttpCacheBody&) = delete;
+
+        private:
+            friend class HttpCache;
+            struct HttpCacheBodyPrivate* d;
+        };
 
+        /**
+         * Disk cache for GET responses in front of a HttpClient, keyed by URL. A stored
+         * entry is revalidated with If-None-Match and If-Modified-Since on every Get;
+         * a 304 costs a round trip without body and the entry is served from disk.
+         * Bodies that compress are kept in the CompressedStream block format, the
+         * others raw, so those are handed out straight from a read only mapping. The
+         * least recently used entries are dropped past the size cap. The index is
+         * rewritten at most once a second while storing, and on destruction.
+         */
+        class K3D_CORE_API HttpCache
+        {
+        public:
+            /// Directory null keeps the cache in "<DataDir>/HttpCache"
+            explicit HttpCache(HttpClient* Client, const char* Directory = nullptr);
+            /// saves the index
+            ~HttpCache();
+
+            /// bytes on disk, default 256 MB; a body larger than a quarter of it is not kept
+            void        SetMaxSize(U64 Bytes);
+
+            /**
+             * Fetches Request, a GET, through the cache, thread safe. A fresh 200 is
+             * stored when it carries an ETag or Last-Modified and no "no-store". On a
+             * 304 the stored head is returned with Status 200. The content goes to Body
+             * for 200s, the response's own Body stays empty then.
+             */
+            HttpResponse Get(HttpRequest const& Request, HttpCacheBody& Body);
+
+            /// drops every entry
+            void        Clear();
+            U32         GetEntryCount() const;
+            /// bytes on disk
+            U64         GetSize() const;
+
+            HttpCache(const HttpCache&) = delete;
+            HttpCache& operator=(const HttpCache&) = delete;
+
+        private:
+            struct HttpCachePrivate* d;
+        };
     }
 }
 
@@ -0,0 +1,570 @@
+#include "CoreMinimal.h"
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#if K3DPLATFORM_OS_UNIX
+#include <pthread.h>
+#endif
+
+#if K3DPLATFORM_OS_WINDOWS
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace k3d;
+
+/**
+ * Microbenchmarks of Core primitives against their platform equivalents,
+ * prints ns per operation, or MB/s for the ones moving bytes.
+ * Usage: BenchCore [threads] [iterations]
+ */
+
+static U64 NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#if K3DPLATFORM_OS_UNIX
+struct PthreadMutex
+{
+    PthreadMutex() { pthread_mutex_init(&m, nullptr); }
+    ~PthreadMutex() { pthread_mutex_destroy(&m); }
+    void Lock() { pthread_mutex_lock(&m); }
+    void UnLock() { pthread_mutex_unlock(&m); }
+    pthread_mutex_t m;
+};
+
+struct PthreadRWLock
+{
+    PthreadRWLock() { pthread_rwlock_init(&m, nullptr); }
+    ~PthreadRWLock() { pthread_rwlock_destroy(&m); }
+    void Lock() { pthread_rwlock_wrlock(&m); }
+    void UnLock() { pthread_rwlock_unlock(&m); }
+    void LockShared() { pthread_rwlock_rdlock(&m); }
+    void UnLockShared() { pthread_rwlock_unlock(&m); }
+    pthread_rwlock_t m;
+};
+#endif
+
+struct StdMutex
+{
+    void Lock() { m.lock(); }
+    void UnLock() { m.unlock(); }
+    std::mutex m;
+};
+
+/// the condition variable semaphore KTL/Semaphore.hpp used to provide
+struct CondVarSemaphore
+{
+    void Signal()
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        ++count;
+        cv.notify_one();
+    }
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (count == 0)
+            cv.wait(lock);
+        count--;
+    }
+    std::mutex mtx;
+    std::condition_variable cv;
+    int count = 0;
+};
+
+template <class F>
+static double RunThreads(U32 threads, F const& body)
+{
+    DynArray<os::Thread*> workers;
+    U64 begin = NowNs();
+    for (U32 i = 1; i < threads; i++)
+    {
+        workers.Append(new os::Thread([&body, i]() { body(i); }, String::Format("Bench%u", i)));
+    }
+    body(0);
+    for (auto worker : workers)
+    {
+        worker->Join();
+        delete worker;
+    }
+    return (double)(NowNs() - begin);
+}
+
+template <class TLock>
+static void BenchLock(const char* name, U32 threads, U32 iterations)
+{
+    TLock lock;
+    volatile U64 counter = 0;
+    double single = RunThreads(1, [&](U32) {
+        for (U32 i = 0; i < iterations; i++)
+        {
+            lock.Lock();
+            counter = counter + 1;
+            lock.UnLock();
+        }
+    });
+    double contended = RunThreads(threads, [&](U32) {
+        for (U32 i = 0; i < iterations; i++)
+        {
+            lock.Lock();
+            counter = counter + 1;
+            lock.UnLock();
+        }
+    });
+    printf("%-28s %12.2f %12.2f\n", name, single / iterations, contended / ((double)iterations * threads));
+}
+
+template <class TLock>
+static void BenchReadMostly(const char* name, U32 threads, U32 iterations)
+{
+    TLock lock;
+    U64 table[16] = {};
+    volatile U64 sink = 0;
+    double elapsed = RunThreads(threads, [&](U32 id) {
+        U64 local = 0;
+        for (U32 i = 0; i < iterations; i++)
+        {
+            if ((i & 31) == (id & 31))
+            {
+                lock.Lock();
+                table[i & 15]++;
+                lock.UnLock();
+            }
+            else
+            {
+                lock.LockShared();
+                local += table[i & 15];
+                lock.UnLockShared();
+            }
+        }
+        sink = sink + local;
+    });
+    printf("%-28s %12s %12.2f\n", name, "-", elapsed / ((double)iterations * threads));
+}
+
+template <class TSemaphore>
+static void BenchPingPong(const char* name, U32 iterations)
+{
+    TSemaphore ping, pong;
+    os::Thread peer([&]() {
+        for (U32 i = 0; i < iterations; i++)
+        {
+            ping.Wait();
+            pong.Signal();
+        }
+    }, "PingPong");
+    U64 begin = NowNs();
+    for (U32 i = 0; i < iterations; i++)
+    {
+        ping.Signal();
+        pong.Wait();
+    }
+    double elapsed = (double)(NowNs() - begin);
+    peer.Join();
+    printf("%-28s %12s %12.2f\n", name, "-", elapsed / iterations);
+}
+
+template <class F>
+static void BenchClock(const char* name, U32 iterations, F const& now)
+{
+    volatile U64 sink = 0;
+    U64 begin = NowNs();
+    for (U32 i = 0; i < iterations; i++)
+    {
+        sink = sink + now();
+    }
+    double elapsed = (double)(NowNs() - begin);
+    printf("%-28s %12.2f %12s\n", name, elapsed / iterations, "-");
+}
+
+static void MaskBytes(U8* Out, const U8* In, U64 Size, const U8 Mask[4])
+{
+    for (U64 i = 0; i < Size; i++)
+        Out[i] = In[i] ^ Mask[i & 3];
+}
+
+template <class F>
+static void BenchMask(const char* name, U32 iterations, F const& mask)
+{
+    const U64 size = 1024 * 1024;
+    std::vector<U8> in(size, 0x5A), out(size);
+    const U8 key[4] = { 1, 2, 3, 4 };
+    U64 begin = NowNs();
+    for (U32 i = 0; i < iterations; i++)
+        mask(out.data(), in.data(), size, key);
+    double elapsed = (double)(NowNs() - begin);
+    printf("%-28s %12.1f\n", name, (double)size * iterations * 1000.0 / elapsed);
+}
+
+/// counts what arrives at the server, the client floods it with masked frames
+struct WebSocketSink : public os::IConnectionHandler
+{
+    std::atomic<U64> Received{ 0 };
+    const std::string* Frames = nullptr;
+    U32 Count = 0;
+
+    void OnConnected(os::Connection* Conn) override
+    {
+        static const char request[] =
+            "GET / HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+            "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+        Conn->Send(request, sizeof(request) - 1);
+        for (U32 i = 0; i < Count; i++)
+            Conn->Send(Frames->data(), Frames->size());
+    }
+    void OnReceived(os::Connection* Conn) override { Conn->Consume(Conn->GetInputSize()); }
+};
+
+static void OnBenchMessage(os::Connection*, const char*, U64 Size, bool, void* UserData)
+{
+    ((std::atomic<U64>*)UserData)->fetch_add(Size);
+}
+
+static void BenchWebSocket(U64 frameSize, U32 count)
+{
+    std::string frame = { (char)0x82, (char)0xFF, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4 };
+    for (int i = 0; i < 8; i++)
+        frame[2 + i] = (char)(frameSize >> (56 - 8 * i));
+    frame.resize(frame.size() + frameSize, 'x');
+    std::atomic<U64> received{ 0 };
+    WebSocketSink client;
+    client.Frames = &frame;
+    client.Count = count;
+    {
+        os::Reactor* loop = new os::Reactor;
+        net::WebSocketServer server(loop);
+        // released before the server, which it reports the connections closed to
+        std::unique_ptr<os::Reactor> owner(loop);
+        server.SetMessageCallback(OnBenchMessage, &received);
+        I32 port = server.Listen(os::IpAddress("127.0.0.1:0"));
+        loop->Start("WebSocketBench");
+        U64 begin = NowNs();
+        loop->Connect(os::IpAddress(String::Format("127.0.0.1:%d", port)), &client);
+        while (received.load() < frameSize * count)
+            os::Sleep(1);
+        double elapsed = (double)(NowNs() - begin);
+        char name[64];
+        snprintf(name, sizeof(name), "WebSocket %llu KB frames", (unsigned long long)(frameSize / 1024));
+        printf("%-28s %12.1f\n", name, (double)frameSize * count * 1000.0 / elapsed);
+    }
+}
+
+/// a Size file served by a local AssetServer, fetched with 1, 2 and 4 ranges in flight
+static void BenchDownload(U64 size)
+{
+    os::Remove("bench_download");
+    os::MakeDir("bench_download");
+    {
+        std::vector<char> chunk(1024 * 1024);
+        for (size_t i = 0; i < chunk.size(); i++)
+            chunk[i] = (char)(i * 7 + (i >> 12));
+        os::File file("bench_download/asset.bin");
+        file.Open(IOFlag::Write);
+        for (U64 written = 0; written < size; written += chunk.size())
+            file.Write(chunk.data(), (size_t)std::min<U64>(chunk.size(), size - written));
+    }
+    {
+        os::Reactor* loop = new os::Reactor;
+        net::AssetServer server(loop, "bench_download");
+        std::unique_ptr<os::Reactor> owner(loop);
+        I32 port = server.Listen(os::IpAddress("127.0.0.1:0"));
+        loop->Start("DownloadBench");
+        String url = String::Format("http://127.0.0.1:%d/asset.bin", port);
+        char name[64];
+        for (U32 ranges : { 1U, 2U, 4U })
+        {
+            os::Remove("bench_download/copy.bin");
+            net::HttpClient client;
+            net::Downloader loader(&client);
+            loader.SetParallelism(ranges);
+            U64 begin = NowNs();
+            bool ok = loader.Download(url.CStr(), "bench_download/copy.bin");
+            double elapsed = (double)(NowNs() - begin);
+            snprintf(name, sizeof(name), "Downloader %u ranges", ranges);
+            printf("%-28s %12.1f%s\n", name, (double)size * 1000.0 / elapsed, ok ? "" : " (failed)");
+        }
+    }
+    os::Remove("bench_download/asset.bin");
+    os::Remove("bench_download/copy.bin");
+    os::Remove("bench_download");
+}
+
+/// count small GETs spread over threads, a new connection for each when close is set
+static void RunHttp(const char* name, net::HttpClient& client, String const& base, U32 threads, U32 count, bool close)
+{
+    std::atomic<U32> ok{ 0 };
+    U64 begin = NowNs();
+    {
+        os::ThreadPool pool(threads, "HttpBench");
+        os::JobCounter done;
+        for (U32 t = 0; t < threads; t++)
+            pool.Enqueue([&, t]() {
+                for (U32 i = 0; i < count / threads; i++)
+                {
+                    net::HttpRequest request("GET", (base + String::Format("%u.txt", (t + i) % 16)).CStr());
+                    if (close)
+                        request.AddHeader("Connection", "close");
+                    if (client.Fetch(request).Status == 200)
+                        ok++;
+                }
+            }, os::TaskPriority::Normal, &done);
+        done.Wait();
+    }
+    double elapsed = (double)(NowNs() - begin);
+    printf("%-28s %12.1f %12llu%s\n", name, ok.load() * 1e9 / elapsed,
+        (unsigned long long)client.GetConnectCount(), ok.load() == count / threads * threads ? "" : " (failed)");
+}
+
+/// HttpClient against a local AssetServer: a connection per request, a keep-alive pool, and pipelining
+static void BenchHttp(U32 threads, U32 count)
+{
+    os::Remove("bench_http");
+    os::MakeDir("bench_http");
+    char path[64];
+    for (U32 i = 0; i < 16; i++)
+    {
+        snprintf(path, sizeof(path), "bench_http/%u.txt", i);
+        os::File file(path);
+        file.Open(IOFlag::Write);
+        file.Write("0123456789abcdef", 16);
+    }
+    {
+        os::Reactor* loop = new os::Reactor;
+        net::AssetServer server(loop, "bench_http");
+        std::unique_ptr<os::Reactor> owner(loop);
+        I32 port = server.Listen(os::IpAddress("127.0.0.1:0"));
+        loop->Start("HttpBench");
+        String base = String::Format("http://127.0.0.1:%d/", port);
+        char name[64];
+        {
+            net::HttpClient client;
+            snprintf(name, sizeof(name), "Connection: close, %u thr", threads);
+            RunHttp(name, client, base, threads, count, true);
+        }
+        {
+            net::HttpClient client;
+            client.SetMaxConnectionsPerHost(threads);
+            snprintf(name, sizeof(name), "keep-alive pool, %u thr", threads);
+            RunHttp(name, client, base, threads, count, false);
+        }
+        {
+            net::HttpClient client;
+            client.SetMaxConnectionsPerHost(2);
+            client.SetPipelineDepth(8);
+            snprintf(name, sizeof(name), "2 conns depth 8, %u thr", threads);
+            RunHttp(name, client, base, threads, count, false);
+        }
+    }
+    for (U32 i = 0; i < 16; i++)
+    {
+        snprintf(path, sizeof(path), "bench_http/%u.txt", i);
+        os::Remove(path);
+    }
+    os::Remove("bench_http");
+}
+
+static void BenchBase64(U32 iterations)
+{
+    const size_t size = 1024 * 1024;
+    std::vector<U8> data(size);
+    for (size_t i = 0; i < size; i++)
+        data[i] = (U8)(i * 131 + (i >> 9));
+    std::vector<char> text(Base64EncodedLength(size));
+    std::vector<U8> decoded(Base64DecodedCapacity(text.size()));
+    U64 begin = NowNs();
+    for (U32 i = 0; i < iterations; i++)
+        Base64Encode(data.data(), size, text.data());
+    double encode = (double)(NowNs() - begin);
+    begin = NowNs();
+    for (U32 i = 0; i < iterations; i++)
+        Base64Decode(text.data(), text.size(), decoded.data());
+    double decode = (double)(NowNs() - begin);
+    printf("%-28s %12.1f\n", "Base64Encode", (double)size * iterations * 1000.0 / encode);
+    printf("%-28s %12.1f\n", "Base64Decode", (double)size * iterations * 1000.0 / decode);
+}
+
+template <class F>
+static void BenchHash(const char* name, U32 iterations, F const& hash)
+{
+    const size_t size = 4 * 1024 * 1024;
+    std::vector<U8> data(size);
+    for (size_t i = 0; i < size; i++)
+        data[i] = (U8)(i * 131 + (i >> 9));
+    volatile U64 sink = 0;
+    U64 begin = NowNs();
+    for (U32 i = 0; i < iterations; i++)
+        sink = hash(data.data(), size);
+    double elapsed = (double)(NowNs() - begin);
+    printf("%-28s %12.1f\n", name, (double)size * iterations * 1000.0 / elapsed);
+}
+
+/// a synthetic bundle of 16-256 KB chunks, digested one by one and as a batch
+static void BenchDigest(U32 iterations)
+{
+    const size_t size = 64 * 1024 * 1024;
+    std::vector<U8> bundle(size);
+    for (size_t i = 0; i < size; i++)
+        bundle[i] = (U8)(i * 131 + (i >> 9));
+    std::vector<DigestJob> chunks;
+    U32 state = 0x9E3779B9;
+    for (size_t pos = 0; pos < size;)
+    {
+        state = state * 1664525u + 1013904223u;
+        size_t chunk = std::min<size_t>(size - pos, 16 * 1024 + (state >> 8) % (240 * 1024));
+        chunks.push_back({ bundle.data() + pos, chunk });
+        pos += chunk;
+    }
+    U32 count = (U32)chunks.size();
+    auto report = [&](const char* name, U64 begin) {
+        printf("%-28s %12.1f\n", name, (double)size * iterations * 1000.0 / (double)(NowNs() - begin));
+    };
+
+    U64 begin = NowNs();
+    for (U32 i = 0; i < iterations; i++)
+        for (DigestJob& job : chunks)
+            memcpy(job.Digest, MD5(job.Data, job.Size).digest(), 16);
+    report("MD5 one by one", begin);
+    begin = NowNs();
+    for (U32 i = 0; i < iterations; i++)
+        MD5Batch(chunks.data(), count);
+    report("MD5Batch", begin);
+    begin = NowNs();
+    for (U32 i = 0; i < iterations; i++)
+    {
+        for (DigestJob& job : chunks)
+        {
+            SHA1 sha;
+            sha.Input((const char*)job.Data, (unsigned)job.Size);
+            unsigned words[5];
+            sha.Result(words);
+            memcpy(job.Digest, words, 20);
+        }
+    }
+    report("SHA1 one by one", begin);
+    begin = NowNs();
+    for (U32 i = 0; i < iterations; i++)
+        SHA1Batch(chunks.data(), count);
+    report("SHA1Batch", begin);
+}
+
+static void BenchRegex(U32 iterations)
+{
+    std::string log;
+    std::vector<std::string> lines;
+    for (U32 i = 0; log.size() < 4 * 1024 * 1024; i++)
+    {
+        lines.push_back("[" + std::to_string(i) + "] " + (i % 3 ? "info" : "error") + ": request " + std::to_string(i * 7) + " took 12ms");
+        log += lines.back() + "\n";
+    }
+    const char* expr = "\\[(\\d+)\\] error: request (\\d+)";
+    volatile U32 sink = 0;
+
+    U64 begin = NowNs();
+    for (U32 i = 0; i < iterations; i++)
+        for (std::string const& line : lines)
+            sink = sink + RegEx(expr, RegEx::Default).Match(line.c_str());
+    printf("%-28s %12.1f\n", "RegEx per line", (double)log.size() * iterations * 1000.0 / (double)(NowNs() - begin));
+    begin = NowNs();
+    RegEx pattern(expr, RegEx::Default);
+    for (U32 i = 0; i < iterations; i++)
+        for (auto all = pattern.MatchAll(log.data(), log.size()); all.Next();)
+            sink = sink + (U32)all.GetGroup(2U).Size;
+    printf("%-28s %12.1f\n", "RegEx::MatchAll", (double)log.size() * iterations * 1000.0 / (double)(NowNs() - begin));
+}
+
+static void BenchSimd(U32 iterations)
+{
+    const U32 count = 1 << 20;
+    std::vector<float> x(count), y(count), z(count), r(count), curve(256), out(count);
+    std::vector<U8> visible(count);
+    U32 state = 0x9E3779B9;
+    auto next = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (float)(state >> 8) / (float)(1 << 24);
+    };
+    for (U32 i = 0; i < count; i++)
+    {
+        x[i] = next() * 4.0f - 2.0f;
+        y[i] = next() * 4.0f - 2.0f;
+        z[i] = next() * 4.0f - 2.0f;
+        r[i] = next() * 0.25f;
+    }
+    for (U32 i = 0; i < 256; i++)
+        curve[i] = (float)i * i / (255.0f * 255.0f);
+    const float planes[6][4] = {
+        { 1, 0, 0, 1 }, { -1, 0, 0, 1 }, { 0, 1, 0, 1 }, { 0, -1, 0, 1 }, { 0, 0, 1, 1 }, { 0, 0, -1, 1 } };
+
+    printf("%-28s %12s\n", "M elements/s", "");
+    char name[64];
+    for (U32 lanes : { 1U, 4U, 8U, 16U })
+    {
+        if (simd::SelectSimdWidth(lanes) != lanes)
+            continue;
+        U64 begin = NowNs();
+        for (U32 i = 0; i < iterations; i++)
+            simd::CullSpheres(x.data(), y.data(), z.data(), r.data(), count, planes, 6, visible.data(), lanes);
+        snprintf(name, sizeof(name), "CullSpheres %u lanes", lanes);
+        printf("%-28s %12.1f\n", name, (double)count * iterations * 1000.0 / (double)(NowNs() - begin));
+        begin = NowNs();
+        for (U32 i = 0; i < iterations; i++)
+            simd::ApplyCurve(x.data(), out.data(), count, curve.data(), 256, lanes);
+        snprintf(name, sizeof(name), "ApplyCurve %u lanes", lanes);
+        printf("%-28s %12.1f\n", name, (double)count * iterations * 1000.0 / (double)(NowNs() - begin));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    U32 threads = argc > 1 ? (U32)atoi(argv[1]) : std::max<U32>(os::GetCpuCoreNum(), 2);
+    U32 iterations = argc > 2 ? (U32)atoi(argv[2]) : 1000000;
+
+    printf("%u threads, %u iterations per thread\n", threads, iterations);
+    printf("%-28s %12s %12s\n", "ns/op", "uncontended", "contended");
+    BenchLock<os::Mutex>("os::Mutex", threads, iterations);
+#if K3DPLATFORM_OS_UNIX
+    BenchLock<PthreadMutex>("pthread_mutex", threads, iterations);
+#endif
+    BenchLock<StdMutex>("std::mutex", threads, iterations);
+    BenchLock<os::SpinMutex>("os::SpinMutex", threads, iterations);
+    BenchLock<os::AdaptiveMutex>("os::AdaptiveMutex", threads, iterations);
+    BenchLock<os::SharedMutex>("os::SharedMutex (write)", threads, iterations);
+
+    BenchReadMostly<os::SharedMutex>("os::SharedMutex (97% read)", threads, iterations);
+#if K3DPLATFORM_OS_UNIX
+    BenchReadMostly<PthreadRWLock>("pthread_rwlock (97% read)", threads, iterations);
+#endif
+
+    BenchPingPong<os::Semaphore>("os::Semaphore ping-pong", iterations / 10);
+    BenchPingPong<CondVarSemaphore>("condvar semaphore ping-pong", iterations / 10);
+
+    printf("os::Clock %s at %llu Hz\n", os::Clock::IsUsingTsc() ? "on the TSC" : "on the system clock",
+        (unsigned long long)os::Clock::GetFrequency());
+    BenchClock("os::Clock::Now", iterations, []() { return os::Clock::Now(); });
+    BenchClock("os::Clock::NowNs", iterations, []() { return os::Clock::NowNs(); });
+    BenchClock("std::chrono::steady_clock", iterations, []() { return NowNs(); });
+
+    printf("%-28s %12s\n", "MB/s", "");
+    BenchMask("byte loop unmask", 200, MaskBytes);
+    BenchMask("net::WebSocketMask", 200, net::WebSocketMask);
+    BenchBase64(100);
+    BenchHash("Hash64", 100, [](const U8* data, size_t size) { return Hash64(data, size); });
+    BenchHash("Hash64x2", 100, [](const U8* data, size_t size) { return Hash64x2(data, size).High; });
+    BenchHash("Crc32c", 100, [](const U8* data, size_t size) { return (U64)Crc32c(data, size); });
+    BenchDigest(4);
+    BenchRegex(4);
+    BenchWebSocket(64 * 1024, 4096);
+    BenchWebSocket(1024 * 1024, 256);
+    BenchDownload(1024ull * 1024 * 1024);
+    BenchSimd(20);
+
+    printf("%-28s %12s %12s\n", "HTTP GETs/s", "", "connects");
+    BenchHttp(1, 8000);
+    BenchHttp(8, 8000);
+    return 0;
+}
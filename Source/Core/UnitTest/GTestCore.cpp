@@ -1,5 +1,8 @@
 #include "CoreMinimal.h"
 #include <gtest/gtest.h>
+#include <atomic>
+#include <string>
+#include <vector>
 
 #if K3DPLATFORM_OS_WINDOWS
 #pragma comment(linker,"/subsystem:console")
@@ -19,6 +22,1809 @@ TEST(os, sys)
     EXPECT_GE(os::GetGpuCount(), 1U);
 }
 
+#if K3DPLATFORM_OS_LINUX
+TEST(os, cpu_sampler)
+{
+    os::CpuSampler sampler(50);
+    sampler.Sample();
+    os::Sleep(100);
+    sampler.Sample();
+    EXPECT_GE(sampler.GetCoreCount(), 1U);
+    DynArray<float> usage;
+    sampler.GetCoreUsage(usage);
+    EXPECT_EQ(usage.Count(), (U64)sampler.GetCoreCount());
+    DynArray<os::CpuThreadTime> times;
+    sampler.GetThreadTimes(times);
+    EXPECT_GE(times.Count(), 1);
+    profiler::Counter core0;
+    EXPECT_TRUE(profiler::GetCounter("Cpu/Core0", core0));
+}
+
+TEST(core, sampling_profiler)
+{
+    ASSERT_TRUE(profiler::StartSampling(1000));
+    EXPECT_TRUE(profiler::IsSampling());
+    volatile double sink = 0;
+    U64 start = os::GetTicks();
+    while (os::GetTicks() - start < 200)
+    {
+        sink = sink + 1.0;
+    }
+    profiler::StopSampling();
+    profiler::SamplingStats stats;
+    profiler::GetSamplingStats(stats);
+    EXPECT_GT(stats.Samples, 0U);
+    EXPECT_TRUE(profiler::ExportCollapsedStacks("sampling.folded"));
+    EXPECT_TRUE(os::Exists("sampling.folded"));
+    os::Remove("sampling.folded");
+    profiler::ResetSamples();
+}
+#endif
+
+TEST(core, lock_profiling)
+{
+    profiler::EnableLockProfiling(true);
+    os::Mutex mutex("UnitTest::Lock");
+    auto work = [&mutex]()
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            os::Mutex::AutoLock lock(&mutex);
+        }
+    };
+    os::Thread thread(work, "LockWorker");
+    work();
+    thread.Join();
+    profiler::EnableLockProfiling(false);
+
+    DynArray<profiler::LockStats> stats;
+    profiler::GetLockStats(stats);
+    bool found = false;
+    for (auto& lock : stats)
+    {
+        if (lock.Name == String("UnitTest::Lock"))
+        {
+            found = true;
+            EXPECT_EQ(lock.Acquisitions, 2000U);
+            EXPECT_GE(lock.CallSites.Count(), 1U);
+        }
+    }
+    EXPECT_TRUE(found);
+
+    // renaming a held mutex must not lose the entry its hold is charged to
+    os::Mutex renamed("UnitTest::Before");
+    profiler::EnableLockProfiling(true);
+    renamed.Lock();
+    renamed.SetName("UnitTest::After");
+    renamed.UnLock();
+    profiler::EnableLockProfiling(false);
+    profiler::ResetLockStats();
+}
+
+template <class TLock>
+static void TestLockExclusion()
+{
+    TLock lock;
+    U32 counter = 0;
+    auto work = [&lock, &counter]()
+    {
+        for (int i = 0; i < 10000; i++)
+        {
+            typename TLock::AutoLock guard(&lock);
+            counter++;
+        }
+    };
+    os::Thread thread0(work, "Locker0");
+    os::Thread thread1(work, "Locker1");
+    work();
+    thread0.Join();
+    thread1.Join();
+    EXPECT_EQ(counter, 30000U);
+}
+
+TEST(os, sync_primitives)
+{
+    TestLockExclusion<os::SpinMutex>();
+    TestLockExclusion<os::AdaptiveMutex>();
+    TestLockExclusion<os::SharedMutex>();
+
+    os::SharedMutex rwLock;
+    {
+        os::SharedMutex::AutoReadLock reader0(&rwLock);
+        EXPECT_TRUE(rwLock.TryLockShared());
+        EXPECT_FALSE(rwLock.TryLock());
+        rwLock.UnLockShared();
+    }
+    EXPECT_TRUE(rwLock.TryLock());
+    EXPECT_FALSE(rwLock.TryLockShared());
+    rwLock.UnLock();
+
+    os::Semaphore semaphore;
+    EXPECT_FALSE(semaphore.Wait(10));
+    semaphore.Signal(2);
+    EXPECT_TRUE(semaphore.TryWait());
+    EXPECT_TRUE(semaphore.Wait(10));
+    EXPECT_FALSE(semaphore.TryWait());
+}
+
+TEST(os, thread_pool)
+{
+    os::ThreadPool pool(2, "UnitTestPool");
+    EXPECT_EQ(pool.GetThreadCount(), 2U);
+    os::JobCounter counter;
+    std::atomic<U32> sum(0);
+    for (U32 i = 0; i < 300; i++)
+    {
+        pool.Enqueue([&sum, i]() { sum += i; }, (os::TaskPriority)(i % 3), &counter);
+    }
+    counter.Wait();
+    EXPECT_EQ(sum.load(), 300U * 299U / 2);
+    EXPECT_EQ(counter.Get(), 0U);
+
+    os::JobCounter pending(1);
+    EXPECT_FALSE(pending.Wait(10));
+}
+
+TEST(os, async_io)
+{
+    const U32 blockSize = os::AsyncIO::GetDirectIOAlignment();
+    const U32 numBlocks = 64;
+    {
+        os::File file("async_io.bin");
+        ASSERT_TRUE(file.Open(IOFlag::Write));
+        DynArray<char> block;
+        block.Resize(blockSize);
+        for (U32 i = 0; i < numBlocks; i++)
+        {
+            memset(block.Data(), (int)i, blockSize);
+            file.Write(block.Data(), blockSize);
+        }
+    }
+
+    os::AsyncIO io(16);
+    os::File file("async_io.bin");
+    ASSERT_TRUE(file.Open(IOFlag::Read));
+    os::IORequest requests[numBlocks];
+    os::JobCounter counter;
+    for (U32 i = 0; i < numBlocks; i++)
+    {
+        requests[i].Target = &file;
+        requests[i].Offset = (U64)i * blockSize;
+        requests[i].Buffer = os::AsyncIO::AllocAligned(blockSize);
+        requests[i].Size = blockSize;
+        requests[i].Priority = (os::TaskPriority)(i % 3);
+        requests[i].Counter = &counter;
+    }
+    io.Submit(requests, numBlocks);
+    counter.Wait();
+    for (U32 i = 0; i < numBlocks; i++)
+    {
+        EXPECT_EQ(requests[i].Result, (I64)blockSize);
+        EXPECT_EQ(((U8*)requests[i].Buffer)[blockSize - 1], (U8)i);
+        os::AsyncIO::FreeAligned(requests[i].Buffer);
+    }
+    file.Close();
+    os::Remove("async_io.bin");
+}
+
+TEST(os, async_io_short_transfer)
+{
+    // a 1000 byte cap splits every request, both backends must continue them
+    const U32 size = 100000;
+    DynArray<char> data;
+    data.Resize(size);
+    for (U32 i = 0; i < size; i++)
+    {
+        data[i] = (char)(i * 7);
+    }
+    os::AsyncIO io(4, 2, 1000);
+    {
+        os::File file("async_io_short.bin");
+        ASSERT_TRUE(file.Open(IOFlag::Write));
+        os::IORequest write;
+        write.Target = &file;
+        write.Operation = os::IOOperation::Write;
+        write.Buffer = data.Data();
+        write.Size = size;
+        os::JobCounter counter;
+        write.Counter = &counter;
+        io.Submit(write);
+        counter.Wait();
+        EXPECT_EQ(write.Result, (I64)size);
+    }
+
+    os::File file("async_io_short.bin");
+    ASSERT_TRUE(file.Open(IOFlag::Read));
+    EXPECT_EQ(file.GetSize(), (I64)size);
+    DynArray<char> whole, tail;
+    whole.Resize(size);
+    tail.Resize(20000);
+    os::IORequest requests[2];
+    requests[0].Target = &file;
+    requests[0].Buffer = whole.Data();
+    requests[0].Size = size;
+    // runs past the end of the file, only the last 10000 bytes come back
+    requests[1].Target = &file;
+    requests[1].Offset = size - 10000;
+    requests[1].Buffer = tail.Data();
+    requests[1].Size = 20000;
+    os::JobCounter counter;
+    requests[0].Counter = requests[1].Counter = &counter;
+    io.Submit(requests, 2);
+    counter.Wait();
+    EXPECT_EQ(requests[0].Result, (I64)size);
+    EXPECT_EQ(memcmp(whole.Data(), data.Data(), size), 0);
+    EXPECT_EQ(requests[1].Result, 10000);
+    EXPECT_EQ(memcmp(tail.Data(), data.Data() + size - 10000, 10000), 0);
+    file.Close();
+    os::Remove("async_io_short.bin");
+}
+
+TEST(os, mem_map_file)
+{
+    const U32 size = 1 << 20;
+    {
+        os::MemMapFile writer;
+        writer.SetWindowSize(64 * 1024);
+        ASSERT_TRUE(writer.Open("mem_map.bin", IOFlag::Write));
+        for (U32 i = 0; i < size; i += sizeof(U32))
+        {
+            writer.Write(&i, sizeof(U32));
+        }
+        EXPECT_EQ(writer.GetSize(), (I64)size);
+        EXPECT_LE(writer.GetMappedSize(), 64U * 1024 + sizeof(U32));
+    }
+
+    os::MemMapFile reader;
+    reader.SetWindowSize(64 * 1024);
+    reader.SetAccessPattern(os::MapAccess::Sequential);
+    ASSERT_TRUE(reader.Open("mem_map.bin", IOFlag::Read));
+    EXPECT_EQ(reader.GetSize(), (I64)size);
+    reader.Prefetch(size / 2, size / 4);
+    U32 value = 0;
+    bool match = true;
+    for (U32 i = 0; i < size; i += sizeof(U32))
+    {
+        match = match && reader.Read((char*)&value, sizeof(U32)) == sizeof(U32) && value == i;
+    }
+    EXPECT_TRUE(match);
+    EXPECT_TRUE(reader.IsEOF());
+    U32* tail = (U32*)reader.MapRange(size - 8, 8);
+    ASSERT_TRUE(tail != nullptr);
+    EXPECT_EQ(tail[1], size - 4);
+    reader.Close();
+    os::Remove("mem_map.bin");
+}
+
+TEST(core, buffered_io)
+{
+    {
+        os::File file("archive.bin");
+        ASSERT_TRUE(file.Open(IOFlag::Write));
+        Archive archive;
+        archive.SetIODevice(&file, 256);
+        for (U32 i = 0; i < 1000; i++)
+        {
+            archive << i;
+        }
+        archive << String("Archive");
+        archive.FlushCurrentCache();
+        file.Close();
+    }
+
+    os::File file("archive.bin");
+    ASSERT_TRUE(file.Open(IOFlag::Read));
+    Archive archive;
+    archive.SetIODevice(&file, 256);
+    size_t available = 0;
+    const U32* head = (const U32*)archive.GetReader().Peek(16, available);
+    ASSERT_GE(available, 16U);
+    EXPECT_EQ(head[3], 3U);
+    archive.GetReader().Consume(8);
+    U32 value = 0;
+    bool match = true;
+    for (U32 i = 2; i < 1000; i++)
+    {
+        archive >> value;
+        match = match && value == i;
+    }
+    EXPECT_TRUE(match);
+    String name;
+    archive >> name;
+    EXPECT_EQ(name, String("Archive"));
+    EXPECT_TRUE(archive.GetReader().IsEOF());
+    file.Close();
+    os::Remove("archive.bin");
+}
+
+TEST(core, compression)
+{
+    DynArray<U8> source;
+    source.Resize(300000);
+    for (int i = 0; i < source.Count(); i++)
+    {
+        source[i] = (U8)("kaleido3d block codec "[i % 22] + (i >> 14));
+    }
+    DynArray<U8> packed;
+    packed.Resize((int)LZCompressBound(source.Count()));
+    size_t packedSize = LZCompress(source.Data(), source.Count(), packed.Data(), packed.Count());
+    EXPECT_LT(packedSize, (size_t)source.Count() / 4);
+    DynArray<U8> unpacked;
+    unpacked.Resize(source.Count());
+    EXPECT_EQ(LZDecompress(packed.Data(), packedSize, unpacked.Data(), unpacked.Count()), (size_t)source.Count());
+    EXPECT_EQ(memcmp(source.Data(), unpacked.Data(), source.Count()), 0);
+    EXPECT_EQ(LZDecompress(packed.Data(), packedSize, unpacked.Data(), 100), size_t(-1));
+
+    {
+        os::File file;
+        CompressedStream writer(&file, 16 * 1024);
+        ASSERT_TRUE(writer.Open("stream.lz", IOFlag(IOFlag::Write | IOFlag::SnappyCompressed)));
+        EXPECT_EQ(writer.Write(source.Data(), source.Count()), (size_t)source.Count());
+        writer.Close();
+    }
+    os::File file;
+    CompressedStream reader(&file);
+    ASSERT_TRUE(reader.Open("stream.lz", IOFlag(IOFlag::Read | IOFlag::SnappyCompressed)));
+    EXPECT_EQ(reader.GetSize(), (U64)source.Count());
+    EXPECT_EQ(reader.GetBlockCount(), 19U);
+    ASSERT_TRUE(reader.Seek(200000));
+    U8 window[64];
+    EXPECT_EQ(reader.Read((char*)window, 64), 64U);
+    EXPECT_EQ(memcmp(window, source.Data() + 200000, 64), 0);
+    ASSERT_TRUE(reader.Seek(0));
+    EXPECT_EQ(reader.Read((char*)unpacked.Data(), unpacked.Count()), (size_t)source.Count());
+    EXPECT_EQ(memcmp(source.Data(), unpacked.Data(), source.Count()), 0);
+    EXPECT_TRUE(reader.IsEOF());
+    reader.Close();
+    os::Remove("stream.lz");
+}
+
+static void WriteBytes(const char* Path, std::vector<U8> const& Bytes)
+{
+    // opening for write doesn't truncate
+    os::Remove(Path);
+    os::File file(Path);
+    ASSERT_TRUE(file.Open(IOFlag::Write));
+    file.Write(Bytes.data(), Bytes.size());
+}
+
+TEST(core, compression_corrupt)
+{
+    std::vector<U8> source(100000);
+    for (size_t i = 0; i < source.size(); i++)
+    {
+        source[i] = (U8)("corrupt stream "[i % 15] + (i >> 12));
+    }
+    {
+        os::File file;
+        CompressedStream writer(&file, 16 * 1024);
+        ASSERT_TRUE(writer.Open("corrupt.lz", IOFlag(IOFlag::Write | IOFlag::SnappyCompressed)));
+        writer.Write(source.data(), source.size());
+        writer.Close();
+    }
+    std::vector<U8> original;
+    {
+        os::File file("corrupt.lz");
+        ASSERT_TRUE(file.Open(IOFlag::Read));
+        original.resize((size_t)file.GetSize());
+        file.Read((char*)original.data(), original.size());
+    }
+    U64 indexOffset;
+    memcpy(&indexOffset, &original[16], 8);
+    U32 firstPacked;
+    memcpy(&firstPacked, &original[24], 4);
+    size_t secondBlock = 24 + 8 + (firstPacked & 0x7fffffff);
+
+    // a huge block count falls back to scanning the blocks
+    std::vector<U8> bytes = original;
+    memset(&bytes[(size_t)indexOffset], 0xff, 7);
+    WriteBytes("corrupt.lz", bytes);
+    {
+        os::File file;
+        CompressedStream reader(&file);
+        ASSERT_TRUE(reader.Open("corrupt.lz", IOFlag(IOFlag::Read | IOFlag::SnappyCompressed)));
+        EXPECT_EQ(reader.GetBlockCount(), 7U);
+        std::vector<U8> unpacked(source.size());
+        EXPECT_EQ(reader.Read((char*)unpacked.data(), unpacked.size()), source.size());
+        EXPECT_TRUE(unpacked == source);
+    }
+
+    // without an index, a block cut short or with impossible sizes ends the stream
+    bytes.assign(original.begin(), original.begin() + secondBlock + 20);
+    memset(&bytes[16], 0, 8);
+    WriteBytes("corrupt.lz", bytes);
+    {
+        os::File file;
+        CompressedStream reader(&file);
+        ASSERT_TRUE(reader.Open("corrupt.lz", IOFlag(IOFlag::Read | IOFlag::SnappyCompressed)));
+        EXPECT_EQ(reader.GetBlockCount(), 1U);
+        EXPECT_EQ(reader.GetSize(), 16U * 1024);
+    }
+    bytes = original;
+    memset(&bytes[16], 0, 8);
+    memset(&bytes[secondBlock], 0x7f, 8);
+    WriteBytes("corrupt.lz", bytes);
+    {
+        os::File file;
+        CompressedStream reader(&file);
+        ASSERT_TRUE(reader.Open("corrupt.lz", IOFlag(IOFlag::Read | IOFlag::SnappyCompressed)));
+        EXPECT_EQ(reader.GetBlockCount(), 1U);
+    }
+    os::Remove("corrupt.lz");
+}
+
+TEST(core, asset_manager)
+{
+    PackBuilder builder;
+    builder.Add("Shaders/Blit.glsl", "void main() {}", 14);
+    String repeated;
+    for (int i = 0; i < 100; i++)
+    {
+        repeated += "kaleido3d ";
+    }
+    builder.Add("Shaders\\Repeated.txt", repeated.CStr(), repeated.Length(), true);
+    ASSERT_TRUE(builder.Save("assets.pack"));
+
+    auto& manager = AssetManager::Get();
+    ASSERT_TRUE(manager.MountPack("pack", "assets.pack"));
+    MemoryMount* memory = new MemoryMount;
+    memory->Add("Shaders/Blit.glsl", "override", 8);
+    manager.Mount("pack", memory, 1);
+
+    IAsset* blit = AssetManager::Open("asset://pack/Shaders/Blit.glsl");
+    ASSERT_TRUE(blit != nullptr);
+    EXPECT_EQ(blit->GetLength(), 8U);
+    delete blit;
+    EXPECT_TRUE(manager.Unmount(memory));
+
+    blit = AssetManager::Open("pack/./Shaders//Blit.glsl");
+    ASSERT_TRUE(blit != nullptr);
+    char text[16] = {};
+    EXPECT_EQ(blit->Read(text, sizeof(text)), 14U);
+    EXPECT_EQ(String(text), String("void main() {}"));
+    delete blit;
+
+    IAsset* repeatedAsset = AssetManager::Open("pack/Shaders/Repeated.txt");
+    ASSERT_TRUE(repeatedAsset != nullptr);
+    EXPECT_EQ(repeatedAsset->GetLength(), (U64)repeated.Length());
+    EXPECT_EQ(memcmp(repeatedAsset->GetBuffer(), repeated.CStr(), repeated.Length()), 0);
+    delete repeatedAsset;
+
+    EXPECT_FALSE(manager.Exists("pack/Shaders/Missing.glsl"));
+    EXPECT_TRUE(AssetManager::Open("pack/Shaders/Missing.glsl") == nullptr);
+
+    // a stored entry keeps the pack mapped after it's unmounted
+    blit = AssetManager::Open("pack/Shaders/Blit.glsl");
+    ASSERT_TRUE(blit != nullptr);
+    manager.Shutdown();
+    EXPECT_EQ(memcmp(blit->GetBuffer(), "void main() {}", 14), 0);
+    delete blit;
+    os::Remove("assets.pack");
+}
+
+TEST(core, pack_corrupt)
+{
+    PackBuilder builder;
+    builder.Add("Blit.glsl", "void main() {}", 14);
+    ASSERT_TRUE(builder.Save("corrupt.pack"));
+    std::vector<U8> original;
+    {
+        os::File file("corrupt.pack");
+        ASSERT_TRUE(file.Open(IOFlag::Read));
+        original.resize(file.GetSize());
+        ASSERT_EQ(file.Read((char*)original.data(), original.size()), original.size());
+    }
+    U64 tableOffset, namesOffset, namesSize;
+    memcpy(&tableOffset, &original[16], 8);
+    memcpy(&namesOffset, &original[24], 8);
+    memcpy(&namesSize, &original[32], 8);
+
+    // names running to the end of the file without a terminating zero
+    std::vector<U8> bytes = original;
+    bytes[namesOffset + namesSize - 1] = 'x';
+    WriteBytes("corrupt.pack", bytes);
+    {
+        PackMount pack;
+        EXPECT_FALSE(pack.Load("corrupt.pack"));
+    }
+
+    // an entry offset that wraps around once its size is added
+    bytes = original;
+    U64 offset = ~0ull - 7;
+    U32 tableSize;
+    memcpy(&tableSize, &original[12], 4);
+    for (U32 i = 0; i < tableSize; i++)
+    {
+        U64 hash;
+        memcpy(&hash, &bytes[tableOffset + i * 40], 8);
+        if (hash)
+            memcpy(&bytes[tableOffset + i * 40 + 8], &offset, 8);
+    }
+    WriteBytes("corrupt.pack", bytes);
+    {
+        PackMount pack;
+        ASSERT_TRUE(pack.Load("corrupt.pack"));
+        EXPECT_TRUE(pack.Exists("Blit.glsl", AssetManager::HashPath("Blit.glsl", 9)));
+        EXPECT_TRUE(pack.Open("Blit.glsl", AssetManager::HashPath("Blit.glsl", 9)) == nullptr);
+    }
+    os::Remove("corrupt.pack");
+}
+
+static void WriteTextFile(const char* Path, const char* Text)
+{
+    os::File file(Path);
+    ASSERT_TRUE(file.Open(IOFlag::Write));
+    file.Write(Text, strlen(Text));
+}
+
+TEST(core, asset_path_traversal)
+{
+    ASSERT_TRUE(os::MakeDir("mounted"));
+    ASSERT_TRUE(os::MakeDir("mounted/root"));
+    WriteTextFile("mounted/secret.txt", "secret");
+    WriteTextFile("mounted/root/public.txt", "public");
+
+    auto& manager = AssetManager::Get();
+    ASSERT_TRUE(manager.MountDirectory("dir", "mounted/root"));
+    IAsset* asset = AssetManager::Open("asset://dir/public.txt");
+    ASSERT_TRUE(asset != nullptr);
+    delete asset;
+    EXPECT_FALSE(manager.Exists("dir/../secret.txt"));
+    EXPECT_TRUE(AssetManager::Open("asset://dir/../secret.txt") == nullptr);
+    EXPECT_TRUE(AssetManager::Open("dir/sub\\..\\..\\secret.txt") == nullptr);
+    EXPECT_TRUE(AssetManager::Open("dir/..") == nullptr);
+    manager.Shutdown();
+    os::Remove("mounted");
+}
+
+TEST(core, file_index)
+{
+    os::Remove("indexed");
+    ASSERT_TRUE(os::MakeDir("indexed"));
+    ASSERT_TRUE(os::MakeDir("indexed/a"));
+    ASSERT_TRUE(os::MakeDir("indexed/a/b"));
+    for (int i = 0; i < 20; i++)
+    {
+        char path[64];
+        snprintf(path, sizeof(path), "indexed/%s/%d.txt", i % 2 ? "a" : "a/b", i);
+        WriteTextFile(path, "content");
+    }
+
+    FileIndex index;
+    ASSERT_TRUE(index.Update("indexed/"));
+    EXPECT_EQ(index.GetFileCount(), 20U);
+    EXPECT_EQ(index.GetChangeCount(), 20U);
+    EXPECT_EQ(index.GetChange(0).Changes, (U32)os::FileAdded);
+    FileRecord record;
+    ASSERT_TRUE(index.Find("a/b/0.txt", record));
+    EXPECT_EQ(record.Size, 7U);
+    ASSERT_TRUE(index.Save("indexed.idx"));
+
+    FileIndex reloaded;
+    ASSERT_TRUE(reloaded.Load("indexed.idx"));
+    EXPECT_EQ(reloaded.GetFileCount(), 20U);
+    // same content rewritten, then one file modified, one removed and one added
+    os::Sleep(10);
+    WriteTextFile("indexed/a/1.txt", "content");
+    WriteTextFile("indexed/a/3.txt", "CONTENT");
+    ASSERT_TRUE(os::Remove("indexed/a/b/2.txt"));
+    WriteTextFile("indexed/new.txt", "new");
+    ASSERT_TRUE(reloaded.Update("indexed"));
+    EXPECT_EQ(reloaded.GetFileCount(), 20U);
+    ASSERT_EQ(reloaded.GetChangeCount(), 3U);
+    EXPECT_EQ(reloaded.GetChange(0).Path, String("a/3.txt"));
+    EXPECT_EQ(reloaded.GetChange(0).Changes, (U32)os::FileModified);
+    EXPECT_EQ(reloaded.GetChange(1).Path, String("new.txt"));
+    EXPECT_EQ(reloaded.GetChange(1).Changes, (U32)os::FileAdded);
+    EXPECT_EQ(reloaded.GetChange(2).Path, String("a/b/2.txt"));
+    EXPECT_EQ(reloaded.GetChange(2).Changes, (U32)os::FileRemoved);
+
+    os::Remove("indexed");
+    os::Remove("indexed.idx");
+}
+
+#if K3DPLATFORM_OS_LINUX
+struct FileChangeLog
+{
+    os::Mutex                   Lock;
+    std::vector<os::FileEvent>  Events;
+
+    static void Collect(const os::FileEvent* Events, U32 Count, void* UserData)
+    {
+        FileChangeLog* Log = (FileChangeLog*)UserData;
+        os::Mutex::AutoLock Guard(&Log->Lock);
+        Log->Events.insert(Log->Events.end(), Events, Events + Count);
+    }
+
+    U32 Find(const char* Path)
+    {
+        os::Mutex::AutoLock Guard(&Lock);
+        U32 Changes = 0;
+        for (auto const& Event : Events)
+            if (Event.Path == String(Path))
+                Changes |= Event.Changes;
+        return Changes;
+    }
+
+    /// waits for the changes of Path to include Changes
+    bool WaitFor(const char* Path, U32 Changes)
+    {
+        for (int i = 0; i < 500; i++, os::Sleep(10))
+            if ((Find(Path) & Changes) == Changes)
+                return true;
+        return false;
+    }
+};
+
+TEST(os, file_watcher)
+{
+    os::Remove("watched");
+    ASSERT_TRUE(os::MakeDir("watched"));
+    FileChangeLog log;
+    {
+        os::FileWatcher watcher(100);
+        watcher.Subscribe(&FileChangeLog::Collect, &log);
+        ASSERT_TRUE(watcher.Watch("watched/"));
+
+        // picked up by the recursive watch, the write may even precede it
+        ASSERT_TRUE(os::MakeDir("watched/sub"));
+        WriteTextFile("watched/sub/a.txt", "a");
+        WriteTextFile("watched/sub/a.txt", "b");
+        // created and deleted within the debounce period, coalesced away
+        WriteTextFile("watched/temp.txt", "t");
+        ASSERT_TRUE(os::Remove("watched/temp.txt"));
+        EXPECT_TRUE(log.WaitFor("watched/sub/a.txt", os::FileAdded));
+        EXPECT_EQ(log.Find("watched/temp.txt"), 0U);
+
+        WriteTextFile("watched/sub/a.txt", "c");
+        EXPECT_TRUE(log.WaitFor("watched/sub/a.txt", os::FileModified));
+        ASSERT_TRUE(os::Remove("watched/sub/a.txt"));
+        EXPECT_TRUE(log.WaitFor("watched/sub/a.txt", os::FileRemoved));
+        EXPECT_TRUE(watcher.Unwatch("watched"));
+    }
+    os::Remove("watched");
+}
+
+struct SlowSubscriber
+{
+    std::atomic<int> Entered{ 0 };
+    std::atomic<int> Left{ 0 };
+
+    static void Collect(const os::FileEvent*, U32, void* UserData)
+    {
+        SlowSubscriber* Self = (SlowSubscriber*)UserData;
+        Self->Entered++;
+        os::Sleep(100);
+        Self->Left++;
+    }
+};
+
+TEST(os, file_watcher_unsubscribe)
+{
+    os::Remove("unsubscribed");
+    ASSERT_TRUE(os::MakeDir("unsubscribed"));
+    SlowSubscriber slow;
+    os::FileWatcher watcher(10);
+    U32 id = watcher.Subscribe(&SlowSubscriber::Collect, &slow);
+    ASSERT_TRUE(watcher.Watch("unsubscribed/"));
+    WriteTextFile("unsubscribed/a.txt", "a");
+    for (int i = 0; i < 500 && !slow.Entered; i++)
+        os::Sleep(10);
+    ASSERT_EQ(slow.Entered.load(), 1);
+    // returns only once the delivery in flight is done with slow
+    watcher.Unsubscribe(id);
+    EXPECT_EQ(slow.Left.load(), 1);
+    EXPECT_TRUE(watcher.Unwatch("unsubscribed"));
+    os::Remove("unsubscribed");
+}
+
+TEST(core, asset_hot_reload)
+{
+    os::Remove("hot_reload");
+    ASSERT_TRUE(os::MakeDir("hot_reload"));
+    ASSERT_TRUE(os::MakeDir("hot_reload/base"));
+    ASSERT_TRUE(os::MakeDir("hot_reload/mod"));
+    WriteTextFile("hot_reload/base/a.mat", "base");
+    WriteTextFile("hot_reload/mod/a.mat", "mod");
+
+    auto& manager = AssetManager::Get();
+    ASSERT_TRUE(manager.MountDirectory("materials", "hot_reload/base"));
+    ASSERT_TRUE(manager.MountDirectory("materials", "hot_reload/mod", 1));
+    ASSERT_TRUE(manager.EnableHotReload(20));
+    FileChangeLog log;
+    U32 listener = manager.AddReloadListener("materials", &FileChangeLog::Collect, &log);
+
+    // shadowed by the mod mount, so not worth a reload
+    WriteTextFile("hot_reload/base/a.mat", "base2");
+    WriteTextFile("hot_reload/base/b.mat", "b");
+    EXPECT_TRUE(log.WaitFor("materials/b.mat", os::FileAdded));
+    EXPECT_EQ(log.Find("materials/a.mat"), 0U);
+    WriteTextFile("hot_reload/mod/a.mat", "mod2");
+    EXPECT_TRUE(log.WaitFor("materials/a.mat", os::FileModified));
+
+    manager.RemoveReloadListener(listener);
+    manager.Shutdown();
+    os::Remove("hot_reload");
+}
+#endif
+
+TEST(os, clock)
+{
+    EXPECT_GT(os::Clock::GetFrequency(), 0U);
+    U64 last = os::Clock::Now();
+    for (int i = 0; i < 100000; i++)
+    {
+        U64 now = os::Clock::Now();
+        ASSERT_GE(now, last);
+        last = now;
+    }
+    EXPECT_NEAR((double)os::Clock::ToNanoseconds(os::Clock::GetFrequency()), 1e9, 1e3);
+
+    U64 start = os::Clock::NowNs();
+    U64 startMs = os::GetTicks();
+    os::Sleep(50);
+    U64 elapsedNs = os::Clock::NowNs() - start;
+    U64 elapsedMs = os::GetTicks() - startMs;
+    EXPECT_GE(elapsedNs, 49000000U);
+    EXPECT_NEAR((double)elapsedNs / 1e6, (double)elapsedMs, 2.0);
+
+    Timer timer(Timer::NanoSecond);
+    timer.BeginTimer();
+    os::Sleep(5);
+    EXPECT_GE(timer.EndTimer(), 5000000);
+    for (int i = 0; i < 5; i++)
+    {
+        os::Sleep(10);
+        timer.Update();
+    }
+    EXPECT_GT(timer.GetFrameRate(), 50.0f);
+    EXPECT_LT(timer.GetFrameRate(), 101.0f);
+}
+
+struct EchoHandler : public os::IConnectionHandler
+{
+    std::atomic<U32> Closed{ 0 };
+
+    void OnReceived(os::Connection* Conn) override
+    {
+        Conn->Send(Conn->GetInput(), Conn->GetInputSize());
+        Conn->Consume(Conn->GetInputSize());
+    }
+    void OnClosed(os::Connection* Conn) override { Closed++; }
+};
+
+struct EchoClient : public os::IConnectionHandler
+{
+    std::atomic<U32> Connected{ 0 };
+    std::atomic<U32> Echoed{ 0 };
+    std::atomic<U32> Closed{ 0 };
+    U64 MessageSize = 0;
+
+    void OnConnected(os::Connection* Conn) override
+    {
+        Connected++;
+        std::vector<U8> message(MessageSize);
+        for (size_t i = 0; i < message.size(); i++)
+            message[i] = (U8)(i * 7 + (size_t)Conn);
+        Conn->Send(message.data(), message.size());
+    }
+    void OnReceived(os::Connection* Conn) override
+    {
+        if (Conn->GetInputSize() < MessageSize)
+            return;
+        bool same = true;
+        for (U64 i = 0; i < MessageSize; i++)
+            same = same && Conn->GetInput()[i] == (U8)(i * 7 + (size_t)Conn);
+        Conn->Consume(MessageSize);
+        if (same)
+            Echoed++;
+        Conn->Close();
+    }
+    void OnClosed(os::Connection* Conn) override { Closed++; }
+};
+
+struct PausedHandler : public os::IConnectionHandler
+{
+    std::atomic<os::Connection*> Accepted{ nullptr };
+    std::atomic<U32> Received{ 0 };
+    std::atomic<U32> Closed{ 0 };
+
+    void OnConnected(os::Connection* Conn) override
+    {
+        Conn->PauseReading();
+        Accepted = Conn;
+    }
+    void OnReceived(os::Connection* Conn) override
+    {
+        Received += (U32)Conn->GetInputSize();
+        Conn->Consume(Conn->GetInputSize());
+    }
+    void OnClosed(os::Connection* Conn) override { Closed++; }
+};
+
+static bool WaitUntil(std::atomic<U32> const& Value, U32 Expected, U32 TimeoutMs = 5000)
+{
+    for (U32 waited = 0; Value.load() < Expected && waited < TimeoutMs; waited++)
+        os::Sleep(1);
+    return Value.load() >= Expected;
+}
+
+TEST(os, reactor)
+{
+    EchoHandler server;
+    EchoClient client, refused, sender;
+    PausedHandler paused;
+    os::Reactor serverLoop;
+    I32 port = serverLoop.Listen(os::IpAddress("127.0.0.1:0"), &server);
+    ASSERT_GT(port, 0);
+    ASSERT_TRUE(serverLoop.Start("EchoServer"));
+
+    // one client thread, many connections, messages larger than a socket buffer
+    const U32 kClients = 64;
+    client.MessageSize = 256 * 1024;
+    os::Reactor clientLoop;
+    ASSERT_TRUE(clientLoop.Start("EchoClients"));
+    String address = String::Format("127.0.0.1:%d", port);
+    for (U32 i = 0; i < kClients; i++)
+        ASSERT_TRUE(clientLoop.Connect(os::IpAddress(address), &client) != nullptr);
+    EXPECT_TRUE(WaitUntil(client.Closed, kClients));
+    EXPECT_EQ(client.Connected.load(), kClients);
+    EXPECT_EQ(client.Echoed.load(), kClients);
+    EXPECT_TRUE(WaitUntil(server.Closed, kClients));
+    EXPECT_EQ(serverLoop.GetConnectionCount(), 0U);
+
+    // a paused connection leaves the bytes to the socket buffers until resumed
+    sender.MessageSize = 1024 * 1024;
+    I32 pausedPort = serverLoop.Listen(os::IpAddress("127.0.0.1:0"), &paused);
+    ASSERT_GT(pausedPort, 0);
+    clientLoop.Connect(os::IpAddress(String::Format("127.0.0.1:%d", pausedPort)), &sender);
+    EXPECT_TRUE(WaitUntil(sender.Connected, 1));
+    os::Sleep(50);
+    EXPECT_EQ(paused.Received.load(), 0U);
+    ASSERT_TRUE(paused.Accepted.load() != nullptr);
+    paused.Accepted.load()->ResumeReading();
+    EXPECT_TRUE(WaitUntil(paused.Received, (U32)sender.MessageSize));
+
+    // refused connects close without OnConnected
+    clientLoop.Connect(os::IpAddress("127.0.0.1:1"), &refused);
+    os::Sleep(50);
+    EXPECT_EQ(refused.Connected.load(), 0U);
+
+    std::atomic<U32> onLoop{ 0 };
+    clientLoop.Post([&clientLoop, &onLoop]() { onLoop += clientLoop.IsReactorThread() ? 1 : 0; });
+    EXPECT_TRUE(WaitUntil(onLoop, 1));
+    EXPECT_FALSE(clientLoop.IsReactorThread());
+
+    std::atomic<U32> ticks{ 0 }, once{ 0 }, cancelled{ 0 };
+    U64 periodic = clientLoop.AddTimer(1, 2, [&ticks]() { ticks++; });
+    clientLoop.AddTimer(5, 0, [&once]() { once++; });
+    U64 never = clientLoop.AddTimer(30, 0, [&cancelled]() { cancelled++; });
+    clientLoop.CancelTimer(never);
+    EXPECT_TRUE(WaitUntil(ticks, 5));
+    clientLoop.CancelTimer(periodic);
+    os::Sleep(50);
+    U32 stopped = ticks.load();
+    os::Sleep(20);
+    EXPECT_EQ(ticks.load(), stopped);
+    EXPECT_EQ(once.load(), 1U);
+    EXPECT_EQ(cancelled.load(), 0U);
+}
+
+TEST(os, reactor_send_file)
+{
+    WriteBytes("send_file.bin", std::vector<U8>(4 << 20, 7));
+    PausedHandler server;
+    os::Reactor serverLoop;
+    I32 port = serverLoop.Listen(os::IpAddress("127.0.0.1:0"), &server);
+    ASSERT_GT(port, 0);
+    ASSERT_TRUE(serverLoop.Start("FileServer"));
+    EchoClient client;
+    os::Reactor clientLoop;
+    ASSERT_TRUE(clientLoop.Start("FileClient"));
+    os::Connection* conn = clientLoop.Connect(os::IpAddress(String::Format("127.0.0.1:%d", port)), &client);
+    ASSERT_TRUE(conn != nullptr);
+    ASSERT_TRUE(WaitUntil(client.Connected, 1));
+    for (U32 waited = 0; !server.Accepted.load() && waited < 5000; waited++)
+        os::Sleep(1);
+    ASSERT_TRUE(server.Accepted.load() != nullptr);
+    conn->Close();
+    ASSERT_TRUE(WaitUntil(client.Closed, 1));
+    os::Sleep(20);
+
+    // the peer is gone, sendfile fails with EPIPE; off the reactor thread
+    // that used to raise SIGPIPE and end the process
+    os::File file("send_file.bin");
+    ASSERT_TRUE(file.Open(IOFlag::Read));
+    server.Accepted.load()->SendFile(file, 0, 4 << 20);
+    EXPECT_TRUE(WaitUntil(server.Closed, 1));
+    file.Close();
+    os::Remove("send_file.bin");
+}
+
+struct WebSocketTestClient : public os::IConnectionHandler
+{
+    std::string Received;
+    os::SpinMutex Lock;
+    std::atomic<U32> Connected{ 0 };
+
+    void OnConnected(os::Connection* Conn) override
+    {
+        static const char request[] =
+            "GET /log HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+            "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+        Conn->Send(request, sizeof(request) - 1);
+        Connected++;
+    }
+    void OnReceived(os::Connection* Conn) override
+    {
+        os::SpinMutex::AutoLock guard(&Lock);
+        Received.append((const char*)Conn->GetInput(), (size_t)Conn->GetInputSize());
+        Conn->Consume(Conn->GetInputSize());
+    }
+    std::string Get()
+    {
+        os::SpinMutex::AutoLock guard(&Lock);
+        return Received;
+    }
+};
+
+static void OnWebSocketMessage(os::Connection* Client, const char* Data, U64 Size, bool Binary, void* UserData)
+{
+    ((std::string*)UserData)->assign(Data, (size_t)Size);
+}
+
+TEST(core, websocket_server)
+{
+    std::string message;
+    WebSocketTestClient client;
+    os::Reactor* loop = new os::Reactor;
+    net::WebSocketServer server(loop);
+    // released first, the reactor reports its connections closed to the handlers
+    std::unique_ptr<os::Reactor> owner(loop);
+    server.SetMessageCallback(&OnWebSocketMessage, &message);
+    I32 port = server.Listen(os::IpAddress("127.0.0.1:0"));
+    ASSERT_GT(port, 0);
+    ASSERT_TRUE(loop->Start("WebSocket"));
+
+    os::Connection* conn = loop->Connect(os::IpAddress(String::Format("127.0.0.1:%d", port)), &client);
+    ASSERT_TRUE(conn != nullptr);
+    for (int i = 0; i < 5000 && client.Get().find("\r\n\r\n") == std::string::npos; i++)
+        os::Sleep(1);
+    ASSERT_EQ(server.GetClientCount(), 1U);
+    // the accept key of the RFC 6455 example
+    EXPECT_NE(client.Get().find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n"), std::string::npos);
+
+    size_t headEnd = client.Get().find("\r\n\r\n") + 4;
+    server.Broadcast("hello", 5);
+    for (int i = 0; i < 5000 && client.Get().size() < headEnd + 7; i++)
+        os::Sleep(1);
+    EXPECT_EQ(client.Get().substr(headEnd), std::string("\x81\x05hello"));
+
+    // masked text frame, split in two fragments
+    const U8 frames[] = { 0x01, 0x83, 1, 2, 3, 4, 'a' ^ 1, 'b' ^ 2, 'c' ^ 3,
+                          0x80, 0x82, 5, 6, 7, 8, 'd' ^ 5, 'e' ^ 6 };
+    loop->Post([conn, &frames]() { conn->Send(frames, sizeof(frames)); });
+    for (int i = 0; i < 5000 && message.size() < 5; i++)
+        os::Sleep(1);
+    EXPECT_EQ(message, std::string("abcde"));
+
+    // a binary frame with a 64 bit length, unmasked a vector at a time
+    std::string payload(200 * 1024 + 3, '\0');
+    for (size_t i = 0; i < payload.size(); i++)
+        payload[i] = (char)(i * 7 + i / 251);
+    const U8 mask[4] = { 0x9A, 0x3C, 0x00, 0xF1 };
+    std::string big = { (char)0x82, (char)0xFF, 0, 0, 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < 8; i++)
+        big[2 + i] = (char)((U64)payload.size() >> (56 - 8 * i));
+    big.append((const char*)mask, 4);
+    size_t maskedAt = big.size();
+    big.resize(maskedAt + payload.size());
+    net::WebSocketMask((U8*)&big[maskedAt], (const U8*)payload.data(), payload.size(), mask);
+    for (size_t i = 0; i < 4096; i++)
+        EXPECT_EQ((U8)big[maskedAt + i], (U8)payload[i] ^ mask[i & 3]);
+    loop->Post([conn, &big]() { conn->Send(big.data(), big.size()); });
+    for (int i = 0; i < 5000 && message.size() != payload.size(); i++)
+        os::Sleep(1);
+    EXPECT_TRUE(message == payload);
+
+    // every length and alignment against the byte loop, in place too
+    std::vector<U8> in(300), out(300);
+    for (size_t i = 0; i < in.size(); i++)
+        in[i] = (U8)(i * 13);
+    U32 wrong = 0;
+    for (size_t offset = 0; offset < 8; offset++)
+    {
+        for (size_t size = 0; size + offset <= 260; size++)
+        {
+            net::WebSocketMask(out.data() + offset, in.data() + offset, size, mask);
+            for (size_t i = 0; i < size; i++)
+                wrong += out[offset + i] != (U8)(in[offset + i] ^ mask[i & 3]);
+        }
+    }
+    std::vector<U8> inPlace(in);
+    net::WebSocketMask(inPlace.data(), inPlace.data(), inPlace.size(), mask);
+    net::WebSocketMask(inPlace.data(), inPlace.data(), inPlace.size(), mask);
+    EXPECT_EQ(wrong, 0U);
+    EXPECT_TRUE(inPlace == in);
+
+    // gathered slices go out as one frame
+    size_t before = client.Get().size();
+    std::string header = "frame:";
+    os::IoSlice slices[] = { { header.data(), header.size() }, { payload.data(), 130 }, { "!", 1 } };
+    server.Broadcast(slices, 3, true);
+    for (int i = 0; i < 5000 && client.Get().size() < before + 4 + 137; i++)
+        os::Sleep(1);
+    EXPECT_EQ(client.Get().substr(before), std::string("\x82\x7e\x00\x89", 4) + header + payload.substr(0, 130) + "!");
+
+    owner.reset();
+    EXPECT_EQ(server.GetClientCount(), 0U);
+}
+
+struct HttpTestClient : public os::IConnectionHandler
+{
+    std::string Request;
+    std::string Received;
+    os::SpinMutex Lock;
+
+    void OnConnected(os::Connection* Conn) override
+    {
+        // split the pipelined requests over a vectored send
+        size_t half = Request.size() / 2;
+        os::IoSlice slices[] = { { Request.data(), half }, { Request.data() + half, Request.size() - half } };
+        Conn->Send(slices, 2);
+    }
+    void OnReceived(os::Connection* Conn) override
+    {
+        os::SpinMutex::AutoLock guard(&Lock);
+        Received.append((const char*)Conn->GetInput(), (size_t)Conn->GetInputSize());
+        Conn->Consume(Conn->GetInputSize());
+    }
+    std::string Get()
+    {
+        os::SpinMutex::AutoLock guard(&Lock);
+        return Received;
+    }
+};
+
+/// splits the next response off Stream, the body is skipped for HEAD requests
+static bool NextResponse(std::string const& Stream, size_t& Offset, bool HeadRequest,
+    std::string& Head, std::string& Body)
+{
+    size_t headEnd = Stream.find("\r\n\r\n", Offset);
+    if (headEnd == std::string::npos)
+        return false;
+    Head = Stream.substr(Offset, headEnd + 4 - Offset);
+    size_t field = Head.find("Content-Length: ");
+    size_t length = field == std::string::npos ? 0 : (size_t)strtoull(Head.c_str() + field + 16, nullptr, 10);
+    if (HeadRequest)
+        length = 0;
+    if (Stream.size() < headEnd + 4 + length)
+        return false;
+    Body = Stream.substr(headEnd + 4, length);
+    Offset = headEnd + 4 + length;
+    return true;
+}
+
+TEST(core, asset_server)
+{
+    os::Remove("served");
+    ASSERT_TRUE(os::MakeDir("served"));
+    std::string big(3 * 1024 * 1024 + 17, '\0');
+    for (size_t i = 0; i < big.size(); i++)
+        big[i] = (char)(i * 31 + (i >> 12));
+    {
+        os::File file("served/big.bin");
+        ASSERT_TRUE(file.Open(IOFlag::Write));
+        file.Write(big.data(), big.size());
+    }
+    WriteTextFile("served/small.txt", "0123456789");
+
+    HttpTestClient client;
+    client.Request =
+        "GET /big.bin HTTP/1.1\r\nHost: localhost\r\n\r\n"
+        "HEAD /small.txt HTTP/1.1\r\nHost: localhost\r\n\r\n"
+        "GET /small.txt?v=2 HTTP/1.1\r\nRange: bytes=2-5\r\n\r\n"
+        "GET /missing.txt HTTP/1.1\r\n\r\n"
+        "GET /../served/small.txt HTTP/1.1\r\n\r\n"
+        "GET /small.txt HTTP/1.1\r\nRange: bytes=10-\r\nConnection: close\r\n\r\n";
+    os::Reactor* loop = new os::Reactor;
+    net::AssetServer server(loop, "served");
+    std::unique_ptr<os::Reactor> owner(loop);
+    I32 port = server.Listen(os::IpAddress("127.0.0.1:0"));
+    ASSERT_GT(port, 0);
+    ASSERT_TRUE(loop->Start("AssetServer"));
+    ASSERT_TRUE(loop->Connect(os::IpAddress(String::Format("127.0.0.1:%d", port)), &client) != nullptr);
+
+    for (int i = 0; i < 10000 && server.GetRequestCount() < 6; i++)
+        os::Sleep(1);
+    for (int i = 0; i < 10000 && loop->GetConnectionCount() > 0; i++)
+        os::Sleep(1);
+    EXPECT_EQ(server.GetRequestCount(), 6U);
+    EXPECT_EQ(server.GetBytesServed(), (U64)big.size() + 4);
+
+    std::string stream = client.Get(), head, body;
+    size_t offset = 0;
+    ASSERT_TRUE(NextResponse(stream, offset, false, head, body));
+    EXPECT_EQ(head.find("HTTP/1.1 200 OK\r\n"), 0U);
+    EXPECT_NE(head.find("ETag: \""), std::string::npos);
+    EXPECT_TRUE(body == big);
+    ASSERT_TRUE(NextResponse(stream, offset, true, head, body));
+    EXPECT_EQ(head.find("HTTP/1.1 200 OK\r\n"), 0U);
+    EXPECT_NE(head.find("Content-Length: 10\r\n"), std::string::npos);
+    ASSERT_TRUE(NextResponse(stream, offset, false, head, body));
+    EXPECT_EQ(head.find("HTTP/1.1 206 Partial Content\r\n"), 0U);
+    EXPECT_NE(head.find("Content-Range: bytes 2-5/10\r\n"), std::string::npos);
+    EXPECT_EQ(body, std::string("2345"));
+    ASSERT_TRUE(NextResponse(stream, offset, false, head, body));
+    EXPECT_EQ(head.find("HTTP/1.1 404 Not Found\r\n"), 0U);
+    ASSERT_TRUE(NextResponse(stream, offset, false, head, body));
+    EXPECT_EQ(head.find("HTTP/1.1 404 Not Found\r\n"), 0U);
+    ASSERT_TRUE(NextResponse(stream, offset, false, head, body));
+    EXPECT_EQ(head.find("HTTP/1.1 416 Range Not Satisfiable\r\n"), 0U);
+    EXPECT_NE(head.find("Connection: close\r\n"), std::string::npos);
+    EXPECT_EQ(offset, stream.size());
+
+    owner.reset();
+    os::Remove("served/big.bin");
+    os::Remove("served/small.txt");
+    os::Remove("served");
+}
+
+TEST(core, http_client)
+{
+    const int kFiles = 16;
+    os::Remove("pooled");
+    ASSERT_TRUE(os::MakeDir("pooled"));
+    for (int i = 0; i < kFiles; i++)
+        WriteTextFile(String::Format("pooled/%d.txt", i).CStr(), String::Format("asset %d", i).CStr());
+
+    os::Reactor* loop = new os::Reactor;
+    net::AssetServer server(loop, "pooled");
+    std::unique_ptr<os::Reactor> owner(loop);
+    I32 port = server.Listen(os::IpAddress("127.0.0.1:0"));
+    ASSERT_GT(port, 0);
+    ASSERT_TRUE(loop->Start("AssetServer"));
+    String base = String::Format("http://127.0.0.1:%d/", port);
+
+    // many threads, many small requests, a handful of connections
+    net::HttpClient client;
+    client.SetMaxConnectionsPerHost(4);
+    os::ThreadPool workers(8, "HttpWorkers");
+    os::JobCounter done;
+    std::atomic<U32> correct{ 0 };
+    for (int t = 0; t < 8; t++)
+    {
+        workers.Enqueue([&client, &correct, &base, t]() {
+            for (int i = 0; i < 200; i++)
+            {
+                int file = (t * 200 + i) % kFiles;
+                net::HttpResponse response = client.Fetch(
+                    net::HttpRequest("GET", (base + String::Format("%d.txt", file)).CStr()));
+                if (response.Status == 200 && response.Body == String::Format("asset %d", file))
+                    correct++;
+            }
+        }, os::TaskPriority::Normal, &done);
+    }
+    done.Wait();
+    EXPECT_EQ(correct.load(), 1600U);
+    EXPECT_LE(client.GetConnectCount(), 4U);
+
+    net::HttpResponse missing = client.Fetch(net::HttpRequest("GET", (base + "missing.txt").CStr()));
+    EXPECT_EQ(missing.Status, 404);
+    net::HttpResponse head = client.Fetch(net::HttpRequest("HEAD", (base + "3.txt").CStr()));
+    String length;
+    EXPECT_EQ(head.Status, 200);
+    EXPECT_TRUE(head.GetHeader("content-length", length));
+    EXPECT_EQ(length, String("7"));
+    EXPECT_EQ(head.Body.Length(), 0);
+
+    // one connection, GETs pipelined behind each other
+    net::HttpClient pipelined;
+    pipelined.SetMaxConnectionsPerHost(1);
+    pipelined.SetPipelineDepth(8);
+    correct = 0;
+    for (int t = 0; t < 8; t++)
+    {
+        workers.Enqueue([&pipelined, &correct, &base, t]() {
+            for (int i = 0; i < 50; i++)
+            {
+                net::HttpResponse response = pipelined.Fetch(
+                    net::HttpRequest("GET", (base + String::Format("%d.txt", t)).CStr()));
+                if (response.Status == 200 && response.Body == String::Format("asset %d", t))
+                    correct++;
+            }
+        }, os::TaskPriority::Normal, &done);
+    }
+    done.Wait();
+    EXPECT_EQ(correct.load(), 400U);
+    EXPECT_EQ(pipelined.GetConnectCount(), 1U);
+
+    // idle connections are closed, the next request reconnects
+    pipelined.SetIdleTimeout(20);
+    EXPECT_EQ(pipelined.Fetch(net::HttpRequest("GET", (base + "1.txt").CStr())).Status, 200);
+    for (int i = 0; i < 1000 && pipelined.GetOpenConnectionCount() > 0; i++)
+        os::Sleep(1);
+    EXPECT_EQ(pipelined.GetOpenConnectionCount(), 0U);
+    EXPECT_EQ(pipelined.Fetch(net::HttpRequest("GET", (base + "1.txt").CStr())).Status, 200);
+    EXPECT_EQ(pipelined.GetConnectCount(), 2U);
+
+    EXPECT_EQ(client.Fetch(net::HttpRequest("GET", "http://127.0.0.1:1/")).Status, 0);
+    EXPECT_EQ(client.Fetch(net::HttpRequest("GET", "ftp://127.0.0.1/")).Status, 0);
+
+    owner.reset();
+    for (int i = 0; i < kFiles; i++)
+        os::Remove(String::Format("pooled/%d.txt", i).CStr());
+    os::Remove("pooled");
+}
+
+struct ChunkedServer : public os::IConnectionHandler
+{
+    void OnReceived(os::Connection* Conn) override
+    {
+        static const char response[] =
+            "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+            "5;name=value\r\nhello\r\n1A\r\nabcdefghijklmnopqrstuvwxyz\r\n0\r\nX-Trailer: yes\r\n\r\n";
+        for (;;)
+        {
+            std::string input((const char*)Conn->GetInput(), (size_t)Conn->GetInputSize());
+            size_t headEnd = input.find("\r\n\r\n");
+            if (headEnd == std::string::npos)
+                return;
+            Conn->Consume(headEnd + 4);
+            // trickled out, so chunks arrive split at every possible place
+            for (size_t i = 0; i < sizeof(response) - 1; i += 7)
+            {
+                size_t size = sizeof(response) - 1 - i < 7 ? sizeof(response) - 1 - i : 7;
+                Conn->Send(response + i, size);
+                os::Sleep(1);
+            }
+        }
+    }
+};
+
+/// takes Capacity bytes, then refuses
+struct LimitedSink : public IIODevice
+{
+    size_t Capacity = 0;
+    size_t Written = 0;
+
+    bool   Open(const char*, IOFlag) override { return true; }
+    bool   IsEOF() override { return false; }
+    size_t Read(char*, size_t) override { return 0; }
+    size_t Write(const void*, size_t Size) override
+    {
+        size_t taken = Written + Size <= Capacity ? Size : 0;
+        Written += taken;
+        return taken;
+    }
+    bool   Seek(size_t) override { return false; }
+    bool   Skip(size_t) override { return false; }
+    void   Flush() override {}
+    void   Close() override {}
+};
+
+TEST(core, http_streaming)
+{
+    os::Remove("streamed");
+    ASSERT_TRUE(os::MakeDir("streamed"));
+    std::string big(5 * 1024 * 1024 + 3, '\0');
+    for (size_t i = 0; i < big.size(); i++)
+        big[i] = (char)(i * 13 + (i >> 16));
+    {
+        os::File file("streamed/big.bin");
+        ASSERT_TRUE(file.Open(IOFlag::Write));
+        file.Write(big.data(), big.size());
+    }
+
+    ChunkedServer chunked;
+    os::Reactor* loop = new os::Reactor;
+    net::AssetServer server(loop, "streamed");
+    std::unique_ptr<os::Reactor> owner(loop);
+    I32 assetPort = server.Listen(os::IpAddress("127.0.0.1:0"));
+    I32 chunkedPort = loop->Listen(os::IpAddress("127.0.0.1:0"), &chunked);
+    ASSERT_GT(assetPort, 0);
+    ASSERT_GT(chunkedPort, 0);
+    ASSERT_TRUE(loop->Start("StreamServer"));
+
+    // chunked framing is decoded, the trailer dropped and the connection kept
+    net::HttpClient client;
+    String chunkedUrl = String::Format("http://127.0.0.1:%d/chunked", chunkedPort);
+    for (int i = 0; i < 2; i++)
+    {
+        net::HttpResponse response = client.Fetch(net::HttpRequest("GET", chunkedUrl.CStr()));
+        EXPECT_EQ(response.Status, 200);
+        EXPECT_EQ(response.Body, String("helloabcdefghijklmnopqrstuvwxyz"));
+    }
+    EXPECT_EQ(client.GetConnectCount(), 1U);
+
+    // a large body goes straight into a file, never into Body
+    String bigUrl = String::Format("http://127.0.0.1:%d/big.bin", assetPort);
+    {
+        os::File sink("streamed/copy.bin");
+        ASSERT_TRUE(sink.Open(IOFlag::Write));
+        net::HttpResponse response = client.Fetch(net::HttpRequest("GET", bigUrl.CStr()), &sink);
+        EXPECT_EQ(response.Status, 200);
+        EXPECT_EQ(response.Body.Length(), 0);
+    }
+    {
+        os::MemMapFile copy;
+        ASSERT_TRUE(copy.Open("streamed/copy.bin", IOFlag::Read));
+        ASSERT_EQ(copy.GetSize(), (I64)big.size());
+        EXPECT_EQ(memcmp(copy.FileData(), big.data(), big.size()), 0);
+    }
+
+    // error pages stay out of the sink
+    LimitedSink limited;
+    limited.Capacity = 64 * 1024;
+    net::HttpResponse missing = client.Fetch(
+        net::HttpRequest("GET", String::Format("http://127.0.0.1:%d/none.bin", assetPort).CStr()), &limited);
+    EXPECT_EQ(missing.Status, 404);
+    EXPECT_EQ(missing.Body, String("Not Found"));
+    EXPECT_EQ(limited.Written, 0U);
+
+    // a sink that gives up fails the request without retrying into it
+    EXPECT_EQ(client.Fetch(net::HttpRequest("GET", bigUrl.CStr()), &limited).Status, 0);
+    EXPECT_LE(limited.Written, limited.Capacity);
+    EXPECT_EQ(client.Fetch(net::HttpRequest("GET", chunkedUrl.CStr())).Status, 200);
+
+    owner.reset();
+    os::Remove("streamed/big.bin");
+    os::Remove("streamed/copy.bin");
+    os::Remove("streamed");
+}
+
+struct DownloadProgress
+{
+    U32 Calls = 0;
+    U64 Received = 0;
+    U64 Total = 0;
+};
+
+static void OnDownloadProgress(U64 Received, U64 Total, float, void* UserData)
+{
+    DownloadProgress* progress = (DownloadProgress*)UserData;
+    progress->Calls++;
+    progress->Received = Received;
+    progress->Total = Total;
+}
+
+TEST(core, ranged_download)
+{
+    const U64 rangeSize = 1024 * 1024;
+    os::Remove("ranged");
+    ASSERT_TRUE(os::MakeDir("ranged"));
+    std::string big(6 * rangeSize + 5, '\0');
+    for (size_t i = 0; i < big.size(); i++)
+        big[i] = (char)(i * 7 + (i >> 12));
+    {
+        os::File file("ranged/asset.bin");
+        ASSERT_TRUE(file.Open(IOFlag::Write));
+        file.Write(big.data(), big.size());
+    }
+    std::vector<U64> hashes;
+    for (U64 first = 0; first < big.size(); first += rangeSize)
+        hashes.push_back(FileIndex::HashContent(big.data() + first,
+            (size_t)std::min<U64>(rangeSize, big.size() - first)));
+
+    os::Reactor* loop = new os::Reactor;
+    net::AssetServer server(loop, "ranged");
+    std::unique_ptr<os::Reactor> owner(loop);
+    I32 port = server.Listen(os::IpAddress("127.0.0.1:0"));
+    ASSERT_GT(port, 0);
+    ASSERT_TRUE(loop->Start("RangeServer"));
+    String url = String::Format("http://127.0.0.1:%d/asset.bin", port);
+
+    net::HttpClient client;
+    net::Downloader loader(&client);
+    loader.SetRangeSize(rangeSize);
+    DownloadProgress progress;
+    loader.SetProgressCallback(OnDownloadProgress, &progress);
+
+    // ranges land at their offsets from four connections at once
+    ASSERT_TRUE(loader.Download(url.CStr(), "ranged/copy.bin"));
+    EXPECT_EQ(loader.GetTotalSize(), (U64)big.size());
+    EXPECT_EQ(loader.GetRangeCount(), 7U);
+    EXPECT_EQ(loader.GetResumedBytes(), 0U);
+    EXPECT_GE(progress.Calls, 1U);
+    EXPECT_EQ(progress.Received, (U64)big.size());
+    EXPECT_EQ(progress.Total, (U64)big.size());
+    EXPECT_GT(client.GetConnectCount(), 1U);
+    EXPECT_FALSE(os::Exists("ranged/copy.bin.part"));
+    {
+        os::MemMapFile copy;
+        ASSERT_TRUE(copy.Open("ranged/copy.bin", IOFlag::Read));
+        ASSERT_EQ(copy.GetSize(), (I64)big.size());
+        EXPECT_EQ(memcmp(copy.FileData(), big.data(), big.size()), 0);
+    }
+    os::Remove("ranged/copy.bin");
+
+    // one range never matches its manifest hash, the ranges before it are kept
+    std::vector<U64> wrong = hashes;
+    wrong[3]++;
+    loader.SetParallelism(1);
+    loader.SetExpectedHashes(wrong.data(), (U32)wrong.size());
+    EXPECT_FALSE(loader.Download(url.CStr(), "ranged/copy.bin"));
+    EXPECT_TRUE(os::Exists("ranged/copy.bin.part"));
+
+    // a kept range whose bytes rotted is fetched again, the others resume
+    {
+        os::MemMapFile copy;
+        ASSERT_TRUE(copy.Open("ranged/copy.bin", IOFlag::Write));
+        ASSERT_EQ(copy.GetSize(), (I64)big.size());
+        copy.FileData()[rangeSize + 17] ^= 0xff;
+    }
+    loader.SetParallelism(4);
+    loader.SetExpectedHashes(hashes.data(), (U32)hashes.size());
+    U64 requests = server.GetRequestCount();
+    ASSERT_TRUE(loader.Download(url.CStr(), "ranged/copy.bin"));
+    EXPECT_EQ(loader.GetResumedBytes(), 2 * rangeSize);
+    // the HEAD and five ranges
+    EXPECT_EQ(server.GetRequestCount() - requests, 6U);
+    EXPECT_FALSE(os::Exists("ranged/copy.bin.part"));
+    {
+        os::MemMapFile copy;
+        ASSERT_TRUE(copy.Open("ranged/copy.bin", IOFlag::Read));
+        ASSERT_EQ(copy.GetSize(), (I64)big.size());
+        EXPECT_EQ(memcmp(copy.FileData(), big.data(), big.size()), 0);
+    }
+
+    // a record left by another resource is not trusted
+    {
+        os::File stale("ranged/copy.bin.part");
+        ASSERT_TRUE(stale.Open(IOFlag::Write));
+        stale.Write(big.data(), 4096);
+    }
+    ASSERT_TRUE(loader.Download(url.CStr(), "ranged/copy.bin"));
+    EXPECT_EQ(loader.GetResumedBytes(), 0U);
+
+    EXPECT_FALSE(loader.Download(String::Format("http://127.0.0.1:%d/none.bin", port).CStr(), "ranged/none.bin"));
+
+    owner.reset();
+    os::Remove("ranged/asset.bin");
+    os::Remove("ranged/copy.bin");
+    os::Remove("ranged");
+}
+
+/// answers every request with Body, announcing byte ranges only if asked to
+struct WholeServer : public os::IConnectionHandler
+{
+    std::string Body;
+    bool Ranges = false;
+
+    void OnReceived(os::Connection* Conn) override
+    {
+        for (;;)
+        {
+            std::string input((const char*)Conn->GetInput(), (size_t)Conn->GetInputSize());
+            size_t headEnd = input.find("\r\n\r\n");
+            if (headEnd == std::string::npos)
+                return;
+            bool head = input.compare(0, 5, "HEAD ") == 0;
+            Conn->Consume(headEnd + 4);
+            std::string response = String::Format("HTTP/1.1 200 OK\r\nContent-Length: %d\r\n%s\r\n",
+                (int)Body.size(), Ranges ? "Accept-Ranges: bytes\r\n" : "").CStr();
+            if (!head)
+                response += Body;
+            Conn->Send(response.data(), response.size());
+        }
+    }
+};
+
+TEST(core, whole_download)
+{
+    WholeServer handler;
+    handler.Body = "fresh body";
+    os::Reactor loop;
+    I32 port = loop.Listen(os::IpAddress("127.0.0.1:0"), &handler);
+    ASSERT_GT(port, 0);
+    ASSERT_TRUE(loop.Start("WholeServer"));
+    String url = String::Format("http://127.0.0.1:%d/asset.bin", port);
+    net::HttpClient client;
+    net::Downloader loader(&client);
+
+    // no byte ranges, the body replaces a longer file already there
+    WriteBytes("whole.bin", std::vector<U8>(10000, 'x'));
+    ASSERT_TRUE(loader.Download(url.CStr(), "whole.bin"));
+    {
+        os::File copy("whole.bin");
+        ASSERT_TRUE(copy.Open(IOFlag::Read));
+        ASSERT_EQ(copy.GetSize(), (I64)handler.Body.size());
+        char text[16] = {};
+        copy.Read(text, handler.Body.size());
+        EXPECT_EQ(std::string(text), handler.Body);
+    }
+
+    // an empty resource leaves an empty file
+    handler.Body.clear();
+    handler.Ranges = true;
+    ASSERT_TRUE(loader.Download(url.CStr(), "whole.bin"));
+    {
+        os::File copy("whole.bin");
+        ASSERT_TRUE(copy.Open(IOFlag::Read));
+        EXPECT_EQ(copy.GetSize(), 0);
+    }
+    loop.Stop();
+    os::Remove("whole.bin");
+}
+
+TEST(core, http_cache)
+{
+    os::Remove("served");
+    ASSERT_TRUE(os::MakeDir("served"));
+    std::string manifest;
+    for (int i = 0; manifest.size() < 100 * 1024; i++)
+        manifest += String::Format("{ \"path\": \"bundle/%d.pak\", \"size\": %d },\n", i, i * 37).CStr();
+    std::string blob(300 * 1024, '\0');
+    U64 state = 0x9E3779B97F4A7C15ull;
+    for (size_t i = 0; i < blob.size(); i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        blob[i] = (char)state;
+    }
+    WriteTextFile("served/manifest.json", manifest.c_str());
+    std::vector<U8> blobBytes(blob.begin(), blob.end());
+    WriteBytes("served/blob.bin", blobBytes);
+
+    os::Reactor* loop = new os::Reactor;
+    net::AssetServer server(loop, "served");
+    std::unique_ptr<os::Reactor> owner(loop);
+    I32 port = server.Listen(os::IpAddress("127.0.0.1:0"));
+    ASSERT_GT(port, 0);
+    ASSERT_TRUE(loop->Start("CacheServer"));
+    net::HttpRequest manifestRequest("GET", String::Format("http://127.0.0.1:%d/manifest.json", port).CStr());
+    net::HttpRequest blobRequest("GET", String::Format("http://127.0.0.1:%d/blob.bin", port).CStr());
+
+    net::HttpClient client;
+    {
+        net::HttpCache cache(&client, "httpcache");
+        cache.Clear();
+        net::HttpCacheBody body;
+        EXPECT_EQ(cache.Get(manifestRequest, body).Status, 200);
+        EXPECT_FALSE(body.IsFromCache());
+        ASSERT_EQ(body.GetSize(), (U64)manifest.size());
+        EXPECT_EQ(memcmp(body.GetData(), manifest.data(), manifest.size()), 0);
+        EXPECT_EQ(cache.GetEntryCount(), 1U);
+        // the manifest compresses, the random blob is kept raw
+        EXPECT_LT(cache.GetSize(), (U64)manifest.size() / 2);
+
+        // revalidated with a 304, no body crosses the wire again
+        net::HttpResponse again = cache.Get(manifestRequest, body);
+        EXPECT_EQ(again.Status, 200);
+        EXPECT_TRUE(body.IsFromCache());
+        EXPECT_EQ(server.GetBytesServed(), (U64)manifest.size());
+        ASSERT_EQ(body.GetSize(), (U64)manifest.size());
+        EXPECT_EQ(memcmp(body.GetData(), manifest.data(), manifest.size()), 0);
+        String etag;
+        EXPECT_TRUE(again.GetHeader("etag", etag));
+
+        EXPECT_EQ(cache.Get(blobRequest, body).Status, 200);
+        EXPECT_FALSE(body.IsFromCache());
+        EXPECT_GE(cache.GetSize(), (U64)blob.size());
+        EXPECT_EQ(cache.Get(blobRequest, body).Status, 200);
+        EXPECT_TRUE(body.IsFromCache());
+        ASSERT_EQ(body.GetSize(), (U64)blob.size());
+        EXPECT_EQ(memcmp(body.GetData(), blob.data(), blob.size()), 0);
+
+        net::HttpCacheBody missing;
+        net::HttpRequest missingRequest("GET", String::Format("http://127.0.0.1:%d/none.json", port).CStr());
+        EXPECT_EQ(cache.Get(missingRequest, missing).Status, 404);
+        EXPECT_EQ(missing.GetSize(), 0U);
+        EXPECT_EQ(cache.GetEntryCount(), 2U);
+
+        // hits from several threads share the entries
+        os::ThreadPool workers(4, "CacheWorkers");
+        os::JobCounter done;
+        std::atomic<U32> hits{ 0 };
+        for (int t = 0; t < 4; t++)
+        {
+            workers.Enqueue([&cache, &hits, &manifestRequest, &blobRequest, &manifest, &blob, t]() {
+                net::HttpCacheBody shared;
+                for (int i = 0; i < 20; i++)
+                {
+                    bool useBlob = (t + i) % 2 == 0;
+                    std::string const& expected = useBlob ? blob : manifest;
+                    if (cache.Get(useBlob ? blobRequest : manifestRequest, shared).Status == 200 &&
+                        shared.IsFromCache() && shared.GetSize() == expected.size() &&
+                        memcmp(shared.GetData(), expected.data(), expected.size()) == 0)
+                        hits++;
+                }
+            }, os::TaskPriority::Normal, &done);
+        }
+        done.Wait();
+        EXPECT_EQ(hits.load(), 80U);
+    }
+
+    // an index listing an entry twice counts it once
+    U64 storedSize = 0;
+    {
+        net::HttpCache cache(&client, "httpcache");
+        storedSize = cache.GetSize();
+    }
+    {
+        std::vector<U8> index;
+        os::File file("httpcache/index");
+        ASSERT_TRUE(file.Open(IOFlag::Read));
+        index.resize(file.GetSize());
+        ASSERT_EQ(file.Read((char*)index.data(), index.size()), index.size());
+        file.Close();
+        // the header is 24 bytes, its EntryCount at 8
+        U32 count = 0;
+        memcpy(&count, &index[8], 4);
+        std::vector<U8> records(index.begin() + 24, index.end());
+        index.insert(index.end(), records.begin(), records.end());
+        count *= 2;
+        memcpy(&index[8], &count, 4);
+        WriteBytes("httpcache/index", index);
+    }
+
+    // the index survives, a changed file is fetched whole
+    {
+        net::HttpCache cache(&client, "httpcache");
+        EXPECT_EQ(cache.GetEntryCount(), 2U);
+        EXPECT_EQ(cache.GetSize(), storedSize);
+        net::HttpCacheBody body;
+        EXPECT_EQ(cache.Get(manifestRequest, body).Status, 200);
+        EXPECT_TRUE(body.IsFromCache());
+
+        manifest += "{}\n";
+        WriteTextFile("served/manifest.json", manifest.c_str());
+        EXPECT_EQ(cache.Get(manifestRequest, body).Status, 200);
+        EXPECT_FALSE(body.IsFromCache());
+        ASSERT_EQ(body.GetSize(), (U64)manifest.size());
+        EXPECT_EQ(memcmp(body.GetData(), manifest.data(), manifest.size()), 0);
+        EXPECT_EQ(cache.Get(manifestRequest, body).Status, 200);
+        EXPECT_TRUE(body.IsFromCache());
+
+        // over the cap the least recently used entries go, blob.bin first, then the manifest
+        cache.SetMaxSize(blob.size() * 4);
+        for (int i = 0; i < 4; i++)
+        {
+            WriteBytes(String::Format("served/blob%d.bin", i).CStr(), blobBytes);
+            net::HttpRequest copyRequest("GET", String::Format("http://127.0.0.1:%d/blob%d.bin", port, i).CStr());
+            EXPECT_EQ(cache.Get(copyRequest, body).Status, 200);
+        }
+        EXPECT_EQ(cache.GetEntryCount(), 4U);
+        EXPECT_LE(cache.GetSize(), (U64)blob.size() * 4);
+        EXPECT_EQ(cache.Get(net::HttpRequest("GET", String::Format("http://127.0.0.1:%d/blob3.bin", port).CStr()),
+            body).Status, 200);
+        EXPECT_TRUE(body.IsFromCache());
+        EXPECT_EQ(cache.Get(blobRequest, body).Status, 200);
+        EXPECT_FALSE(body.IsFromCache());
+        cache.Clear();
+        EXPECT_EQ(cache.GetEntryCount(), 0U);
+    }
+
+    owner.reset();
+    os::Remove("httpcache/index");
+    os::Remove("httpcache");
+    os::Remove("served/manifest.json");
+    os::Remove("served/blob.bin");
+    for (int i = 0; i < 4; i++)
+        os::Remove(String::Format("served/blob%d.bin", i).CStr());
+    os::Remove("served");
+}
+
+/// reads requests and never answers
+struct SilentServer : public os::IConnectionHandler
+{
+    void OnReceived(os::Connection* Conn) override { Conn->Consume(Conn->GetInputSize()); }
+};
+
+struct AsyncTally
+{
+    std::atomic<U32> Correct{ 0 };
+    std::atomic<U32> OnJobs{ 0 };
+    os::ThreadPool* Jobs = nullptr;
+};
+
+static void OnAsyncFetched(net::HttpAsyncRequest& Request)
+{
+    AsyncTally* tally = (AsyncTally*)Request.UserData;
+    if (Request.Outcome == net::HttpOutcome::Completed && Request.Response.Status == 200 &&
+        Request.Response.Body.Length() > 0)
+        tally->Correct++;
+    if (tally->Jobs && Request.Jobs == tally->Jobs)
+        tally->OnJobs++;
+}
+
+TEST(core, http_async)
+{
+    const int kFiles = 16;
+    const int kRequests = 400;
+    os::Remove("async");
+    ASSERT_TRUE(os::MakeDir("async"));
+    for (int i = 0; i < kFiles; i++)
+        WriteTextFile(String::Format("async/%d.txt", i).CStr(), String::Format("asset %d", i).CStr());
+
+    os::Reactor* loop = new os::Reactor;
+    net::AssetServer server(loop, "async");
+    std::unique_ptr<os::Reactor> owner(loop);
+    I32 port = server.Listen(os::IpAddress("127.0.0.1:0"));
+    ASSERT_GT(port, 0);
+    SilentServer silent;
+    I32 silentPort = loop->Listen(os::IpAddress("127.0.0.1:0"), &silent);
+    ASSERT_GT(silentPort, 0);
+    ASSERT_TRUE(loop->Start("AsyncServer"));
+
+    // one thread keeps hundreds of requests in flight without blocking on any
+    net::HttpClient client;
+    client.SetMaxConnectionsPerHost(4);
+    client.SetPipelineDepth(4);
+    AsyncTally tally;
+    os::JobCounter done;
+    std::vector<net::HttpAsyncRequest> requests(kRequests);
+    for (int i = 0; i < kRequests; i++)
+    {
+        requests[i].Request = net::HttpRequest("GET", String::Format("http://127.0.0.1:%d/%d.txt", port, i % kFiles).CStr());
+        requests[i].OnComplete = OnAsyncFetched;
+        requests[i].UserData = &tally;
+        requests[i].Counter = &done;
+    }
+    client.Submit(requests.data(), kRequests);
+    done.Wait();
+    EXPECT_EQ(tally.Correct.load(), (U32)kRequests);
+    U32 matching = 0;
+    for (int i = 0; i < kRequests; i++)
+        matching += requests[i].Response.Body == String::Format("asset %d", i % kFiles) ? 1 : 0;
+    EXPECT_EQ(matching, (U32)kRequests);
+    EXPECT_LE(client.GetConnectCount(), 4U);
+
+    // completions handed to a pool instead of the reactor thread
+    os::ThreadPool callbacks(2, "HttpCallbacks");
+    tally.Correct = 0;
+    tally.Jobs = &callbacks;
+    for (int i = 0; i < 32; i++)
+    {
+        requests[i].Jobs = &callbacks;
+        client.Submit(requests[i]);
+    }
+    done.Wait();
+    EXPECT_EQ(tally.Correct.load(), 32U);
+    EXPECT_EQ(tally.OnJobs.load(), 32U);
+
+    // a server that never answers times out, or is cancelled
+    String silentUrl = String::Format("http://127.0.0.1:%d/never", silentPort);
+    net::HttpAsyncRequest timed, cancelled, broken;
+    timed.Request = net::HttpRequest("GET", silentUrl.CStr());
+    timed.TimeoutMs = 50;
+    timed.Counter = &done;
+    cancelled.Request = net::HttpRequest("GET", silentUrl.CStr());
+    cancelled.Counter = &done;
+    broken.Request = net::HttpRequest("GET", "ftp://127.0.0.1/");
+    broken.Counter = &done;
+    U64 start = os::Clock::NowNs();
+    client.Submit(timed);
+    U64 id = client.Submit(cancelled);
+    EXPECT_EQ(id, cancelled.Id);
+    client.Submit(broken);
+    os::Sleep(10);
+    client.Cancel(id);
+    done.Wait();
+    EXPECT_EQ(timed.Outcome, net::HttpOutcome::TimedOut);
+    EXPECT_EQ(timed.Response.Status, 0);
+    EXPECT_GE(os::Clock::NowNs() - start, 50000000ull);
+    EXPECT_EQ(cancelled.Outcome, net::HttpOutcome::Cancelled);
+    EXPECT_EQ(broken.Outcome, net::HttpOutcome::Failed);
+    // cancelling a finished request does nothing
+    client.Cancel(id);
+
+    // the client still serves after losing connections to the timeout and the cancel
+    net::HttpAsyncRequest after;
+    after.Request = net::HttpRequest("GET", String::Format("http://127.0.0.1:%d/3.txt", port).CStr());
+    after.Counter = &done;
+    client.Submit(after);
+    done.Wait();
+    EXPECT_EQ(after.Outcome, net::HttpOutcome::Completed);
+    EXPECT_EQ(after.Response.Body, String("asset 3"));
+
+    owner.reset();
+    for (int i = 0; i < kFiles; i++)
+        os::Remove(String::Format("async/%d.txt", i).CStr());
+    os::Remove("async");
+}
+
 TEST(os, thread)
 {
     auto file = MakeShared<os::File>();
@@ -61,6 +1867,161 @@ TEST(core, string)
     EXPECT_TRUE(testMd5.CStr() == nullptr);
 }
 
+TEST(core, base64)
+{
+    // RFC 4648 test vectors
+    const char* plain[] = { "", "f", "fo", "foo", "foob", "fooba", "foobar" };
+    const char* coded[] = { "", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy" };
+    for (int i = 0; i < 7; i++)
+    {
+        EXPECT_EQ(Base64Encode(String(plain[i])), String(coded[i]));
+        EXPECT_EQ(Base64Decode(String(coded[i])), String(plain[i]));
+    }
+
+    // every length through the vector blocks and their tails, binary bytes included
+    std::vector<U8> data(1024 * 1024 + 5);
+    U32 state = 0x12345678;
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        state = state * 1664525u + 1013904223u;
+        data[i] = (U8)(state >> 24);
+    }
+    std::vector<char> text(Base64EncodedLength(data.size()));
+    std::vector<U8> decoded(Base64DecodedCapacity(text.size()));
+    U32 wrong = 0;
+    for (size_t size = 0; size < 300; size++)
+    {
+        size_t length = Base64Encode(data.data() + size, size, text.data());
+        wrong += length != Base64EncodedLength(size);
+        for (size_t i = 0; i + 3 <= size; i += 3)
+        {
+            // each group of the text against the one of its bytes
+            U32 triple = ((U32)data[size + i] << 16) | ((U32)data[size + i + 1] << 8) | data[size + i + 2];
+            const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            for (int c = 0; c < 4; c++)
+                wrong += text[i / 3 * 4 + c] != alphabet[(triple >> (18 - 6 * c)) & 63];
+        }
+        wrong += Base64Decode(text.data(), length, decoded.data()) != size;
+        wrong += memcmp(decoded.data(), data.data() + size, size) != 0;
+    }
+    EXPECT_EQ(wrong, 0U);
+    size_t length = Base64Encode(data.data(), data.size(), text.data());
+    EXPECT_EQ(Base64Decode(text.data(), length, decoded.data()), data.size());
+    EXPECT_EQ(memcmp(decoded.data(), data.data(), data.size()), 0);
+    String big((const char*)data.data(), data.size());
+    EXPECT_EQ(Base64Decode(Base64Encode(big)), big);
+
+    // decoding stops at the first character outside the alphabet, unpadded text decodes too
+    std::string broken(text.data(), 4000);
+    broken[1001] = '*';
+    EXPECT_EQ(Base64Decode(broken.data(), broken.size(), decoded.data()), 750U);
+    EXPECT_EQ(memcmp(decoded.data(), data.data(), 750), 0);
+    EXPECT_EQ(Base64Decode(String("Zm9vYg")), String("foob"));
+    EXPECT_EQ(Base64Decode(String("Zm9v\nYmFy")), String("foo"));
+}
+
+TEST(core, hash)
+{
+    // reference xxHash64 and CRC-32C values
+    EXPECT_EQ(Hash64("", 0), 0xEF46DB3751D8E999ull);
+    EXPECT_EQ(Hash64("abc", 3), 0x44BC2CF5AD770999ull);
+    EXPECT_EQ(Crc32c("123456789", 9), 0xE3069283u);
+    std::vector<U8> data(1024 * 1024 + 3);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (U8)(i * 131 + (i >> 5));
+    EXPECT_EQ(Hash64(data.data(), 1000), 0x3424F7DA072BE7F7ull);
+    EXPECT_EQ(Hash64(data.data(), 37, 7), 0x869F431B951455F2ull);
+    EXPECT_EQ(Crc32c(data.data(), 1000), 0x8224C29Bu);
+    EXPECT_EQ(Crc32c(data.data() + 400, 600, Crc32c(data.data(), 400)), 0x8224C29Bu);
+
+    // pieces of any size give the one-shot digests
+    U32 state = 0x2545F491;
+    U32 wrong = 0;
+    for (size_t size = 0; size < 300; size++)
+    {
+        HashStream stream(size);
+        for (size_t pos = 0; pos < size;)
+        {
+            state = state * 1664525u + 1013904223u;
+            size_t piece = std::min<size_t>(size - pos, (state >> 24) % 40);
+            stream.Update(data.data() + pos, piece);
+            pos += piece;
+        }
+        Hash128 wide = Hash64x2(data.data(), size, size);
+        wrong += stream.Digest64() != Hash64(data.data(), size, size);
+        wrong += stream.Digest64x2() != wide;
+        wrong += wide.Low != Hash64(data.data(), size, size) || wide.High == wide.Low;
+    }
+    EXPECT_EQ(wrong, 0U);
+    HashStream stream;
+    stream.Update(data.data(), 12345);
+    stream.Update(data.data() + 12345, data.size() - 12345);
+    EXPECT_EQ(stream.Digest64(), Hash64(data.data(), data.size()));
+    EXPECT_EQ(stream.Digest64x2(), Hash64x2(data.data(), data.size()));
+    EXPECT_NE(Hash64(data.data(), data.size(), 1), Hash64(data.data(), data.size()));
+
+    EXPECT_EQ(Hasher<String>()(String("abc")), Hash64("abc", 3));
+    EXPECT_NE(Hasher<int>()(1), Hasher<int>()(2));
+    EXPECT_EQ(Hasher<const U8*>()(data.data()), HashMix((U64)(uintptr_t)data.data()));
+}
+
+static String DigestHex(const U8* Digest, int Size)
+{
+    String Hex;
+    for (int i = 0; i < Size; i++)
+        Hex.AppendSprintf("%02x", Digest[i]);
+    return Hex;
+}
+
+static void Sha1Digest(const U8* Data, unsigned Size, U8 (&Digest)[20])
+{
+    SHA1 sha;
+    // in two pieces, through the partial block of the stream
+    sha.Input((const char*)Data, Size / 3);
+    sha.Input((const char*)Data + Size / 3, Size - Size / 3);
+    unsigned words[5];
+    sha.Result(words);
+    for (int i = 0; i < 20; i++)
+        Digest[i] = (U8)(words[i / 4] >> (24 - 8 * (i % 4)));
+}
+
+TEST(core, digest_batch)
+{
+    std::vector<U8> data(1024 * 1024 + 3);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (U8)(i * 131 + (i >> 5));
+    EXPECT_EQ(DigestHex(MD5(data.data(), 1000).digest(), 16), String("36e415a16ebfb14ef251d2cac837dd11"));
+    U8 digest[20];
+    Sha1Digest(data.data(), 1000, digest);
+    EXPECT_EQ(DigestHex(digest, 20), String("fced997dd29de4705a6d3ef9e518d83841110a42"));
+    Sha1Digest((const U8*)"abc", 3, digest);
+    EXPECT_EQ(DigestHex(digest, 20), String("a9993e364706816aba3e25717850c26c9cd0d89d"));
+
+    // every length around the block and padding edges, in all the lanes, then a long one
+    std::vector<DigestJob> jobs;
+    for (U32 size = 0; size < 200; size++)
+        jobs.push_back({ data.data() + size, size });
+    jobs.push_back({ data.data(), data.size() });
+    U32 count = (U32)jobs.size();
+    MD5Batch(jobs.data(), count);
+    U32 wrong = 0;
+    for (U32 i = 0; i + 1 < count; i++)
+        wrong += memcmp(jobs[i].Digest, MD5(jobs[i].Data, jobs[i].Size).digest(), 16) != 0;
+    EXPECT_EQ(wrong, 0U);
+    EXPECT_EQ(DigestHex(jobs.back().Digest, 16), String("030cbc1fd42a95d7532a664adab68a0d"));
+
+    SHA1Batch(jobs.data(), count);
+    wrong = 0;
+    for (U32 i = 0; i + 1 < count; i++)
+    {
+        Sha1Digest((const U8*)jobs[i].Data, (unsigned)jobs[i].Size, digest);
+        wrong += memcmp(jobs[i].Digest, digest, 20) != 0;
+    }
+    EXPECT_EQ(wrong, 0U);
+    EXPECT_EQ(DigestHex(jobs.back().Digest, 20), String("fec993a4f390b735095428956d2d7a27ebea7baf"));
+    SHA1Batch(jobs.data(), 0);
+}
+
 TEST(core, array)
 {
     DynArray<int> ints;
@@ -138,6 +2099,87 @@ TEST(core, regex)
     EXPECT_EQ(String("8.0.0"), newVal);
 }
 
+static std::string SpanText(RegEx::Span const& span)
+{
+    return std::string(span.Data ? span.Data : "", (size_t)span.Size);
+}
+
+TEST(core, regex_match_all)
+{
+    std::string log;
+    for (int i = 0; i < 1000; i++)
+        log += "[" + std::to_string(i) + "] " + (i % 3 ? "info" : "error") + ": line " + std::to_string(i * 7) + "\n";
+
+    // every match, spans into the subject
+    RegEx line("\\[(\\d+)\\] (?<level>error|info): line (\\d+)", RegEx::Default);
+    ASSERT_TRUE(line.IsValid());
+    auto it = line.MatchAll(log.data(), log.size());
+    EXPECT_EQ(it.GetGroupCount(), 4U);
+    U32 count = 0, errors = 0, wrong = 0;
+    while (it.Next())
+    {
+        wrong += SpanText(it.GetGroup(1U)) != std::to_string(count);
+        wrong += SpanText(it.GetGroup(3U)) != std::to_string(count * 7);
+        errors += SpanText(it.GetGroup("level")) == "error";
+        wrong += it.GetGroup(0U).Data < log.data() || it.GetGroup(0U).Data >= log.data() + log.size();
+        count++;
+    }
+    EXPECT_EQ(count, 1000U);
+    EXPECT_EQ(errors, 334U);
+    EXPECT_EQ(wrong, 0U);
+    EXPECT_FALSE(it.Next());
+    EXPECT_EQ(it.GetGroup(0U).Data, nullptr);
+
+    // empty matches step a character on, whole UTF-8 sequences
+    std::vector<std::string> found;
+    RegEx stars("x*", RegEx::Default);
+    for (auto all = stars.MatchAll("axxb"); all.Next();)
+        found.push_back(SpanText(all.GetGroup(0U)));
+    EXPECT_EQ(found, std::vector<std::string>({ "", "xx", "", "" }));
+    RegEx empty("", RegEx::Default);
+    std::vector<U64> offsets;
+    const char* accented = "\xC3\xA9t\xC3\xA9";
+    for (auto all = empty.MatchAll(accented); all.Next();)
+        offsets.push_back(all.GetGroup(0U).Data - accented);
+    EXPECT_EQ(offsets, std::vector<U64>({ 0, 2, 3, 5 }));
+
+    // an unset group has no data, a name not in the pattern neither
+    RegEx optional("a(b)?(c)", RegEx::Default);
+    auto one = optional.MatchAll("ac");
+    ASSERT_TRUE(one.Next());
+    EXPECT_EQ(one.GetGroup(1U).Data, nullptr);
+    EXPECT_EQ(SpanText(one.GetGroup(2U)), "c");
+    EXPECT_EQ(one.GetGroup("missing").Data, nullptr);
+    EXPECT_EQ(one.GetGroup(9U).Data, nullptr);
+
+    // the modes are compiled in, the same expression in another mode is another pattern
+    EXPECT_TRUE(RegEx("ERROR", RegEx::IgnoreCase).Match("an error"));
+    EXPECT_FALSE(RegEx("ERROR", RegEx::Default).Match("an error"));
+    RegEx invalid("(unclosed", RegEx::Default);
+    EXPECT_FALSE(invalid.IsValid());
+    EXPECT_FALSE(invalid.MatchAll("(unclosed").Next());
+    RegEx copy = line;
+    EXPECT_TRUE(copy.Match("[1] info: line 7"));
+
+    // one RegEx matching on several threads at once
+    os::ThreadPool workers(4, "RegExWorkers");
+    os::JobCounter done;
+    std::atomic<U32> total{ 0 };
+    for (int t = 0; t < 4; t++)
+    {
+        workers.Enqueue([&line, &log, &total]() {
+            for (int i = 0; i < 10; i++)
+            {
+                auto all = line.MatchAll(log.data(), log.size());
+                while (all.Next())
+                    total++;
+            }
+        }, os::TaskPriority::Normal, &done);
+    }
+    done.Wait();
+    EXPECT_EQ(total.load(), 40000U);
+}
+
 // ADB
 class NetClient : public os::Socket
 {
@@ -187,6 +2229,138 @@ TEST(core, simd)
     EXPECT_EQ(simd::GetFloat(data, 0), 2.0f);
 }
 
+template <U32 N>
+static void CheckSimdLanes()
+{
+    using namespace simd;
+    float In[N + 3];
+    I32 Table[64];
+    for (U32 i = 0; i < N + 3; i++)
+        In[i] = (float)i - 2.5f;
+    for (I32 i = 0; i < 64; i++)
+        Table[i] = i * i;
+
+    VecF<N> a = VecF<N>::Load(In), b = VecF<N>::Broadcast(1.0f);
+    Mask<N> Below = a < b;
+    U32 Expected = 0;
+    for (U32 i = 0; i < N; i++)
+        Expected |= (In[i] < 1.0f ? 1u : 0u) << i;
+    EXPECT_EQ(BitMask(Below), Expected);
+    EXPECT_TRUE(Any(Below));
+    EXPECT_EQ(All(Below), N <= 4);
+    VecF<N> Low = Min(a, b), High = Max(a, b), Picked = Select(Below, b, a);
+    VecF<N> Fused = Fma(a, a, b);
+    VecI<N> Index = Convert<I32>(Abs(a) * VecF<N>::Broadcast(4.0f));
+    VecI<N> Squares = Gather(Table, Index);
+    // lanes off may hold any index, they are not read
+    VecI<N> Guarded = Gather(Table, Select(Below, Index, VecI<N>::Sequence(1000)), Below, VecI<N>::Broadcast(-7));
+    for (U32 i = 0; i < N; i++)
+    {
+        EXPECT_EQ(Low[i], In[i] < 1.0f ? In[i] : 1.0f);
+        EXPECT_EQ(High[i], In[i] > 1.0f ? In[i] : 1.0f);
+        EXPECT_EQ(Picked[i], In[i] < 1.0f ? 1.0f : In[i]);
+        EXPECT_EQ(Fused[i], In[i] * In[i] + 1.0f);
+        I32 Lane = (I32)(fabsf(In[i]) * 4.0f);
+        EXPECT_EQ(Squares[i], Lane * Lane);
+        EXPECT_EQ(Guarded[i], In[i] < 1.0f ? Lane * Lane : -7);
+    }
+    I32 Sum = 0;
+    for (U32 i = 0; i < N; i++)
+        Sum += Index[i];
+    EXPECT_EQ(ReduceAdd(Index), Sum);
+    EXPECT_EQ(ReduceMin(a), In[0]);
+    EXPECT_EQ(ReduceMax(a), In[N - 1]);
+
+    // a tail leaves the rest of the array alone and reads zeros
+    float Out[N + 3];
+    for (U32 i = 0; i < N + 3; i++)
+        Out[i] = 42.0f;
+    VecF<N> Tail = VecF<N>::Load(In + 3, N - 1);
+    Tail.Store(Out, N - 1);
+    EXPECT_EQ(Tail[N - 1], 0.0f);
+    EXPECT_EQ(Out[N - 1], 42.0f);
+    EXPECT_EQ(memcmp(Out, In + 3, sizeof(float) * (N - 1)), 0);
+    VecI<N> Bits = BitCast<I32>(VecF<N>::Broadcast(-0.0f));
+    EXPECT_EQ(BitMask(Bits == VecI<N>::Broadcast(INT32_MIN)), (U32)((1ull << N) - 1));
+    EXPECT_EQ(ReduceAdd((VecI<N>::Sequence(0) << 2) >> 1), (I32)(N * (N - 1)));
+}
+
+TEST(core, simd_lanes)
+{
+    auto const& Features = simd::GetCpuFeatures();
+    EXPECT_TRUE(!Features.Avx2 || Features.Avx);
+    EXPECT_TRUE(!Features.Avx512F || Features.Avx);
+    U32 Width = simd::GetSimdWidth();
+    EXPECT_TRUE(Width == 1 || Width == 4 || Width == 8 || Width == 16);
+    EXPECT_EQ(simd::SelectSimdWidth(0), Width);
+    EXPECT_EQ(simd::SelectSimdWidth(64), Width);
+    EXPECT_EQ(simd::SelectSimdWidth(1), 1U);
+    EXPECT_EQ(simd::SelectSimdWidth(6), Width < 4 ? Width : 4U);
+
+    CheckSimdLanes<1>();
+    CheckSimdLanes<4>();
+    CheckSimdLanes<8>();
+    CheckSimdLanes<16>();
+
+    // spheres on a grid, against the unit cube as six planes
+    const float Planes[6][4] = {
+        { 1, 0, 0, 1 }, { -1, 0, 0, 1 }, { 0, 1, 0, 1 }, { 0, -1, 0, 1 }, { 0, 0, 1, 1 }, { 0, 0, -1, 1 } };
+    const U32 Count = 1003;
+    std::vector<float> X(Count), Y(Count), Z(Count), R(Count);
+    std::vector<U8> Expected(Count);
+    for (U32 i = 0; i < Count; i++)
+    {
+        X[i] = (float)(i % 11) * 0.375f - 2.0f;
+        Y[i] = (float)(i % 7) * 0.5f - 1.5f;
+        Z[i] = (float)(i % 13) * 0.25f - 1.625f;
+        R[i] = (float)(i % 5) * 0.125f;
+        bool In = true;
+        for (auto& P : Planes)
+            In = In && P[0] * X[i] + P[1] * Y[i] + P[2] * Z[i] + P[3] >= -R[i];
+        Expected[i] = In;
+    }
+    for (U32 Lanes : { 1U, 4U, 8U, 16U })
+    {
+        std::vector<U8> Visible(Count, 7);
+        simd::CullSpheres(X.data(), Y.data(), Z.data(), R.data(), Count, Planes, 6, Visible.data(), Lanes);
+        EXPECT_EQ(Visible, Expected) << Lanes << " lanes";
+    }
+
+    // a gamma like curve, samples off the grid and out of range
+    std::vector<float> Curve(256), Values(777), Mapped(777);
+    for (U32 i = 0; i < 256; i++)
+        Curve[i] = powf(i / 255.0f, 2.2f);
+    for (U32 i = 0; i < 777; i++)
+        Values[i] = (float)i / 700.0f - 0.05f;
+    Values[5] = NAN;
+    for (U32 Lanes : { 1U, 4U, 8U, 16U })
+    {
+        simd::ApplyCurve(Values.data(), Mapped.data(), Values.size(), Curve.data(), 256, Lanes);
+        U32 Wrong = 0;
+        for (U32 i = 0; i < 777; i++)
+        {
+            float x = i == 5 ? 0.0f : std::min(std::max(Values[i], 0.0f), 1.0f) * 255.0f;
+            U32 At = std::min((U32)x, 254U);
+            float Reference = Curve[At] + (x - At) * (Curve[At + 1] - Curve[At]);
+            Wrong += fabsf(Mapped[i] - Reference) > 1e-6f;
+        }
+        EXPECT_EQ(Wrong, 0U) << Lanes << " lanes";
+        EXPECT_EQ(Mapped[776], Curve[255]);
+        EXPECT_EQ(Mapped[0], Curve[0]);
+    }
+
+    // the 4x4 helpers Matrix.h runs on
+    alignas(16) float M[16] = { 2, 0.5f, 0, 0, 0, 4, 0, 0, 0, 1, 1, 0, 1, 2, 3, 1 };
+    alignas(16) float Inverse[16], Product[16], V[4] = { 1, 2, 3, 4 }, MV[4];
+    simd::MatrixInverse(M, Inverse);
+    simd::MatrixMultiply(Product, M, Inverse);
+    for (U32 i = 0; i < 16; i++)
+        EXPECT_NEAR(Product[i], i % 5 == 0 ? 1.0f : 0.0f, 1e-6f);
+    simd::MatrixVectorMultiply(MV, M, V);
+    EXPECT_EQ(MV[0], 3.0f);
+    EXPECT_EQ(MV[3], 18.0f);
+}
+
 TEST(core, math)
 {
     math::TVector<float, 4> Vector4 = {1.0f, 0.4f, 0.2f, 1.0f};
@@ -0,0 +1,469 @@
+#include "CoreMinimal.h"
+#include "Base/Platform.h"
+
+#include <deque>
+#include <vector>
+
+#if K3DPLATFORM_OS_LINUX && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define __K3D_HAS_IO_URING 1
+#endif
+#endif
+
+namespace k3d
+{
+namespace os
+{
+static const U32 kDirectIOAlignment = 4096;
+// what a single read(2)/write(2) transfers at most on Linux
+static const size_t kMaxTransferSize = 0x7ffff000;
+
+static void
+__CompleteRequest(IORequest* Request, I64 Result)
+{
+  Request->Result = Result;
+  if (Request->OnComplete)
+    Request->OnComplete(*Request);
+  if (Request->Counter)
+    Request->Counter->Done();
+}
+
+#if __K3D_HAS_IO_URING
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+
+#define __IOPRIO_CLASS_BE 2
+#define __IOPRIO_PRIO_VALUE(Class, Level) (((Class) << 13) | (Level))
+
+/**
+ * Minimal io_uring driver over the raw syscalls so we don't depend on liburing,
+ * the submission side is serialized by the caller, completions are reaped by
+ * a single thread.
+ */
+struct __IoUring
+{
+  __IoUring()
+    : Fd(-1)
+    , Entries(0)
+    , SqRing(MAP_FAILED)
+    , CqRing(MAP_FAILED)
+    , Sqes((io_uring_sqe*)MAP_FAILED)
+    , SqRingSize(0)
+    , CqRingSize(0)
+    , SqesSize(0)
+  {
+  }
+
+  ~__IoUring()
+  {
+    if (Sqes != MAP_FAILED)
+      munmap(Sqes, SqesSize);
+    if (CqRing != MAP_FAILED && CqRing != SqRing)
+      munmap(CqRing, CqRingSize);
+    if (SqRing != MAP_FAILED)
+      munmap(SqRing, SqRingSize);
+    if (Fd >= 0)
+      close(Fd);
+  }
+
+  bool Init(U32 Depth)
+  {
+    io_uring_params Params;
+    memset(&Params, 0, sizeof(Params));
+    Fd = (int)syscall(__NR_io_uring_setup, Depth, &Params);
+    if (Fd < 0)
+      return false;
+    // IORING_OP_READ/WRITE came with the same kernel (5.6) as this feature bit
+    if (!(Params.features & IORING_FEAT_RW_CUR_POS))
+      return false;
+    Entries = Params.sq_entries;
+    SqRingSize = Params.sq_off.array + Params.sq_entries * sizeof(U32);
+    CqRingSize = Params.cq_off.cqes + Params.cq_entries * sizeof(io_uring_cqe);
+    bool SingleMap = (Params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (SingleMap)
+      SqRingSize = CqRingSize = std::max(SqRingSize, CqRingSize);
+    SqRing = mmap(nullptr, SqRingSize, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_SQ_RING);
+    if (SqRing == MAP_FAILED)
+      return false;
+    CqRing = SingleMap ? SqRing
+                       : mmap(nullptr, CqRingSize, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_CQ_RING);
+    if (CqRing == MAP_FAILED)
+      return false;
+    SqesSize = Params.sq_entries * sizeof(io_uring_sqe);
+    Sqes = (io_uring_sqe*)mmap(nullptr, SqesSize, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_SQES);
+    if (Sqes == MAP_FAILED)
+      return false;
+
+    char* Sq = (char*)SqRing;
+    SqHead = (U32*)(Sq + Params.sq_off.head);
+    SqTail = (U32*)(Sq + Params.sq_off.tail);
+    SqMask = (U32*)(Sq + Params.sq_off.ring_mask);
+    SqArray = (U32*)(Sq + Params.sq_off.array);
+    char* Cq = (char*)CqRing;
+    CqHead = (U32*)(Cq + Params.cq_off.head);
+    CqTail = (U32*)(Cq + Params.cq_off.tail);
+    CqMask = (U32*)(Cq + Params.cq_off.ring_mask);
+    Cqes = (io_uring_cqe*)(Cq + Params.cq_off.cqes);
+    return true;
+  }
+
+  io_uring_sqe* NextSqe(U32 Index)
+  {
+    U32 Tail = *SqTail + Index;
+    U32 Slot = Tail & *SqMask;
+    SqArray[Slot] = Slot;
+    io_uring_sqe* Sqe = &Sqes[Slot];
+    memset(Sqe, 0, sizeof(*Sqe));
+    return Sqe;
+  }
+
+  // publishes Count prepared entries and hands them to the kernel
+  void Submit(U32 Count)
+  {
+    if (!Count)
+      return;
+    __atomic_store_n(SqTail, *SqTail + Count, __ATOMIC_RELEASE);
+    U32 Left = Count;
+    while (Left) {
+      int Ret = (int)syscall(__NR_io_uring_enter, Fd, Left, 0, 0, nullptr, 0);
+      if (Ret < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+          continue;
+        break;
+      }
+      Left -= std::min<U32>(Left, (U32)Ret);
+    }
+  }
+
+  void WaitCompletion()
+  {
+    syscall(__NR_io_uring_enter, Fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+  }
+
+  int Fd;
+  U32 Entries;
+  void* SqRing;
+  void* CqRing;
+  io_uring_sqe* Sqes;
+  size_t SqRingSize;
+  size_t CqRingSize;
+  size_t SqesSize;
+  U32* SqHead;
+  U32* SqTail;
+  U32* SqMask;
+  U32* SqArray;
+  U32* CqHead;
+  U32* CqTail;
+  U32* CqMask;
+  io_uring_cqe* Cqes;
+};
+#endif
+
+struct AsyncIOPrivate
+{
+  AsyncIOPrivate(U32 InFallbackThreads, size_t InMaxTransferSize)
+    : Lock("AsyncIO")
+    , FallbackThreads(InFallbackThreads ? InFallbackThreads : 1)
+    , MaxTransferSize(InMaxTransferSize && InMaxTransferSize < kMaxTransferSize
+                        ? InMaxTransferSize
+                        : kMaxTransferSize)
+    , Pool(nullptr)
+#if __K3D_HAS_IO_URING
+    , Ring(nullptr)
+    , InFlight(0)
+    , Backlogged(0)
+    , Stopping(false)
+    , Reaper(nullptr)
+#endif
+  {
+  }
+
+  ~AsyncIOPrivate()
+  {
+#if __K3D_HAS_IO_URING
+    if (Ring) {
+      Lock.Lock();
+      Stopping = true;
+      while (InFlight || Backlogged)
+        Drained.Wait(&Lock);
+      // the reaper exits on the completion of this nop
+      io_uring_sqe* Sqe = Ring->NextSqe(0);
+      Sqe->opcode = IORING_OP_NOP;
+      Sqe->user_data = 0;
+      Ring->Submit(1);
+      Lock.UnLock();
+      Reaper->Join();
+      delete Reaper;
+      delete Ring;
+    }
+#endif
+    delete Pool;
+  }
+
+  // positional transfer used by the thread pool backend, loops over short transfers
+  static I64 TransferBlocking(IORequest* Request, size_t MaxTransfer)
+  {
+  #if K3DPLATFORM_OS_WINDOWS
+    HANDLE Handle = (HANDLE)Request->Target->m_hFile;
+    size_t Done = 0;
+    while (Done < Request->Size) {
+      OVERLAPPED Overlapped = {};
+      U64 Offset = Request->Offset + Done;
+      Overlapped.Offset = (DWORD)(Offset & 0xffffffff);
+      Overlapped.OffsetHigh = (DWORD)(Offset >> 32);
+      DWORD Chunk = (DWORD)std::min<size_t>(Request->Size - Done, MaxTransfer);
+      DWORD Transferred = 0;
+      BOOL Ok = Request->Operation == IOOperation::Read
+        ? ::ReadFile(Handle, (char*)Request->Buffer + Done, Chunk, &Transferred, &Overlapped)
+        : ::WriteFile(Handle, (const char*)Request->Buffer + Done, Chunk, &Transferred, &Overlapped);
+      if (!Ok) {
+        DWORD Error = ::GetLastError();
+        if (Error == ERROR_HANDLE_EOF)
+          break;
+        return Done ? (I64)Done : -(I64)Error;
+      }
+      if (!Transferred)
+        break;
+      Done += Transferred;
+    }
+    return (I64)Done;
+  #else
+    int Fd = Request->Target->m_fd;
+    size_t Done = 0;
+    while (Done < Request->Size) {
+      size_t Chunk = std::min<size_t>(Request->Size - Done, MaxTransfer);
+      ssize_t Ret = Request->Operation == IOOperation::Read
+        ? ::pread(Fd, (char*)Request->Buffer + Done, Chunk, Request->Offset + Done)
+        : ::pwrite(Fd, (const char*)Request->Buffer + Done, Chunk, Request->Offset + Done);
+      if (Ret < 0) {
+        if (errno == EINTR)
+          continue;
+        return Done ? (I64)Done : -(I64)errno;
+      }
+      if (Ret == 0)
+        break;
+      Done += Ret;
+    }
+    return (I64)Done;
+  #endif
+  }
+
+  void Init(U32 QueueDepth)
+  {
+#if __K3D_HAS_IO_URING
+    Ring = new __IoUring;
+    if (Ring->Init(QueueDepth ? QueueDepth : 1)) {
+      auto Impl = this;
+      Reaper = new Thread([Impl]() { Impl->Reap(); }, "AsyncIO",
+                          ThreadPriority::High);
+      return;
+    }
+    delete Ring;
+    Ring = nullptr;
+#endif
+    Pool = new ThreadPool(FallbackThreads, "AsyncIO", ThreadPriority::High);
+  }
+
+  void Submit(IORequest* Requests, U32 Count)
+  {
+    for (U32 i = 0; i < Count; i++) {
+      if (Requests[i].Counter)
+        Requests[i].Counter->Add();
+    }
+#if __K3D_HAS_IO_URING
+    if (Ring) {
+      Mutex::AutoLock Guard(&Lock);
+      for (U32 i = 0; i < Count; i++) {
+        // counts the bytes done until the request completes
+        Requests[i].Result = 0;
+        Backlog[(U32)Requests[i].Priority].push_back(&Requests[i]);
+      }
+      Backlogged += Count;
+      FillRing();
+      return;
+    }
+#endif
+    size_t MaxTransfer = MaxTransferSize;
+    for (U32 i = 0; i < Count; i++) {
+      IORequest* Request = &Requests[i];
+      Pool->Enqueue(
+        [Request, MaxTransfer]() {
+          __CompleteRequest(Request, TransferBlocking(Request, MaxTransfer));
+        },
+        Request->Priority);
+    }
+  }
+
+#if __K3D_HAS_IO_URING
+  // moves backlogged requests into free ring slots, highest priority first,
+  // a partly done request continues after its Result bytes
+  void FillRing()
+  {
+    U32 Prepared = 0;
+    for (U32 Queue = 0; Queue < (U32)TaskPriority::Count; Queue++) {
+      auto& Requests = Backlog[Queue];
+      while (!Requests.empty() && InFlight < Ring->Entries) {
+        IORequest* Request = Requests.front();
+        Requests.pop_front();
+        Backlogged--;
+        size_t Done = (size_t)Request->Result;
+        io_uring_sqe* Sqe = Ring->NextSqe(Prepared++);
+        Sqe->opcode = Request->Operation == IOOperation::Read
+                        ? IORING_OP_READ
+                        : IORING_OP_WRITE;
+        Sqe->fd = Request->Target->m_fd;
+        Sqe->off = Request->Offset + Done;
+        Sqe->addr = (U64)(uintptr_t)((char*)Request->Buffer + Done);
+        Sqe->len = (U32)std::min<size_t>(Request->Size - Done, MaxTransferSize);
+        Sqe->ioprio = __IOPRIO_PRIO_VALUE(__IOPRIO_CLASS_BE, Queue * 3 + 1);
+        Sqe->user_data = (U64)(uintptr_t)Request;
+        InFlight++;
+      }
+    }
+    Ring->Submit(Prepared);
+  }
+
+  // like TransferBlocking, a request is done once Size bytes moved, at end of
+  // file or on an error, short transfers are queued again for the rest
+  void Reap()
+  {
+    std::vector<IORequest*> Unfinished;
+    for (;;) {
+      Ring->WaitCompletion();
+      U32 Head = *Ring->CqHead;
+      U32 Tail = __atomic_load_n(Ring->CqTail, __ATOMIC_ACQUIRE);
+      U32 Reaped = 0;
+      bool Exit = false;
+      while (Head != Tail) {
+        io_uring_cqe* Cqe = &Ring->Cqes[Head & *Ring->CqMask];
+        IORequest* Request = (IORequest*)(uintptr_t)Cqe->user_data;
+        I32 Result = Cqe->res;
+        Head++;
+        __atomic_store_n(Ring->CqHead, Head, __ATOMIC_RELEASE);
+        if (!Request) {
+          Exit = true;
+          continue;
+        }
+        Reaped++;
+        I64 Done = Request->Result;
+        if (Result == -EINTR || Result == -EAGAIN) {
+          Unfinished.push_back(Request);
+        } else if (Result < 0) {
+          __CompleteRequest(Request, Done ? Done : (I64)Result);
+        } else if (Result > 0 && (size_t)(Done + Result) < Request->Size) {
+          Request->Result = Done + Result;
+          Unfinished.push_back(Request);
+        } else {
+          __CompleteRequest(Request, Done + Result);
+        }
+      }
+      if (Reaped) {
+        Mutex::AutoLock Guard(&Lock);
+        InFlight -= Reaped;
+        for (IORequest* Request : Unfinished) {
+          Backlog[(U32)Request->Priority].push_front(Request);
+        }
+        Backlogged += (U32)Unfinished.size();
+        Unfinished.clear();
+        FillRing();
+        if (Stopping && !InFlight && !Backlogged)
+          Drained.NotifyAll();
+      }
+      if (Exit)
+        return;
+    }
+  }
+#endif
+
+  Mutex Lock;
+  U32 FallbackThreads;
+  size_t MaxTransferSize;
+  ThreadPool* Pool;
+#if __K3D_HAS_IO_URING
+  __IoUring* Ring;
+  U32 InFlight;
+  U32 Backlogged;
+  bool Stopping;
+  ConditionVariable Drained;
+  std::deque<IORequest*> Backlog[(U32)TaskPriority::Count];
+  Thread* Reaper;
+#endif
+};
+
+AsyncIO::AsyncIO(U32 QueueDepth, U32 FallbackThreads, size_t MaxTransferSize)
+  : d(new AsyncIOPrivate(FallbackThreads, MaxTransferSize))
+{
+  d->Init(QueueDepth);
+}
+
+AsyncIO::~AsyncIO()
+{
+  delete d;
+  d = nullptr;
+}
+
+AsyncIO&
+AsyncIO::Get()
+{
+  static AsyncIO sAsyncIO;
+  return sAsyncIO;
+}
+
+bool
+AsyncIO::IsUsingIoUring() const
+{
+#if __K3D_HAS_IO_URING
+  return d->Ring != nullptr;
+#else
+  return false;
+#endif
+}
+
+void
+AsyncIO::Submit(IORequest* Requests, U32 Count)
+{
+  if (Requests && Count)
+    d->Submit(Requests, Count);
+}
+
+U32
+AsyncIO::GetDirectIOAlignment()
+{
+  return kDirectIOAlignment;
+}
+
+void*
+AsyncIO::AllocAligned(size_t Size)
+{
+  // rounded up so the tail of a direct read can land in the buffer
+  Size = (Size + kDirectIOAlignment - 1) & ~(size_t)(kDirectIOAlignment - 1);
+#if K3DPLATFORM_OS_WINDOWS
+  return _aligned_malloc(Size, kDirectIOAlignment);
+#else
+  void* Ptr = nullptr;
+  if (posix_memalign(&Ptr, kDirectIOAlignment, Size) != 0)
+    return nullptr;
+  return Ptr;
+#endif
+}
+
+void
+AsyncIO::FreeAligned(void* Ptr)
+{
+#if K3DPLATFORM_OS_WINDOWS
+  _aligned_free(Ptr);
+#else
+  free(Ptr);
+#endif
+}
+}
+}
@@ -0,0 +1,230 @@
+#include "CoreMinimal.h"
+
+#if K3DPLATFORM_OS_WINDOWS
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define __K3D_CLOCK_TSC 1
+#if K3DCOMPILER_MSVC
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#elif defined(__aarch64__) && !K3DCOMPILER_MSVC
+#define __K3D_CLOCK_CNTVCT 1
+#endif
+
+namespace k3d
+{
+namespace os
+{
+enum class __ClockSource : U8
+{
+  System,
+  Tsc,
+  Counter,
+};
+
+// calibration rounds must agree within 1/kTscTolerance
+static const U64 kTscTolerance = 1000;
+static const U32 kCalibrationMs = 5;
+
+/// nanoseconds of the clock the TSC is calibrated against, and of the fallback
+static U64
+__SystemNs()
+{
+#if K3DPLATFORM_OS_WINDOWS
+  static LARGE_INTEGER sFrequency = { 0 };
+  if (!sFrequency.QuadPart)
+    ::QueryPerformanceFrequency(&sFrequency);
+  LARGE_INTEGER Now;
+  ::QueryPerformanceCounter(&Now);
+  return (U64)((double)Now.QuadPart * 1000000000.0 / sFrequency.QuadPart);
+#else
+  struct timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+  return (U64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+/// ticks of the fallback clock, counted at GetFrequency
+static inline U64
+__SystemTicks()
+{
+#if K3DPLATFORM_OS_WINDOWS
+  LARGE_INTEGER Now;
+  ::QueryPerformanceCounter(&Now);
+  return (U64)Now.QuadPart;
+#else
+  return __SystemNs();
+#endif
+}
+
+#if __K3D_CLOCK_TSC
+static inline U64
+__ReadTsc()
+{
+  return __rdtsc();
+}
+
+static bool
+__HasInvariantTsc()
+{
+#if K3DCOMPILER_MSVC
+  int Regs[4];
+  __cpuid(Regs, 0x80000000);
+  if ((unsigned)Regs[0] < 0x80000007u)
+    return false;
+  __cpuid(Regs, 0x80000007);
+  return (Regs[3] & (1 << 8)) != 0;
+#else
+  unsigned Eax, Ebx, Ecx, Edx;
+  if (!__get_cpuid(0x80000007, &Eax, &Ebx, &Ecx, &Edx))
+    return false;
+  return (Edx & (1 << 8)) != 0;
+#endif
+}
+
+/// the kernel switches away from the TSC when it finds it unsynchronized or drifting
+static bool
+__KernelTrustsTsc()
+{
+#if K3DPLATFORM_OS_LINUX || K3DPLATFORM_OS_ANDROID
+  FILE* Source = fopen("/sys/devices/system/clocksource/clocksource0/current_clocksource", "r");
+  if (!Source)
+    return true;
+  char Name[32] = { 0 };
+  bool Tsc = fgets(Name, sizeof(Name), Source) && strncmp(Name, "tsc", 3) == 0;
+  fclose(Source);
+  return Tsc;
+#else
+  return true;
+#endif
+}
+
+static U64
+__MeasureTscFrequency(U32 Ms)
+{
+  U64 Ns0 = __SystemNs();
+  U64 Tsc0 = __ReadTsc();
+  U64 Ns1, Tsc1;
+  do {
+    Ns1 = __SystemNs();
+    Tsc1 = __ReadTsc();
+  } while (Ns1 - Ns0 < Ms * 1000000ull);
+  return (U64)((double)(Tsc1 - Tsc0) * 1000000000.0 / (double)(Ns1 - Ns0));
+}
+#endif
+
+#if __K3D_CLOCK_CNTVCT
+static inline U64
+__ReadCounter()
+{
+  U64 Value;
+  __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(Value));
+  return Value;
+}
+#endif
+
+struct __ClockState
+{
+  __ClockState()
+    : Source(__ClockSource::System)
+    , Frequency(1000000000ull)
+  {
+#if K3DPLATFORM_OS_WINDOWS
+    LARGE_INTEGER SystemFrequency;
+    if (::QueryPerformanceFrequency(&SystemFrequency))
+      Frequency = (U64)SystemFrequency.QuadPart;
+#endif
+#if __K3D_CLOCK_TSC
+    if (__HasInvariantTsc() && __KernelTrustsTsc()) {
+      // two rounds, a VM migrating or a frequency scaling TSC won't agree with itself
+      U64 First = __MeasureTscFrequency(kCalibrationMs);
+      U64 Second = __MeasureTscFrequency(kCalibrationMs);
+      U64 Delta = First > Second ? First - Second : Second - First;
+      if (First && Delta <= First / kTscTolerance) {
+        Source = __ClockSource::Tsc;
+        Frequency = (First + Second) / 2;
+      } else {
+        KLOG(Warn, Clock, "TSC unstable (%llu vs %llu Hz), using the system clock.",
+             (unsigned long long)First, (unsigned long long)Second);
+      }
+    }
+#elif __K3D_CLOCK_CNTVCT
+    U64 CounterFrequency;
+    __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(CounterFrequency));
+    if (CounterFrequency) {
+      Source = __ClockSource::Counter;
+      Frequency = CounterFrequency;
+    }
+#endif
+    // largest shift keeping Mult in 32 bits, see ToNanoseconds
+    for (Shift = 32;; Shift--) {
+      Mult = ((1000000000ull << Shift) + Frequency / 2) / Frequency;
+      if (Mult < (1ull << 32) || !Shift)
+        break;
+    }
+  }
+
+  __ClockSource Source;
+  U64 Frequency;
+  U64 Mult;
+  U32 Shift;
+};
+
+static __ClockState const&
+__Clock()
+{
+  static __ClockState sState;
+  return sState;
+}
+
+U64
+Clock::Now()
+{
+  switch (__Clock().Source) {
+#if __K3D_CLOCK_TSC
+    case __ClockSource::Tsc:
+      return __ReadTsc();
+#endif
+#if __K3D_CLOCK_CNTVCT
+    case __ClockSource::Counter:
+      return __ReadCounter();
+#endif
+    default:
+      return __SystemTicks();
+  }
+}
+
+U64
+Clock::ToNanoseconds(U64 Ticks)
+{
+  // 32x32 bit halves, so neither product overflows and no division is needed
+  __ClockState const& State = __Clock();
+  U64 High = ((Ticks >> 32) * State.Mult) << (32 - State.Shift);
+  U64 Low = ((Ticks & 0xffffffffull) * State.Mult) >> State.Shift;
+  return High + Low;
+}
+
+U64
+Clock::GetFrequency()
+{
+  return __Clock().Frequency;
+}
+
+bool
+Clock::IsUsingTsc()
+{
+  return __Clock().Source == __ClockSource::Tsc;
+}
+}
+}
@@ -0,0 +1,452 @@
+#include "CoreMinimal.h"
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if K3DPLATFORM_OS_LINUX || K3DPLATFORM_OS_ANDROID
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define __K3D_HAS_INOTIFY 1
+#endif
+
+namespace k3d
+{
+namespace os
+{
+// a batch is delivered at the latest this many debounce periods after its first event
+static const U32 kMaxDebouncePeriods = 10;
+
+struct __WatchRoot
+{
+  std::string Path;
+  bool Recursive;
+  U32 Refs;
+};
+
+struct __Subscriber
+{
+  U32 Id;
+  PFN_FileChanges Callback;
+  void* UserData;
+};
+
+// the watcher and subscriber whose callback runs on this thread, so a callback
+// unsubscribing itself doesn't wait for its own return
+static thread_local struct FileWatcherPrivate* tDeliveringWatcher = nullptr;
+static thread_local U32 tDeliveringId = 0;
+
+struct __PendingChange
+{
+  std::string Path;
+  U32 Changes;
+};
+
+struct FileWatcherPrivate
+{
+  FileWatcherPrivate(U32 InDebounceMs, ThreadPool* InJobs)
+    : DebounceMs(InDebounceMs)
+    , Jobs(InJobs)
+    , OwnsJobs(InJobs == nullptr)
+    , NextId(1)
+    , FirstEventMs(0)
+    , LastEventMs(0)
+    , Fd(-1)
+    , Poller(nullptr)
+    , Quit(false)
+  {
+    if (OwnsJobs)
+      Jobs = new ThreadPool(1, "FileWatcher", ThreadPriority::Low);
+    WakeFd[0] = WakeFd[1] = -1;
+#if __K3D_HAS_INOTIFY
+    Fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (Fd < 0 || pipe2(WakeFd, O_NONBLOCK | O_CLOEXEC) != 0) {
+      KLOG(Error, FileWatcher, "inotify unavailable (%s).", strerror(errno));
+      return;
+    }
+    FileWatcherPrivate* Impl = this;
+    Poller = new Thread([Impl]() { Impl->Poll(); }, "FileWatcher",
+                        ThreadPriority::Low);
+#endif
+  }
+
+  ~FileWatcherPrivate()
+  {
+#if __K3D_HAS_INOTIFY
+    if (Poller) {
+      Quit.store(true);
+      char Byte = 0;
+      ssize_t Written = write(WakeFd[1], &Byte, 1);
+      (void)Written;
+      Poller->Join();
+      delete Poller;
+    }
+    for (int Pipe : WakeFd)
+      if (Pipe >= 0)
+        close(Pipe);
+    if (Fd >= 0)
+      close(Fd);
+#endif
+    InFlight.Wait();
+    if (OwnsJobs)
+      delete Jobs;
+  }
+
+  /// whether Directory lies below a root that watches it
+  bool IsCovered(std::string const& Directory) const
+  {
+    for (auto const& Root : Roots) {
+      if (Directory == Root.Path)
+        return true;
+      if (Root.Recursive && Directory.size() > Root.Path.size() &&
+          Directory[Root.Path.size()] == '/' &&
+          Directory.compare(0, Root.Path.size(), Root.Path) == 0)
+        return true;
+    }
+    return false;
+  }
+
+  void Record(std::string const& Path, U32 Change)
+  {
+    U64 Now = GetTicks();
+    if (Pending.empty())
+      FirstEventMs = Now;
+    LastEventMs = Now;
+    auto It = PendingIndex.find(Path);
+    if (It == PendingIndex.end()) {
+      PendingIndex.emplace(Path, Pending.size());
+      Pending.push_back({ Path, Change });
+      return;
+    }
+    U32& Changes = Pending[It->second].Changes;
+    if (Change & FileRemoved) {
+      // a file created and deleted within the batch never existed for subscribers
+      Changes = (Changes & FileAdded) ? 0 : (U32)FileRemoved;
+    } else if (Change & FileAdded) {
+      // replaced, e.g. saved through a rename
+      Changes = (Changes & FileRemoved) ? (U32)FileModified : Changes | FileAdded;
+    } else {
+      Changes |= Change;
+    }
+  }
+
+  void Flush()
+  {
+    std::vector<FileEvent>* Batch = new std::vector<FileEvent>;
+    Batch->reserve(Pending.size());
+    for (auto const& Change : Pending)
+      if (Change.Changes)
+        Batch->push_back({ String(Change.Path.c_str()), Change.Changes });
+    Pending.clear();
+    PendingIndex.clear();
+    if (Batch->empty()) {
+      delete Batch;
+      return;
+    }
+    FileWatcherPrivate* Impl = this;
+    Jobs->Enqueue([Impl, Batch]() {
+      Impl->Deliver(*Batch);
+      delete Batch;
+    }, TaskPriority::Low, &InFlight);
+  }
+
+  void Deliver(std::vector<FileEvent> const& Batch)
+  {
+    std::vector<__Subscriber> Targets;
+    {
+      Mutex::AutoLock Guard(&SubscriberLock);
+      Targets = Subscribers;
+    }
+    for (auto const& Target : Targets) {
+      {
+        Mutex::AutoLock Guard(&SubscriberLock);
+        // unsubscribed since the copy, its UserData may be gone already
+        if (!IsSubscribed(Target.Id))
+          continue;
+        Delivering.push_back(Target.Id);
+      }
+      tDeliveringWatcher = this;
+      tDeliveringId = Target.Id;
+      Target.Callback(Batch.data(), (U32)Batch.size(), Target.UserData);
+      tDeliveringWatcher = nullptr;
+      tDeliveringId = 0;
+      {
+        Mutex::AutoLock Guard(&SubscriberLock);
+        Delivering.erase(std::find(Delivering.begin(), Delivering.end(), Target.Id));
+        Delivered.NotifyAll();
+      }
+    }
+  }
+
+  bool IsSubscribed(U32 Id) const
+  {
+    for (auto const& Subscriber : Subscribers)
+      if (Subscriber.Id == Id)
+        return true;
+    return false;
+  }
+
+#if __K3D_HAS_INOTIFY
+  static const U32 kWatchMask = IN_CREATE | IN_DELETE | IN_MODIFY |
+                                IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM |
+                                IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF |
+                                IN_ONLYDIR;
+
+  static bool IsDirectory(std::string const& Path, const dirent* Entry)
+  {
+    if (Entry->d_type != DT_UNKNOWN)
+      return Entry->d_type == DT_DIR;
+    struct stat Stat;
+    return lstat(Path.c_str(), &Stat) == 0 && S_ISDIR(Stat.st_mode);
+  }
+
+  /// watches Directory, and its subdirectories when a recursive root covers them,
+  /// RecordFiles reports the files found as added
+  bool AddTree(std::string const& Directory, bool RecordFiles)
+  {
+    int Wd = inotify_add_watch(Fd, Directory.c_str(), kWatchMask);
+    if (Wd < 0)
+      return false;
+    Watches[Wd] = Directory;
+    DIR* Dir = opendir(Directory.c_str());
+    if (!Dir)
+      return true;
+    while (dirent* Entry = readdir(Dir)) {
+      if (!strcmp(Entry->d_name, ".") || !strcmp(Entry->d_name, ".."))
+        continue;
+      std::string Path = Directory + "/" + Entry->d_name;
+      if (IsDirectory(Path, Entry)) {
+        if (IsCovered(Path))
+          AddTree(Path, RecordFiles);
+      } else if (RecordFiles) {
+        Record(Path, FileAdded);
+      }
+    }
+    closedir(Dir);
+    return true;
+  }
+
+  void RemoveTree(std::string const& Directory)
+  {
+    for (auto It = Watches.begin(); It != Watches.end();) {
+      std::string const& Path = It->second;
+      bool Below = Path == Directory ||
+                   (Path.size() > Directory.size() && Path[Directory.size()] == '/' &&
+                    Path.compare(0, Directory.size(), Directory) == 0);
+      if (Below && !IsCovered(Path)) {
+        inotify_rm_watch(Fd, It->first);
+        It = Watches.erase(It);
+      } else {
+        ++It;
+      }
+    }
+  }
+
+  void HandleEvent(const inotify_event* Event)
+  {
+    if (Event->mask & IN_Q_OVERFLOW) {
+      for (auto const& Root : Roots)
+        Record(Root.Path, FileRescan);
+      return;
+    }
+    auto It = Watches.find(Event->wd);
+    if (It == Watches.end())
+      return;
+    if (Event->mask & IN_IGNORED) {
+      Watches.erase(It);
+      return;
+    }
+    if (Event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+      // children are reported by their parent, only the roots need this
+      for (auto const& Root : Roots)
+        if (Root.Path == It->second)
+          Record(Root.Path, FileRemoved);
+      return;
+    }
+    if (!Event->len)
+      return;
+    std::string Path = It->second + "/" + Event->name;
+    if (Event->mask & IN_ISDIR) {
+      if (Event->mask & (IN_CREATE | IN_MOVED_TO)) {
+        // files may have landed before the watch, report them as added
+        if (IsCovered(Path))
+          AddTree(Path, true);
+      } else if (Event->mask & IN_MOVED_FROM) {
+        // moved away without per file events
+        RemoveTree(Path);
+        Record(Path, FileRemoved);
+      }
+      return;
+    }
+    if (Event->mask & (IN_CREATE | IN_MOVED_TO))
+      Record(Path, FileAdded);
+    else if (Event->mask & (IN_DELETE | IN_MOVED_FROM))
+      Record(Path, FileRemoved);
+    else
+      Record(Path, FileModified);
+  }
+
+  void Poll()
+  {
+    alignas(inotify_event) char Buffer[16 * 1024];
+    pollfd Fds[2] = { { Fd, POLLIN, 0 }, { WakeFd[0], POLLIN, 0 } };
+    while (!Quit.load()) {
+      int Timeout = -1;
+      {
+        Mutex::AutoLock Guard(&Lock);
+        if (!Pending.empty()) {
+          U64 Deadline = std::min(LastEventMs + DebounceMs,
+                                  FirstEventMs + DebounceMs * kMaxDebouncePeriods);
+          U64 Now = GetTicks();
+          if (Now >= Deadline) {
+            Flush();
+            continue;
+          }
+          Timeout = (int)(Deadline - Now);
+        }
+      }
+      if (poll(Fds, 2, Timeout) < 0 && errno != EINTR)
+        break;
+      if (!(Fds[0].revents & POLLIN))
+        continue;
+      Mutex::AutoLock Guard(&Lock);
+      for (;;) {
+        ssize_t Length = read(Fd, Buffer, sizeof(Buffer));
+        if (Length <= 0)
+          break;
+        for (char* It = Buffer; It < Buffer + Length;) {
+          const inotify_event* Event = (const inotify_event*)It;
+          HandleEvent(Event);
+          It += sizeof(inotify_event) + Event->len;
+        }
+      }
+    }
+  }
+#endif
+
+  U32 DebounceMs;
+  ThreadPool* Jobs;
+  bool OwnsJobs;
+  JobCounter InFlight;
+
+  Mutex SubscriberLock;
+  std::vector<__Subscriber> Subscribers;
+  /// ids whose callback is running, once per delivery
+  std::vector<U32> Delivering;
+  ConditionVariable Delivered;
+  U32 NextId;
+
+  /// guards the roots, watches and pending changes
+  Mutex Lock;
+  std::vector<__WatchRoot> Roots;
+  std::unordered_map<int, std::string> Watches;
+  std::vector<__PendingChange> Pending;
+  std::unordered_map<std::string, size_t> PendingIndex;
+  U64 FirstEventMs;
+  U64 LastEventMs;
+
+  int Fd;
+  int WakeFd[2];
+  Thread* Poller;
+  std::atomic<bool> Quit;
+};
+
+static std::string
+__RootPath(const char* Directory)
+{
+  std::string Path(Directory ? Directory : "");
+  while (Path.size() > 1 && (Path.back() == '/' || Path.back() == '\\'))
+    Path.pop_back();
+  return Path;
+}
+
+FileWatcher::FileWatcher(U32 DebounceMs, ThreadPool* Jobs)
+  : d(new FileWatcherPrivate(DebounceMs, Jobs))
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+  delete d;
+  d = nullptr;
+}
+
+bool
+FileWatcher::Watch(const char* Directory, bool Recursive)
+{
+#if __K3D_HAS_INOTIFY
+  if (!d->Poller)
+    return false;
+  std::string Path = __RootPath(Directory);
+  if (Path.empty())
+    return false;
+  Mutex::AutoLock Guard(&d->Lock);
+  for (auto& Root : d->Roots) {
+    if (Root.Path == Path && Root.Recursive == Recursive) {
+      Root.Refs++;
+      return true;
+    }
+  }
+  d->Roots.push_back({ Path, Recursive, 1 });
+  if (!d->AddTree(Path, false)) {
+    d->Roots.pop_back();
+    KLOG(Error, FileWatcher, "Failed to watch %s (%s).", Path.c_str(), strerror(errno));
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool
+FileWatcher::Unwatch(const char* Directory)
+{
+#if __K3D_HAS_INOTIFY
+  std::string Path = __RootPath(Directory);
+  Mutex::AutoLock Guard(&d->Lock);
+  for (auto It = d->Roots.begin(); It != d->Roots.end(); ++It) {
+    if (It->Path != Path)
+      continue;
+    if (--It->Refs == 0) {
+      d->Roots.erase(It);
+      d->RemoveTree(Path);
+    }
+    return true;
+  }
+#endif
+  return false;
+}
+
+U32
+FileWatcher::Subscribe(PFN_FileChanges Callback, void* UserData)
+{
+  if (!Callback)
+    return 0;
+  Mutex::AutoLock Guard(&d->SubscriberLock);
+  U32 Id = d->NextId++;
+  d->Subscribers.push_back({ Id, Callback, UserData });
+  return Id;
+}
+
+void
+FileWatcher::Unsubscribe(U32 Id)
+{
+  Mutex::AutoLock Guard(&d->SubscriberLock);
+  for (auto It = d->Subscribers.begin(); It != d->Subscribers.end(); ++It) {
+    if (It->Id == Id) {
+      d->Subscribers.erase(It);
+      break;
+    }
+  }
+  size_t Own = tDeliveringWatcher == d && tDeliveringId == Id ? 1 : 0;
+  while ((size_t)std::count(d->Delivering.begin(), d->Delivering.end(), Id) > Own)
+    d->Delivered.Wait(&d->SubscriberLock);
+}
+}
+}
@@ -8,10 +8,29 @@
 #include <algorithm>
 #include <regex>
 
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #if K3DPLATFORM_OS_WIN
 #include <process.h>
+#include <intrin.h>
+#define __K3D_RETURN_ADDRESS() _ReturnAddress()
 #else
 #include <sched.h>  
+#include <netdb.h>
+#include <cxxabi.h>
+#define __K3D_RETURN_ADDRESS() __builtin_return_address(0)
+#endif
+
+#if K3DPLATFORM_OS_LINUX || K3DPLATFORM_OS_ANDROID
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <climits>
+#define __K3D_USE_FUTEX 1
+#elif K3DCOMPILER_MSVC
+#pragma comment(lib, "Synchronization.lib")
 #endif
 
 namespace k3d
@@ -86,7 +105,7 @@ File::Open(const char* fileName, IOFlag flag)
                     shareMode,
                     &securityAttrs,
                     createDisp,
-                    FILE_ATTRIBUTE_NORMAL,
+                    (flag & IOFlag::Direct) ? FILE_FLAG_NO_BUFFERING : FILE_ATTRIBUTE_NORMAL,
                     NULL);
 #else
       CreateFile2(name_buf, // file to open
@@ -98,8 +117,14 @@ File::Open(const char* fileName, IOFlag flag)
   if (m_hFile == INVALID_HANDLE_VALUE)
     return false;
 #else
-  m_fd =
-    ::open(fileName, flag == IOFlag::Read ? O_RDONLY : (O_WRONLY | O_CREAT), S_IRWXU);
+  int openFlag = O_RDONLY;
+  if (flag & IOFlag::Write)
+    openFlag = ((flag & IOFlag::Read) ? O_RDWR : O_WRONLY) | O_CREAT;
+#ifdef O_DIRECT
+  if (flag & IOFlag::Direct)
+    openFlag |= O_DIRECT;
+#endif
+  m_fd = ::open(fileName, openFlag, S_IRWXU);
   if (m_fd < 0) {
     int err = errno;
     if (err == EACCES) {
@@ -162,9 +187,12 @@ File::Read(char* data, size_t len)
 
   return totalRead;
 #else
-  size_t _read = 0;
-  _read = ::read(m_fd, data, len);
-  return _read;
+  ssize_t _read = ::read(m_fd, data, len);
+  if (_read > 0)
+    m_CurOffset += _read;
+  else if (_read == 0)
+    m_EOF = true;
+  return (size_t)_read;
 #endif
 }
 
@@ -218,8 +246,10 @@ File::Close()
     m_hFile = NULL;
   }
 #else
-  if (m_fd)
+  if (m_fd >= 0) {
     ::close(m_fd);
+    m_fd = -1;
+  }
 #endif
 }
 
@@ -242,17 +272,42 @@ File::CreateIOInterface()
 }
 //--------------------------------------------------------------------------------------------
 
+// mapping offsets must be multiples of this
+static U64
+__MapGranularity()
+{
+  static U64 sGranularity = 0;
+  if (!sGranularity) {
+#if K3DPLATFORM_OS_WINDOWS
+    SYSTEM_INFO Info;
+    ::GetSystemInfo(&Info);
+    sGranularity = Info.dwAllocationGranularity;
+#else
+    sGranularity = (U64)sysconf(_SC_PAGESIZE);
+#endif
+  }
+  return sGranularity;
+}
+
 MemMapFile::MemMapFile()
   :
 #if K3DPLATFORM_OS_WINDOWS
-  m_FileHandle(NULL)
+  m_FileHandle(INVALID_HANDLE_VALUE)
   , m_FileMappingHandle(NULL)
   ,
 #else
   m_Fd(-1)
   ,
 #endif
-  m_szFile(0)
+  m_Writable(false)
+  , m_Populate(false)
+  , m_Access(MapAccess::Normal)
+  , m_szFile(0)
+  , m_szCapacity(0)
+  , m_Window(0)
+  , m_MapOffset(0)
+  , m_MapSize(0)
+  , m_Cur(0)
   , m_pData(NULL)
 {
 }
@@ -271,84 +326,283 @@ MemMapFile::GetSize()
 bool
 MemMapFile::Open(const char* fileName, IOFlag mode)
 {
-  assert(mode == IOFlag::Read);
+  Close();
+  m_Writable = (mode & IOFlag::Write) != 0;
 
 #if K3DPLATFORM_OS_WINDOWS
   wchar_t name_buf[1024];
   ::MultiByteToWideChar(CP_ACP, 0, fileName, (int)strlen(fileName) + 1, name_buf, 1024);
+  DWORD access = m_Writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+  DWORD disposition = m_Writable ? OPEN_ALWAYS : OPEN_EXISTING;
+  DWORD hint = m_Access == MapAccess::Random ? FILE_FLAG_RANDOM_ACCESS
+                                             : FILE_FLAG_SEQUENTIAL_SCAN;
   m_FileHandle =
 #if K3DPLATFORM_OS_WIN
     ::CreateFileW(name_buf,
-                  GENERIC_READ,
+                  access,
                   FILE_SHARE_READ,
                   NULL,
-                  OPEN_EXISTING,
-                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                  disposition,
+                  FILE_ATTRIBUTE_NORMAL | hint,
                   NULL);
 #else
       CreateFile2(name_buf, // file to open
-          GENERIC_READ,
+          access,
           FILE_SHARE_READ,
-          OPEN_EXISTING,
+          disposition,
           NULL);
 #endif
   if (m_FileHandle == INVALID_HANDLE_VALUE)
     return false;
 
-  auto ret = ::GetFileSizeEx(m_FileHandle, (PLARGE_INTEGER)&m_szFile);
-  if (ret != S_OK && m_szFile == INVALID_FILE_SIZE)
-    return false;
-
-  m_FileMappingHandle =
-    ::CreateFileMapping(m_FileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
-  if (m_FileMappingHandle == INVALID_HANDLE_VALUE)
-    return false;
-
-  m_pData =
-    (unsigned char*)MapViewOfFile(m_FileMappingHandle, FILE_MAP_READ, 0, 0, 0);
-  if (m_pData == NULL)
+  LARGE_INTEGER size;
+  if (!::GetFileSizeEx(m_FileHandle, &size)) {
+    Close();
     return false;
+  }
+  m_szFile = size.QuadPart;
 #else
-  m_Fd = open(fileName, O_RDONLY);
+  m_Fd = open(fileName, m_Writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
   if (m_Fd == -1)
     return false;
 
   struct stat st;
-  if (fstat(m_Fd, &st) != 0)
+  if (fstat(m_Fd, &st) != 0) {
+    Close();
     return false;
-
+  }
   m_szFile = st.st_size;
-  if (st.st_size == 0)
+  SetAccessPattern(m_Access);
+#endif
+  m_szCapacity = m_szFile;
+  m_Cur = 0;
+  // nothing to map yet, a writable file gets mapped on first Write
+  if (m_szFile == 0) {
+    if (!m_Writable)
+      Close();
+    return m_Writable;
+  }
+  if (!Map(0, m_Window ? m_Window : m_szFile)) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+bool
+MemMapFile::Map(U64 Offset, U64 Size)
+{
+  UnMap();
+  U64 base = 0;
+  U64 length = m_szCapacity;
+  if (m_Window) {
+    base = Offset - Offset % __MapGranularity();
+    length = std::min(std::max(Size + Offset - base, m_Window), m_szCapacity - base);
+  }
+  if (!length)
     return false;
 
-  m_pData =
-    (unsigned char*)mmap(NULL, m_szFile, PROT_READ, MAP_PRIVATE, m_Fd, 0);
-  if (m_pData == MAP_FAILED)
+#if K3DPLATFORM_OS_WINDOWS
+  if (!m_FileMappingHandle) {
+    m_FileMappingHandle =
+      ::CreateFileMapping(m_FileHandle, NULL, m_Writable ? PAGE_READWRITE : PAGE_READONLY,
+                          (DWORD)(m_szCapacity >> 32), (DWORD)m_szCapacity, NULL);
+    if (!m_FileMappingHandle)
+      return false;
+  }
+  m_pData = (U8*)::MapViewOfFile(m_FileMappingHandle,
+                                 m_Writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+                                 (DWORD)(base >> 32), (DWORD)base, (SIZE_T)length);
+  if (!m_pData)
     return false;
+#if _WIN32_WINNT >= 0x0602
+  if (m_Populate) {
+    WIN32_MEMORY_RANGE_ENTRY range = { m_pData, (SIZE_T)length };
+    ::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0);
+  }
+#endif
+#else
+  int flags = m_Writable ? MAP_SHARED : MAP_PRIVATE;
+#ifdef MAP_POPULATE
+  if (m_Populate)
+    flags |= MAP_POPULATE;
+#endif
+  void* ptr = mmap(NULL, length, m_Writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                   flags, m_Fd, (off_t)base);
+  if (ptr == MAP_FAILED)
+    return false;
+  m_pData = (U8*)ptr;
 #endif
-  m_pCur = m_pData;
+  m_MapOffset = base;
+  m_MapSize = length;
+  Advise(m_pData, m_MapSize);
   return true;
 }
 
+void
+MemMapFile::UnMap()
+{
+  if (!m_pData)
+    return;
+#if K3DPLATFORM_OS_WINDOWS
+  UnmapViewOfFile(m_pData);
+#else
+  munmap(m_pData, m_MapSize);
+#endif
+  m_pData = NULL;
+  m_MapOffset = 0;
+  m_MapSize = 0;
+}
+
+void
+MemMapFile::Advise(U8* Address, U64 Size)
+{
+#if K3DPLATFORM_OS_UNIX
+  int advice = MADV_NORMAL;
+  if (m_Access == MapAccess::Sequential)
+    advice = MADV_SEQUENTIAL;
+  else if (m_Access == MapAccess::Random)
+    advice = MADV_RANDOM;
+  madvise(Address, Size, advice);
+#endif
+}
+
+void
+MemMapFile::SetAccessPattern(MapAccess Access)
+{
+  m_Access = Access;
+#if K3DPLATFORM_OS_LINUX || K3DPLATFORM_OS_ANDROID
+  if (m_Fd >= 0) {
+    int advice = POSIX_FADV_NORMAL;
+    if (Access == MapAccess::Sequential)
+      advice = POSIX_FADV_SEQUENTIAL;
+    else if (Access == MapAccess::Random)
+      advice = POSIX_FADV_RANDOM;
+    posix_fadvise(m_Fd, 0, 0, advice);
+  }
+#endif
+  if (m_pData)
+    Advise(m_pData, m_MapSize);
+}
+
+void
+MemMapFile::Prefetch(U64 Offset, U64 Size)
+{
+  if (Offset >= m_szFile)
+    return;
+  Size = std::min(Size, m_szFile - Offset);
+  U64 end = Offset + Size;
+  U64 mapEnd = m_MapOffset + m_MapSize;
+  if (m_pData && Offset < mapEnd && end > m_MapOffset) {
+    U64 begin = std::max(Offset, m_MapOffset);
+    begin -= (begin - m_MapOffset) % __MapGranularity();
+    U64 length = std::min(end, mapEnd) - begin;
+#if K3DPLATFORM_OS_UNIX
+    madvise(m_pData + (begin - m_MapOffset), length, MADV_WILLNEED);
+#elif _WIN32_WINNT >= 0x0602
+    WIN32_MEMORY_RANGE_ENTRY range = { m_pData + (begin - m_MapOffset), (SIZE_T)length };
+    ::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0);
+#endif
+  }
+#if K3DPLATFORM_OS_LINUX || K3DPLATFORM_OS_ANDROID
+  // readahead into the page cache for the part outside the window
+  if (Offset < m_MapOffset || end > mapEnd)
+    posix_fadvise(m_Fd, (off_t)Offset, (off_t)Size, POSIX_FADV_WILLNEED);
+#endif
+}
+
+bool
+MemMapFile::SetCapacity(U64 Capacity)
+{
+  UnMap();
+#if K3DPLATFORM_OS_WINDOWS
+  if (m_FileMappingHandle) {
+    CloseHandle(m_FileMappingHandle);
+    m_FileMappingHandle = NULL;
+  }
+  LARGE_INTEGER length;
+  length.QuadPart = Capacity;
+  if (!::SetFilePointerEx(m_FileHandle, length, NULL, FILE_BEGIN) ||
+      !::SetEndOfFile(m_FileHandle))
+    return false;
+#else
+  if (ftruncate(m_Fd, (off_t)Capacity) != 0)
+    return false;
+#endif
+  m_szCapacity = Capacity;
+  return true;
+}
+
+bool
+MemMapFile::Resize(U64 Size)
+{
+  if (!m_Writable || !SetCapacity(Size))
+    return false;
+  m_szFile = Size;
+  m_Cur = std::min(m_Cur, Size);
+  return true;
+}
+
+U64
+MemMapFile::MapAt(U64 Offset)
+{
+  if (!m_pData || Offset < m_MapOffset || Offset >= m_MapOffset + m_MapSize) {
+    if (Offset >= m_szCapacity || !Map(Offset, 1))
+      return 0;
+  }
+  return m_MapOffset + m_MapSize - Offset;
+}
+
+U8*
+MemMapFile::MapRange(U64 Offset, size_t Size)
+{
+  if (Offset + Size > m_szFile)
+    return nullptr;
+  if (!m_pData || Offset < m_MapOffset || Offset + Size > m_MapOffset + m_MapSize) {
+    if (!Map(Offset, Size))
+      return nullptr;
+  }
+  return m_pData + (Offset - m_MapOffset);
+}
+
 size_t
 MemMapFile::Read(char* data_ptr, size_t len)
 {
-  size_t bytes_to_end = m_szFile - (m_pCur - m_pData);
-  if (len <= bytes_to_end) {
-    memcpy(data_ptr, m_pCur, len);
-    m_pCur += len;
-    return len;
+  size_t total = 0;
+  while (total < len && m_Cur < m_szFile) {
+    U64 mapped = MapAt(m_Cur);
+    if (!mapped)
+      break;
+    size_t chunk = (size_t)std::min<U64>(std::min<U64>(len - total, mapped), m_szFile - m_Cur);
+    memcpy(data_ptr + total, m_pData + (m_Cur - m_MapOffset), chunk);
+    m_Cur += chunk;
+    total += chunk;
   }
-  memcpy(data_ptr, m_pCur, bytes_to_end);
-  m_pCur += bytes_to_end;
-  return bytes_to_end;
+  return total;
 }
 
 size_t
-MemMapFile::Write(const void*, size_t)
+MemMapFile::Write(const void* data_ptr, size_t len)
 {
-  assert(0 && "MemMapFile::Write(): can't write into the memory");
-  return 0;
+  if (!m_Writable)
+    return 0;
+  U64 end = m_Cur + len;
+  // grow geometrically, Close trims the file back to what was written
+  if (end > m_szCapacity &&
+      !SetCapacity(std::max(end, m_szCapacity + m_szCapacity / 2)))
+    return 0;
+  size_t total = 0;
+  while (total < len) {
+    U64 mapped = MapAt(m_Cur);
+    if (!mapped)
+      break;
+    size_t chunk = (size_t)std::min<U64>(len - total, mapped);
+    memcpy(m_pData + (m_Cur - m_MapOffset), (const U8*)data_ptr + total, chunk);
+    m_Cur += chunk;
+    total += chunk;
+  }
+  m_szFile = std::max(m_szFile, m_Cur);
+  return total;
 }
 
 bool
@@ -356,47 +610,63 @@ MemMapFile::Seek(size_t offset)
 {
   if (offset > m_szFile)
     return false;
-  m_pCur = m_pData + offset;
+  m_Cur = offset;
   return true;
 }
 
 bool
 MemMapFile::Skip(size_t offset)
 {
-  if (m_pCur + offset > m_pData + m_szFile)
+  if (m_Cur + offset > m_szFile)
     return false;
-  m_pCur = m_pCur + offset;
+  m_Cur += offset;
   return true;
 }
 
 bool
 MemMapFile::IsEOF()
 {
-  return (m_pCur >= m_pData + m_szFile);
+  return m_Cur >= m_szFile;
 }
 
 void
 MemMapFile::Flush()
 {
+  if (!m_pData || !m_Writable)
+    return;
+#if K3DPLATFORM_OS_WINDOWS
+  FlushViewOfFile(m_pData, (SIZE_T)m_MapSize);
+  FlushFileBuffers(m_FileHandle);
+#else
+  msync(m_pData, m_MapSize, MS_SYNC);
+#endif
 }
 
 void
 MemMapFile::Close()
 {
+  UnMap();
+  if (m_Writable && m_szCapacity != m_szFile)
+    SetCapacity(m_szFile);
 #if K3DPLATFORM_OS_WINDOWS
-  if (m_pData) {
-    UnmapViewOfFile(m_pData);
-    m_pData = nullptr;
-  }
   if (m_FileMappingHandle) {
     CloseHandle(m_FileMappingHandle);
     m_FileMappingHandle = NULL;
   }
-#elif K3DPLATFORM_OS_UNIX
-  // TODO : need fix
-  munmap(m_pData, m_szFile);
-  close(m_Fd);
+  if (m_FileHandle != INVALID_HANDLE_VALUE) {
+    CloseHandle(m_FileHandle);
+    m_FileHandle = INVALID_HANDLE_VALUE;
+  }
+#else
+  if (m_Fd >= 0) {
+    close(m_Fd);
+    m_Fd = -1;
+  }
 #endif
+  m_Writable = false;
+  m_szFile = 0;
+  m_szCapacity = 0;
+  m_Cur = 0;
 }
 
 MemMapFile*
@@ -491,7 +761,8 @@ bool Exists(const char* name)
 #if K3DPLATFORM_OS_WIN
     return TRUE == PathFileExistsA(name);
 #elif K3DPLATFORM_OS_UNIX
-    return ::opendir(name) != nullptr;
+    struct stat st;
+    return ::stat(name, &st) == 0;
 #endif
 }
 
@@ -561,17 +832,21 @@ bool Remove(const char* lpszDir)
                 snprintf(buf, len, "%s/%s", lpszDir, p->d_name);
                 if (!stat(buf, &statbuf)) {
                     if (S_ISDIR(statbuf.st_mode)) {
-                        r2 = Remove(buf);
+                        r2 = Remove(buf) ? 0 : -1;
                     }
                     else {
                         r2 = unlink(buf);
                     }
                 }
+                free(buf);
             }
             r = r2;
         }
         closedir(d);
     }
+    else if (errno == ENOTDIR) {
+        return unlink(lpszDir) == 0;
+    }
     if (!r) {
         r = rmdir(lpszDir);
     }
@@ -602,7 +877,19 @@ bool Walk(const char* srcPath, PFN_FileProcessRoutine pFn)
     FindClose(hFind);
     return true;
 #else
-    return false;
+    if (pFn == nullptr)
+        return false;
+    DIR* dir = opendir(srcPath);
+    if (!dir) {
+        return false;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+            pFn(entry->d_name, entry->d_type == DT_DIR);
+        }
+    }
+    closedir(dir);
+    return true;
 #endif
 }
 
@@ -640,6 +927,29 @@ U64 GetTicks()
 #endif
 }
 
+String
+GetSymbolName(void* Address)
+{
+#if K3DPLATFORM_OS_UNIX
+  Dl_info Info;
+  if (dladdr(Address, &Info) && Info.dli_fname) {
+    if (Info.dli_sname) {
+      int Status = 0;
+      char* Demangled =
+        abi::__cxa_demangle(Info.dli_sname, nullptr, nullptr, &Status);
+      String Name = (Status == 0 && Demangled) ? Demangled : Info.dli_sname;
+      free(Demangled);
+      return Name;
+    }
+    const char* Module = strrchr(Info.dli_fname, '/');
+    return String::Format("%s+0x%zx",
+                          Module ? Module + 1 : Info.dli_fname,
+                          (size_t)((uintptr_t)Address - (uintptr_t)Info.dli_fbase));
+  }
+#endif
+  return String::Format("%p", Address);
+}
+
 void
 Sleep(U32 ms)
 {
@@ -667,6 +977,116 @@ GetCpuCoreNum()
 #endif
 }
 
+static inline U64
+__NowNs()
+{
+  return Clock::NowNs();
+}
+
+static std::atomic<bool> sLockProfiling(false);
+
+static void
+__AtomicMax(std::atomic<U64>& Max, U64 Value)
+{
+  U64 Current = Max.load(std::memory_order_relaxed);
+  while (Value > Current &&
+         !Max.compare_exchange_weak(Current, Value, std::memory_order_relaxed))
+    ;
+}
+
+struct LockSiteEntry
+{
+  std::atomic<void*> Site;
+  std::atomic<U64> Acquisitions;
+  std::atomic<U64> Contentions;
+  std::atomic<U64> WaitNs;
+  std::atomic<U64> HoldNs;
+
+  LockSiteEntry()
+    : Site(nullptr)
+  {
+    Reset();
+  }
+
+  void Reset()
+  {
+    Acquisitions = 0;
+    Contentions = 0;
+    WaitNs = 0;
+    HoldNs = 0;
+  }
+};
+
+/**
+ * Statistics shared by all mutexes of the same name (or constructed by the same
+ * code when unnamed). Updated lock-free, call sites live in a small open
+ * addressing table, the ones not fitting are merged into Overflow.
+ */
+struct LockStatsEntry
+{
+  static const U32 kMaxSites = 32;
+
+  std::string Name;
+  void* Origin;
+  std::atomic<U64> Acquisitions;
+  std::atomic<U64> Contentions;
+  std::atomic<U64> WaitNs;
+  std::atomic<U64> MaxWaitNs;
+  std::atomic<U64> HoldNs;
+  std::atomic<U64> MaxHoldNs;
+  std::atomic<U64> CondWaits;
+  std::atomic<U64> CondWaitNs;
+  LockSiteEntry Sites[kMaxSites];
+  LockSiteEntry Overflow;
+
+  LockStatsEntry(std::string const& InName, void* InOrigin)
+    : Name(InName)
+    , Origin(InOrigin)
+  {
+    Reset();
+  }
+
+  void Reset()
+  {
+    Acquisitions = 0;
+    Contentions = 0;
+    WaitNs = 0;
+    MaxWaitNs = 0;
+    HoldNs = 0;
+    MaxHoldNs = 0;
+    CondWaits = 0;
+    CondWaitNs = 0;
+    for (auto& Site : Sites)
+      Site.Reset();
+    Overflow.Reset();
+  }
+
+  LockSiteEntry* FindSite(void* Site)
+  {
+    U32 Hash = (U32)(((uintptr_t)Site >> 2) * 2654435761u) % kMaxSites;
+    for (U32 i = 0; i < kMaxSites; i++) {
+      LockSiteEntry& Entry = Sites[(Hash + i) % kMaxSites];
+      void* Current = Entry.Site.load(std::memory_order_acquire);
+      if (Current == nullptr &&
+          Entry.Site.compare_exchange_strong(Current, Site))
+        return &Entry;
+      if (Current == Site)
+        return &Entry;
+    }
+    return &Overflow;
+  }
+
+  void AddHold(LockSiteEntry* Site, U64 Ns)
+  {
+    HoldNs.fetch_add(Ns, std::memory_order_relaxed);
+    __AtomicMax(MaxHoldNs, Ns);
+    if (Site)
+      Site->HoldNs.fetch_add(Ns, std::memory_order_relaxed);
+  }
+};
+
+static LockStatsEntry* __ResolveLockStats(struct MutexPrivate* Mutex);
+
 struct MutexPrivate
 {
 #if K3DPLATFORM_OS_WINDOWS
@@ -674,7 +1094,21 @@ struct MutexPrivate
 #else
   pthread_mutex_t mMutex;
 #endif
-  MutexPrivate()
+  String Name;
+  void* Origin;
+  std::atomic<LockStatsEntry*> Stats;
+  // only touched by the owning thread while profiling, the entries are the
+  // ones resolved by ProfiledLock so SetName during a hold can't pull them away
+  U64 AcquiredAt;
+  LockStatsEntry* AcquiredStats;
+  LockSiteEntry* AcquiredSite;
+
+  MutexPrivate(void* InOrigin = nullptr)
+    : Origin(InOrigin)
+    , Stats(nullptr)
+    , AcquiredAt(0)
+    , AcquiredStats(nullptr)
+    , AcquiredSite(nullptr)
   {
 #if K3DPLATFORM_OS_WINDOWS
     InitializeCriticalSection(&CS);
@@ -698,6 +1132,14 @@ struct MutexPrivate
     EnterCriticalSection(&CS);
 #else
     pthread_mutex_lock(&mMutex);
+#endif
+  }
+  bool TryLock()
+  {
+#if K3DPLATFORM_OS_WINDOWS
+    return TryEnterCriticalSection(&CS) != FALSE;
+#else
+    return pthread_mutex_trylock(&mMutex) == 0;
 #endif
   }
   void UnLock()
@@ -708,11 +1150,89 @@ struct MutexPrivate
     pthread_mutex_unlock(&mMutex);
 #endif
   }
+
+  void ProfiledLock(void* Site)
+  {
+    LockStatsEntry* Entry = __ResolveLockStats(this);
+    LockSiteEntry* SiteEntry = Entry->FindSite(Site);
+    if (!TryLock()) {
+      U64 Begin = __NowNs();
+      Lock();
+      U64 WaitNs = __NowNs() - Begin;
+      Entry->Contentions.fetch_add(1, std::memory_order_relaxed);
+      Entry->WaitNs.fetch_add(WaitNs, std::memory_order_relaxed);
+      __AtomicMax(Entry->MaxWaitNs, WaitNs);
+      SiteEntry->Contentions.fetch_add(1, std::memory_order_relaxed);
+      SiteEntry->WaitNs.fetch_add(WaitNs, std::memory_order_relaxed);
+    }
+    Entry->Acquisitions.fetch_add(1, std::memory_order_relaxed);
+    SiteEntry->Acquisitions.fetch_add(1, std::memory_order_relaxed);
+    AcquiredStats = Entry;
+    AcquiredSite = SiteEntry;
+    AcquiredAt = __NowNs();
+  }
+
+  // ends the current hold period, returns its end time or 0 if not profiled
+  U64 EndHold()
+  {
+    if (!AcquiredAt)
+      return 0;
+    U64 Now = __NowNs();
+    AcquiredStats->AddHold(AcquiredSite, Now - AcquiredAt);
+    AcquiredAt = 0;
+    return Now;
+  }
+};
+
+struct LockStatsRegistry
+{
+  MutexPrivate Lock;
+  // entries are never freed, mutexes keep pointers to them
+  std::unordered_map<std::string, LockStatsEntry*> Entries;
 };
 
+static LockStatsRegistry&
+__GetLockStatsRegistry()
+{
+  // leaked on purpose, static mutexes may still lock during exit
+  static LockStatsRegistry* sRegistry = new LockStatsRegistry;
+  return *sRegistry;
+}
+
+static LockStatsEntry*
+__ResolveLockStats(MutexPrivate* Mutex)
+{
+  LockStatsEntry* Entry = Mutex->Stats.load(std::memory_order_acquire);
+  if (Entry)
+    return Entry;
+  std::string Key;
+  if (Mutex->Name.Empty()) {
+    char Buffer[32];
+    snprintf(Buffer, sizeof(Buffer), "@%p", Mutex->Origin);
+    Key = Buffer;
+  } else {
+    Key = Mutex->Name.CStr();
+  }
+  auto& Registry = __GetLockStatsRegistry();
+  Registry.Lock.Lock();
+  auto& Slot = Registry.Entries[Key];
+  if (!Slot)
+    Slot = new LockStatsEntry(Mutex->Name.Empty() ? "" : Key, Mutex->Origin);
+  Entry = Slot;
+  Registry.Lock.UnLock();
+  Mutex->Stats.store(Entry, std::memory_order_release);
+  return Entry;
+}
+
 Mutex::Mutex()
-  : m_Impl(new MutexPrivate)
+  : m_Impl(new MutexPrivate(__K3D_RETURN_ADDRESS()))
+{
+}
+
+Mutex::Mutex(const char* Name)
+  : m_Impl(new MutexPrivate(__K3D_RETURN_ADDRESS()))
 {
+  m_Impl->Name = Name;
 }
 
 Mutex::~Mutex()
@@ -724,15 +1244,27 @@ Mutex::~Mutex()
 void
 Mutex::Lock()
 {
-  m_Impl->Lock();
+  if (!sLockProfiling.load(std::memory_order_relaxed)) {
+    m_Impl->Lock();
+    return;
+  }
+  m_Impl->ProfiledLock(__K3D_RETURN_ADDRESS());
 }
 
 void
 Mutex::UnLock()
 {
+  m_Impl->EndHold();
   m_Impl->UnLock();
 }
 
+void
+Mutex::SetName(const char* Name)
+{
+  m_Impl->Name = Name;
+  m_Impl->Stats.store(nullptr, std::memory_order_release);
+}
+
 struct ConditionVariablePrivate
 {
 #if K3DPLATFORM_OS_WINDOWS
@@ -758,11 +1290,36 @@ struct ConditionVariablePrivate
 
   void Wait(MutexPrivate* mutex, U32 time)
   {
+    // waiting releases the mutex, keep it out of the hold time
+    U64 Begin = mutex->EndHold();
 #if K3DPLATFORM_OS_WINDOWS
     ::SleepConditionVariableCS(&CV, &(mutex->CS), time);
 #else
-    pthread_cond_wait(&mCond, &mutex->mMutex);
+    if (time == 0xffffffff)
+    {
+      pthread_cond_wait(&mCond, &mutex->mMutex);
+    }
+    else
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += time / 1000;
+      ts.tv_nsec += (time % 1000) * 1000000;
+      if (ts.tv_nsec >= 1000000000)
+      {
+        ts.tv_sec += 1;
+        ts.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&mCond, &mutex->mMutex, &ts);
+    }
 #endif
+    if (Begin) {
+      U64 End = __NowNs();
+      LockStatsEntry* Entry = mutex->AcquiredStats;
+      Entry->CondWaits.fetch_add(1, std::memory_order_relaxed);
+      Entry->CondWaitNs.fetch_add(End - Begin, std::memory_order_relaxed);
+      mutex->AcquiredAt = End;
+    }
   }
   void Notify()
   {
@@ -818,6 +1375,339 @@ ConditionVariable::NotifyAll()
   m_Impl->NotifyAll();
 }
 
+#if !__K3D_USE_FUTEX && !K3DPLATFORM_OS_WINDOWS
+/**
+ * Fallback for platforms without a futex-like primitive: waiters park on the
+ * condition variable of a bucket chosen by address, wakers broadcast the bucket.
+ */
+struct __ParkingLot
+{
+  enum
+  {
+    kBuckets = 64
+  };
+  struct Bucket
+  {
+    pthread_mutex_t Lock;
+    pthread_cond_t Cond;
+  } Buckets[kBuckets];
+
+  __ParkingLot()
+  {
+    for (auto& Entry : Buckets) {
+      pthread_mutex_init(&Entry.Lock, NULL);
+      pthread_cond_init(&Entry.Cond, NULL);
+    }
+  }
+
+  Bucket& Get(void* Address)
+  {
+    return Buckets[((uintptr_t)Address >> 4) % kBuckets];
+  }
+};
+
+static __ParkingLot&
+__GetParkingLot()
+{
+  static __ParkingLot sParkingLot;
+  return sParkingLot;
+}
+
+static void
+__WakeParked(void* Address)
+{
+  auto& Entry = __GetParkingLot().Get(Address);
+  pthread_mutex_lock(&Entry.Lock);
+  pthread_cond_broadcast(&Entry.Cond);
+  pthread_mutex_unlock(&Entry.Lock);
+}
+#endif
+
+bool
+WaitOnAddress(std::atomic<U32>* Address, U32 Expected, U32 TimeoutMs)
+{
+#if __K3D_USE_FUTEX
+  struct timespec Timeout;
+  struct timespec* TimeoutPtr = nullptr;
+  if (TimeoutMs != 0xffffffff) {
+    Timeout.tv_sec = TimeoutMs / 1000;
+    Timeout.tv_nsec = (TimeoutMs % 1000) * 1000000;
+    TimeoutPtr = &Timeout;
+  }
+  long Ret = syscall(SYS_futex, (U32*)Address, FUTEX_WAIT_PRIVATE, Expected,
+                     TimeoutPtr, nullptr, 0);
+  return !(Ret == -1 && errno == ETIMEDOUT);
+#elif K3DPLATFORM_OS_WINDOWS
+  U32 Compare = Expected;
+  if (::WaitOnAddress((volatile VOID*)Address, &Compare, sizeof(U32),
+                      TimeoutMs == 0xffffffff ? INFINITE : TimeoutMs))
+    return true;
+  return ::GetLastError() != ERROR_TIMEOUT;
+#else
+  auto& Entry = __GetParkingLot().Get(Address);
+  int Ret = 0;
+  pthread_mutex_lock(&Entry.Lock);
+  if (Address->load() == Expected) {
+    if (TimeoutMs == 0xffffffff) {
+      pthread_cond_wait(&Entry.Cond, &Entry.Lock);
+    } else {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += TimeoutMs / 1000;
+      ts.tv_nsec += (TimeoutMs % 1000) * 1000000;
+      if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec += 1;
+        ts.tv_nsec -= 1000000000;
+      }
+      Ret = pthread_cond_timedwait(&Entry.Cond, &Entry.Lock, &ts);
+    }
+  }
+  pthread_mutex_unlock(&Entry.Lock);
+  return Ret != ETIMEDOUT;
+#endif
+}
+
+void
+WakeOnAddress(std::atomic<U32>* Address, U32 Count)
+{
+#if __K3D_USE_FUTEX
+  syscall(SYS_futex, (U32*)Address, FUTEX_WAKE_PRIVATE,
+          Count > INT_MAX ? INT_MAX : (int)Count, nullptr, nullptr, 0);
+#elif K3DPLATFORM_OS_WINDOWS
+  if (Count == 1)
+    ::WakeByAddressSingle((PVOID)Address);
+  else
+    ::WakeByAddressAll((PVOID)Address);
+#else
+  __WakeParked(Address);
+#endif
+}
+
+void
+WakeAllOnAddress(std::atomic<U32>* Address)
+{
+#if __K3D_USE_FUTEX
+  syscall(SYS_futex, (U32*)Address, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr,
+          nullptr, 0);
+#elif K3DPLATFORM_OS_WINDOWS
+  ::WakeByAddressAll((PVOID)Address);
+#else
+  __WakeParked(Address);
+#endif
+}
+
+static void
+__YieldThread()
+{
+#if K3DPLATFORM_OS_WINDOWS
+  ::SwitchToThread();
+#else
+  sched_yield();
+#endif
+}
+
+// spinning only pays off when the owner can run at the same time
+static bool
+__ShouldSpin()
+{
+  static const bool sMultiCore = GetCpuCoreNum() > 1;
+  return sMultiCore;
+}
+
+void
+SpinMutex::LockSlow()
+{
+  const U32 kMaxBackoff = 64;
+  U32 Backoff = 1;
+  for (;;) {
+    // wait on a plain load so the cache line stays shared until released
+    while (m_Locked.load(std::memory_order_relaxed)) {
+      if (Backoff < kMaxBackoff && __ShouldSpin()) {
+        for (U32 i = 0; i < Backoff; i++)
+          CpuRelax();
+        Backoff <<= 1;
+      } else {
+        __YieldThread();
+      }
+    }
+    if (!m_Locked.exchange(true, std::memory_order_acquire))
+      return;
+  }
+}
+
+void
+AdaptiveMutex::LockSlow()
+{
+  if (__ShouldSpin()) {
+    U32 Estimate = m_SpinEstimate.load(std::memory_order_relaxed);
+    U32 MaxSpins = std::min<U32>(Estimate * 2, kMaxSpins);
+    U32 Spins = 0;
+    bool Acquired = false;
+    for (; Spins < MaxSpins; Spins++) {
+      U32 State = m_State.load(std::memory_order_relaxed);
+      if (State == 0 &&
+          m_State.compare_exchange_weak(State, 1, std::memory_order_acquire)) {
+        Acquired = true;
+        break;
+      }
+      CpuRelax();
+    }
+    // moving average of the spins needed, as glibc does
+    I32 Next = (I32)Estimate + ((I32)Spins - (I32)Estimate) / 8;
+    m_SpinEstimate.store(std::max<I32>(Next, kMinSpins),
+                         std::memory_order_relaxed);
+    if (Acquired)
+      return;
+  }
+  U32 State = m_State.exchange(2, std::memory_order_acquire);
+  while (State != 0) {
+    WaitOnAddress(&m_State, 2);
+    State = m_State.exchange(2, std::memory_order_acquire);
+  }
+}
+
+static const U32 kSharedMutexSpins = 64;
+
+void
+SharedMutex::Lock()
+{
+  U32 Spins = 0;
+  for (;;) {
+    U32 State = m_State.load(std::memory_order_relaxed);
+    if (!(State & (kWriter | kReaderMask))) {
+      // clears kWriterWaiting, other queued writers set it again
+      if (m_State.compare_exchange_weak(State, kWriter,
+                                        std::memory_order_acquire))
+        return;
+      continue;
+    }
+    if (!(State & kWriterWaiting)) {
+      m_State.compare_exchange_weak(State, State | kWriterWaiting);
+      continue;
+    }
+    if (Spins++ < kSharedMutexSpins && __ShouldSpin()) {
+      CpuRelax();
+      continue;
+    }
+    m_Sleepers.fetch_add(1);
+    WaitOnAddress(&m_State, State);
+    m_Sleepers.fetch_sub(1);
+  }
+}
+
+bool
+SharedMutex::TryLock()
+{
+  U32 State = m_State.load(std::memory_order_relaxed);
+  if (State & (kWriter | kReaderMask))
+    return false;
+  return m_State.compare_exchange_strong(State, kWriter,
+                                         std::memory_order_acquire);
+}
+
+void
+SharedMutex::UnLock()
+{
+  m_State.fetch_and(~(U32)kWriter);
+  WakeSleepers();
+}
+
+void
+SharedMutex::LockSharedSlow()
+{
+  U32 Spins = 0;
+  for (;;) {
+    U32 State = m_State.load(std::memory_order_relaxed);
+    if (!(State & (kWriter | kWriterWaiting))) {
+      if (m_State.compare_exchange_weak(State, State + 1,
+                                        std::memory_order_acquire))
+        return;
+      continue;
+    }
+    if (Spins++ < kSharedMutexSpins && __ShouldSpin()) {
+      CpuRelax();
+      continue;
+    }
+    m_Sleepers.fetch_add(1);
+    WaitOnAddress(&m_State, State);
+    m_Sleepers.fetch_sub(1);
+  }
+}
+
+bool
+SharedMutex::TryLockShared()
+{
+  U32 State = m_State.load(std::memory_order_relaxed);
+  while (!(State & (kWriter | kWriterWaiting))) {
+    if (m_State.compare_exchange_weak(State, State + 1,
+                                      std::memory_order_acquire))
+      return true;
+  }
+  return false;
+}
+
+void
+SharedMutex::WakeSleepers()
+{
+  // pairs with the increment before WaitOnAddress: either the sleeper is
+  // counted here or its futex compare sees the new state
+  if (m_Sleepers.load())
+    WakeAllOnAddress(&m_State);
+}
+
+void
+Semaphore::Signal(U32 Count)
+{
+  m_Count.fetch_add(Count);
+  if (m_Sleepers.load())
+    WakeOnAddress(&m_Count, Count);
+}
+
+bool
+Semaphore::TryWait()
+{
+  U32 Count = m_Count.load(std::memory_order_relaxed);
+  while (Count > 0) {
+    if (m_Count.compare_exchange_weak(Count, Count - 1,
+                                      std::memory_order_acquire))
+      return true;
+  }
+  return false;
+}
+
+void
+Semaphore::Wait()
+{
+  Wait(0xffffffff);
+}
+
+bool
+Semaphore::Wait(U32 TimeoutMs)
+{
+  if (__ShouldSpin()) {
+    for (U32 i = 0; i < kSharedMutexSpins; i++) {
+      if (TryWait())
+        return true;
+      CpuRelax();
+    }
+  }
+  U64 Deadline = TimeoutMs == 0xffffffff ? 0 : GetTicks() + TimeoutMs;
+  for (;;) {
+    if (TryWait())
+      return true;
+    U32 Remaining = 0xffffffff;
+    if (Deadline) {
+      U64 Now = GetTicks();
+      if (Now >= Deadline)
+        return false;
+      Remaining = (U32)(Deadline - Now);
+    }
+    m_Sleepers.fetch_add(1);
+    WaitOnAddress(&m_Count, 0, Remaining);
+    m_Sleepers.fetch_sub(1);
+  }
+}
+
 #define DEFAULT_THREAD_STACK_SIZE 2048
 
 __INTERNAL_THREAD_ROUTINE_RETURN Thread::RunOnThread(void* Thr)
@@ -1023,6 +1913,11 @@ Thread::GetCurrentThreadName()
   char name[32];
   prctl(PR_GET_NAME, (unsigned long)name);
   return name;
+#elif K3DPLATFORM_OS_LINUX
+  char name[16] = { 0 };
+  if (pthread_getname_np(pthread_self(), name, sizeof(name)) != 0)
+    return "Anonymous Thread";
+  return name;
 #else
   pthread_t tid = pthread_self();
   return "Anonymous Thread";
@@ -1034,9 +1929,166 @@ Thread::SetCurrentThreadName(k3d::String const& name)
 {
 #if K3DPLATFORM_OS_APPLE
     pthread_setname_np(name.CStr());
+#elif K3DPLATFORM_OS_LINUX
+    // kernel limits comm to 15 chars, it shows up in /proc/self/task/<tid>/comm
+    char shortName[16] = { 0 };
+    strncpy(shortName, name.CStr() ? name.CStr() : "", sizeof(shortName) - 1);
+    pthread_setname_np(pthread_self(), shortName);
 #endif
 }
 
+void
+JobCounter::Done()
+{
+  if (m_Count.fetch_sub(1) == 1)
+    WakeAllOnAddress(&m_Count);
+}
+
+void
+JobCounter::Wait()
+{
+  for (;;) {
+    U32 Count = m_Count.load();
+    if (!Count)
+      return;
+    WaitOnAddress(&m_Count, Count);
+  }
+}
+
+bool
+JobCounter::Wait(U32 TimeoutMs)
+{
+  U64 Deadline = GetTicks() + TimeoutMs;
+  for (;;) {
+    U32 Count = m_Count.load();
+    if (!Count)
+      return true;
+    U64 Now = GetTicks();
+    if (Now >= Deadline)
+      return false;
+    WaitOnAddress(&m_Count, Count, (U32)(Deadline - Now));
+  }
+}
+
+struct ThreadPoolPrivate
+{
+  ThreadPoolPrivate()
+    : Lock("ThreadPool")
+    , Pending(0)
+    , Stopping(false)
+  {
+    for (U32 i = 0; i < (U32)TaskPriority::Count; i++) {
+      Heads[i] = nullptr;
+      Tails[i] = nullptr;
+    }
+  }
+
+  void Push(__internal::TaskClosure* Task, TaskPriority Priority)
+  {
+    U32 Queue = (U32)Priority;
+    Task->Next = nullptr;
+    if (Tails[Queue])
+      Tails[Queue]->Next = Task;
+    else
+      Heads[Queue] = Task;
+    Tails[Queue] = Task;
+    Pending++;
+  }
+
+  __internal::TaskClosure* Pop()
+  {
+    for (U32 i = 0; i < (U32)TaskPriority::Count; i++) {
+      __internal::TaskClosure* Task = Heads[i];
+      if (Task) {
+        Heads[i] = Task->Next;
+        if (!Heads[i])
+          Tails[i] = nullptr;
+        Pending--;
+        return Task;
+      }
+    }
+    return nullptr;
+  }
+
+  void Run()
+  {
+    Lock.Lock();
+    for (;;) {
+      while (!Pending && !Stopping)
+        HasWork.Wait(&Lock);
+      __internal::TaskClosure* Task = Pop();
+      if (!Task)
+        break;
+      Lock.UnLock();
+      Task->Run();
+      if (Task->Counter)
+        Task->Counter->Done();
+      delete Task;
+      Lock.Lock();
+    }
+    Lock.UnLock();
+  }
+
+  Mutex Lock;
+  ConditionVariable HasWork;
+  __internal::TaskClosure* Heads[(U32)TaskPriority::Count];
+  __internal::TaskClosure* Tails[(U32)TaskPriority::Count];
+  U32 Pending;
+  bool Stopping;
+  std::vector<Thread*> Workers;
+};
+
+ThreadPool::ThreadPool(U32 NumThreads, k3d::String const& Name,
+                       ThreadPriority Priority)
+  : d(new ThreadPoolPrivate)
+{
+  if (!NumThreads)
+    NumThreads = GetCpuCoreNum();
+  for (U32 i = 0; i < NumThreads; i++) {
+    auto Impl = d;
+    d->Workers.push_back(new Thread([Impl]() { Impl->Run(); },
+                                    String::Format("%s%u", Name.CStr(), i),
+                                    Priority));
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  d->Lock.Lock();
+  d->Stopping = true;
+  d->HasWork.NotifyAll();
+  d->Lock.UnLock();
+  for (auto Worker : d->Workers) {
+    Worker->Join();
+    delete Worker;
+  }
+  delete d;
+  d = nullptr;
+}
+
+void
+ThreadPool::Submit(__internal::TaskClosure* Task, TaskPriority Priority)
+{
+  if (Task->Counter)
+    Task->Counter->Add();
+  Mutex::AutoLock Lock(&d->Lock);
+  d->Push(Task, Priority);
+  d->HasWork.Notify();
+}
+
+U32
+ThreadPool::GetThreadCount() const
+{
+  return (U32)d->Workers.size();
+}
+
+U32
+ThreadPool::GetPendingCount() const
+{
+  Mutex::AutoLock Lock(&d->Lock);
+  return d->Pending;
+}
+
 #if K3DPLATFORM_OS_WINDOWS
 typedef SOCKET  SocketHandle;
 #else
@@ -1146,9 +2198,37 @@ I32 IpAddress::GetPort() const
     return -1;
 }
 
+U32 IpAddress::ToSockAddr(void* SockAddr, U32 Capacity) const
+{
+    U32 Size = d->Type == V6 ? sizeof(d->BSDAddr6) : sizeof(d->BSDAddr);
+    if (Size > Capacity)
+        return 0;
+    ::memcpy(SockAddr, d->Type == V6 ? (void*)&d->BSDAddr6 : (void*)&d->BSDAddr, Size);
+    return Size;
+}
+
 IpAddress* IpAddress::GetHostIp(String const& HostName)
 {
-    return nullptr;
+    addrinfo Hints;
+    ::memset(&Hints, 0, sizeof(Hints));
+    Hints.ai_family = AF_UNSPEC;
+    Hints.ai_socktype = SOCK_STREAM;
+    addrinfo* Found = nullptr;
+    if (::getaddrinfo(*HostName, nullptr, &Hints, &Found) != 0 || !Found)
+        return nullptr;
+    // the first answer, v4 or v6 as the resolver ordered them
+    IpAddress* Address = new IpAddress(String("0.0.0.0"));
+    if (Found->ai_family == AF_INET6)
+    {
+        ::memcpy(&Address->d->BSDAddr6, Found->ai_addr, sizeof(sockaddr_in6));
+        Address->d->Type = V6;
+    }
+    else
+    {
+        ::memcpy(&Address->d->BSDAddr, Found->ai_addr, sizeof(sockaddr_in));
+    }
+    ::freeaddrinfo(Found);
+    return Address;
 }
 
 class SocketImpl
@@ -1390,4 +2470,120 @@ void* LibraryLoader::ResolveSymbol(const char* entryName)
     return d->Resolve(entryName);
 }
 }
+
+namespace profiler {
+void
+EnableLockProfiling(bool Enable)
+{
+  os::sLockProfiling.store(Enable);
+}
+
+bool
+IsLockProfilingEnabled()
+{
+  return os::sLockProfiling.load();
+}
+
+void
+GetLockStats(DynArray<LockStats>& OutStats)
+{
+  std::vector<LockStats> Stats;
+  auto& Registry = os::__GetLockStatsRegistry();
+  Registry.Lock.Lock();
+  for (auto& Item : Registry.Entries) {
+    os::LockStatsEntry* Entry = Item.second;
+    if (!Entry->Acquisitions && !Entry->CondWaits)
+      continue;
+    LockStats Lock;
+    Lock.Name = Entry->Name.empty()
+                  ? "Mutex in " + os::GetSymbolName(Entry->Origin)
+                  : String(Entry->Name.c_str());
+    Lock.Acquisitions = Entry->Acquisitions;
+    Lock.Contentions = Entry->Contentions;
+    Lock.WaitNs = Entry->WaitNs;
+    Lock.MaxWaitNs = Entry->MaxWaitNs;
+    Lock.HoldNs = Entry->HoldNs;
+    Lock.MaxHoldNs = Entry->MaxHoldNs;
+    Lock.CondWaits = Entry->CondWaits;
+    Lock.CondWaitNs = Entry->CondWaitNs;
+    std::vector<LockCallSite> Sites;
+    auto AddSite = [&Sites](os::LockSiteEntry const& Site, void* Address) {
+      if (!Site.Acquisitions)
+        return;
+      LockCallSite CallSite;
+      CallSite.Address = Address;
+      CallSite.Symbol =
+        Address ? os::GetSymbolName(Address) : String("<other call sites>");
+      CallSite.Acquisitions = Site.Acquisitions;
+      CallSite.Contentions = Site.Contentions;
+      CallSite.WaitNs = Site.WaitNs;
+      CallSite.HoldNs = Site.HoldNs;
+      Sites.push_back(CallSite);
+    };
+    for (auto& Site : Entry->Sites)
+      AddSite(Site, Site.Site.load());
+    AddSite(Entry->Overflow, nullptr);
+    std::sort(Sites.begin(), Sites.end(),
+              [](LockCallSite const& A, LockCallSite const& B) {
+                return A.WaitNs != B.WaitNs ? A.WaitNs > B.WaitNs
+                                            : A.HoldNs > B.HoldNs;
+              });
+    for (auto& Site : Sites)
+      Lock.CallSites.Append(Site);
+    Stats.push_back(Lock);
+  }
+  Registry.Lock.UnLock();
+  std::sort(Stats.begin(), Stats.end(),
+            [](LockStats const& A, LockStats const& B) {
+              return A.WaitNs != B.WaitNs ? A.WaitNs > B.WaitNs
+                                          : A.HoldNs > B.HoldNs;
+            });
+  for (auto& Lock : Stats)
+    OutStats.Append(Lock);
+}
+
+String
+FormatLockReport(U32 TopN)
+{
+  DynArray<LockStats> Stats;
+  GetLockStats(Stats);
+  String Report;
+  Report.AppendSprintf("%-40s %10s %10s %12s %12s %12s %12s\n", "Lock",
+                       "Acquire", "Contended", "Wait(us)", "MaxWait(us)",
+                       "Hold(us)", "MaxHold(us)");
+  for (U64 i = 0; i < Stats.Count() && i < TopN; i++) {
+    LockStats const& Lock = Stats[i];
+    Report.AppendSprintf("%-40s %10llu %10llu %12.1f %12.1f %12.1f %12.1f\n",
+                         Lock.Name.CStr(),
+                         (unsigned long long)Lock.Acquisitions,
+                         (unsigned long long)Lock.Contentions,
+                         Lock.WaitNs / 1000.0, Lock.MaxWaitNs / 1000.0,
+                         Lock.HoldNs / 1000.0, Lock.MaxHoldNs / 1000.0);
+    if (Lock.CondWaits)
+      Report.AppendSprintf("    condition waits %llu, %.1f us\n",
+                           (unsigned long long)Lock.CondWaits,
+                           Lock.CondWaitNs / 1000.0);
+    for (U64 j = 0; j < Lock.CallSites.Count() && j < 4; j++) {
+      LockCallSite const& Site = Lock.CallSites[j];
+      Report.AppendSprintf("    %-36s %10llu %10llu %12.1f %12s %12.1f\n",
+                           Site.Symbol.CStr(),
+                           (unsigned long long)Site.Acquisitions,
+                           (unsigned long long)Site.Contentions,
+                           Site.WaitNs / 1000.0, "",
+                           Site.HoldNs / 1000.0);
+    }
+  }
+  return Report;
+}
+
+void
+ResetLockStats()
+{
+  auto& Registry = os::__GetLockStatsRegistry();
+  Registry.Lock.Lock();
+  for (auto& Item : Registry.Entries)
+    Item.second->Reset();
+  Registry.Lock.UnLock();
+}
+}
 }
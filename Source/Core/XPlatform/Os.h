@@ -5,6 +5,11 @@
 #include <netinet/in.h>
 #endif
 
+#include <atomic>
+#if K3DCOMPILER_MSVC
+#include <intrin.h>
+#endif
+
 
 /**
  * This module provides facilities on OS like:
@@ -43,6 +48,8 @@ namespace k3d
             static File* CreateIOInterface();
 
         private:
+            friend struct AsyncIOPrivate;
+            friend class Connection;
 #if K3DPLATFORM_OS_WINDOWS
             void* m_hFile;
 #else
@@ -53,6 +60,20 @@ namespace k3d
             const char* m_pFileName;
         };
 
+        /// access hint applied to every mapping of a MemMapFile
+        enum class MapAccess : U8
+        {
+            Normal,
+            Sequential,
+            Random,
+        };
+
+        /**
+         * Memory mapped file. IOFlag::Read maps it read-only and private, IOFlag::Write
+         * maps it shared and writable, growing the file on Write and trimming it on Close.
+         * By default the whole file is mapped, SetWindowSize limits the resident view to
+         * a window that slides with Read/Write/MapRange.
+         */
         class K3D_CORE_API MemMapFile : public k3d::IIODevice
         {
         public:
@@ -71,11 +92,27 @@ namespace k3d
             void Close();
             //---------------------------------------------------------
 
+            /// \param Bytes 0 maps the whole file, set before Open
+            void SetWindowSize(U64 Bytes) { m_Window = Bytes; }
+            /// pre-fault every mapping (MAP_POPULATE), for small hot files
+            void SetPopulate(bool Populate) { m_Populate = Populate; }
+            void SetAccessPattern(MapAccess Access);
+
+            /// asks the kernel to start reading a range ahead of use, it needn't be mapped yet
+            void Prefetch(U64 Offset, U64 Size);
+            /// grows or shrinks a writable file
+            bool Resize(U64 Size);
+            /// makes [Offset, Offset + Size) resident in the window,
+            /// the pointer stays valid until the window moves
+            U8* MapRange(U64 Offset, size_t Size);
+
             //---------------------------------------------------------
             /// FileData
             /// \brief FileData
-            /// \return data const pointer
+            /// \return start of the mapped window, the whole file unless a window size is set
             U8* FileData() { return m_pData; }
+            U64 GetWindowOffset() const { return m_MapOffset; }
+            U64 GetMappedSize() const { return m_MapSize; }
 
             template<class T>
             /// Convert FileBlocks To Class
@@ -97,15 +134,30 @@ namespace k3d
             static MemMapFile* CreateIOInterface();
 
         private:
+            bool Map(U64 Offset, U64 Size);
+            void UnMap();
+            bool SetCapacity(U64 Capacity);
+            void Advise(U8* Address, U64 Size);
+            /// ensures the window covers Offset, returns the bytes mapped from there
+            U64 MapAt(U64 Offset);
+
 #if K3DPLATFORM_OS_WINDOWS
             void* m_FileHandle;
             void* m_FileMappingHandle;
 #else
             int m_Fd;
 #endif
-            size_t m_szFile;
+            bool m_Writable;
+            bool m_Populate;
+            MapAccess m_Access;
+            U64 m_szFile;
+            /// on-disk length of a writable file, reserved ahead of m_szFile
+            U64 m_szCapacity;
+            U64 m_Window;
+            U64 m_MapOffset;
+            U64 m_MapSize;
+            U64 m_Cur;
             U8* m_pData;
-            U8* m_pCur;
         };
 
         class K3D_CORE_API LibraryLoader
@@ -127,6 +179,7 @@ namespace k3d
         extern K3D_CORE_API bool Copy(const char* src, const char* target);
         extern K3D_CORE_API bool Remove(const char* name);
         typedef void(*PFN_FileProcessRoutine)(const char* path, bool isDir);
+        /// lists the entries of srcPath by name, see WalkTree for whole trees
         extern K3D_CORE_API bool Walk(const char* srcPath, PFN_FileProcessRoutine);
 
 
@@ -148,6 +201,68 @@ namespace k3d
 
         extern K3D_CORE_API U64 GetTicks();
 
+        /**
+         * Cheap monotonic timestamps for profiling and frame pacing. Now reads the
+         * invariant TSC on x86 when the kernel trusts it, calibrated against
+         * CLOCK_MONOTONIC_RAW, or the architected counter on ARM64; otherwise it falls
+         * back to clock_gettime or QueryPerformanceCounter. Ticks are converted with a
+         * multiply and shift. The first use calibrates, which takes about 10ms.
+         */
+        class K3D_CORE_API Clock
+        {
+        public:
+            static U64  Now();
+            static U64  ToNanoseconds(U64 Ticks);
+            static U64  NowNs() { return ToNanoseconds(Now()); }
+            /// ticks per second
+            static U64  GetFrequency();
+            static bool IsUsingTsc();
+        };
+        /// demangled name of the function containing Address, "module+0xoffset" if not exported
+        extern K3D_CORE_API String GetSymbolName(void* Address);
+
+#if K3DPLATFORM_OS_LINUX
+        struct CpuThreadTime
+        {
+            U32     ThreadId = 0;
+            String  Name;
+            U64     UserTimeUs = 0;     // accumulated since thread start
+            U64     SystemTimeUs = 0;
+            float   Usage = 0.0f;       // percent of one core during the last interval
+        };
+
+        /**
+         * Samples /proc/stat and /proc/self/task/<tid>/stat every IntervalMs,
+         * per-core usage is published as profiler counter "Cpu/Core<N>" and
+         * per-thread usage as "Cpu/Thread/<Name>", name is the one given by
+         * Thread::SetCurrentThreadName. Threads sharing a name are summed.
+         */
+        class K3D_CORE_API CpuSampler
+        {
+        public:
+            explicit CpuSampler(U32 IntervalMs = 1000);
+            ~CpuSampler();
+
+            void            SetInterval(U32 IntervalMs);
+            void            Start();
+            void            Stop();
+            bool            IsRunning() const;
+            /// take one sample on the calling thread
+            void            Sample();
+
+            U32             GetCoreCount() const;
+            /// copies the percent usage per core, GetCoreCount() entries, into OutUsage
+            void            GetCoreUsage(DynArray<float>& OutUsage) const;
+            void            GetThreadTimes(DynArray<CpuThreadTime>& OutTimes) const;
+
+            CpuSampler(const CpuSampler&) = delete;
+            CpuSampler& operator=(const CpuSampler&) = delete;
+
+        private:
+            struct CpuSamplerPrivate* d;
+        };
+#endif
+
         enum class ThreadPriority
         {
             Low,
@@ -168,10 +283,13 @@ namespace k3d
         {
         public:
             Mutex();
+            /// Name groups contention statistics, see profiler::EnableLockProfiling
+            explicit Mutex(const char* Name);
             ~Mutex();
 
             void Lock();
             void UnLock();
+            void SetName(const char* Name);
             friend class ConditionVariable;
 
             struct AutoLock
@@ -186,6 +304,7 @@ namespace k3d
                     : m_OnwerShipGot(lostOwnerShip)
                     , m_Mutex(mutex)
                 {
+                    m_Mutex->Lock();
                 }
 
                 ~AutoLock()
@@ -225,6 +344,209 @@ namespace k3d
             ConditionVariablePrivate* m_Impl;
         };
 
+        /// hint for spin-wait loops, lowers power and lets the sibling hyper-thread run
+        KFORCE_INLINE void CpuRelax()
+        {
+#if K3DCOMPILER_MSVC && (defined(_M_X64) || defined(_M_IX86))
+            _mm_pause();
+#elif K3DCOMPILER_MSVC
+            __yield();
+#elif defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+            __asm__ __volatile__("yield" ::: "memory");
+#endif
+        }
+
+        /**
+         * Blocks while *Address == Expected, for at most TimeoutMs (0xffffffff = forever).
+         * Futex on Linux/Android, WaitOnAddress on Windows, a hashed parking table elsewhere.
+         * May return spuriously, returns false on timeout.
+         */
+        extern K3D_CORE_API bool WaitOnAddress(std::atomic<U32>* Address, U32 Expected, U32 TimeoutMs = 0xffffffff);
+        extern K3D_CORE_API void WakeOnAddress(std::atomic<U32>* Address, U32 Count);
+        extern K3D_CORE_API void WakeAllOnAddress(std::atomic<U32>* Address);
+
+        template <class TLock>
+        class ScopedLock
+        {
+        public:
+            explicit ScopedLock(TLock* Lock) : m_Lock(Lock) { m_Lock->Lock(); }
+            ~ScopedLock() { m_Lock->UnLock(); }
+
+            ScopedLock(const ScopedLock&) = delete;
+            ScopedLock& operator=(const ScopedLock&) = delete;
+
+        private:
+            TLock* m_Lock;
+        };
+
+        template <class TLock>
+        class ScopedReadLock
+        {
+        public:
+            explicit ScopedReadLock(TLock* Lock) : m_Lock(Lock) { m_Lock->LockShared(); }
+            ~ScopedReadLock() { m_Lock->UnLockShared(); }
+
+            ScopedReadLock(const ScopedReadLock&) = delete;
+            ScopedReadLock& operator=(const ScopedReadLock&) = delete;
+
+        private:
+            TLock* m_Lock;
+        };
+
+        /**
+         * Test-and-test-and-set lock with exponential backoff, for critical sections
+         * of a few dozen nanoseconds. Never sleeps, don't hold it across blocking calls.
+         */
+        class K3D_CORE_API SpinMutex
+        {
+        public:
+            typedef ScopedLock<SpinMutex> AutoLock;
+
+            SpinMutex() : m_Locked(false) {}
+
+            void Lock()
+            {
+                if (!m_Locked.exchange(true, std::memory_order_acquire))
+                    return;
+                LockSlow();
+            }
+
+            bool TryLock()
+            {
+                return !m_Locked.load(std::memory_order_relaxed)
+                    && !m_Locked.exchange(true, std::memory_order_acquire);
+            }
+
+            void UnLock() { m_Locked.store(false, std::memory_order_release); }
+
+            SpinMutex(const SpinMutex&) = delete;
+            SpinMutex& operator=(const SpinMutex&) = delete;
+
+        private:
+            void LockSlow();
+
+            std::atomic<bool> m_Locked;
+        };
+
+        /**
+         * Spins briefly before parking on WaitOnAddress, the spin budget adapts to
+         * how long the lock was recently held (like glibc's PTHREAD_MUTEX_ADAPTIVE_NP).
+         * Uncontended Lock/UnLock are a single atomic operation each.
+         */
+        class K3D_CORE_API AdaptiveMutex
+        {
+        public:
+            typedef ScopedLock<AdaptiveMutex> AutoLock;
+
+            AdaptiveMutex() : m_State(0), m_SpinEstimate(kMinSpins) {}
+
+            void Lock()
+            {
+                U32 Unlocked = 0;
+                if (m_State.compare_exchange_strong(Unlocked, 1, std::memory_order_acquire))
+                    return;
+                LockSlow();
+            }
+
+            bool TryLock()
+            {
+                U32 Unlocked = 0;
+                return m_State.compare_exchange_strong(Unlocked, 1, std::memory_order_acquire);
+            }
+
+            void UnLock()
+            {
+                if (m_State.exchange(0, std::memory_order_release) == 2)
+                    WakeOnAddress(&m_State, 1);
+            }
+
+            AdaptiveMutex(const AdaptiveMutex&) = delete;
+            AdaptiveMutex& operator=(const AdaptiveMutex&) = delete;
+
+        private:
+            enum { kMinSpins = 10, kMaxSpins = 200 };
+            void LockSlow();
+
+            std::atomic<U32> m_State;   // 0 unlocked, 1 locked, 2 locked with sleepers
+            std::atomic<U32> m_SpinEstimate;
+        };
+
+        /**
+         * Reader-writer lock for read-mostly data, writers are preferred: new readers
+         * wait once a writer is queued. Not recursive, readers can't upgrade.
+         */
+        class K3D_CORE_API SharedMutex
+        {
+        public:
+            typedef ScopedLock<SharedMutex> AutoLock;
+            typedef ScopedReadLock<SharedMutex> AutoReadLock;
+
+            SharedMutex() : m_State(0), m_Sleepers(0) {}
+
+            void Lock();
+            bool TryLock();
+            void UnLock();
+
+            void LockShared()
+            {
+                U32 State = m_State.load(std::memory_order_relaxed);
+                if (!(State & (kWriter | kWriterWaiting))
+                    && m_State.compare_exchange_weak(State, State + 1, std::memory_order_acquire))
+                    return;
+                LockSharedSlow();
+            }
+
+            bool TryLockShared();
+
+            void UnLockShared()
+            {
+                U32 State = m_State.fetch_sub(1);
+                if ((State & kReaderMask) == 1 && (State & kWriterWaiting))
+                    WakeSleepers();
+            }
+
+            SharedMutex(const SharedMutex&) = delete;
+            SharedMutex& operator=(const SharedMutex&) = delete;
+
+        private:
+            enum : U32
+            {
+                kWriter = 1u << 31,
+                kWriterWaiting = 1u << 30,
+                kReaderMask = kWriterWaiting - 1,
+            };
+            void LockSharedSlow();
+            void WakeSleepers();
+
+            std::atomic<U32> m_State;   // reader count | kWriterWaiting | kWriter
+            std::atomic<U32> m_Sleepers;
+        };
+
+        /**
+         * Counting semaphore, Signal never takes a lock and only enters the kernel
+         * when a thread is actually sleeping in Wait.
+         */
+        class K3D_CORE_API Semaphore
+        {
+        public:
+            explicit Semaphore(U32 InitialCount = 0) : m_Count(InitialCount), m_Sleepers(0) {}
+
+            void Signal(U32 Count = 1);
+            void Wait();
+            /// false on timeout
+            bool Wait(U32 TimeoutMs);
+            bool TryWait();
+
+            Semaphore(const Semaphore&) = delete;
+            Semaphore& operator=(const Semaphore&) = delete;
+
+        private:
+            std::atomic<U32> m_Count;
+            std::atomic<U32> m_Sleepers;
+        };
+
 #define __INTERNAL_THREAD_ROUTINE_RETURN void *
 
         namespace __internal
@@ -333,6 +655,231 @@ namespace k3d
             __internal::ThreadClosure*  m_ThreadClosure;
         };
 
+        /**
+         * Counts outstanding jobs, Wait blocks until it drops to zero.
+         * Pass one to ThreadPool::Enqueue or IORequest to wait for a whole batch.
+         */
+        class K3D_CORE_API JobCounter
+        {
+        public:
+            explicit JobCounter(U32 Count = 0) : m_Count(Count) {}
+
+            void Add(U32 Count = 1) { m_Count.fetch_add(Count); }
+            void Done();
+            U32  Get() const { return m_Count.load(); }
+            void Wait();
+            /// false on timeout
+            bool Wait(U32 TimeoutMs);
+
+            JobCounter(const JobCounter&) = delete;
+            JobCounter& operator=(const JobCounter&) = delete;
+
+        private:
+            std::atomic<U32> m_Count;
+        };
+
+        enum class TaskPriority : U8
+        {
+            High,
+            Normal,
+            Low,
+            Count
+        };
+
+        namespace __internal
+        {
+            struct TaskClosure : ThreadClosure
+            {
+                TaskClosure() : Counter(nullptr), Next(nullptr) {}
+                virtual ~TaskClosure() {}
+                virtual void Run() = 0;
+
+                JobCounter*     Counter;
+                TaskClosure*    Next;
+            };
+
+            template <class F> struct TaskClosure0 : TaskClosure
+            {
+                F Function;
+                TaskClosure0(const F& f) : Function(f) {}
+                void Run() override { Function(); }
+            };
+        }
+
+        /**
+         * Fixed set of worker threads consuming one FIFO per TaskPriority,
+         * higher priorities are always drained first.
+         */
+        class K3D_CORE_API ThreadPool
+        {
+        public:
+            /// NumThreads 0 means one per core
+            explicit ThreadPool(U32 NumThreads = 0, k3d::String const& Name = "Worker",
+                ThreadPriority Priority = ThreadPriority::Normal);
+            /// runs the tasks still queued, then joins the workers
+            ~ThreadPool();
+
+            template <class F>
+            void Enqueue(F f, TaskPriority Priority = TaskPriority::Normal, JobCounter* Counter = nullptr)
+            {
+                __internal::TaskClosure* Task = new __internal::TaskClosure0<F>(f);
+                Task->Counter = Counter;
+                Submit(Task, Priority);
+            }
+
+            U32 GetThreadCount() const;
+            U32 GetPendingCount() const;
+
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
+
+        private:
+            void Submit(__internal::TaskClosure* Task, TaskPriority Priority);
+
+            struct ThreadPoolPrivate* d;
+        };
+
+        enum class IOOperation : U8
+        {
+            Read,
+            Write
+        };
+
+        struct IORequest;
+        typedef void(*PFN_IOCompletion)(IORequest& Request);
+
+        /**
+         * One asynchronous read or write at an absolute file offset, owned by the
+         * caller and left untouched by the engine until completion.
+         */
+        struct IORequest
+        {
+            File*               Target = nullptr;
+            IOOperation         Operation = IOOperation::Read;
+            TaskPriority        Priority = TaskPriority::Normal;
+            U64                 Offset = 0;
+            void*               Buffer = nullptr;
+            size_t              Size = 0;
+            /// called on an io thread once Result is set, keep it short
+            PFN_IOCompletion    OnComplete = nullptr;
+            void*               UserData = nullptr;
+            /// Done() is called after OnComplete
+            JobCounter*         Counter = nullptr;
+            /// bytes transferred, or -errno on failure; short transfers are
+            /// continued, it falls below Size only at end of file or on an error
+            I64                 Result = 0;
+        };
+
+        /**
+         * Asynchronous file I/O. On Linux requests go through io_uring, batches are
+         * submitted with a single io_uring_enter; elsewhere, or when io_uring is
+         * unavailable, a pool of I/O threads runs pread/pwrite. Requests that don't fit
+         * in the ring wait in per-priority queues, High first. A single read or write
+         * moves at most MaxTransferSize bytes (0 for the OS limit), bigger requests
+         * go out in pieces.
+         */
+        class K3D_CORE_API AsyncIO
+        {
+        public:
+            explicit AsyncIO(U32 QueueDepth = 128, U32 FallbackThreads = 4, size_t MaxTransferSize = 0);
+            ~AsyncIO();
+
+            /// shared engine, created on first use
+            static AsyncIO& Get();
+
+            bool IsUsingIoUring() const;
+
+            /// Requests[0..Count) must stay valid until their completion
+            void Submit(IORequest* Requests, U32 Count);
+            void Submit(IORequest& Request) { Submit(&Request, 1); }
+
+            /// alignment of offsets, sizes and buffers for files opened with IOFlag::Direct
+            static U32      GetDirectIOAlignment();
+            static void*    AllocAligned(size_t Size);
+            static void     FreeAligned(void* Ptr);
+
+            AsyncIO(const AsyncIO&) = delete;
+            AsyncIO& operator=(const AsyncIO&) = delete;
+
+        private:
+            struct AsyncIOPrivate* d;
+        };
+
+        enum FileChange : U8
+        {
+            FileAdded       = 1,
+            FileModified    = 1 << 1,
+            FileRemoved     = 1 << 2,
+            /// events were dropped, Path is a watched root that should be rescanned
+            FileRescan      = 1 << 3,
+        };
+
+        struct FileEvent
+        {
+            k3d::String Path;
+            /// FileChange flags accumulated during the batch
+            U32         Changes;
+        };
+
+        /// Events[0..Count) only live for the duration of the call
+        typedef void(*PFN_FileChanges)(const FileEvent* Events, U32 Count, void* UserData);
+
+        /**
+         * Watches directory trees for changes. Events are debounced until the tree has
+         * been quiet for DebounceMs, coalesced per path, then handed as one batch to every
+         * subscriber on a ThreadPool. Directories created below a recursive watch are
+         * picked up automatically. Backed by inotify on Linux and Android, Watch fails
+         * elsewhere.
+         */
+        class K3D_CORE_API FileWatcher
+        {
+        public:
+            /// \param Jobs pool running the subscribers, a private single thread keeps
+            /// batches in order when nullptr
+            explicit FileWatcher(U32 DebounceMs = 50, ThreadPool* Jobs = nullptr);
+            /// stops watching and waits for the batches in flight
+            ~FileWatcher();
+
+            /// watching the same directory again only counts a reference
+            bool Watch(const char* Directory, bool Recursive = true);
+            bool Unwatch(const char* Directory);
+
+            /// returns an id for Unsubscribe
+            U32  Subscribe(PFN_FileChanges Callback, void* UserData);
+            /// waits for the callbacks of Id still running, after it returns UserData
+            /// is no longer used; from Id's own callback it skips waiting for that call
+            void Unsubscribe(U32 Id);
+
+            FileWatcher(const FileWatcher&) = delete;
+            FileWatcher& operator=(const FileWatcher&) = delete;
+
+        private:
+            struct FileWatcherPrivate* d;
+        };
+
+        struct WalkEntry
+        {
+            /// Root joined with the relative path by '/'
+            const char* Path;
+            U32         PathLength;
+            U64         Size;
+            /// nanoseconds since the epoch
+            U64         ModifiedTime;
+        };
+
+        /// Entries[0..Count) are the files of one directory, called from several threads at once
+        typedef void(*PFN_WalkRoutine)(const WalkEntry* Entries, U32 Count, void* UserData);
+
+        /**
+         * Recursive Walk listing each directory as its own task on Jobs, through
+         * getdents64 on Linux and Android. Routine receives the regular files only,
+         * symbolic links are not followed. Returns false if Root can't be listed.
+         * \param Jobs a temporary pool with one thread per core when nullptr, must not
+         * be the pool of the calling task
+         */
+        extern K3D_CORE_API bool WalkTree(const char* Root, PFN_WalkRoutine Routine, void* UserData,
+            ThreadPool* Jobs = nullptr);
+
         class IpAddressImpl;
         class SocketImpl;
 
@@ -361,6 +908,11 @@ namespace k3d
 
             void SetAddrPort(I32 Port);
 
+            /// copies the sockaddr_in or sockaddr_in6, 0 if Capacity is too small
+            U32 ToSockAddr(void* SockAddr, U32 Capacity) const;
+
+            /// first address HostName resolves to, with port 0; nullptr if it doesn't
+            /// resolve, otherwise owned by the caller. Blocks on the resolver.
             static IpAddress* GetHostIp(String const& HostName);
 
         private:
@@ -422,6 +974,137 @@ namespace k3d
             Socket(SockType const& Type, void* RawSocketHandle);
             SocketImpl* d;
         };
+
+        class Connection;
+        class Reactor;
+
+        struct IoSlice
+        {
+            const void* Data;
+            U64         Size;
+        };
+
+        /**
+         * Events of the connections of a Reactor, all called on the reactor thread.
+         * One handler usually serves every connection of a listener, the state of
+         * each connection goes to Connection::SetUserData.
+         */
+        class K3D_CORE_API IConnectionHandler
+        {
+        public:
+            virtual ~IConnectionHandler() {}
+            /// accepted, or the connect completed
+            virtual void OnConnected(Connection* Conn) {}
+            /// bytes were appended to the input, Consume what was handled
+            virtual void OnReceived(Connection* Conn) = 0;
+            /// the output queued while the socket was full has been sent
+            virtual void OnDrained(Connection* Conn) {}
+            /// last event, Conn is deleted when it returns
+            virtual void OnClosed(Connection* Conn) {}
+        };
+
+        /**
+         * Non-blocking TCP stream owned by a Reactor. Input is read until the socket
+         * would block and kept until consumed, output the socket doesn't take at once
+         * is queued and flushed as soon as it becomes writable again.
+         */
+        class K3D_CORE_API Connection
+        {
+        public:
+            /// thread safe until OnClosed returned, false once closing
+            bool Send(const void* Data, U64 Size);
+            /// the slices go out back to back, gathered in one vectored send
+            bool Send(const IoSlice* Slices, U32 Count);
+            /// queues [Offset, Offset + Length) of Source, which may be closed once this
+            /// returns. Sent with sendfile on Linux and Android, so the bytes never pass
+            /// through user memory, elsewhere read in chunks as the socket drains.
+            bool SendFile(File& Source, U64 Offset, U64 Length);
+            /// closes once the queued output is sent, thread safe
+            void Close();
+
+            /// stops reading, so the peer's sends back up once the socket buffers
+            /// are full; OnReceived resumes with what arrived meanwhile. Thread safe.
+            void PauseReading();
+            void ResumeReading();
+
+            /// unconsumed input, reactor thread only
+            const U8* GetInput() const;
+            U64  GetInputSize() const;
+            void Consume(U64 Size);
+
+            /// bytes queued for sending
+            U64  GetOutputSize() const;
+            bool IsConnected() const;
+            Reactor* GetReactor() const;
+
+            void  SetUserData(void* UserData);
+            void* GetUserData() const;
+
+            Connection(const Connection&) = delete;
+            Connection& operator=(const Connection&) = delete;
+
+        private:
+            friend struct ReactorPrivate;
+            Connection();
+            ~Connection();
+
+            struct ConnectionPrivate* d;
+        };
+
+        /**
+         * Event loop serving many non-blocking connections from one thread, on
+         * edge-triggered epoll on Linux and Android, poll elsewhere. Handlers, posted
+         * tasks and timers all run on the reactor thread, Listen, Connect, Post and
+         * the timer functions may be called from any thread.
+         */
+        class K3D_CORE_API Reactor
+        {
+        public:
+            Reactor();
+            /// stops the loop, then closes the remaining connections, so their
+            /// handlers have to outlive the reactor
+            ~Reactor();
+
+            /// runs the loop on a thread of its own
+            bool Start(k3d::String const& Name = "Reactor");
+            /// runs the loop on the calling thread until Stop
+            void Run();
+            void Stop();
+
+            /// accepts connections to Address for Handler, port 0 picks a free one
+            /// \return the bound port, -1 on failure
+            I32  Listen(IpAddress const& Address, IConnectionHandler* Handler, I32 Backlog = 128);
+            /// nullptr if the connect failed at once, a later failure is closed
+            /// without OnConnected; like any connection it is gone after OnClosed
+            Connection* Connect(IpAddress const& Address, IConnectionHandler* Handler);
+
+            template <class F>
+            void Post(F f)
+            {
+                Submit(new __internal::TaskClosure0<F>(f));
+            }
+
+            /// runs f after DelayMs, then every PeriodMs unless 0
+            /// \return an id for CancelTimer
+            template <class F>
+            U64 AddTimer(U32 DelayMs, U32 PeriodMs, F f)
+            {
+                return Schedule(DelayMs, PeriodMs, new __internal::TaskClosure0<F>(f));
+            }
+            void CancelTimer(U64 Id);
+
+            U32  GetConnectionCount() const;
+            bool IsReactorThread() const;
+
+            Reactor(const Reactor&) = delete;
+            Reactor& operator=(const Reactor&) = delete;
+
+        private:
+            void Submit(__internal::TaskClosure* Task);
+            U64  Schedule(U32 DelayMs, U32 PeriodMs, __internal::TaskClosure* Task);
+
+            struct ReactorPrivate* d;
+        };
     }
 }
 
@@ -0,0 +1,1212 @@
+#include "CoreMinimal.h"
+#include "Base/Platform.h"
+
+#include <climits>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#if K3DPLATFORM_OS_UNIX
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/uio.h>
+#if K3DPLATFORM_OS_LINUX || K3DPLATFORM_OS_ANDROID
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <signal.h>
+#define __K3D_REACTOR_EPOLL 1
+#define __K3D_HAS_SENDFILE 1
+#endif
+#endif
+
+namespace k3d
+{
+namespace os
+{
+#if K3DPLATFORM_OS_WINDOWS
+typedef SOCKET SocketHandle;
+typedef HANDLE FileHandle;
+static const SocketHandle kInvalidSocket = INVALID_SOCKET;
+typedef WSAPOLLFD __PollFd;
+#define __K3D_POLL ::WSAPoll
+#else
+typedef int SocketHandle;
+typedef int FileHandle;
+static const SocketHandle kInvalidSocket = -1;
+typedef pollfd __PollFd;
+#define __K3D_POLL ::poll
+#endif
+
+// bytes read per recv, the input grows by this much at a time
+static const size_t kReadChunk = 16 * 1024;
+/// input read in one go before the handler gets to consume it
+static const size_t kMaxReadPass = 256 * 1024;
+static const int kMaxEvents = 256;
+// slices per vectored send, well below IOV_MAX
+static const U32 kMaxSlices = 64;
+// largest single send, sendfile and WSASend take 32-bit counts
+static const U64 kMaxSendSize = 1ull << 30;
+// file ranges without sendfile are read and sent in chunks this big
+static const size_t kFileChunk = 64 * 1024;
+
+static void
+__CloseSocket(SocketHandle Handle)
+{
+#if K3DPLATFORM_OS_WINDOWS
+  ::closesocket(Handle);
+#else
+  ::close(Handle);
+#endif
+}
+
+static bool
+__WouldBlock()
+{
+#if K3DPLATFORM_OS_WINDOWS
+  int Error = ::WSAGetLastError();
+  return Error == WSAEWOULDBLOCK || Error == WSAEINTR;
+#else
+  return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+static bool
+__Interrupted()
+{
+#if K3DPLATFORM_OS_WINDOWS
+  return ::WSAGetLastError() == WSAEINTR;
+#else
+  return errno == EINTR;
+#endif
+}
+
+static bool
+__InProgress()
+{
+#if K3DPLATFORM_OS_WINDOWS
+  return ::WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+  return errno == EINPROGRESS;
+#endif
+}
+
+static void
+__SetNonBlocking(SocketHandle Handle)
+{
+#if K3DPLATFORM_OS_WINDOWS
+  unsigned long NonBlocking = 1;
+  ::ioctlsocket(Handle, FIONBIO, &NonBlocking);
+#else
+  ::fcntl(Handle, F_SETFL, ::fcntl(Handle, F_GETFL, 0) | O_NONBLOCK);
+  ::fcntl(Handle, F_SETFD, FD_CLOEXEC);
+#endif
+}
+
+static void
+__SetStreamOptions(SocketHandle Handle)
+{
+  int One = 1;
+  // small writes like log lines and requests go out immediately
+  ::setsockopt(Handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&One, sizeof(One));
+#if K3DPLATFORM_OS_APPLE
+  ::setsockopt(Handle, SOL_SOCKET, SO_NOSIGPIPE, &One, sizeof(One));
+#endif
+}
+
+static I64
+__Send(SocketHandle Handle, const U8* Data, U64 Size)
+{
+#if K3DPLATFORM_OS_WINDOWS
+  return ::send(Handle, (const char*)Data, (int)(Size > INT_MAX ? INT_MAX : Size), 0);
+#elif defined(MSG_NOSIGNAL)
+  return ::send(Handle, Data, (size_t)Size, MSG_NOSIGNAL);
+#else
+  return ::send(Handle, Data, (size_t)Size, 0);
+#endif
+}
+
+static I64
+__SendVector(SocketHandle Handle, const IoSlice* Slices, U32 Count)
+{
+  Count = Count < kMaxSlices ? Count : kMaxSlices;
+#if K3DPLATFORM_OS_WINDOWS
+  WSABUF Buffers[kMaxSlices];
+  for (U32 i = 0; i < Count; i++) {
+    Buffers[i].buf = (char*)Slices[i].Data;
+    Buffers[i].len = (ULONG)(Slices[i].Size < kMaxSendSize ? Slices[i].Size : kMaxSendSize);
+  }
+  DWORD Sent = 0;
+  if (::WSASend(Handle, Buffers, Count, &Sent, 0, nullptr, nullptr) != 0)
+    return -1;
+  return (I64)Sent;
+#else
+  iovec Vectors[kMaxSlices];
+  for (U32 i = 0; i < Count; i++) {
+    Vectors[i].iov_base = (void*)Slices[i].Data;
+    Vectors[i].iov_len = (size_t)(Slices[i].Size < kMaxSendSize ? Slices[i].Size : kMaxSendSize);
+  }
+  msghdr Message = {};
+  Message.msg_iov = Vectors;
+  Message.msg_iovlen = Count;
+#if defined(MSG_NOSIGNAL)
+  return ::sendmsg(Handle, &Message, MSG_NOSIGNAL);
+#else
+  return ::sendmsg(Handle, &Message, 0);
+#endif
+#endif
+}
+
+static FileHandle
+__DuplicateFile(FileHandle File)
+{
+#if K3DPLATFORM_OS_WINDOWS
+  HANDLE Duplicate = nullptr;
+  if (!::DuplicateHandle(::GetCurrentProcess(), File, ::GetCurrentProcess(), &Duplicate, 0, FALSE,
+                         DUPLICATE_SAME_ACCESS))
+    return nullptr;
+  return Duplicate;
+#else
+  return File < 0 ? -1 : ::fcntl(File, F_DUPFD_CLOEXEC, 0);
+#endif
+}
+
+static void
+__CloseFile(FileHandle File)
+{
+#if K3DPLATFORM_OS_WINDOWS
+  ::CloseHandle(File);
+#else
+  ::close(File);
+#endif
+}
+
+/// bytes of the range the socket took, 0 if the file ended early
+static I64
+__SendFileRange(SocketHandle Handle, FileHandle File, U64 Offset, U64 Size)
+{
+  if (Size > kMaxSendSize)
+    Size = kMaxSendSize;
+#if __K3D_HAS_SENDFILE
+  // page cache straight to the socket, nothing is copied through user memory
+  off_t Position = (off_t)Offset;
+  return ::sendfile(Handle, File, &Position, (size_t)Size);
+#else
+  // what the socket doesn't take is read again on the next attempt
+  U8 Buffer[kFileChunk];
+  size_t Chunk = (size_t)(Size < kFileChunk ? Size : kFileChunk);
+#if K3DPLATFORM_OS_WINDOWS
+  OVERLAPPED At = {};
+  At.Offset = (DWORD)Offset;
+  At.OffsetHigh = (DWORD)(Offset >> 32);
+  DWORD Read = 0;
+  if (!::ReadFile(File, Buffer, (DWORD)Chunk, &Read, &At) || !Read)
+    return 0;
+#else
+  I64 Read = ::pread(File, Buffer, Chunk, (off_t)Offset);
+  if (Read <= 0)
+    return 0;
+#endif
+  return __Send(Handle, Buffer, (U64)Read);
+#endif
+}
+
+static I64
+__Receive(SocketHandle Handle, U8* Data, size_t Size)
+{
+  return ::recv(Handle, (char*)Data, (int)Size, 0);
+}
+
+enum class __ChannelKind : U8
+{
+  Wake,
+  Listener,
+  Connection,
+};
+
+/// what a poller event points back to
+struct __Channel
+{
+  __ChannelKind Kind;
+  SocketHandle Handle;
+};
+
+struct __Listener : __Channel
+{
+  IConnectionHandler* Handler;
+};
+
+enum class __ConnectionState : U8
+{
+  Connecting,
+  Connected,
+  Closed,
+};
+
+/// queued output, either bytes or a range of a file sent without copying
+struct __OutputSegment
+{
+  bool IsFile;
+  std::vector<U8> Bytes;
+  size_t Head;
+  FileHandle File;
+  U64 Offset;
+  U64 Remaining;
+};
+
+struct ConnectionPrivate : __Channel
+{
+  Connection* Self;
+  Reactor* Owner;
+  struct ReactorPrivate* Loop;
+  IConnectionHandler* Handler;
+  void* UserData;
+  U64 Id;
+  std::atomic<__ConnectionState> State;
+  std::atomic<bool> Closing;
+  std::atomic<bool> ReadPaused;
+
+  std::vector<U8> Input;
+  size_t InputHead;
+
+  /// taken by Send on any thread and by the reactor flushing
+  mutable SpinMutex OutputLock;
+  std::deque<__OutputSegment> Output;
+  U64 OutputSize;
+  /// the socket was full, OnDrained is due once the output is sent
+  bool Blocked;
+
+  ~ConnectionPrivate()
+  {
+    for (__OutputSegment& Segment : Output)
+      if (Segment.IsFile)
+        __CloseFile(Segment.File);
+  }
+
+  bool HasOutput() const { return !Output.empty(); }
+
+  void Append(const U8* Data, U64 Size)
+  {
+    if (!Size)
+      return;
+    if (Output.empty() || Output.back().IsFile) {
+      Output.emplace_back();
+      Output.back().IsFile = false;
+      Output.back().Head = 0;
+    }
+    Output.back().Bytes.insert(Output.back().Bytes.end(), Data, Data + Size);
+    OutputSize += Size;
+  }
+
+  /// drops Size sent bytes from the front
+  void Advance(U64 Size)
+  {
+    OutputSize -= Size;
+    while (Size) {
+      __OutputSegment& Front = Output.front();
+      if (Front.IsFile) {
+        Front.Offset += Size;
+        Front.Remaining -= Size;
+        Size = 0;
+        if (Front.Remaining)
+          break;
+        __CloseFile(Front.File);
+      } else {
+        U64 Left = Front.Bytes.size() - Front.Head;
+        U64 Taken = Size < Left ? Size : Left;
+        Front.Head += (size_t)Taken;
+        Size -= Taken;
+        if (Front.Head != Front.Bytes.size())
+          break;
+      }
+      Output.pop_front();
+    }
+  }
+
+  /// writes queued output until done or the socket is full, false on error
+  bool Flush()
+  {
+    while (!Output.empty()) {
+      I64 Sent;
+      __OutputSegment& Front = Output.front();
+      if (Front.IsFile) {
+        Sent = __SendFileRange(Handle, Front.File, Front.Offset, Front.Remaining);
+      } else {
+        // consecutive buffers go out in one vectored send
+        IoSlice Slices[kMaxSlices];
+        U32 Count = 0;
+        for (auto It = Output.begin(); It != Output.end() && !It->IsFile && Count < kMaxSlices; ++It)
+          Slices[Count++] = { It->Bytes.data() + It->Head, It->Bytes.size() - It->Head };
+        Sent = Count == 1 ? __Send(Handle, (const U8*)Slices[0].Data, Slices[0].Size)
+                          : __SendVector(Handle, Slices, Count);
+      }
+      if (Sent > 0) {
+        Advance((U64)Sent);
+      } else if (Sent < 0 && __WouldBlock()) {
+        if (__Interrupted())
+          continue;
+        Blocked = true;
+        return true;
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+struct __Timer
+{
+  __internal::TaskClosure* Task;
+  U32 PeriodMs;
+};
+
+struct ReactorPrivate;
+static thread_local ReactorPrivate* tCurrentReactor = nullptr;
+
+struct ReactorPrivate
+{
+  ReactorPrivate(Reactor* InOwner)
+    : Owner(InOwner)
+    , WakePending(false)
+    , Quit(false)
+    , NextId(1)
+    , LoopThread(nullptr)
+    , TaskHead(nullptr)
+    , TaskTail(nullptr)
+  {
+    Wake.Kind = __ChannelKind::Wake;
+#if __K3D_REACTOR_EPOLL
+    Poll = ::epoll_create1(EPOLL_CLOEXEC);
+    Wake.Handle = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event Event = {};
+    Event.events = EPOLLIN;
+    Event.data.ptr = &Wake;
+    ::epoll_ctl(Poll, EPOLL_CTL_ADD, Wake.Handle, &Event);
+#elif K3DPLATFORM_OS_WINDOWS
+    // a loopback datagram socket talking to itself, WSAPoll only waits on sockets
+    Wake.Handle = ::socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in Address = {};
+    Address.sin_family = AF_INET;
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int Length = sizeof(Address);
+    ::bind(Wake.Handle, (sockaddr*)&Address, Length);
+    ::getsockname(Wake.Handle, (sockaddr*)&Address, &Length);
+    ::connect(Wake.Handle, (sockaddr*)&Address, Length);
+    __SetNonBlocking(Wake.Handle);
+    WakeWrite = Wake.Handle;
+#else
+    int Pipe[2] = { -1, -1 };
+    if (::pipe(Pipe) == 0) {
+      __SetNonBlocking(Pipe[0]);
+      __SetNonBlocking(Pipe[1]);
+    }
+    Wake.Handle = Pipe[0];
+    WakeWrite = Pipe[1];
+#endif
+  }
+
+  ~ReactorPrivate()
+  {
+    for (auto& Item : Connections)
+      __CloseSocket(Item.second->Handle);
+    for (__Listener* Listener : Listeners) {
+      __CloseSocket(Listener->Handle);
+      delete Listener;
+    }
+    while (TaskHead) {
+      __internal::TaskClosure* Task = TaskHead;
+      TaskHead = Task->Next;
+      delete Task;
+    }
+    for (auto& Item : Timers)
+      delete Item.second.Task;
+#if __K3D_REACTOR_EPOLL
+    ::close(Wake.Handle);
+    ::close(Poll);
+#elif K3DPLATFORM_OS_WINDOWS
+    ::closesocket(Wake.Handle);
+#else
+    ::close(Wake.Handle);
+    ::close(WakeWrite);
+#endif
+  }
+
+  void Signal()
+  {
+    if (WakePending.exchange(true))
+      return;
+#if __K3D_REACTOR_EPOLL
+    U64 One = 1;
+    ::write(Wake.Handle, &One, sizeof(One));
+#elif K3DPLATFORM_OS_WINDOWS
+    char One = 1;
+    ::send(WakeWrite, &One, 1, 0);
+#else
+    char One = 1;
+    ::write(WakeWrite, &One, 1);
+#endif
+  }
+
+  void DrainWake()
+  {
+    WakePending.store(false);
+    char Buffer[64];
+#if K3DPLATFORM_OS_WINDOWS
+    while (::recv(Wake.Handle, Buffer, sizeof(Buffer), 0) > 0) {
+    }
+#else
+    while (::read(Wake.Handle, Buffer, sizeof(Buffer)) > 0) {
+    }
+#endif
+  }
+
+  void Register(__Channel* Channel)
+  {
+#if __K3D_REACTOR_EPOLL
+    // edge triggered, each handler reads and writes until the socket would block
+    epoll_event Event = {};
+    Event.events = EPOLLIN | EPOLLET;
+    if (Channel->Kind == __ChannelKind::Connection)
+      Event.events |= EPOLLOUT | EPOLLRDHUP;
+    Event.data.ptr = Channel;
+    ::epoll_ctl(Poll, EPOLL_CTL_ADD, Channel->Handle, &Event);
+#endif
+    // the poll set is rebuilt from the channel lists on every wait
+    if (tCurrentReactor != this)
+      Signal();
+  }
+
+  /// the connection may already be closed when this returns off the reactor thread
+  Connection* AddConnection(SocketHandle Handle, IConnectionHandler* Handler, __ConnectionState State)
+  {
+    Connection* Conn = new Connection;
+    ConnectionPrivate* C = Conn->d;
+    C->Kind = __ChannelKind::Connection;
+    C->Handle = Handle;
+    C->Self = Conn;
+    C->Owner = Owner;
+    C->Loop = this;
+    C->Handler = Handler;
+    C->Id = NextId.fetch_add(1);
+    C->State.store(State);
+    {
+      SpinMutex::AutoLock Guard(&ChannelLock);
+      Connections.emplace(C->Id, C);
+    }
+    Register(C);
+    return Conn;
+  }
+
+  void Finish(ConnectionPrivate* C)
+  {
+    {
+      // a Send on another thread either writes before the close or sees Closed,
+      // never a descriptor number the system may have handed out again
+      SpinMutex::AutoLock Guard(&C->OutputLock);
+      if (C->State.exchange(__ConnectionState::Closed) == __ConnectionState::Closed)
+        return;
+      // closing the descriptor also drops it from the epoll set
+      __CloseSocket(C->Handle);
+    }
+    {
+      SpinMutex::AutoLock Guard(&ChannelLock);
+      Connections.erase(C->Id);
+    }
+    C->Handler->OnClosed(C->Self);
+    delete C->Self;
+  }
+
+  /// reads what arrived while paused, the edge that announced it is gone
+  void ResumeReading(U64 Id)
+  {
+    ConnectionPrivate* C = Find(Id);
+    if (C && C->State.load() == __ConnectionState::Connected)
+      OnConnectionEvent(C, true, false, false);
+  }
+
+  /// sends output queued by another thread, see Connection::SendFile
+  void FlushOutput(U64 Id)
+  {
+    ConnectionPrivate* C = Find(Id);
+    if (C && C->State.load() == __ConnectionState::Connected)
+      OnConnectionEvent(C, false, true, false);
+  }
+
+  void CloseIfDrained(U64 Id)
+  {
+    ConnectionPrivate* C = Find(Id);
+    if (!C)
+      return;
+    bool Drained;
+    {
+      SpinMutex::AutoLock Guard(&C->OutputLock);
+      Drained = !C->HasOutput();
+    }
+    // still connecting counts as pending, the queue is sent once connected
+    if (Drained && C->State.load() == __ConnectionState::Connected)
+      Finish(C);
+  }
+
+  ConnectionPrivate* Find(U64 Id)
+  {
+    SpinMutex::AutoLock Guard(&ChannelLock);
+    auto It = Connections.find(Id);
+    return It == Connections.end() ? nullptr : It->second;
+  }
+
+  void Accept(__Listener* Listener)
+  {
+    for (;;) {
+#if K3DPLATFORM_OS_LINUX || K3DPLATFORM_OS_ANDROID
+      SocketHandle Handle = ::accept4(Listener->Handle, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+      SocketHandle Handle = ::accept(Listener->Handle, nullptr, nullptr);
+      if (Handle != kInvalidSocket)
+        __SetNonBlocking(Handle);
+#endif
+      if (Handle == kInvalidSocket) {
+        if (__Interrupted())
+          continue;
+        // would block, or out of descriptors which the next connection retries
+        return;
+      }
+      __SetStreamOptions(Handle);
+      Connection* Conn = AddConnection(Handle, Listener->Handler, __ConnectionState::Connected);
+      Listener->Handler->OnConnected(Conn);
+    }
+  }
+
+  /// reads until the socket would block or kMaxReadPass arrived, More in the
+  /// latter case; false once the peer closed or the socket failed
+  bool ReadPass(ConnectionPrivate* C, bool& Received, bool& More)
+  {
+    More = false;
+    for (size_t Total = 0; Total < kMaxReadPass;) {
+      size_t Used = C->Input.size();
+      C->Input.resize(Used + kReadChunk);
+      I64 Read = __Receive(C->Handle, C->Input.data() + Used, kReadChunk);
+      C->Input.resize(Used + (Read > 0 ? (size_t)Read : 0));
+      if (Read > 0) {
+        Received = true;
+        Total += (size_t)Read;
+        continue;
+      }
+      if (Read < 0 && __WouldBlock())
+        return true;
+      return false;
+    }
+    More = true;
+    return true;
+  }
+
+  void OnConnectionEvent(ConnectionPrivate* C, bool Readable, bool Writable, bool Failed)
+  {
+    if (C->State.load() == __ConnectionState::Connecting) {
+      if (!Writable && !Failed)
+        return;
+      int Error = 0;
+      socklen_t Length = sizeof(Error);
+      ::getsockopt(C->Handle, SOL_SOCKET, SO_ERROR, (char*)&Error, &Length);
+      if (Error || Failed) {
+        Finish(C);
+        return;
+      }
+      C->State.store(__ConnectionState::Connected);
+      C->Handler->OnConnected(C->Self);
+      Writable = true;
+    }
+
+    bool Alive = true;
+    if (Readable || Failed) {
+      // a pass at a time, a fast sender can't pile up more input than the
+      // handler consumes in between; a failed socket is read regardless of
+      // the pause to find out it's gone
+      bool More = true;
+      while (Alive && More && !C->Closing.load() && (Failed || !C->ReadPaused.load())) {
+        bool Received = false;
+        Alive = ReadPass(C, Received, More);
+        if (Received)
+          C->Handler->OnReceived(C->Self);
+      }
+    }
+
+    if (Writable || C->Closing.load()) {
+      bool Drained = false;
+      {
+        SpinMutex::AutoLock Guard(&C->OutputLock);
+        bool WasBlocked = C->Blocked;
+        C->Blocked = false;
+        if (!C->Flush())
+          Alive = false;
+        Drained = WasBlocked && !C->Blocked;
+      }
+      if (Drained && Alive)
+        C->Handler->OnDrained(C->Self);
+    }
+
+    if (!Alive) {
+      Finish(C);
+      return;
+    }
+    if (C->Closing.load())
+      CloseIfDrained(C->Id);
+  }
+
+  void Dispatch(__Channel* Channel, bool Readable, bool Writable, bool Failed)
+  {
+    switch (Channel->Kind) {
+      case __ChannelKind::Wake:
+        DrainWake();
+        break;
+      case __ChannelKind::Listener:
+        Accept(static_cast<__Listener*>(Channel));
+        break;
+      case __ChannelKind::Connection:
+        OnConnectionEvent(static_cast<ConnectionPrivate*>(Channel), Readable, Writable, Failed);
+        break;
+    }
+  }
+
+  /// milliseconds until the next timer, -1 when there is none
+  int NextTimeout()
+  {
+    {
+      SpinMutex::AutoLock Guard(&TaskLock);
+      if (TaskHead)
+        return 0;
+    }
+    SpinMutex::AutoLock Guard(&TimerLock);
+    if (Timers.empty())
+      return -1;
+    U64 Deadline = Timers.begin()->first.first;
+    U64 Now = Clock::NowNs();
+    if (Deadline <= Now)
+      return 0;
+    U64 Ms = (Deadline - Now + 999999) / 1000000;
+    return Ms > INT_MAX ? INT_MAX : (int)Ms;
+  }
+
+  void Wait(int TimeoutMs)
+  {
+#if __K3D_REACTOR_EPOLL
+    epoll_event Events[kMaxEvents];
+    int Count = ::epoll_wait(Poll, Events, kMaxEvents, TimeoutMs);
+    for (int i = 0; i < Count; i++) {
+      U32 Flags = Events[i].events;
+      Dispatch((__Channel*)Events[i].data.ptr,
+               (Flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) != 0,
+               (Flags & EPOLLOUT) != 0,
+               (Flags & EPOLLERR) != 0);
+    }
+#else
+    PollFds.clear();
+    PollChannels.clear();
+    auto Add = [this](__Channel* Channel, short Events) {
+      __PollFd Fd = {};
+      Fd.fd = Channel->Handle;
+      Fd.events = Events;
+      PollFds.push_back(Fd);
+      PollChannels.push_back(Channel);
+    };
+    Add(&Wake, POLLIN);
+    {
+      SpinMutex::AutoLock Guard(&ChannelLock);
+      for (__Listener* Listener : Listeners)
+        Add(Listener, POLLIN);
+      for (auto& Item : Connections) {
+        ConnectionPrivate* C = Item.second;
+        short Events = C->ReadPaused.load() ? 0 : POLLIN;
+        SpinMutex::AutoLock OutputGuard(&C->OutputLock);
+        if (C->State.load() == __ConnectionState::Connecting || C->HasOutput())
+          Events |= POLLOUT;
+        // left out while it waits for nothing, a hang up would keep waking the loop
+        if (Events)
+          Add(C, Events);
+      }
+    }
+    int Count = __K3D_POLL(PollFds.data(), (U32)PollFds.size(), TimeoutMs);
+    for (size_t i = 0; Count > 0 && i < PollFds.size(); i++) {
+      short Flags = PollFds[i].revents;
+      if (!Flags)
+        continue;
+      Count--;
+      Dispatch(PollChannels[i], (Flags & (POLLIN | POLLHUP)) != 0, (Flags & POLLOUT) != 0,
+               (Flags & (POLLERR | POLLNVAL)) != 0);
+    }
+#endif
+  }
+
+  void RunTasks()
+  {
+    __internal::TaskClosure* Task;
+    {
+      SpinMutex::AutoLock Guard(&TaskLock);
+      Task = TaskHead;
+      TaskHead = TaskTail = nullptr;
+    }
+    while (Task) {
+      __internal::TaskClosure* Next = Task->Next;
+      Task->Run();
+      delete Task;
+      Task = Next;
+    }
+  }
+
+  void RunTimers()
+  {
+    U64 Now = Clock::NowNs();
+    for (;;) {
+      U64 Id;
+      __Timer Timer;
+      {
+        SpinMutex::AutoLock Guard(&TimerLock);
+        if (Timers.empty() || Timers.begin()->first.first > Now)
+          return;
+        Id = Timers.begin()->first.second;
+        Timer = Timers.begin()->second;
+        Timers.erase(Timers.begin());
+      }
+      Timer.Task->Run();
+      SpinMutex::AutoLock Guard(&TimerLock);
+      // CancelTimer while running only drops the deadline
+      auto It = Deadlines.find(Id);
+      if (It != Deadlines.end() && Timer.PeriodMs) {
+        // periods count from the deadline so a late timer doesn't drift
+        U64 Deadline = It->second + Timer.PeriodMs * 1000000ull;
+        if (Deadline <= Now)
+          Deadline = Now + Timer.PeriodMs * 1000000ull;
+        It->second = Deadline;
+        Timers.emplace(std::make_pair(Deadline, Id), Timer);
+      } else {
+        if (It != Deadlines.end())
+          Deadlines.erase(It);
+        delete Timer.Task;
+      }
+    }
+  }
+
+  void Close()
+  {
+    // nothing runs any more, handlers still hear about their connections
+    std::vector<ConnectionPrivate*> Remaining;
+    {
+      SpinMutex::AutoLock Guard(&ChannelLock);
+      for (auto& Item : Connections)
+        Remaining.push_back(Item.second);
+    }
+    for (ConnectionPrivate* C : Remaining)
+      Finish(C);
+  }
+
+  Reactor* Owner;
+  __Channel Wake;
+#if __K3D_REACTOR_EPOLL
+  int Poll;
+#else
+  SocketHandle WakeWrite;
+  std::vector<__PollFd> PollFds;
+  std::vector<__Channel*> PollChannels;
+#endif
+  std::atomic<bool> WakePending;
+  std::atomic<bool> Quit;
+  std::atomic<U64> NextId;
+  Thread* LoopThread;
+
+  /// guards the channel lists, written from Listen and Connect on any thread
+  SpinMutex ChannelLock;
+  std::vector<__Listener*> Listeners;
+  std::unordered_map<U64, ConnectionPrivate*> Connections;
+
+  SpinMutex TaskLock;
+  __internal::TaskClosure* TaskHead;
+  __internal::TaskClosure* TaskTail;
+
+  SpinMutex TimerLock;
+  /// ordered by (deadline, id)
+  std::map<std::pair<U64, U64>, __Timer> Timers;
+  std::unordered_map<U64, U64> Deadlines;
+};
+
+Connection::Connection()
+  : d(new ConnectionPrivate)
+{
+  d->UserData = nullptr;
+  d->Closing.store(false);
+  d->ReadPaused.store(false);
+  d->InputHead = 0;
+  d->OutputSize = 0;
+  d->Blocked = false;
+}
+
+Connection::~Connection()
+{
+  delete d;
+  d = nullptr;
+}
+
+bool
+Connection::Send(const void* Data, U64 Size)
+{
+  IoSlice Slice = { Data, Size };
+  return Send(&Slice, 1);
+}
+
+bool
+Connection::Send(const IoSlice* Slices, U32 Count)
+{
+  if (d->Closing.load() || d->State.load() == __ConnectionState::Closed)
+    return false;
+  U32 First = 0;
+  U64 Skip = 0;
+  SpinMutex::AutoLock Guard(&d->OutputLock);
+  if (d->State.load() == __ConnectionState::Connected && !d->HasOutput()) {
+    // nothing queued, the socket takes as much as it can right away
+    while (First < Count) {
+      IoSlice Pending[kMaxSlices];
+      U32 Batch = 0;
+      for (U32 i = First; i < Count && Batch < kMaxSlices; i++) {
+        U64 Offset = i == First ? Skip : 0;
+        Pending[Batch++] = { (const U8*)Slices[i].Data + Offset, Slices[i].Size - Offset };
+      }
+      I64 Sent = __SendVector(d->Handle, Pending, Batch);
+      if (Sent < 0 && __WouldBlock()) {
+        if (__Interrupted())
+          continue;
+        d->Blocked = true;
+        break;
+      }
+      if (Sent < 0)
+        // the reactor sees the error and closes
+        return false;
+      for (U64 Left = (U64)Sent; First < Count;) {
+        U64 Rest = Slices[First].Size - Skip;
+        if (Left < Rest) {
+          Skip += Left;
+          break;
+        }
+        Left -= Rest;
+        Skip = 0;
+        First++;
+      }
+    }
+  }
+  for (U32 i = First; i < Count; i++) {
+    U64 Offset = i == First ? Skip : 0;
+    d->Append((const U8*)Slices[i].Data + Offset, Slices[i].Size - Offset);
+  }
+#if !__K3D_REACTOR_EPOLL
+  // the poll set only asks for writability while output is queued
+  if (d->HasOutput() && tCurrentReactor != d->Loop)
+    d->Loop->Signal();
+#endif
+  return true;
+}
+
+bool
+Connection::SendFile(File& Source, U64 Offset, U64 Length)
+{
+  if (d->Closing.load() || d->State.load() == __ConnectionState::Closed)
+    return false;
+  if (!Length)
+    return true;
+#if K3DPLATFORM_OS_WINDOWS
+  FileHandle Duplicate = __DuplicateFile((FileHandle)Source.m_hFile);
+  if (!Duplicate)
+    return false;
+#else
+  FileHandle Duplicate = __DuplicateFile(Source.m_fd);
+  if (Duplicate < 0)
+    return false;
+#endif
+  bool PostFlush = false;
+  {
+    SpinMutex::AutoLock Guard(&d->OutputLock);
+    d->Output.emplace_back();
+    __OutputSegment& Segment = d->Output.back();
+    Segment.IsFile = true;
+    Segment.Head = 0;
+    Segment.File = Duplicate;
+    Segment.Offset = Offset;
+    Segment.Remaining = Length;
+    d->OutputSize += Length;
+    if (d->State.load() == __ConnectionState::Connected && d->Output.size() == 1) {
+      // sendfile raises SIGPIPE on a peer that hung up and only the reactor
+      // thread blocks it, elsewhere the first transfer is left to the loop
+      if (tCurrentReactor == d->Loop)
+        return d->Flush();
+      PostFlush = true;
+    }
+  }
+  if (PostFlush) {
+    ReactorPrivate* Loop = d->Loop;
+    U64 Id = d->Id;
+    d->Owner->Post([Loop, Id]() { Loop->FlushOutput(Id); });
+  }
+#if !__K3D_REACTOR_EPOLL
+  if (tCurrentReactor != d->Loop)
+    d->Loop->Signal();
+#endif
+  return true;
+}
+
+void
+Connection::Close()
+{
+  if (d->Closing.exchange(true))
+    return;
+  ReactorPrivate* Loop = d->Loop;
+  U64 Id = d->Id;
+  // deferred, the handler may be running for this connection
+  d->Owner->Post([Loop, Id]() { Loop->CloseIfDrained(Id); });
+}
+
+void
+Connection::PauseReading()
+{
+  d->ReadPaused.store(true);
+}
+
+void
+Connection::ResumeReading()
+{
+  if (!d->ReadPaused.exchange(false))
+    return;
+  ReactorPrivate* Loop = d->Loop;
+  U64 Id = d->Id;
+  d->Owner->Post([Loop, Id]() { Loop->ResumeReading(Id); });
+}
+
+const U8*
+Connection::GetInput() const
+{
+  return d->Input.data() + d->InputHead;
+}
+
+U64
+Connection::GetInputSize() const
+{
+  return d->Input.size() - d->InputHead;
+}
+
+void
+Connection::Consume(U64 Size)
+{
+  d->InputHead += (size_t)(Size < GetInputSize() ? Size : GetInputSize());
+  if (d->InputHead == d->Input.size()) {
+    d->Input.clear();
+    d->InputHead = 0;
+  } else if (d->InputHead >= kReadChunk && d->InputHead * 2 >= d->Input.size()) {
+    d->Input.erase(d->Input.begin(), d->Input.begin() + d->InputHead);
+    d->InputHead = 0;
+  }
+}
+
+U64
+Connection::GetOutputSize() const
+{
+  SpinMutex::AutoLock Guard(&d->OutputLock);
+  return d->OutputSize;
+}
+
+bool
+Connection::IsConnected() const
+{
+  return d->State.load() == __ConnectionState::Connected && !d->Closing.load();
+}
+
+Reactor*
+Connection::GetReactor() const
+{
+  return d->Owner;
+}
+
+void
+Connection::SetUserData(void* UserData)
+{
+  d->UserData = UserData;
+}
+
+void*
+Connection::GetUserData() const
+{
+  return d->UserData;
+}
+
+Reactor::Reactor()
+  : d(new ReactorPrivate(this))
+{
+}
+
+Reactor::~Reactor()
+{
+  Stop();
+  d->Close();
+  delete d;
+  d = nullptr;
+}
+
+bool
+Reactor::Start(k3d::String const& Name)
+{
+  if (d->LoopThread)
+    return false;
+  d->Quit.store(false);
+  d->LoopThread = new Thread([this]() { Run(); }, Name, ThreadPriority::Normal);
+  return true;
+}
+
+void
+Reactor::Run()
+{
+  ReactorPrivate* Previous = tCurrentReactor;
+  tCurrentReactor = d;
+#if __K3D_HAS_SENDFILE
+  // sendfile has no MSG_NOSIGNAL, a peer that hung up mid-file would raise SIGPIPE
+  sigset_t Pipe, PreviousMask;
+  sigemptyset(&Pipe);
+  sigaddset(&Pipe, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &Pipe, &PreviousMask);
+#endif
+  while (!d->Quit.load()) {
+    d->Wait(d->NextTimeout());
+    d->RunTasks();
+    d->RunTimers();
+  }
+#if __K3D_HAS_SENDFILE
+  sigset_t Pending;
+  int Signal;
+  if (sigpending(&Pending) == 0 && sigismember(&Pending, SIGPIPE))
+    sigwait(&Pipe, &Signal);
+  pthread_sigmask(SIG_SETMASK, &PreviousMask, nullptr);
+#endif
+  tCurrentReactor = Previous;
+}
+
+void
+Reactor::Stop()
+{
+  d->Quit.store(true);
+  d->Signal();
+  if (d->LoopThread && !IsReactorThread()) {
+    d->LoopThread->Join();
+    delete d->LoopThread;
+    d->LoopThread = nullptr;
+  }
+}
+
+I32
+Reactor::Listen(IpAddress const& Address, IConnectionHandler* Handler, I32 Backlog)
+{
+  sockaddr_storage Storage;
+  socklen_t Length = (socklen_t)Address.ToSockAddr(&Storage, sizeof(Storage));
+  if (!Length || !Handler)
+    return -1;
+  SocketHandle Handle = ::socket(Storage.ss_family, SOCK_STREAM, 0);
+  if (Handle == kInvalidSocket)
+    return -1;
+  int One = 1;
+  ::setsockopt(Handle, SOL_SOCKET, SO_REUSEADDR, (const char*)&One, sizeof(One));
+  if (::bind(Handle, (sockaddr*)&Storage, Length) != 0 || ::listen(Handle, Backlog) != 0 ||
+      ::getsockname(Handle, (sockaddr*)&Storage, &Length) != 0) {
+    __CloseSocket(Handle);
+    return -1;
+  }
+  __SetNonBlocking(Handle);
+  __Listener* Listener = new __Listener;
+  Listener->Kind = __ChannelKind::Listener;
+  Listener->Handle = Handle;
+  Listener->Handler = Handler;
+  {
+    SpinMutex::AutoLock Guard(&d->ChannelLock);
+    d->Listeners.push_back(Listener);
+  }
+  d->Register(Listener);
+  U16 Port = Storage.ss_family == AF_INET6 ? ((sockaddr_in6*)&Storage)->sin6_port
+                                           : ((sockaddr_in*)&Storage)->sin_port;
+  return (I32)ntohs(Port);
+}
+
+Connection*
+Reactor::Connect(IpAddress const& Address, IConnectionHandler* Handler)
+{
+  sockaddr_storage Storage;
+  socklen_t Length = (socklen_t)Address.ToSockAddr(&Storage, sizeof(Storage));
+  if (!Length || !Handler)
+    return nullptr;
+  SocketHandle Handle = ::socket(Storage.ss_family, SOCK_STREAM, 0);
+  if (Handle == kInvalidSocket)
+    return nullptr;
+  __SetNonBlocking(Handle);
+  __SetStreamOptions(Handle);
+  if (::connect(Handle, (sockaddr*)&Storage, Length) != 0 && !__InProgress()) {
+    __CloseSocket(Handle);
+    return nullptr;
+  }
+  // completes on the reactor once the socket turns writable
+  return d->AddConnection(Handle, Handler, __ConnectionState::Connecting);
+}
+
+void
+Reactor::Submit(__internal::TaskClosure* Task)
+{
+  Task->Next = nullptr;
+  {
+    SpinMutex::AutoLock Guard(&d->TaskLock);
+    if (d->TaskTail)
+      d->TaskTail->Next = Task;
+    else
+      d->TaskHead = Task;
+    d->TaskTail = Task;
+  }
+  if (!IsReactorThread())
+    d->Signal();
+}
+
+U64
+Reactor::Schedule(U32 DelayMs, U32 PeriodMs, __internal::TaskClosure* Task)
+{
+  U64 Id = d->NextId.fetch_add(1);
+  U64 Deadline = Clock::NowNs() + DelayMs * 1000000ull;
+  {
+    SpinMutex::AutoLock Guard(&d->TimerLock);
+    d->Timers.emplace(std::make_pair(Deadline, Id), __Timer{ Task, PeriodMs });
+    d->Deadlines.emplace(Id, Deadline);
+  }
+  // the loop may be sleeping towards a later deadline
+  if (!IsReactorThread())
+    d->Signal();
+  return Id;
+}
+
+void
+Reactor::CancelTimer(U64 Id)
+{
+  SpinMutex::AutoLock Guard(&d->TimerLock);
+  auto It = d->Deadlines.find(Id);
+  if (It == d->Deadlines.end())
+    return;
+  auto Scheduled = d->Timers.find(std::make_pair(It->second, Id));
+  if (Scheduled != d->Timers.end()) {
+    delete Scheduled->second.Task;
+    d->Timers.erase(Scheduled);
+  }
+  d->Deadlines.erase(It);
+}
+
+U32
+Reactor::GetConnectionCount() const
+{
+  SpinMutex::AutoLock Guard(&d->ChannelLock);
+  return (U32)d->Connections.size();
+}
+
+bool
+Reactor::IsReactorThread() const
+{
+  return tCurrentReactor == d;
+}
+}
+}
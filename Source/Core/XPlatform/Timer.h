@@ -4,8 +4,10 @@
 
 namespace k3d
 {
+	/// Timer
+	/// Frame and interval timing on os::Clock.
 	class K3D_CORE_API Timer
-  {
+	{
 	public:
 
 		enum Precision
@@ -18,12 +20,16 @@ namespace k3d
 		~Timer();
 
 		void      ResetTimer();
-		int64     MicrosecElapsed();
+		/// microseconds since the previous call or ResetTimer
+		I64       MicrosecElapsed();
 
 		void      BeginTimer();
-		int64     EndTimer();
+		/// time since BeginTimer in the timer's Precision
+		I64       EndTimer();
+		/// frames per second averaged over the last CMAX_PREFRAMES calls to Update
 		float     GetFrameRate() { return m_FrameRate; }
 
+		/// call once per frame
 		void      Update();
 
 		void      EnableTimer(bool enable);
@@ -34,15 +40,17 @@ namespace k3d
 		static const int CMAX_PREFRAMES = 60;
 
 		Precision m_Precision;
-		int       m_TimerId;
-	//	std::function<void()> TimerFunction;
 
-		uint64    m_BaseTime;
-		uint64    m_LastTime;
-		uint64    m_OffSetTime;
-		uint64    m_CurrentTime;
+		// os::Clock ticks
+		U64       m_BaseTime;
+		U64       m_LastTime;
+		U64       m_OffSetTime;
+		U64       m_CurrentTime;
 
-		uint64    m_PreFrameTime[CMAX_PREFRAMES];
+		U64       m_PreFrameTime[CMAX_PREFRAMES];
+		U64       m_FrameTimeSum;
+		U32       m_FrameIndex;
+		U32       m_FrameCount;
 
 		float     m_FrameRate;
 		bool      m_Enabled;
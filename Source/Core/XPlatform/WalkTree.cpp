@@ -0,0 +1,203 @@
+#include "CoreMinimal.h"
+
+#include <string>
+#include <vector>
+
+#if K3DPLATFORM_OS_WINDOWS
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if K3DPLATFORM_OS_LINUX || K3DPLATFORM_OS_ANDROID
+#include <sys/syscall.h>
+#define __K3D_HAS_GETDENTS64 1
+#endif
+#endif
+
+namespace k3d
+{
+namespace os
+{
+struct __WalkContext
+{
+  ThreadPool* Jobs;
+  PFN_WalkRoutine Routine;
+  void* UserData;
+  JobCounter Pending;
+};
+
+/// files of one directory, paths are kept in a single buffer until reported
+struct __DirectoryListing
+{
+  std::vector<WalkEntry> Entries;
+  std::vector<size_t> PathOffsets;
+  std::string Paths;
+
+  void Add(std::string const& Directory, const char* Name, U64 Size, U64 ModifiedTime)
+  {
+    PathOffsets.push_back(Paths.size());
+    Paths.append(Directory).append(1, '/').append(Name).append(1, '\0');
+    WalkEntry Entry = { nullptr, (U32)(Paths.size() - PathOffsets.back() - 1), Size, ModifiedTime };
+    Entries.push_back(Entry);
+  }
+
+  void Report(__WalkContext* Context)
+  {
+    if (Entries.empty())
+      return;
+    for (size_t i = 0; i < Entries.size(); i++)
+      Entries[i].Path = Paths.c_str() + PathOffsets[i];
+    Context->Routine(Entries.data(), (U32)Entries.size(), Context->UserData);
+  }
+};
+
+static void __WalkDirectory(__WalkContext* Context, std::string const& Directory);
+
+static void
+__EnqueueDirectory(__WalkContext* Context, std::string Directory)
+{
+  Context->Jobs->Enqueue([Context, Directory]() { __WalkDirectory(Context, Directory); },
+                         TaskPriority::Normal, &Context->Pending);
+}
+
+#if K3DPLATFORM_OS_WINDOWS
+static void
+__WalkDirectory(__WalkContext* Context, std::string const& Directory)
+{
+  WIN32_FIND_DATAA Data;
+  HANDLE Find = ::FindFirstFileExA((Directory + "\\*").c_str(), FindExInfoBasic, &Data,
+                                   FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+  if (Find == INVALID_HANDLE_VALUE)
+    return;
+  __DirectoryListing Listing;
+  do {
+    if (!strcmp(Data.cFileName, ".") || !strcmp(Data.cFileName, ".."))
+      continue;
+    if (Data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)
+      continue;
+    if (Data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+      __EnqueueDirectory(Context, Directory + "/" + Data.cFileName);
+      continue;
+    }
+    U64 Size = ((U64)Data.nFileSizeHigh << 32) | Data.nFileSizeLow;
+    U64 Time = ((U64)Data.ftLastWriteTime.dwHighDateTime << 32) | Data.ftLastWriteTime.dwLowDateTime;
+    // FILETIME counts 100ns since 1601
+    Listing.Add(Directory, Data.cFileName, Size, (Time - 116444736000000000ull) * 100);
+  } while (::FindNextFileA(Find, &Data));
+  ::FindClose(Find);
+  Listing.Report(Context);
+}
+#else
+static void
+__AddEntry(__WalkContext* Context, __DirectoryListing& Listing, int DirFd,
+           std::string const& Directory, const char* Name, unsigned char Type)
+{
+  if (Type == DT_DIR) {
+    __EnqueueDirectory(Context, Directory + "/" + Name);
+    return;
+  }
+  if (Type != DT_REG && Type != DT_UNKNOWN)
+    return;
+  struct stat Stat;
+  if (fstatat(DirFd, Name, &Stat, AT_SYMLINK_NOFOLLOW) != 0)
+    return;
+  if (S_ISDIR(Stat.st_mode)) {
+    __EnqueueDirectory(Context, Directory + "/" + Name);
+    return;
+  }
+  if (!S_ISREG(Stat.st_mode))
+    return;
+#if K3DPLATFORM_OS_APPLE
+  U64 Time = (U64)Stat.st_mtimespec.tv_sec * 1000000000ull + Stat.st_mtimespec.tv_nsec;
+#else
+  U64 Time = (U64)Stat.st_mtim.tv_sec * 1000000000ull + Stat.st_mtim.tv_nsec;
+#endif
+  Listing.Add(Directory, Name, (U64)Stat.st_size, Time);
+}
+
+#if __K3D_HAS_GETDENTS64
+struct __LinuxDirent64
+{
+  U64 Ino;
+  I64 Off;
+  unsigned short RecLen;
+  unsigned char Type;
+  char Name[1];
+};
+
+static void
+__WalkDirectory(__WalkContext* Context, std::string const& Directory)
+{
+  int Fd = open(Directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (Fd < 0)
+    return;
+  // large reads keep the syscall count low on big directories
+  alignas(8) char Buffer[32 * 1024];
+  __DirectoryListing Listing;
+  for (;;) {
+    long Read = syscall(SYS_getdents64, Fd, Buffer, sizeof(Buffer));
+    if (Read <= 0)
+      break;
+    for (long Pos = 0; Pos < Read;) {
+      const __LinuxDirent64* Entry = (const __LinuxDirent64*)(Buffer + Pos);
+      Pos += Entry->RecLen;
+      const char* Name = Entry->Name;
+      if (Name[0] == '.' && (!Name[1] || (Name[1] == '.' && !Name[2])))
+        continue;
+      __AddEntry(Context, Listing, Fd, Directory, Name, Entry->Type);
+    }
+  }
+  close(Fd);
+  Listing.Report(Context);
+}
+#else
+static void
+__WalkDirectory(__WalkContext* Context, std::string const& Directory)
+{
+  DIR* Dir = opendir(Directory.c_str());
+  if (!Dir)
+    return;
+  __DirectoryListing Listing;
+  while (dirent* Entry = readdir(Dir)) {
+    const char* Name = Entry->d_name;
+    if (Name[0] == '.' && (!Name[1] || (Name[1] == '.' && !Name[2])))
+      continue;
+    __AddEntry(Context, Listing, dirfd(Dir), Directory, Name, Entry->d_type);
+  }
+  closedir(Dir);
+  Listing.Report(Context);
+}
+#endif
+#endif
+
+bool
+WalkTree(const char* Root, PFN_WalkRoutine Routine, void* UserData, ThreadPool* Jobs)
+{
+  if (!Root || !Routine)
+    return false;
+  std::string Directory(Root);
+  while (Directory.size() > 1 && (Directory.back() == '/' || Directory.back() == '\\'))
+    Directory.pop_back();
+#if K3DPLATFORM_OS_WINDOWS
+  DWORD Attributes = ::GetFileAttributesA(Directory.c_str());
+  if (Attributes == INVALID_FILE_ATTRIBUTES || !(Attributes & FILE_ATTRIBUTE_DIRECTORY))
+    return false;
+#else
+  struct stat Stat;
+  if (stat(Directory.c_str(), &Stat) != 0 || !S_ISDIR(Stat.st_mode))
+    return false;
+#endif
+  ThreadPool* Local = Jobs ? nullptr : new ThreadPool(0, "WalkTree");
+  __WalkContext Context;
+  Context.Jobs = Jobs ? Jobs : Local;
+  Context.Routine = Routine;
+  Context.UserData = UserData;
+  __EnqueueDirectory(&Context, Directory);
+  Context.Pending.Wait();
+  delete Local;
+  return true;
+}
+}
+}
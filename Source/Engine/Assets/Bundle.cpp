@@ -43,6 +43,7 @@ namespace k3d
 			if (Opened)
 			{
 				KLOG(Info, AssetBundleImpl, "Close");
+				Archv.FlushCurrentCache();
 				BundleFile.Close();
 			}
 		}
@@ -65,6 +66,7 @@ namespace k3d
 			EMeshVersion mVer = EMeshVersion::VERSION_1_1;
 			archive << mVer;
 			archive << *mesh;
+			archive.FlushCurrentCache();
 			AssetChunk* chunk = new AssetChunk;
 			memset(chunk, 0, sizeof(AssetChunk));
 			chunk->Type = EAssetType::EMesh;
@@ -87,6 +89,7 @@ namespace k3d
 			ECamVersion cVer = ECamVersion::VERSION_1_0;
 			archive << cVer;
 			archive << *camera;
+			archive.FlushCurrentCache();
 			AssetChunk* chunk = new AssetChunk;
 			memset(chunk, 0, sizeof(AssetChunk));
 			chunk->Type = EAssetType::ECamera;
@@ -8,10 +8,6 @@
 
 #include <Core/App.h>
 #include <Core/Os.h>
-#include <Core/WebSocket.h>
-
-#include <rapidjson/writer.h>
-#include <rapidjson/stringbuffer.h>
 
 #if K3DPLATFORM_OS_MAC
 #import <Foundation/NSObjCRuntime.h>
@@ -83,123 +79,6 @@ namespace k3d
 	};
 
 
-	class WebSocketLogger : public ILogger, public Net::WebSocket
-	{
-	public:
-		static const uint32 BUF_LEN = 8192;
-
-		WebSocketLogger() : Net::WebSocket()
-		{
-			m_Thread = new Os::Thread([this]()->void {
-				this->BindAndListen();
-				Os::IPv4Address unnamedClient("");
-				Os::SocketHandle client;
-				while (true)
-				{
-					client = this->Accept(unnamedClient);
-					if (client == -1)
-					{
-						Os::Sleep(1000);
-						continue;
-					}
-
-					char buffer[BUF_LEN + 1] = { 0 };
-					uint64 recvLen = this->Receive(client, buffer, BUF_LEN);
-					if (recvLen > 0 && recvLen < BUF_LEN)
-					{
-						//OutputDebugStringA(buffer);
-					}
-
-					while (true)
-					{
-						bool canQuit = false;
-						if (m_Logs.empty())
-						{
-							unique_lock<std::mutex> uSignal(m_Signal);
-							m_CV.wait(uSignal);
-						}
-						else
-						{
-							lock_guard<mutex> scopeLock(m_LogMutex);
-							while (!m_Logs.empty())
-							{
-								LogItem log = m_Logs.front();
-								string output = log.JsonStr();
-								uint64 sent = Send(client, output.data(), (uint32)output.size());
-								m_Logs.pop();
-								if (sent <= 0)
-									canQuit = true;
-							}
-						}
-						if (canQuit)
-						{
-							break;
-						}
-					}
-				}
-			}, "WebsocketLogger");
-			m_Thread->Start();
-		}
-
-		~WebSocketLogger() override
-		{
-		}
-
-		void Log(ELogLevel const & lv, const char * tag, const char * logLine) override
-		{
-#if 0
-			{
-				lock_guard<mutex> scopeLock(m_LogMutex);
-				static char sCurBuffer[4096] = { 0 }; // 4K buffer less than websocket buffer size
-				snprintf(sCurBuffer, 4096, "[%s]@[%s]:%s", GetLocalTime(), Os::Thread::GetCurrentThreadName().CStr(), logLine);
-				m_Logs.push({ sCurBuffer, tag, lv });
-			}
-			m_CV.notify_one();
-#endif
-		}
-
-	protected:
-		struct LogItem
-		{
-			LogItem(string const &log, string const &tag, ELogLevel const& lv)
-				: LogLine(log), Tag(tag), LogLv(lv)
-			{}
-			string		JsonStr()
-			{
-				rapidjson::StringBuffer s;
-				rapidjson::Writer<rapidjson::StringBuffer> writer(s);
-				writer.StartObject();
-				writer.Key("LogLevel");
-				writer.Int(int(LogLv));
-				writer.Key("Tag");
-				writer.String(Tag.c_str());
-				writer.Key("Log");
-				writer.String(LogLine.c_str());
-				writer.EndObject();
-				return s.GetString();
-			}
-			string		LogLine;
-			string		Tag;
-			ELogLevel	LogLv;
-		};
-
-		void BindAndListen()
-		{
-			Create();
-			Os::IPv4Address addr(":7000");
-			this->SetBlocking(true);
-			Bind(addr);
-			Listen(10);
-		}
-
-	private:
-		queue<LogItem>			m_Logs;
-		Os::Thread*				m_Thread;
-		mutex					m_LogMutex;
-		mutex					m_Signal;
-		condition_variable		m_CV;
-	};
-
 	class ConsoleLogger : public ILogger
 	{
 	public:
@@ -263,7 +142,7 @@ namespace k3d
 								m_pLoggers[type] = new FileLogger;
 								break;
 							case ELoggerType::EWebsocket:
-								m_pLoggers[type] = new WebSocketLogger;
+								m_pLoggers[type] = new net::WebSocketLogger(os::IpAddress(":7000"));
 								break;
 						}
 					}
@@ -281,6 +281,7 @@ ngfx::Result SerializeLibrary(const FunctionMap& Data, const char* Path)
   {
     ArchLib.ArrayIn(pair.second.ByteCodes.data(), pair.second.ByteCodes.size());
   }
+  ArchLib.FlushCurrentCache();
   OutputLib.Close();
   return Result::Ok;
 }
\ No newline at end of file
@@ -15,8 +15,10 @@ namespace Net
     namespace Http
     {
         class Connection;
+        class PooledConnection;
         class Client;
         using SpConn = SharedPtr<Connection>;
+        using SpPooledConn = SharedPtr<PooledConnection>;
         using SpClient = SharedPtr<Client>;
 
         bool SplitUri(String const& Uri, String& Protocol, String& Host, int& Port, String& File, bool& UseSSL)
@@ -373,6 +375,81 @@ namespace Net
             return RecvLen;
         }
 
+        /**
+         * Plain HTTP goes through the per-host pool of the client's k3d::net::HttpClient,
+         * so requests to the same host reuse kept-alive connections instead of
+         * connecting again, and concurrent GETs may be pipelined.
+         */
+        class PooledConnection : public IHttpConnection, public k3d::EnableSharedFromThis<PooledConnection>
+        {
+        public:
+            PooledConnection(String const& TargetHost, SpClient _Client)
+                : Host(TargetHost), OwningClient(_Client), SpeedNotifier(nullptr) {}
+
+            void InstallSpeedNotifier(INetSpeedNotifier* Notifier) override { SpeedNotifier = Notifier; }
+            void SetUserAgent(String const& UA) override { UserAgent = UA; }
+            Http::PtrHeader MakeHeader() override { return k3d::MakeShared<Header>(); }
+            Http::PtrReq MakeRequest(HttpMethod Method, String const& UriPath) override;
+            bool Download(String const& UriPath, String const& LocalPath) override;
+
+            const String& GetHost() const { return Host; }
+            SpClient GetClient() const { return OwningClient; }
+            String const& GetUserAgent() const { return UserAgent; }
+
+        private:
+            String              Host;
+            String              UserAgent;
+            SpClient            OwningClient;
+            INetSpeedNotifier*  SpeedNotifier;
+        };
+
+        /// hands the body to an IHttpStream piece by piece as the client decodes it
+        struct StreamSink : public k3d::IIODevice
+        {
+            explicit StreamSink(IHttpStream* InStream) : Stream(InStream) {}
+
+            bool      Open(const char*, k3d::IOFlag) override { return true; }
+            bool      IsEOF() override { return false; }
+            size_t    Read(char*, size_t) override { return 0; }
+            size_t    Write(const void* Data, size_t Size) override { Stream->Write(Data, Size); return Size; }
+            bool      Seek(size_t) override { return false; }
+            bool      Skip(size_t) override { return false; }
+            void      Flush() override {}
+            void      Close() override {}
+
+            IHttpStream* Stream;
+        };
+
+        struct PooledRequest : public IHttpRequest
+        {
+            PooledRequest(HttpMethod M, String const& InUri, SpPooledConn Conn)
+                : Method(M), Uri(InUri), OwningConn(Conn), Stream(nullptr), PendingId(0) {}
+
+            const String&   GetHost() const override { return OwningConn->GetHost(); }
+            HttpMethod      GetMethod() const override { return Method; }
+            void            SetStream(IHttpStream* pHttpStream) override { Stream = pHttpStream; }
+            Http::PtrResp   GetResponse(bool bOnlyGetResponseHeader) override;
+            void            GetResponseAsync(IHttpResponseHandler* Handler, uint32 TimeoutMs) override;
+            void            Cancel() override;
+
+            HttpMethod      Method;
+            String          Uri;
+            SpPooledConn    OwningConn;
+            IHttpStream*    Stream;
+            /* Id of the pending GetResponseAsync */
+            k3d::U64        PendingId;
+        };
+
+        /* Owned by the client until the response arrives, keeps no reference to the client */
+        struct AsyncResponse
+        {
+            k3d::net::HttpAsyncRequest  Call;
+            IHttpResponseHandler*       Handler;
+            StreamSink                  Sink;
+
+            AsyncResponse(IHttpResponseHandler* InHandler, IHttpStream* Stream) : Handler(InHandler), Sink(Stream) {}
+        };
+
         Request::Request(HttpMethod M, String Uri, SpConn Conn) : Method(M), OwningConn(Conn)
         {
             if (OwningConn)
@@ -415,7 +492,7 @@ namespace Net
         class Client : public IHttpClient, public EnableSharedFromThis<Client>
         {
         public:
-            Client() {}
+            Client() : Callbacks(2, "HttpCallbacks"), Cache(&Pool) {}
             ~Client() {}
 
             Http::PtrConn   MakeConnection(String const& Host, bool WithSSL) override
@@ -426,11 +503,114 @@ namespace Net
                 }
                 else
                 {
-                    return k3d::MakeShared<Connection>(Host, SharedFromThis());
+                    return k3d::MakeShared<PooledConnection>(Host, SharedFromThis());
                 }
             }
+
+            k3d::net::HttpClient& GetPool() { return Pool; }
+            k3d::net::HttpCache& GetCache() { return Cache; }
+            k3d::os::ThreadPool& GetCallbacks() { return Callbacks; }
+
+        private:
+            // outlives the pool, whose last failed requests still run their handlers here
+            k3d::os::ThreadPool Callbacks;
+            k3d::net::HttpClient Pool;
+            // bodies of plain GETs, revalidated instead of fetched again
+            k3d::net::HttpCache Cache;
         };
 
+        Http::PtrReq PooledConnection::MakeRequest(HttpMethod Method, String const& UriPath)
+        {
+            return k3d::MakeShared<PooledRequest>(Method, UriPath, SharedFromThis());
+        }
+
+        static void ReportDownloadSpeed(k3d::U64, k3d::U64, float KBPerSecond, void* UserData)
+        {
+            ((INetSpeedNotifier*)UserData)->UpdateCurrentSpeed(KBPerSecond);
+        }
+
+        bool PooledConnection::Download(String const& UriPath, String const& LocalPath)
+        {
+            k3d::net::Downloader Loader(&OwningClient->GetPool());
+            if (SpeedNotifier)
+                Loader.SetProgressCallback(ReportDownloadSpeed, SpeedNotifier);
+            return Loader.Download(("http://" + Host + UriPath).CStr(), *LocalPath);
+        }
+
+        Http::PtrResp PooledRequest::GetResponse(bool bOnlyGetResponseHeader)
+        {
+            static const char* MethodNames[] = { "POST", "GET", "HEAD", "PUT", "OPTIONS" };
+            bool HeadOnly = bOnlyGetResponseHeader || Method == HttpMethod::Head;
+            k3d::net::HttpRequest Req(HeadOnly ? "HEAD" : MethodNames[(uint32)Method],
+                ("http://" + OwningConn->GetHost() + Uri).CStr());
+            if (OwningConn->GetUserAgent().Length())
+                Req.AddHeader("User-Agent", OwningConn->GetUserAgent().CStr());
+            StreamSink Sink(Stream);
+            k3d::net::HttpCacheBody Cached;
+            bool UseCache = !HeadOnly && !Stream && Method == HttpMethod::Get;
+            k3d::net::HttpResponse Fetched = UseCache ? OwningConn->GetClient()->GetCache().Get(Req, Cached)
+                : OwningConn->GetClient()->GetPool().Fetch(Req, Stream ? &Sink : nullptr);
+            if (UseCache && Fetched.Status == 200 && Cached.GetSize())
+                Fetched.Body = String((const char*)Cached.GetData(), Cached.GetSize());
+
+            auto Resp = k3d::MakeShared<Response>();
+            Resp->Result = (HttpResult)Fetched.Status;
+            String Length;
+            Resp->ContentLength = Fetched.GetHeader("content-length", Length) ? strtoull(*Length, nullptr, 10)
+                                                                             : Fetched.Body.Length();
+            String Location;
+            if ((Resp->Result == HttpResult::Found || Resp->Result == HttpResult::MovedPermanently) &&
+                Fetched.GetHeader("location", Location))
+            {
+                String Protocol, Host, File;
+                int Port;
+                bool UseSSL;
+                if (SplitUri(Location, Protocol, Host, Port, File, UseSSL))
+                {
+                    auto NewConn = OwningConn->GetClient()->MakeConnection(Host, UseSSL);
+                    auto Redirected = NewConn->MakeRequest(Method, File);
+                    Redirected->SetStream(Stream);
+                    return Redirected->GetResponse(bOnlyGetResponseHeader);
+                }
+            }
+            Resp->Data = Fetched.Body;
+            return Resp;
+        }
+
+        static void OnAsyncResponse(k3d::net::HttpAsyncRequest& Call)
+        {
+            AsyncResponse* Pending = (AsyncResponse*)Call.UserData;
+            auto Resp = k3d::MakeShared<Response>();
+            Resp->Result = (HttpResult)Call.Response.Status;
+            Resp->Data = Call.Response.Body;
+            String Length;
+            Resp->ContentLength = Call.Response.GetHeader("content-length", Length) ? strtoull(*Length, nullptr, 10)
+                                                                                   : Call.Response.Body.Length();
+            Pending->Handler->OnResponse(Resp);
+            delete Pending;
+        }
+
+        void PooledRequest::GetResponseAsync(IHttpResponseHandler* Handler, uint32 TimeoutMs)
+        {
+            static const char* MethodNames[] = { "POST", "GET", "HEAD", "PUT", "OPTIONS" };
+            AsyncResponse* Pending = new AsyncResponse(Handler, Stream);
+            k3d::net::HttpAsyncRequest& Call = Pending->Call;
+            Call.Request = k3d::net::HttpRequest(MethodNames[(uint32)Method], ("http://" + OwningConn->GetHost() + Uri).CStr());
+            if (OwningConn->GetUserAgent().Length())
+                Call.Request.AddHeader("User-Agent", OwningConn->GetUserAgent().CStr());
+            Call.BodySink = Stream ? &Pending->Sink : nullptr;
+            Call.TimeoutMs = TimeoutMs;
+            Call.OnComplete = OnAsyncResponse;
+            Call.UserData = Pending;
+            Call.Jobs = &OwningConn->GetClient()->GetCallbacks();
+            PendingId = OwningConn->GetClient()->GetPool().Submit(Call);
+        }
+
+        void PooledRequest::Cancel()
+        {
+            OwningConn->GetClient()->GetPool().Cancel(PendingId);
+        }
+
         Http::PtrResp Request::GetResponse(bool bOnlyGetResponseHeader)
         {
             Http::PtrResp FinalResp;
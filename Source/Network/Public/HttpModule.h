@@ -76,15 +76,31 @@ namespace Net
         virtual String const& GetData() const = 0;
     };
 
+    struct IHttpResponseHandler
+    {
+        virtual ~IHttpResponseHandler() {}
+        /* Result 0 when the request failed, timed out or was cancelled */
+        virtual void OnResponse(Http::PtrResp Response) = 0;
+    };
+
     struct IHttpRequest
     {
         virtual ~IHttpRequest() {}
 
         virtual const String&   GetHost() const = 0;
         virtual HttpMethod      GetMethod() const = 0;
+        /* The body is written to the stream as it arrives instead of GetData */
+        virtual void            SetStream(IHttpStream* pHttpStream) {}
 
         /* Response */
         virtual Http::PtrResp   GetResponse(bool bOnlyGetResponseHeader = false) = 0;
+        /* Returns at once, Handler is called on a job thread; 0 TimeoutMs waits as long as it takes */
+        virtual void            GetResponseAsync(IHttpResponseHandler* Handler, uint32 TimeoutMs = 0)
+        {
+            Handler->OnResponse(GetResponse());
+        }
+        /* Of the pending GetResponseAsync, the handler still gets called */
+        virtual void            Cancel() {}
     };
     // User interface
     struct INetSpeedNotifier
@@ -99,6 +115,8 @@ namespace Net
         virtual void            SetUserAgent(String const& UA) {}
         virtual Http::PtrReq    MakeRequest(HttpMethod Method, String const& UriPath) = 0;
         virtual Http::PtrHeader MakeHeader() = 0;
+        /* Large files: parallel PartialContent ranges that resume from "<LocalPath>.part" */
+        virtual bool            Download(String const& UriPath, String const& LocalPath) { return false; }
     };
 
     struct IHttpClient
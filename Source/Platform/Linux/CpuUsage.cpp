@@ -1,21 +1,321 @@
-#include "Kaleido3D.h"
-#include <Core/Os.h>
+#include "CoreMinimal.h"
+#include "Base/Platform.h"
 
-namespace Os
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace k3d
+{
+namespace os
+{
+struct __CoreTicks
+{
+    U64 Busy = 0;
+    U64 Total = 0;
+};
+
+struct __ThreadTicks
+{
+    std::string Name;
+    U64         User = 0;
+    U64         System = 0;
+};
+
+static U64 __NowMicroseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (U64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// reads "cpuN user nice system idle iowait irq softirq steal ..." lines
+static void __ReadCoreTicks(std::vector<__CoreTicks>& Cores)
+{
+    FILE* Fp = fopen("/proc/stat", "r");
+    if (!Fp)
+        return;
+    char Line[512];
+    while (fgets(Line, sizeof(Line), Fp))
+    {
+        if (strncmp(Line, "cpu", 3) != 0)
+            break;
+        if (Line[3] == ' ') // aggregated line
+            continue;
+        unsigned Core = 0;
+        unsigned long long V[8] = { 0 };
+        int Num = sscanf(Line + 3, "%u %llu %llu %llu %llu %llu %llu %llu %llu",
+            &Core, &V[0], &V[1], &V[2], &V[3], &V[4], &V[5], &V[6], &V[7]);
+        if (Num < 5)
+            continue;
+        if (Core >= Cores.size())
+            Cores.resize(Core + 1);
+        U64 Idle = V[3] + V[4];
+        U64 Total = 0;
+        for (auto T : V)
+            Total += T;
+        Cores[Core].Busy = Total - Idle;
+        Cores[Core].Total = Total;
+    }
+    fclose(Fp);
+}
+
+// /proc/self/task/<tid>/stat: "tid (comm) state ppid ... utime stime ...",
+// comm may contain spaces and parenthesis so parse from the last ')'
+static bool __ReadThreadTicks(const char* Tid, __ThreadTicks& Ticks)
+{
+    char Path[64];
+    snprintf(Path, sizeof(Path), "/proc/self/task/%s/stat", Tid);
+    FILE* Fp = fopen(Path, "r");
+    if (!Fp)
+        return false;
+    char Line[1024] = { 0 };
+    size_t Len = fread(Line, 1, sizeof(Line) - 1, Fp);
+    fclose(Fp);
+    if (Len == 0)
+        return false;
+    const char* NameBegin = strchr(Line, '(');
+    const char* NameEnd = strrchr(Line, ')');
+    if (!NameBegin || !NameEnd || NameEnd < NameBegin)
+        return false;
+    Ticks.Name.assign(NameBegin + 1, NameEnd - NameBegin - 1);
+    // fields after comm: state(3) ppid pgrp session tty_nr tpgid flags minflt cminflt majflt cmajflt utime(14) stime(15)
+    unsigned long long UTime = 0, STime = 0;
+    int Num = sscanf(NameEnd + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &UTime, &STime);
+    if (Num != 2)
+        return false;
+    Ticks.User = UTime;
+    Ticks.System = STime;
+    return true;
+}
+
+struct CpuSamplerPrivate
+{
+    CpuSamplerPrivate(U32 IntervalMs)
+        : Interval(IntervalMs)
+        , ClockTick(sysconf(_SC_CLK_TCK))
+        , LastSampleUs(0)
+        , Running(false)
+        , SampleThread(nullptr)
+        , DataLock("CpuSampler")
+    {
+        if (ClockTick <= 0)
+            ClockTick = 100;
+    }
+
+    void Sample()
+    {
+        Mutex::AutoLock Lock(&DataLock);
+        U64 NowUs = __NowMicroseconds();
+        double ElapsedTicks = LastSampleUs
+            ? (double)(NowUs - LastSampleUs) * ClockTick / 1000000.0 : 0.0;
+
+        std::vector<__CoreTicks> Cores(PrevCores.size());
+        __ReadCoreTicks(Cores);
+        CoreUsage.resize(Cores.size(), 0.0f);
+        for (size_t i = 0; i < Cores.size(); i++)
+        {
+            if (i < PrevCores.size() && LastSampleUs)
+            {
+                U64 Total = Cores[i].Total - PrevCores[i].Total;
+                U64 Busy = Cores[i].Busy - PrevCores[i].Busy;
+                CoreUsage[i] = Total ? 100.0f * Busy / Total : 0.0f;
+            }
+            char Name[32];
+            snprintf(Name, sizeof(Name), "Cpu/Core%u", (U32)i);
+            profiler::SetCounter(Name, CoreUsage[i], profiler::CounterUnit::Percent);
+        }
+        PrevCores.swap(Cores);
+
+        std::unordered_map<U32, __ThreadTicks> Threads;
+        DIR* Dir = opendir("/proc/self/task");
+        if (Dir)
+        {
+            struct dirent* Entry;
+            while ((Entry = readdir(Dir)) != nullptr)
+            {
+                if (Entry->d_name[0] == '.')
+                    continue;
+                __ThreadTicks Ticks;
+                if (__ReadThreadTicks(Entry->d_name, Ticks))
+                {
+                    Threads[(U32)atoi(Entry->d_name)] = Ticks;
+                }
+            }
+            closedir(Dir);
+        }
+
+        ThreadTimes.clear();
+        std::unordered_map<std::string, float> UsageByName;
+        for (auto& Thr : Threads)
+        {
+            CpuThreadTime Time;
+            Time.ThreadId = Thr.first;
+            Time.Name = Thr.second.Name.c_str();
+            Time.UserTimeUs = Thr.second.User * 1000000 / ClockTick;
+            Time.SystemTimeUs = Thr.second.System * 1000000 / ClockTick;
+            auto Prev = PrevThreads.find(Thr.first);
+            if (Prev != PrevThreads.end() && ElapsedTicks > 0.0)
+            {
+                U64 Delta = (Thr.second.User + Thr.second.System) - (Prev->second.User + Prev->second.System);
+                Time.Usage = (float)(100.0 * Delta / ElapsedTicks);
+            }
+            UsageByName[Thr.second.Name] += Time.Usage;
+            ThreadTimes.push_back(Time);
+        }
+        for (auto& Published : PublishedNames)
+        {
+            if (UsageByName.find(Published) == UsageByName.end())
+            {
+                profiler::RemoveCounter(("Cpu/Thread/" + Published).c_str());
+            }
+        }
+        PublishedNames.clear();
+        for (auto& Usage : UsageByName)
+        {
+            profiler::SetCounter(("Cpu/Thread/" + Usage.first).c_str(), Usage.second, profiler::CounterUnit::Percent);
+            PublishedNames.push_back(Usage.first);
+        }
+        PrevThreads.swap(Threads);
+        LastSampleUs = NowUs;
+    }
+
+    void Run()
+    {
+        Thread::SetCurrentThreadName("CpuSampler");
+        Mutex::AutoLock Lock(&WaitLock);
+        while (Running)
+        {
+            Sample();
+            WaitCV.Wait(&WaitLock, Interval);
+        }
+    }
+
+    U32                                     Interval;
+    long                                    ClockTick;
+    U64                                     LastSampleUs;
+    volatile bool                           Running;
+    Thread*                                 SampleThread;
+
+    Mutex                                   WaitLock;
+    ConditionVariable                       WaitCV;
+
+    mutable Mutex                           DataLock;
+    std::vector<__CoreTicks>                PrevCores;
+    std::vector<float>                      CoreUsage;
+    std::unordered_map<U32, __ThreadTicks>  PrevThreads;
+    std::vector<CpuThreadTime>              ThreadTimes;
+    std::vector<std::string>                PublishedNames;
+};
+
+CpuSampler::CpuSampler(U32 IntervalMs)
+    : d(new CpuSamplerPrivate(IntervalMs))
+{
+}
+
+CpuSampler::~CpuSampler()
+{
+    Stop();
+    delete d;
+    d = nullptr;
+}
+
+void CpuSampler::SetInterval(U32 IntervalMs)
+{
+    Mutex::AutoLock Lock(&d->WaitLock);
+    d->Interval = IntervalMs ? IntervalMs : 1;
+    d->WaitCV.Notify();
+}
+
+void CpuSampler::Start()
+{
+    if (d->Running)
+        return;
+    d->Running = true;
+    auto Impl = d;
+    d->SampleThread = new Thread([Impl]() { Impl->Run(); }, "CpuSampler", ThreadPriority::Low);
+}
+
+void CpuSampler::Stop()
+{
+    if (!d->Running)
+        return;
+    {
+        Mutex::AutoLock Lock(&d->WaitLock);
+        d->Running = false;
+        d->WaitCV.NotifyAll();
+    }
+    d->SampleThread->Join();
+    delete d->SampleThread;
+    d->SampleThread = nullptr;
+}
+
+bool CpuSampler::IsRunning() const
+{
+    return d->Running;
+}
+
+void CpuSampler::Sample()
+{
+    d->Sample();
+}
+
+U32 CpuSampler::GetCoreCount() const
+{
+    Mutex::AutoLock Lock(&d->DataLock);
+    return (U32)d->CoreUsage.size();
+}
+
+void CpuSampler::GetCoreUsage(DynArray<float>& OutUsage) const
+{
+    Mutex::AutoLock Lock(&d->DataLock);
+    OutUsage.Clear();
+    for (float Usage : d->CoreUsage)
+    {
+        OutUsage.Append(Usage);
+    }
+}
+
+void CpuSampler::GetThreadTimes(DynArray<CpuThreadTime>& OutTimes) const
 {
+    Mutex::AutoLock Lock(&d->DataLock);
+    for (auto& Time : d->ThreadTimes)
+    {
+        OutTimes.Append(Time);
+    }
+}
+
 float* GetCpuUsage()
 {
-	return nullptr;
+    // usage since the previous call, the first call only primes the counters
+    // valid until the next call, like the other platforms' buffers
+    static CpuSampler sSampler;
+    static DynArray<float> sUsage;
+    sSampler.Sample();
+    sSampler.GetCoreUsage(sUsage);
+    return sUsage.Count() ? sUsage.Data() : nullptr;
 }
 
-uint32
+U32
 GetGpuCount()
 {
-  return 1;
+    return 1;
 }
 
 float GetGpuUsage(int Id)
 {
-  return 0.1f;
+    // only amdgpu exposes a generic busy counter through sysfs
+    char Path[128];
+    snprintf(Path, sizeof(Path), "/sys/class/drm/card%d/device/gpu_busy_percent", Id);
+    FILE* Fp = fopen(Path, "r");
+    if (!Fp)
+        return 0.0f;
+    int Busy = 0;
+    if (fscanf(Fp, "%d", &Busy) != 1)
+        Busy = 0;
+    fclose(Fp);
+    return Busy / 100.0f;
+}
 }
 }
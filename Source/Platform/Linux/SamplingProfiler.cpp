@@ -0,0 +1,567 @@
+#include "CoreMinimal.h"
+#include "Base/Platform.h"
+
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ucontext.h>
+#include <sys/time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#if K3D_USE_LIBUNWIND
+#define UNW_LOCAL_ONLY
+#include <libunwind.h>
+#endif
+
+namespace k3d
+{
+namespace profiler
+{
+static const U32 kMaxStackDepth = 64;
+static const U32 kRingCapacity = 4096;   // power of two
+static const U32 kDrainIntervalMs = 10;
+// a saved frame pointer is trusted only if it moves up the stack by less than this
+static const uintptr_t kMaxFrameSize = 128 * 1024;
+
+struct __RawSample
+{
+    std::atomic<U64>    Sequence;
+    U32                 ThreadId;
+    U32                 Depth;
+    uintptr_t           Frames[kMaxStackDepth];
+};
+
+/**
+ * Bounded multi-producer ring, producers are signal handlers so Push never
+ * blocks nor allocates, a full ring drops the sample. Only the drain thread pops.
+ */
+struct __SampleRing
+{
+    __SampleRing()
+        : Slots(new __RawSample[kRingCapacity])
+        , Head(0)
+        , Tail(0)
+    {
+        for (U32 i = 0; i < kRingCapacity; i++)
+        {
+            Slots[i].Sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~__SampleRing()
+    {
+        delete[] Slots;
+    }
+
+    bool Push(U32 ThreadId, const uintptr_t* Frames, U32 Depth)
+    {
+        U64 Pos = Head.load(std::memory_order_relaxed);
+        __RawSample* Slot = nullptr;
+        for (;;)
+        {
+            Slot = &Slots[Pos & (kRingCapacity - 1)];
+            U64 Seq = Slot->Sequence.load(std::memory_order_acquire);
+            I64 Diff = (I64)Seq - (I64)Pos;
+            if (Diff == 0)
+            {
+                if (Head.compare_exchange_weak(Pos, Pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (Diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                Pos = Head.load(std::memory_order_relaxed);
+            }
+        }
+        Slot->ThreadId = ThreadId;
+        Slot->Depth = Depth;
+        memcpy(Slot->Frames, Frames, Depth * sizeof(uintptr_t));
+        Slot->Sequence.store(Pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    template <class F>
+    U32 Drain(F&& Consume)
+    {
+        U32 Count = 0;
+        for (;;)
+        {
+            __RawSample& Slot = Slots[Tail & (kRingCapacity - 1)];
+            if (Slot.Sequence.load(std::memory_order_acquire) != Tail + 1)
+                break;
+            Consume(Slot);
+            Slot.Sequence.store(Tail + kRingCapacity, std::memory_order_release);
+            Tail++;
+            Count++;
+        }
+        return Count;
+    }
+
+    __RawSample*        Slots;
+    std::atomic<U64>    Head;
+    U64                 Tail;
+};
+
+struct __StackEntry
+{
+    U32                     ThreadId;
+    std::vector<uintptr_t>  Frames;     // leaf first
+    U64                     Count;
+};
+
+static std::atomic<__SampleRing*>   sRing(nullptr);
+static std::atomic<U64>             sSampleCount(0);
+static std::atomic<U64>             sDroppedCount(0);
+
+static U32 __UnwindFramePointers(const ucontext_t* Uc, uintptr_t* Frames, U32 MaxDepth)
+{
+#if defined(__x86_64__)
+    uintptr_t Pc = Uc->uc_mcontext.gregs[REG_RIP];
+    uintptr_t Fp = Uc->uc_mcontext.gregs[REG_RBP];
+    uintptr_t Sp = Uc->uc_mcontext.gregs[REG_RSP];
+#elif defined(__i386__)
+    uintptr_t Pc = Uc->uc_mcontext.gregs[REG_EIP];
+    uintptr_t Fp = Uc->uc_mcontext.gregs[REG_EBP];
+    uintptr_t Sp = Uc->uc_mcontext.gregs[REG_ESP];
+#elif defined(__aarch64__)
+    uintptr_t Pc = Uc->uc_mcontext.pc;
+    uintptr_t Fp = Uc->uc_mcontext.regs[29];
+    uintptr_t Sp = Uc->uc_mcontext.sp;
+#else
+    // no reliable frame chain on this architecture
+    uintptr_t Pc = 0, Fp = 0, Sp = 0;
+    (void)Uc;
+#endif
+    if (!Pc)
+        return 0;
+    U32 Depth = 0;
+    Frames[Depth++] = Pc;
+    // the leaf may still be in its prologue, in which case its caller is skipped
+    uintptr_t Prev = Sp;
+    while (Depth < MaxDepth)
+    {
+        if (Fp < Prev || Fp - Prev > kMaxFrameSize || (Fp & (sizeof(uintptr_t) - 1)))
+            break;
+        const uintptr_t* Frame = reinterpret_cast<const uintptr_t*>(Fp);
+        uintptr_t Ret = Frame[1];
+        if (!Ret)
+            break;
+        Frames[Depth++] = Ret;
+        Prev = Fp + 2 * sizeof(uintptr_t);
+        Fp = Frame[0];
+    }
+    return Depth;
+}
+
+static U32 __Unwind(void* Context, uintptr_t* Frames, U32 MaxDepth)
+{
+#if K3D_USE_LIBUNWIND
+    unw_cursor_t Cursor;
+    if (unw_init_local2(&Cursor, (unw_context_t*)Context, UNW_INIT_SIGNAL_FRAME) < 0)
+        return 0;
+    U32 Depth = 0;
+    do
+    {
+        unw_word_t Ip = 0;
+        if (unw_get_reg(&Cursor, UNW_REG_IP, &Ip) < 0 || !Ip)
+            break;
+        Frames[Depth++] = (uintptr_t)Ip;
+    } while (Depth < MaxDepth && unw_step(&Cursor) > 0);
+    return Depth;
+#else
+    return __UnwindFramePointers((const ucontext_t*)Context, Frames, MaxDepth);
+#endif
+}
+
+static void __OnSampleSignal(int, siginfo_t*, void* Context)
+{
+    int SavedErrno = errno;
+    __SampleRing* Ring = sRing.load(std::memory_order_acquire);
+    if (Ring)
+    {
+        uintptr_t Frames[kMaxStackDepth];
+        U32 Depth = __Unwind(Context, Frames, kMaxStackDepth);
+        if (Depth && Ring->Push((U32)syscall(SYS_gettid), Frames, Depth))
+            sSampleCount.fetch_add(1, std::memory_order_relaxed);
+        else
+            sDroppedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    errno = SavedErrno;
+}
+
+static int __OpenPerfEvent(pid_t Tid, U64 PeriodNs)
+{
+    struct perf_event_attr Attr;
+    memset(&Attr, 0, sizeof(Attr));
+    Attr.size = sizeof(Attr);
+    Attr.type = PERF_TYPE_SOFTWARE;
+    Attr.config = PERF_COUNT_SW_TASK_CLOCK;
+    Attr.sample_period = PeriodNs;
+    Attr.disabled = 1;
+    Attr.exclude_kernel = 1;
+    Attr.exclude_hv = 1;
+    Attr.wakeup_events = 1;
+    int Fd = (int)syscall(SYS_perf_event_open, &Attr, Tid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    if (Fd < 0)
+        return -1;
+    // every overflow raises SIGPROF on the sampled thread itself
+    struct f_owner_ex Owner = { F_OWNER_TID, Tid };
+    if (fcntl(Fd, F_SETFL, fcntl(Fd, F_GETFL) | O_ASYNC) == -1
+        || fcntl(Fd, F_SETSIG, SIGPROF) == -1
+        || fcntl(Fd, F_SETOWN_EX, &Owner) == -1
+        || ioctl(Fd, PERF_EVENT_IOC_ENABLE, 0) == -1)
+    {
+        close(Fd);
+        return -1;
+    }
+    return Fd;
+}
+
+static std::string __ReadThreadName(U32 Tid)
+{
+    char Path[64];
+    snprintf(Path, sizeof(Path), "/proc/self/task/%u/comm", Tid);
+    char Name[64] = { 0 };
+    FILE* Fp = fopen(Path, "r");
+    if (Fp)
+    {
+        if (!fgets(Name, sizeof(Name), Fp))
+            Name[0] = 0;
+        fclose(Fp);
+    }
+    size_t Len = strlen(Name);
+    while (Len && (Name[Len - 1] == '\n'))
+        Name[--Len] = 0;
+    if (!Len)
+        snprintf(Name, sizeof(Name), "Thread-%u", Tid);
+    return Name;
+}
+
+static std::string __Symbolize(uintptr_t Addr)
+{
+    std::string Name = os::GetSymbolName((void*)Addr).CStr();
+    for (auto& C : Name)
+    {
+        if (C == ';')
+            C = ':';
+    }
+    return Name;
+}
+
+struct SamplingProfilerPrivate
+{
+    SamplingProfilerPrivate()
+        : Running(false)
+        , UsePerfEvent(false)
+        , PeriodNs(0)
+        , DrainThread(nullptr)
+        , DataLock("SamplingProfiler")
+    {
+        memset(&OldAction, 0, sizeof(OldAction));
+    }
+
+    bool Start(U32 FrequencyHz)
+    {
+        if (Running)
+            return false;
+        if (!FrequencyHz)
+            FrequencyHz = 1;
+        PeriodNs = 1000000000ull / FrequencyHz;
+        if (!sRing.load())
+            sRing.store(new __SampleRing);
+
+        struct sigaction Action;
+        memset(&Action, 0, sizeof(Action));
+        Action.sa_sigaction = __OnSampleSignal;
+        Action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&Action.sa_mask);
+        if (sigaction(SIGPROF, &Action, &OldAction) != 0)
+            return false;
+
+        // perf_event samples each thread on its own cpu time, it is refused
+        // when perf_event_paranoid > 2 or inside most containers
+        UsePerfEvent = true;
+        RefreshPerfEvents();
+        if (PerfEvents.empty())
+        {
+            UsePerfEvent = false;
+            struct itimerval Timer;
+            Timer.it_interval.tv_sec = PeriodNs / 1000000000ull;
+            Timer.it_interval.tv_usec = (PeriodNs % 1000000000ull) / 1000;
+            if (!Timer.it_interval.tv_sec && !Timer.it_interval.tv_usec)
+                Timer.it_interval.tv_usec = 1;
+            Timer.it_value = Timer.it_interval;
+            if (setitimer(ITIMER_PROF, &Timer, nullptr) != 0)
+            {
+                sigaction(SIGPROF, &OldAction, nullptr);
+                return false;
+            }
+        }
+
+        Running = true;
+        DrainThread = new os::Thread([this]() { Run(); }, "SampleDrain", os::ThreadPriority::Low);
+        return true;
+    }
+
+    void Stop()
+    {
+        if (!Running)
+            return;
+        // the drain thread refreshes PerfEvents, it has to be gone before they are closed
+        {
+            os::Mutex::AutoLock Lock(&WaitLock);
+            Running = false;
+            WaitCV.NotifyAll();
+        }
+        DrainThread->Join();
+        delete DrainThread;
+        DrainThread = nullptr;
+        if (UsePerfEvent)
+        {
+            for (auto& Event : PerfEvents)
+            {
+                ioctl(Event.second, PERF_EVENT_IOC_DISABLE, 0);
+                close(Event.second);
+            }
+            PerfEvents.clear();
+        }
+        else
+        {
+            struct itimerval Timer;
+            memset(&Timer, 0, sizeof(Timer));
+            setitimer(ITIMER_PROF, &Timer, nullptr);
+        }
+        Drain();
+        // a SIGPROF may still be in flight, its default action terminates the process
+        if (OldAction.sa_handler == SIG_DFL && !(OldAction.sa_flags & SA_SIGINFO))
+            OldAction.sa_handler = SIG_IGN;
+        sigaction(SIGPROF, &OldAction, nullptr);
+    }
+
+    void Run()
+    {
+        os::Mutex::AutoLock Lock(&WaitLock);
+        while (Running)
+        {
+            Drain();
+            if (UsePerfEvent)
+                RefreshPerfEvents();
+            WaitCV.Wait(&WaitLock, kDrainIntervalMs);
+        }
+    }
+
+    // opens events for threads created since the last call, closes the ones of exited threads
+    void RefreshPerfEvents()
+    {
+        DIR* Dir = opendir("/proc/self/task");
+        if (!Dir)
+            return;
+        std::unordered_map<U32, int> Alive;
+        struct dirent* Entry;
+        while ((Entry = readdir(Dir)) != nullptr)
+        {
+            if (Entry->d_name[0] == '.')
+                continue;
+            U32 Tid = (U32)atoi(Entry->d_name);
+            auto Iter = PerfEvents.find(Tid);
+            if (Iter != PerfEvents.end())
+            {
+                Alive[Tid] = Iter->second;
+                PerfEvents.erase(Iter);
+                continue;
+            }
+            int Fd = __OpenPerfEvent((pid_t)Tid, PeriodNs);
+            if (Fd >= 0)
+                Alive[Tid] = Fd;
+        }
+        closedir(Dir);
+        for (auto& Dead : PerfEvents)
+        {
+            close(Dead.second);
+        }
+        PerfEvents.swap(Alive);
+    }
+
+    void Drain()
+    {
+        __SampleRing* Ring = sRing.load();
+        if (!Ring)
+            return;
+        os::Mutex::AutoLock Lock(&DataLock);
+        Ring->Drain([this](const __RawSample& Sample) {
+            std::string Key((const char*)&Sample.ThreadId, sizeof(Sample.ThreadId));
+            Key.append((const char*)Sample.Frames, Sample.Depth * sizeof(uintptr_t));
+            auto& Entry = Stacks[Key];
+            if (!Entry.Count)
+            {
+                Entry.ThreadId = Sample.ThreadId;
+                Entry.Frames.assign(Sample.Frames, Sample.Frames + Sample.Depth);
+            }
+            Entry.Count++;
+            if (ThreadNames.find(Sample.ThreadId) == ThreadNames.end())
+            {
+                ThreadNames[Sample.ThreadId] = __ReadThreadName(Sample.ThreadId);
+            }
+        });
+        SetCounter("Profiler/Samples", (double)sSampleCount.load(), CounterUnit::Count);
+        SetCounter("Profiler/DroppedSamples", (double)sDroppedCount.load(), CounterUnit::Count);
+    }
+
+    bool ExportCollapsed(const char* Path)
+    {
+        Drain();
+        FILE* Fp = fopen(Path, "w");
+        if (!Fp)
+            return false;
+        os::Mutex::AutoLock Lock(&DataLock);
+        std::unordered_map<uintptr_t, std::string> Symbols;
+        std::unordered_map<std::string, U64> Collapsed;
+        for (auto& Stack : Stacks)
+        {
+            const __StackEntry& Entry = Stack.second;
+            std::string Line = ThreadNames[Entry.ThreadId];
+            for (size_t i = Entry.Frames.size(); i-- > 0;)
+            {
+                // return addresses point past the call, look up the call itself
+                uintptr_t Addr = i ? Entry.Frames[i] - 1 : Entry.Frames[i];
+                auto Sym = Symbols.find(Addr);
+                if (Sym == Symbols.end())
+                    Sym = Symbols.emplace(Addr, __Symbolize(Addr)).first;
+                Line += ';';
+                Line += Sym->second;
+            }
+            Collapsed[Line] += Entry.Count;
+        }
+        for (auto& Line : Collapsed)
+        {
+            fprintf(Fp, "%s %llu\n", Line.first.c_str(), (unsigned long long)Line.second);
+        }
+        fclose(Fp);
+        return true;
+    }
+
+    // "<count>\t<tid>\t<thread name>\t<leaf addr> ... <root addr>" per stack,
+    // then "# maps" and the content of /proc/self/maps
+    bool ExportRaw(const char* Path)
+    {
+        Drain();
+        FILE* Fp = fopen(Path, "w");
+        if (!Fp)
+            return false;
+        {
+            os::Mutex::AutoLock Lock(&DataLock);
+            for (auto& Stack : Stacks)
+            {
+                const __StackEntry& Entry = Stack.second;
+                fprintf(Fp, "%llu\t%u\t%s\t", (unsigned long long)Entry.Count,
+                    Entry.ThreadId, ThreadNames[Entry.ThreadId].c_str());
+                for (size_t i = 0; i < Entry.Frames.size(); i++)
+                {
+                    fprintf(Fp, i ? " 0x%zx" : "0x%zx", (size_t)Entry.Frames[i]);
+                }
+                fputc('\n', Fp);
+            }
+        }
+        fputs("# maps\n", Fp);
+        FILE* Maps = fopen("/proc/self/maps", "r");
+        if (Maps)
+        {
+            char Buffer[4096];
+            size_t Len;
+            while ((Len = fread(Buffer, 1, sizeof(Buffer), Maps)) > 0)
+            {
+                fwrite(Buffer, 1, Len, Fp);
+            }
+            fclose(Maps);
+        }
+        fclose(Fp);
+        return true;
+    }
+
+    void Reset()
+    {
+        Drain();
+        os::Mutex::AutoLock Lock(&DataLock);
+        Stacks.clear();
+        ThreadNames.clear();
+        sSampleCount.store(0);
+        sDroppedCount.store(0);
+    }
+
+    volatile bool                                   Running;
+    bool                                            UsePerfEvent;
+    U64                                             PeriodNs;
+    struct sigaction                                OldAction;
+    std::unordered_map<U32, int>                    PerfEvents;
+    os::Thread*                                     DrainThread;
+
+    os::Mutex                                       WaitLock;
+    os::ConditionVariable                           WaitCV;
+
+    os::Mutex                                       DataLock;
+    std::unordered_map<std::string, __StackEntry>   Stacks;
+    std::unordered_map<U32, std::string>            ThreadNames;
+};
+
+static SamplingProfilerPrivate& GetSamplingProfiler()
+{
+    static SamplingProfilerPrivate Profiler;
+    return Profiler;
+}
+
+static os::Mutex& GetControlLock()
+{
+    static os::Mutex Lock;
+    return Lock;
+}
+
+bool StartSampling(U32 FrequencyHz)
+{
+    os::Mutex::AutoLock Lock(&GetControlLock());
+    return GetSamplingProfiler().Start(FrequencyHz);
+}
+
+void StopSampling()
+{
+    os::Mutex::AutoLock Lock(&GetControlLock());
+    GetSamplingProfiler().Stop();
+}
+
+bool IsSampling()
+{
+    return GetSamplingProfiler().Running;
+}
+
+void GetSamplingStats(SamplingStats& OutStats)
+{
+    OutStats.Samples = sSampleCount.load();
+    OutStats.Dropped = sDroppedCount.load();
+    OutStats.UsePerfEvent = GetSamplingProfiler().UsePerfEvent;
+}
+
+bool ExportCollapsedStacks(const char* Path)
+{
+    return Path && GetSamplingProfiler().ExportCollapsed(Path);
+}
+
+bool ExportRawSamples(const char* Path)
+{
+    return Path && GetSamplingProfiler().ExportRaw(Path);
+}
+
+void ResetSamples()
+{
+    GetSamplingProfiler().Reset();
+}
+}
+}
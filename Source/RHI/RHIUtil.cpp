@@ -1,5 +1,4 @@
 #include "RHIUtil.h"
-#include <Core/Utils/farmhash.h>
 #include <Core/Utils/SHA1.h>
 
 using namespace kMath;
@@ -29,8 +28,8 @@ uint64 HashRenderPassDesc(NGFXRenderPassDesc const& Desc)
   {
     RenderPassDescs.Append(RenderPassDesc);
   }
-  HashCode = util::Hash64(
-    (const char*)RenderPassDescs.Data(), 
+  HashCode = Hash64(
+    RenderPassDescs.Data(),
     sizeof(RenderPassAttachDesc) * RenderPassDescs.Count());
   
   if (Desc.pDepthAttachment)
@@ -44,7 +43,7 @@ uint64 HashRenderPassDesc(NGFXRenderPassDesc const& Desc)
 
 uint64 HashTextureDesc(NGFXResourceDesc const& Desc)
 {
-  return util::Hash64((const char*)&Desc, sizeof(Desc));
+  return Hash64(&Desc, sizeof(Desc));
 }
 
 uint64 HashAttachments(NGFXRenderPassDesc const& Desc)
@@ -55,12 +54,8 @@ uint64 HashAttachments(NGFXRenderPassDesc const& Desc)
   {
     auto TextureAddr = Attachment.pTexture->GetLocation();
     auto TextureDesc = Attachment.pTexture->GetDesc();
-    HashCode = util::Hash64WithSeed(
-      (const char*)&TextureAddr,
-      8, HashCode);
-    HashCode = util::Hash64WithSeed(
-      (const char*)&TextureDesc,
-      sizeof(TextureDesc), HashCode);
+    HashCode = Hash64(&TextureAddr, 8, HashCode);
+    HashCode = Hash64(&TextureDesc, sizeof(TextureDesc), HashCode);
   }
   return HashCode;
 }
@@ -37,6 +37,7 @@ void TestShaderCompiler()
 			Archive ar;
 			ar.SetIODevice(&shBundle);
 			ar << bundle;
+			ar.FlushCurrentCache();
 			shBundle.Close();
 
 			// write spirv to file
@@ -85,6 +86,7 @@ void TestShaderCompiler()
             Archive ar;
             ar.SetIODevice(&shBundle);
             ar << bundle;
+            ar.FlushCurrentCache();
             shBundle.Close();
         }
 	}